@@ -8,12 +8,27 @@
 
 static const char *TAG = "ble_battery_server_app";
 
+#define BATTERY_LEVEL_CHAR 0 // Index in battery_chars.
+#define FILLER_UUID16 0xFF00  // Read-only characteristics padding the service, see CONFIG_BATTERY_SERVER_CHARS.
+
+#ifdef CONFIG_BATTERY_SERVER_CHAR_COUNT
+#define BATTERY_SERVER_CHAR_COUNT CONFIG_BATTERY_SERVER_CHAR_COUNT
+#else
+#define BATTERY_SERVER_CHAR_COUNT 1
+#endif
+
 typedef struct app_context
 {
     const char *pszAdvName;
     uint16_t battery_level_handle;
+    uint8_t battery_level;
     bat_ble_uuid128_t battery_level_uuid;
     bat_ble_uuid128_t battery_service_uuid;
+    uint8_t filler_value;
+    bat_gatts_char_def_t battery_chars[BATTERY_SERVER_CHAR_COUNT];
+    bat_gatts_service_def_t battery_service;
+    bat_gatts_table_t battery_table;
+    bat_gatts_notify_t notify;
 
 } app_context;
 
@@ -27,12 +42,41 @@ typedef struct app_context
 static void app_context_init(app_context *pContext)
 {
     pContext->battery_level_handle = 0;
+    pContext->battery_level = 100;
+    pContext->filler_value = 0;
     pContext->pszAdvName = "Bitmans Battery";
 
     const char *pszBatteryLevelId = bat_get_battery_level_id();
     const char *pszBatteryServiceId = bat_get_battery_server_id();
     ESP_ERROR_CHECK(bat_ble_string4_to_uuid128(pszBatteryLevelId, &pContext->battery_level_uuid));
     ESP_ERROR_CHECK(bat_ble_string4_to_uuid128(pszBatteryServiceId, &pContext->battery_service_uuid));
+
+    // The whole service is registered with one call, the CCCD is implied by NOTIFY.
+    pContext->battery_chars[BATTERY_LEVEL_CHAR] = (bat_gatts_char_def_t){
+        .uuid = {.pUuid128 = &pContext->battery_level_uuid},
+        .properties = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY,
+        .perm = ESP_GATT_PERM_READ,
+        .max_len = 1,
+        .len = 1,
+        .pValue = &pContext->battery_level, // Copied by the stack, reads are answered from its copy.
+    };
+    for (size_t c = BATTERY_LEVEL_CHAR + 1; c < BATTERY_SERVER_CHAR_COUNT; ++c)
+    {
+        pContext->battery_chars[c] = (bat_gatts_char_def_t){
+            .uuid = {.uuid16 = (uint16_t)(FILLER_UUID16 + c)},
+            .properties = ESP_GATT_CHAR_PROP_BIT_READ,
+            .perm = ESP_GATT_PERM_READ,
+            .len = 1,
+            .pValue = &pContext->filler_value,
+        };
+    }
+    pContext->battery_service = (bat_gatts_service_def_t){
+        .uuid = {.pUuid128 = &pContext->battery_service_uuid},
+        .pChars = pContext->battery_chars,
+        .char_count = sizeof(pContext->battery_chars) / sizeof(pContext->battery_chars[0]),
+    };
+
+    ESP_ERROR_CHECK(bat_gatts_notify_init(&pContext->notify, NULL));
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -40,37 +84,16 @@ static void app_context_init(app_context *pContext)
 static void app_on_gatts_reg(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
 {
     app_context *pAppContext = (app_context *)pCb->pContext;
-    bat_gatts_create_service128(pCb->gatts_if, &pAppContext->battery_service_uuid);
+    bat_gatts_create_attr_table(pCb, &pAppContext->battery_service, &pAppContext->battery_table);
 }
 
-static void app_on_gatts_create(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
+static void app_on_gatts_create_attr_tab(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
 {
-    // Here we create the characteristic for the battery level.
+    // bat_lib starts the service once the table exists, we only need the handles.
     app_context *pAppContext = (app_context *)pCb->pContext;
-    bat_gatts_create_char128(
-        pCb->gatts_if, pCb->service_handle, &pAppContext->battery_level_uuid,
-        ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY, // TODO: handle notifications
-        ESP_GATT_PERM_READ);
-}
-
-static void app_on_gatts_add_char(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
-{
-    app_context *pAppContext = (app_context *)pCb->pContext;
-    if (bat_ble_uuid_try_match(&pParam->add_char.char_uuid, &pAppContext->battery_level_uuid))
-    {
-        pAppContext->battery_level_handle = pParam->add_char.attr_handle;
-        ESP_LOGI(TAG, "Battery level characteristic added with handle: %d", pAppContext->battery_level_handle);
-
-        // Add CCCD so clients can enable notifications
-        bat_gatts_add_cccd(pCb->service_handle, pAppContext->battery_level_handle);
-    }
-
-    // TODO: delete/restart service if we fail to add the characteristic???
-}
-
-static void app_on_add_char_desc(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
-{
-    bat_gatts_start_service(pCb->service_handle);
+    pAppContext->battery_level_handle = bat_gatts_table_value_handle(&pAppContext->battery_table, BATTERY_LEVEL_CHAR);
+    ESP_LOGI(TAG, "Battery level characteristic added with handle: %d", pAppContext->battery_level_handle);
+    ESP_ERROR_CHECK(bat_gatts_notify_add_table(&pAppContext->notify, &pAppContext->battery_table));
 }
 
 static void app_on_gatts_start(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
@@ -81,34 +104,18 @@ static void app_on_gatts_start(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_para
 
 static void app_on_gatts_connect(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
 {
-    bat_gatts_stop_advertising();
-
-    // You might want to cache the connection ID for later use for notifications,
-    // to send responses to the client, to manage the connection state,
-    // or to manage the connection state.
-}
-
-static void app_on_gatts_read(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
-{
-    app_context *pAppContext = (app_context *)pCb->pContext;
-
-    // This is a read request for the battery level characteristic
-    if (pParam->read.handle == pAppContext->battery_level_handle)
-    {
-        uint8_t battery_level = 42; // Simulated value
-        ESP_LOGI(TAG, "Sending battery level response: %d", battery_level);
-
-        bat_gatts_send_uint8(
-            pCb->gatts_if,
-            pParam->read.handle, pParam->read.conn_id, pParam->read.trans_id,
-            ESP_GATT_OK, battery_level);
-    }
+    // bat_lib tracks the connection and keeps advertising while more centrals can connect.
+    ESP_LOGI(TAG, "Client connected, conn_id: %d, %u connected",
+             pParam->connect.conn_id, (unsigned)bat_gatts_get_conn_table()->count);
 }
 
 static void app_on_gatts_disconnect(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
 {
-    app_context *pAppContext = (app_context *)pCb->pContext;
-    bat_gatts_begin_advert_data_set128(pAppContext->pszAdvName, &pAppContext->battery_service_uuid);
+    // Advertising resumes by itself if every slot was taken, from the cached payloads (bat_gatts_readvertise).
+    bat_gatts_conn_t *pConn = bat_gatts_get_conn(pParam->disconnect.conn_id);
+    if (pConn != NULL)
+        ESP_LOGI(TAG, "Client disconnected, conn_id: %d, mtu: %d, reads: %lu, tx: %llu bytes",
+                 pConn->conn_id, pConn->mtu, (unsigned long)pConn->reads, (unsigned long long)pConn->tx_bytes);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -119,13 +126,19 @@ static void on_gaps_advert_data_set(bat_gaps_callbacks_t *pCb, esp_ble_gap_cb_pa
     bat_gatts_start_advertising();
 }
 
+static void on_gaps_advert_start(bat_gaps_callbacks_t *pCb, esp_ble_gap_cb_param_t *pParam)
+{
+    // Compare runs built with CONFIG_BATTERY_SERVER_CHARS set to 1, 10 and 40.
+    if (pParam->adv_start_cmpl.status == ESP_BT_STATUS_SUCCESS)
+        ESP_LOGI(TAG, "%d characteristics, registration to advertising: %lld us", BATTERY_SERVER_CHAR_COUNT,
+                 (long long)bat_gatts_get_startup_latency_us());
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 // As it stands: this  is a correct, minimal, read-only fake battery service.
 // Testable with Bluetooth LE Explorer (Windows) or similar app.
+// The simulated battery level drains every two seconds and is notified to subscribed clients.
 // TODO: To be “fully functioning pretend battery”:
-// Add a simulated battery level that changes over time.
-// Implement notification logic and CCCD write handling.
-// Add a timer to update the battery level and send notifications if a client is subscribed.
 // Handle client connection/pairing.
 ////////////////////////////////////////////////////////////////////////////////////////////
 void app_main(void)
@@ -134,17 +147,15 @@ void app_main(void)
 
     bat_gatts_callbacks_t gatts_callbacks = {
         .on_reg = app_on_gatts_reg,
-        .on_read = app_on_gatts_read,
         .on_start = app_on_gatts_start,
-        .on_create = app_on_gatts_create,
         .on_connect = app_on_gatts_connect,
-        .on_add_char = app_on_gatts_add_char,
         .on_disconnect = app_on_gatts_disconnect,
-        .on_add_char_descr = app_on_add_char_desc,
+        .on_create_attr_tab = app_on_gatts_create_attr_tab,
     };
 
     bat_gaps_callbacks_t gaps_callbacks = {
         .on_advert_data_set = on_gaps_advert_data_set,
+        .on_advert_start = on_gaps_advert_start,
     };
 
     ESP_ERROR_CHECK(bat_lib_init());
@@ -154,6 +165,7 @@ void app_main(void)
     app_context appContext;
     app_context_init(&appContext);
     bat_ble_gaps_callbacks_init(&gaps_callbacks, &appContext);
+    gatts_callbacks.pNotify = &appContext.notify;
     bat_ble_gatts_callbacks_init(&gatts_callbacks, &appContext);
 
 #define BAT_APP_ID 0x56
@@ -165,6 +177,13 @@ void app_main(void)
     for (int counter = 180; counter > 0; counter--)
     {
         ESP_LOGI(TAG, "App counter: %d", counter);
+
+        if (appContext.battery_level_handle != 0 && counter % 2 == 0)
+        {
+            appContext.battery_level = (appContext.battery_level > 0) ? appContext.battery_level - 1 : 100;
+            bat_gatts_set_value(appContext.battery_level_handle, &appContext.battery_level, 1);
+            bat_gatts_notify_update(&appContext.notify, appContext.battery_level_handle, &appContext.battery_level, 1);
+        }
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
 
@@ -1,20 +1,105 @@
+#include <string.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "bat_lib.h"
 #include "bat_config.h"
 
 static const char *TAG = "ble_client_app";
 
+#define BENCH_OPS 500           // Operations in each phase of the run, per server.
+#define BENCH_PIPELINE 4        // Operations kept queued per link.
+#define BENCH_MAX_PAYLOAD 512   // Largest characteristic value written.
+#define BENCH_MAX_PEERS 3       // Servers benchmarked at once.
+#define BENCH_SCAN_SECS 10      // Time spent collecting servers before the links open.
+#define STREAM_SECS 5           // Time each server streams notifications after the operations.
+#define STREAM_SLOTS 128        // Notifications buffered per link between two drains.
+#define STREAM_BATCH 16         // Notifications handled per peek.
+
+typedef enum
+{
+    BENCH_SCANNING = 0,
+    BENCH_RUNNING,       // Scan stopped, links open and run on their own.
+    BENCH_DONE,
+} bench_state;
+
+// Each server gets the phases in turn, BENCH_OPS operations each.
+typedef enum
+{
+    BENCH_PHASE_WRITE = 0,
+    BENCH_PHASE_WRITE_NO_RSP,
+    BENCH_PHASE_READ,
+    BENCH_PHASE_COUNT,
+} bench_phase;
+
+static const char *const bench_phase_names[BENCH_PHASE_COUNT] = {"write", "write without response", "read"};
+static const bat_gattc_op_type_t bench_phase_ops[BENCH_PHASE_COUNT] = {
+    BAT_GATTC_OP_WRITE, BAT_GATTC_OP_WRITE_NO_RSP, BAT_GATTC_OP_READ};
+
+struct app_gap_context;
+
+// One benchmarked server, the link manager keeps a pointer to it in the link context.
+typedef struct
+{
+    esp_bd_addr_t bda;
+    bool running;
+    uint16_t conn_id;
+    esp_gatt_if_t gattc_if;
+    uint16_t char_handle;
+    uint16_t len;               // Bytes per write, MTU - 3.
+    bench_phase phase;
+    uint32_t ops_left;          // Operations of the phase not submitted yet.
+    uint32_t ops_done;          // Operations of the phase completed.
+    uint64_t bytes;             // Bytes they moved.
+    int64_t phase_us;           // Start of the phase.
+    struct app_gap_context *pApp;
+
+    bat_gattc_sub_t *pSub;      // Notification stream, drained by the main task.
+    volatile bool streaming;    // Subscribed, the main task drains and ends the stream.
+    int64_t stream_us;          // Start of the stream.
+    uint32_t stream_values;     // Notifications received.
+    uint32_t stream_skipped;    // Server samples missing from the sequence, coalesced by the server.
+    uint32_t stream_seq;        // Sequence number of the latest sample.
+    uint64_t stream_bytes;
+} bench_peer;
+
 typedef struct app_gap_context
 {
     uint32_t scan_duration_secs;
+    bat_ble_uuid128_t char_uuid;
     bat_ble_uuid128_t service_uuid;
+    bat_scan_filter_t server_filter;
+
+    volatile bench_state state;
+    bench_peer peers[BENCH_MAX_PEERS];
+    volatile size_t peers_found;
+    volatile size_t peers_done;
+    volatile size_t peers_failed; // Finished without being benchmarked.
+    uint8_t payload[BENCH_MAX_PAYLOAD];
+    TaskHandle_t consumer;      // Drains the notification rings.
 
 } app_gap_context;
 
 void app_context_init(app_gap_context *pContext)
 {
     pContext->scan_duration_secs = 0; // Set to 0 for indefinite scanning - we'll stop manually after one sweep
+    ESP_ERROR_CHECK(bat_ble_string36_to_uuid128(bat_get_char_id(), &pContext->char_uuid));
     ESP_ERROR_CHECK(bat_ble_string36_to_uuid128(bat_get_server_id(), &pContext->service_uuid));
+
+    pContext->state = BENCH_SCANNING;
+    for (size_t i = 0; i < sizeof(pContext->payload); ++i)
+        pContext->payload[i] = (uint8_t)i;
+
+    // Either the expected name or the custom service UUID identifies the server.
+    const bat_scan_filter_rule_t rules[] = {
+        {.pszName = "BitmansGATTS_0", .name_exact = true, .min_rssi = BAT_SCAN_FILTER_ANY_RSSI},
+        {.pUuid128 = &pContext->service_uuid, .uuid128_count = 1, .min_rssi = BAT_SCAN_FILTER_ANY_RSSI},
+    };
+    ESP_ERROR_CHECK(bat_scan_filter_compile(&pContext->server_filter, rules, sizeof(rules) / sizeof(rules[0])));
+}
+
+void app_context_deinit(app_gap_context *pContext)
+{
+    bat_scan_filter_free(&pContext->server_filter);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -39,9 +124,12 @@ void app_on_gapc_scan_start_complete(struct bat_gapc_callbacks_t *pCb, esp_ble_g
 
 void app_on_gapc_update_conn_params(struct bat_gapc_callbacks_t *pCb, esp_ble_gap_cb_param_t *pParam)
 {
-    ESP_LOGI(TAG, "Connection parameters updated: min_int=%d, max_int=%d, latency=%d, timeout=%d",
+    // bat_ble_throughput logs which connection profile the parameters serve.
+    ESP_LOGI(TAG, "Connection parameters updated: status=%d, min_int=%d, max_int=%d, conn_int=%d, latency=%d, timeout=%d",
+             pParam->update_conn_params.status,
              pParam->update_conn_params.min_int,
              pParam->update_conn_params.max_int,
+             pParam->update_conn_params.conn_int,
              pParam->update_conn_params.latency,
              pParam->update_conn_params.timeout);
 
@@ -53,31 +141,15 @@ void app_on_gapc_sec_req(struct bat_gapc_callbacks_t *pCb, esp_ble_gap_cb_param_
     bat_bda_context_lookup(&pParam->ble_security.ble_req.bd_addr);
 }
 
-// In your scan result handler:
-// if (bat_ble_client_find_service_uuid(&scan_result->scan_rst, &pAppContext->service_uuid)) {
-//     // Found the device you want
-//     memcpy(g_target_bda, scan_result->scan_rst.bda, ESP_BD_ADDR_LEN);
-//     g_target_addr_type = scan_result->scan_rst.ble_addr_type;
-//     esp_ble_gap_stop_scanning(); // Stop scanning before connecting
-// }
-
-// // In your scan stop complete handler:
-// esp_ble_gattc_open(g_gattc_handles[GATTC_APP0], g_target_bda, g_target_addr_type, true);
-// // This results in calls to the GATT Client callbacks, where you can handle the connection establishment.
+// Servers found by the scan are handed to the link manager with bat_ble_client_connect. It opens them
+// one at a time once the scan stops, discovers their services and reports them through on_link_ready.
 
 static bool is_server_recognised(struct bat_gapc_callbacks_t *pCb, esp_ble_gap_cb_param_t *pParam)
 {
     app_gap_context *pAppContext = (app_gap_context *)pCb->pContext;
 
-    // Check if the device advertises the expected name
-    if (bat_ble_advname_matches(&pParam->scan_rst, "BitmansGATTS_0"))
-        return true;
-
-    // Check if the device advertises the custom service UUID
-    if (bat_ble_client_find_service_uuid(&pParam->scan_rst, &pAppContext->service_uuid))
-        return true;
-
-    return false;
+    // One pass over the advertising data, no copies.
+    return bat_scan_filter_match_result(&pAppContext->server_filter, &pParam->scan_rst) != 0;
 }
 
 void app_on_gapc_scan_result(struct bat_gapc_callbacks_t *pCb, esp_ble_gap_cb_param_t *pParam)
@@ -104,15 +176,27 @@ void app_on_gapc_scan_result(struct bat_gapc_callbacks_t *pCb, esp_ble_gap_cb_pa
                  pParam->scan_rst.bda[2], pParam->scan_rst.bda[3],
                  pParam->scan_rst.bda[4], pParam->scan_rst.bda[5]);
 
-        // Store BDA for connection if needed:
-        // memcpy(g_target_bda, scan_result->scan_rst.bda, ESP_BD_ADDR_LEN);
-        // g_target_addr_type = scan_result->scan_rst.ble_addr_type;
-
-        // esp_err_t err = bat_bda_context_set(&scan_result->scan_rst.bda, NULL); // TODO!
-        // if (err == ESP_OK)
-        bat_ble_client_stop_scanning(); // Stop scanning before connecting
-
-        // The connection attempt should ideally happen in ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT
+        // The link manager opens the links once the scan has stopped. Repeats of a known server are ignored.
+        app_gap_context *pAppContext = (app_gap_context *)pCb->pContext;
+        if (pAppContext->state != BENCH_SCANNING || pAppContext->peers_found == BENCH_MAX_PEERS)
+            break;
+        for (size_t i = 0; i < pAppContext->peers_found; ++i)
+        {
+            if (memcmp(pAppContext->peers[i].bda, pParam->scan_rst.bda, ESP_BD_ADDR_LEN) == 0)
+                return;
+        }
+
+        bench_peer *pPeer = &pAppContext->peers[pAppContext->peers_found];
+        memcpy(pPeer->bda, pParam->scan_rst.bda, ESP_BD_ADDR_LEN);
+        esp_err_t err = bat_ble_client_connect(GATTC_APP0, pParam->scan_rst.bda, pParam->scan_rst.ble_addr_type, pPeer);
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Server not queued: %s", esp_err_to_name(err));
+            break;
+        }
+
+        if (++pAppContext->peers_found == BENCH_MAX_PEERS)
+            bat_ble_client_stop_scanning();
         break;
 
     // Triggered when one complete scan sweep is finished
@@ -128,7 +212,286 @@ void app_on_gapc_scan_result(struct bat_gapc_callbacks_t *pCb, esp_ble_gap_cb_pa
 
 void app_on_gapc_scan_stop_complete(struct bat_gapc_callbacks_t *pCb, esp_ble_gap_cb_param_t *pParam)
 {
-    // If you stopped scanning to connect, initiate connection here
+    // bat_lib opens the queued links from here on.
+    app_gap_context *pAppContext = (app_gap_context *)pCb->pContext;
+    if (pAppContext->state == BENCH_SCANNING)
+        pAppContext->state = (pAppContext->peers_found != 0) ? BENCH_RUNNING : BENCH_DONE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// Operations per second benchmark: writes with response, writes without response, then reads of each server's
+// characteristic through the link's request queue. Every completion queues one more operation, so BENCH_PIPELINE
+// stay queued and bat_lib issues the next one from the completion event. The links run concurrently, bat_lib
+// adds their traffic up.
+static bench_peer *bench_find_peer(app_gap_context *pAppContext, uint16_t conn_id)
+{
+    for (size_t i = 0; i < pAppContext->peers_found; ++i)
+    {
+        if (pAppContext->peers[i].running && pAppContext->peers[i].conn_id == conn_id)
+            return &pAppContext->peers[i];
+    }
+    return NULL;
+}
+
+static void bench_peer_finish(bench_peer *pPeer, bool close)
+{
+    app_gap_context *pAppContext = pPeer->pApp;
+    bat_gattc_link_t link;
+    if (bat_ble_client_get_link(pPeer->conn_id, &link) == ESP_OK && link.ops != 0)
+        ESP_LOGI(TAG, "conn_id %d: %lu ops, %llu bytes, latency avg %lu us, max %lu us", pPeer->conn_id,
+                 (unsigned long)link.ops, (unsigned long long)link.bytes,
+                 (unsigned long)(link.latency_sum_us / link.ops), (unsigned long)link.latency_max_us);
+    bat_gattc_queue_stats_t queue;
+    if (bat_ble_client_get_queue_stats(pPeer->conn_id, &queue) == ESP_OK)
+        ESP_LOGI(TAG, "conn_id %d: queue high water %u, %lu failed, %lu congestion stalls", pPeer->conn_id,
+                 (unsigned)queue.high_water, (unsigned long)queue.failed, (unsigned long)queue.congestion_stalls);
+
+    pPeer->running = false;
+    if (close)
+        esp_ble_gattc_close(pPeer->gattc_if, pPeer->conn_id);
+
+    if (++pAppContext->peers_done < pAppContext->peers_found)
+        return;
+
+    bat_gattc_conn_stats_t stats;
+    bat_ble_client_get_link_stats(&stats, false);
+    ESP_LOGI(TAG, "Links: %lu connected, %lu failed opens, scan hit to ready avg %lu us, max %lu us",
+             (unsigned long)stats.connects, (unsigned long)stats.connect_failures,
+             (unsigned long)stats.connect_avg_us, (unsigned long)stats.connect_max_us);
+    bat_bench_log_report("gattc ops, all links", &stats.traffic);
+    if (pAppContext->peers_failed != 0)
+        ESP_LOGW(TAG, "%u of %u servers not benchmarked", (unsigned)pAppContext->peers_failed, (unsigned)pAppContext->peers_found);
+
+    // Servers benchmarked on an earlier boot are known from NVS.
+    bat_gattc_cache_stats_t cache;
+    if (bat_ble_client_get_cache_stats(&cache) == ESP_OK && cache.hits != 0)
+        ESP_LOGI(TAG, "Attribute cache: %lu hits, %lu misses, %llu us of discovery saved, %lu us per reconnect",
+                 (unsigned long)cache.hits, (unsigned long)cache.misses, (unsigned long long)cache.saved_us,
+                 (unsigned long)(cache.saved_us / cache.hits));
+    pAppContext->state = BENCH_DONE;
+}
+
+static void bench_op_done(const bat_gattc_op_result_t *pResult);
+
+// After the operations the server streams its characteristic. bat_lib copies each notification into the
+// subscription's ring on the Bluedroid task, the main task drains the rings in batches, see stream_drain.
+static void stream_start(bench_peer *pPeer)
+{
+    bat_gattc_sub_config_t config = {
+        .slots = STREAM_SLOTS,
+        .consumer = pPeer->pApp->consumer,
+        .pContext = pPeer,
+    };
+    esp_err_t err = bat_ble_client_subscribe(pPeer->conn_id, pPeer->char_handle, &config, &pPeer->pSub);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "conn_id %d not streamed: %s", pPeer->conn_id, esp_err_to_name(err));
+        bench_peer_finish(pPeer, true);
+    }
+}
+
+static void stream_stop(bench_peer *pPeer)
+{
+    pPeer->streaming = false;
+    int64_t elapsed_us = esp_timer_get_time() - pPeer->stream_us;
+    bat_gattc_notify_stats_t stats;
+    bat_gattc_notify_get_stats(pPeer->pSub, &stats);
+    ESP_LOGI(TAG, "conn_id %d stream: %lu notifications in %lld us, %llu per second, %llu bytes/s, %lu samples skipped",
+             pPeer->conn_id, (unsigned long)pPeer->stream_values, (long long)elapsed_us,
+             (unsigned long long)(pPeer->stream_values * 1000000ULL / elapsed_us),
+             (unsigned long long)(pPeer->stream_bytes * 1000000ULL / elapsed_us), (unsigned long)pPeer->stream_skipped);
+    ESP_LOGI(TAG, "conn_id %d ring: %lu dropped, %lu truncated, high water %u of %d", pPeer->conn_id,
+             (unsigned long)stats.dropped, (unsigned long)stats.truncated, (unsigned)stats.high_water, STREAM_SLOTS);
+
+    // on_disconnect finishes the peer.
+    bat_ble_client_unsubscribe(pPeer->pSub);
+    pPeer->pSub = NULL;
+    esp_ble_gattc_close(pPeer->gattc_if, pPeer->conn_id);
+}
+
+// Main task. Each peek hands out up to STREAM_BATCH notifications straight from the ring, no copies.
+static void stream_drain(app_gap_context *pAppContext)
+{
+    for (size_t i = 0; i < pAppContext->peers_found; ++i)
+    {
+        bench_peer *pPeer = &pAppContext->peers[i];
+        if (pPeer->pSub == NULL)
+            continue;
+        if (!pPeer->running)
+        {
+            // Link lost or subscription failed, the ring is ours to free.
+            pPeer->streaming = false;
+            bat_ble_client_unsubscribe(pPeer->pSub);
+            pPeer->pSub = NULL;
+            continue;
+        }
+        if (!pPeer->streaming)
+            continue;
+
+        bat_gattc_notify_msg_t msgs[STREAM_BATCH];
+        size_t count;
+        while ((count = bat_gattc_notify_peek(pPeer->pSub, msgs, STREAM_BATCH)) != 0)
+        {
+            for (size_t n = 0; n < count; ++n)
+            {
+                uint32_t seq = 0;
+                if (msgs[n].len >= sizeof(seq))
+                    memcpy(&seq, msgs[n].pValue, sizeof(seq));
+                if (pPeer->stream_values != 0 && seq > pPeer->stream_seq + 1)
+                    pPeer->stream_skipped += seq - pPeer->stream_seq - 1;
+                pPeer->stream_seq = seq;
+                pPeer->stream_values++;
+                pPeer->stream_bytes += msgs[n].len;
+            }
+            bat_gattc_notify_release(pPeer->pSub, count);
+        }
+
+        if (esp_timer_get_time() - pPeer->stream_us >= STREAM_SECS * 1000000LL)
+            stream_stop(pPeer);
+    }
+}
+
+static void bench_submit(bench_peer *pPeer, uint32_t count)
+{
+    if (count > pPeer->ops_left)
+        count = pPeer->ops_left;
+    if (count == 0)
+        return;
+
+    bool read = (pPeer->phase == BENCH_PHASE_READ);
+    bat_gattc_op_t ops[BENCH_PIPELINE];
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        ops[i] = (bat_gattc_op_t){
+            .type = bench_phase_ops[pPeer->phase],
+            .handle = pPeer->char_handle,
+            .len = read ? 0 : pPeer->len,
+            .pData = read ? NULL : pPeer->pApp->payload,
+            .cb = bench_op_done,
+            .pContext = pPeer,
+        };
+    }
+
+    esp_err_t err = bat_ble_client_submit(pPeer->conn_id, ops, count);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Benchmark %s not queued: %s", bench_phase_names[pPeer->phase], esp_err_to_name(err));
+        bench_peer_finish(pPeer, true);
+        return;
+    }
+    pPeer->ops_left -= count;
+}
+
+static void bench_phase_start(bench_peer *pPeer, bench_phase phase)
+{
+    pPeer->phase = phase;
+    pPeer->ops_left = BENCH_OPS;
+    pPeer->ops_done = 0;
+    pPeer->bytes = 0;
+    pPeer->phase_us = esp_timer_get_time();
+    bench_submit(pPeer, BENCH_PIPELINE);
+}
+
+static void bench_op_done(const bat_gattc_op_result_t *pResult)
+{
+    bench_peer *pPeer = (bench_peer *)pResult->op.pContext;
+    if (!pPeer->running)
+        return;
+
+    if (pResult->status != ESP_GATT_OK)
+    {
+        ESP_LOGE(TAG, "Benchmark %s failed on conn_id %d, status %x", bench_phase_names[pPeer->phase],
+                 pPeer->conn_id, pResult->status);
+        bench_peer_finish(pPeer, true);
+        return;
+    }
+
+    pPeer->ops_done++;
+    pPeer->bytes += (pResult->op.type == BAT_GATTC_OP_READ) ? pResult->value_len : pResult->op.len;
+    if (pPeer->ops_left != 0)
+    {
+        bench_submit(pPeer, 1);
+        return;
+    }
+    if (pPeer->ops_done < BENCH_OPS)
+        return;
+
+    int64_t elapsed_us = esp_timer_get_time() - pPeer->phase_us;
+    if (elapsed_us <= 0)
+        elapsed_us = 1;
+    ESP_LOGI(TAG, "conn_id %d %s: %lu ops in %lld us, %llu ops/s, %llu bytes/s", pPeer->conn_id,
+             bench_phase_names[pPeer->phase], (unsigned long)pPeer->ops_done, (long long)elapsed_us,
+             (unsigned long long)(pPeer->ops_done * 1000000ULL / elapsed_us),
+             (unsigned long long)(pPeer->bytes * 1000000ULL / elapsed_us));
+
+    if (pPeer->phase + 1 < BENCH_PHASE_COUNT)
+        bench_phase_start(pPeer, pPeer->phase + 1);
+    else
+        stream_start(pPeer);
+}
+
+static void app_on_gattc_subscribe(bat_gattc_callbacks_t *pCb, bat_gattc_sub_t *pSub)
+{
+    bench_peer *pPeer = (bench_peer *)pSub->pContext;
+    if (!pPeer->running)
+        return;
+    if (pSub->status != ESP_GATT_OK)
+    {
+        bench_peer_finish(pPeer, true);
+        return;
+    }
+
+    pPeer->stream_us = esp_timer_get_time();
+    pPeer->streaming = true;
+}
+
+static void app_on_gattc_link_ready(bat_gattc_callbacks_t *pCb, bat_gattc_link_t *pLink)
+{
+    app_gap_context *pAppContext = (app_gap_context *)pCb->pContext;
+    bench_peer *pPeer = (bench_peer *)pLink->pContext;
+    if (pPeer == NULL)
+        return;
+
+    // Resolved from the attribute cache when bat_lib skipped the discovery of a known server.
+    uint16_t char_handle = 0;
+    if (bat_ble_client_find_char(pLink->conn_id, &pAppContext->service_uuid, &pAppContext->char_uuid, &char_handle) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Benchmark characteristic not found on conn_id %d", pLink->conn_id);
+        // Counted as done, or the report waits for it forever. Not running, so the disconnect does not count it twice.
+        pPeer->conn_id = pLink->conn_id;
+        pPeer->gattc_if = pLink->gattc_if;
+        pPeer->pApp = pAppContext;
+        pAppContext->peers_failed++;
+        bench_peer_finish(pPeer, true);
+        return;
+    }
+
+    bat_ble_link_params_t link;
+    uint16_t len = 20;
+    if (bat_ble_throughput_get_link(pLink->conn_id, &link) == ESP_OK)
+        len = link.mtu - 3;
+    if (len > sizeof(pAppContext->payload))
+        len = sizeof(pAppContext->payload);
+
+    pPeer->conn_id = pLink->conn_id;
+    pPeer->gattc_if = pLink->gattc_if;
+    pPeer->char_handle = char_handle;
+    pPeer->len = len;
+    pPeer->pApp = pAppContext;
+    pPeer->running = true;
+    ESP_LOGI(TAG, "Benchmark: %d ops per phase on handle %d of conn_id %d, ready %lld us after the scan hit (%s)",
+             BENCH_OPS, pPeer->char_handle, pPeer->conn_id, (long long)(pLink->ready_us - pLink->hit_us),
+             pLink->cached ? "cached database" : "discovered");
+
+    bench_phase_start(pPeer, BENCH_PHASE_WRITE);
+}
+
+static void app_on_gattc_disconnect(bat_gattc_callbacks_t *pCb, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *pParam)
+{
+    app_gap_context *pAppContext = (app_gap_context *)pCb->pContext;
+    bench_peer *pPeer = bench_find_peer(pAppContext, pParam->disconnect.conn_id);
+    if (pPeer != NULL)
+        bench_peer_finish(pPeer, false);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -141,7 +504,16 @@ void app_main(void)
     ESP_ERROR_CHECK(bat_ble_client_init());
     ESP_ERROR_CHECK(bat_ble_register_gattc(GATTC_APP0));
 
-    app_gap_context app_context;
+    // ble_server requests the same profile, whatever both controllers support is what gets negotiated.
+    const bat_ble_throughput_profile_t profile = BAT_BLE_THROUGHPUT_PROFILE_MAX;
+    ESP_ERROR_CHECK(bat_ble_throughput_set_profile(&profile));
+
+    // The client switches connection profiles by traffic, the bulk phases get 7.5 ms and idle links
+    // low power. Usage per profile is logged when a link closes. ble_server leaves switching to us.
+    const bat_ble_conn_policy_t policy = {0};
+    ESP_ERROR_CHECK(bat_ble_throughput_set_conn_policy(&policy));
+
+    static app_gap_context app_context; // Too large for the main task stack.
     bat_gapc_callbacks_t gap_callbacks = {
         .pContext = NULL,
         .on_sec_req = app_on_gapc_sec_req,
@@ -151,8 +523,15 @@ void app_main(void)
         .on_scan_start_complete = app_on_gapc_scan_start_complete,
         .on_scan_param_set_complete = app_on_gapc_scan_param_set_complete,
     };
+    static bat_gattc_callbacks_t gattc_callbacks = {
+        .on_disconnect = app_on_gattc_disconnect,
+        .on_link_ready = app_on_gattc_link_ready,
+        .on_subscribe = app_on_gattc_subscribe,
+    };
     app_context_init(&app_context);
+    app_context.consumer = xTaskGetCurrentTaskHandle();
     bat_ble_gapc_callbacks_init(&gap_callbacks, &app_context);
+    bat_ble_gattc_callbacks_init(&gattc_callbacks, &app_context);
 
     ESP_ERROR_CHECK(bat_blink_init(-1));
     bat_set_blink_mode(BLINK_MODE_SLOW);
@@ -162,10 +541,21 @@ void app_main(void)
 
     bat_set_blink_mode(BLINK_MODE_BREATHING);
     ESP_ERROR_CHECK(bat_ble_client_set_scan_params());
-    for (int counter = 20; counter > 0; counter--)
+    for (int counter = 60; counter > 0 && app_context.state != BENCH_DONE; counter--)
     {
         ESP_LOGI(TAG, "Running application: %d", counter);
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+
+        // Streams are drained as they arrive, bat_lib wakes this task when a ring stops being empty.
+        int64_t second_us = esp_timer_get_time() + 1000000;
+        while (esp_timer_get_time() < second_us)
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+            stream_drain(&app_context);
+        }
+
+        // Servers found by now are benchmarked together.
+        if (counter == 60 - BENCH_SCAN_SECS && app_context.state == BENCH_SCANNING)
+            bat_ble_client_stop_scanning();
     }
     ESP_ERROR_CHECK(bat_ble_client_stop_scanning());
 
@@ -180,4 +570,5 @@ void app_main(void)
 	bat_blink_deinit();
     bat_ble_unregister_gattc(GATTC_APP0);
     bat_ble_client_deinit();
+    app_context_deinit(&app_context);
 }
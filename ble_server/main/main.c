@@ -8,6 +8,8 @@
 
 static const char *TAG = "ble_server_app";
 
+#define STREAM_LEN 20           // Bytes per streamed sample: a sequence number, then filler.
+
 typedef enum app_bits
 {
     ERROR_BIT = BIT0,
@@ -24,6 +26,9 @@ typedef struct app_context
     EventGroupHandle_t ble_events;
     bat_ble_uuid128_t char_uuid;
     bat_ble_uuid128_t service_uuid;
+    bat_gatts_notify_t notify;      // Streams the characteristic to subscribed clients.
+    uint16_t char_handle;
+    uint8_t sample[STREAM_LEN];
 
 } app_context;
 
@@ -35,6 +40,9 @@ void app_context_init(app_context *pContext)
 
     ESP_ERROR_CHECK(bat_ble_string36_to_uuid128(bat_get_char_id(), &pContext->char_uuid));
     ESP_ERROR_CHECK(bat_ble_string36_to_uuid128(bat_get_server_id(), &pContext->service_uuid));
+    ESP_ERROR_CHECK(bat_gatts_notify_init(&pContext->notify, NULL));
+    for (size_t i = 0; i < sizeof(pContext->sample); ++i)
+        pContext->sample[i] = (uint8_t)i;
 }
 
 bool try_handle_error(app_context *pAppContext, esp_err_t err, const char *pszMethod)
@@ -62,17 +70,28 @@ static void app_on_gatts_create(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_par
     app_context *pAppContext = (app_context *)pCb->pContext;
     esp_err_t err = bat_gatts_create_char128(
         pCb->gatts_if, pCb->service_handle, &pAppContext->char_uuid,
-        ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE,
+        ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_WRITE_NR |
+            ESP_GATT_CHAR_PROP_BIT_NOTIFY,
         ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE);
     try_handle_error(pAppContext, err, "app_on_gatts_create");
 }
 
 static void app_on_gatts_add_char(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
+{
+    // ble_client subscribes to the characteristic through its CCCD.
+    app_context *pAppContext = (app_context *)pCb->pContext;
+    pAppContext->char_handle = pParam->add_char.attr_handle;
+    esp_err_t err = bat_gatts_add_cccd(pCb->service_handle, pParam->add_char.attr_handle);
+    try_handle_error(pAppContext, err, "app_on_gatts_add_char");
+}
+
+static void app_on_gatts_add_char_descr(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
 {
     app_context *pAppContext = (app_context *)pCb->pContext;
-    // esp_err_t err = bat_gatts_start_service(pCb->service_handle);
-    // try_handle_error(pAppContext, err, "app_on_gatts_add_char");
-    xEventGroupSetBits(pAppContext->ble_events, GATTS_READY_TO_START_BIT);
+    esp_err_t err = bat_gatts_notify_add_char(&pAppContext->notify, pAppContext->char_handle,
+                                              pParam->add_char_descr.attr_handle, STREAM_LEN);
+    if (!try_handle_error(pAppContext, err, "app_on_gatts_add_char_descr"))
+        xEventGroupSetBits(pAppContext->ble_events, GATTS_READY_TO_START_BIT);
 }
 
 static void app_on_gatts_start(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
@@ -84,6 +103,29 @@ static void app_on_gatts_start(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_para
     return;
 }
 
+static void app_on_gatts_write(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
+{
+    // ble_client's benchmark writes with and without response, answer straight away.
+    if (pParam->write.need_rsp)
+        bat_gatts_send_response(pCb->gatts_if, pParam->write.conn_id, pParam->write.trans_id, ESP_GATT_OK, NULL);
+}
+
+static void app_on_gatts_read(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
+{
+    // ble_client's benchmark reads back a counter, one byte per read. The stack only routes reads of
+    // attributes it knows, any other one of ours is not readable here.
+    app_context *pAppContext = (app_context *)pCb->pContext;
+    if (pParam->read.handle != pAppContext->char_handle)
+    {
+        bat_gatts_send_response(pCb->gatts_if, pParam->read.conn_id, pParam->read.trans_id, ESP_GATT_READ_NOT_PERMIT, NULL);
+        return;
+    }
+
+    static uint8_t reads = 0;
+    bat_gatts_send_uint8(pCb->gatts_if, pParam->read.handle, pParam->read.conn_id, pParam->read.trans_id,
+                         ESP_GATT_OK, reads++);
+}
+
 static void app_on_gatts_stop(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pParam)
 {
     app_context *pAppContext = (app_context *)pCb->pContext;
@@ -165,7 +207,23 @@ esp_err_t run_gatts_service(bat_gatts_callbacks_t *pGattsCallbacks, const char *
 
     bat_set_blink_mode(BLINK_MODE_BREATHING);
     ESP_LOGI(TAG, "Running");
-    vTaskDelay(runtimeMs / portTICK_PERIOD_MS);
+
+    // A new sample every tick. The engine sends the latest one whenever a subscribed link can take it, so
+    // ble_client sees the rate the link sustains; sequence gaps are samples coalesced here.
+    uint32_t seq = 0;
+    TickType_t start = xTaskGetTickCount();
+    while (xTaskGetTickCount() - start < pdMS_TO_TICKS(runtimeMs))
+    {
+        seq++;
+        memcpy(pAppContext->sample, &seq, sizeof(seq));
+        bat_gatts_notify_update(&pAppContext->notify, pAppContext->char_handle, pAppContext->sample, STREAM_LEN);
+        vTaskDelay(1);
+    }
+
+    bat_gatts_notify_stats_t stats;
+    if (bat_gatts_notify_get_stats(&pAppContext->notify, &stats) == ESP_OK)
+        ESP_LOGI(TAG, "Stream: %lu samples, %lu notified, %lu coalesced, %lu congestions", (unsigned long)stats.updates,
+                 (unsigned long)stats.notified, (unsigned long)stats.coalesced, (unsigned long)stats.congestions);
 
     bat_set_blink_mode(BLINK_MODE_SLOW);
     err = bat_gatts_stop_advertising();
@@ -200,9 +258,12 @@ void app_main(void)
     bat_gatts_callbacks_t gatts_callbacks = {
         .on_reg = app_on_gatts_reg,
         .on_stop = app_on_gatts_stop,
+        .on_read = app_on_gatts_read,
+        .on_write = app_on_gatts_write,
         .on_start = app_on_gatts_start,
         .on_create = app_on_gatts_create,
         .on_add_char = app_on_gatts_add_char,
+        .on_add_char_descr = app_on_gatts_add_char_descr,
     };
 
     bat_gaps_callbacks_t gaps_callbacks = {
@@ -215,9 +276,15 @@ void app_main(void)
     ESP_ERROR_CHECK(bat_blink_init(-1));
     ESP_ERROR_CHECK(bat_ble_server_init());
 
+    // Matches ble_client, so its benchmark runs on the best link both controllers support.
+    const bat_ble_throughput_profile_t profile = BAT_BLE_THROUGHPUT_PROFILE_MAX;
+    ESP_ERROR_CHECK(bat_ble_throughput_set_profile(&profile));
+    // ble_client runs the connection profile policy, the links log their radio usage here too when they close.
+
     app_context appContext;
     app_context_init(&appContext);
     bat_ble_gaps_callbacks_init(&gaps_callbacks, &appContext);
+    gatts_callbacks.pNotify = &appContext.notify;
     bat_ble_gatts_callbacks_init(&gatts_callbacks, &appContext);
 
 #define BAT_APP_ID 0x55
@@ -14,6 +14,7 @@
 #include "bat_gatts_fsm.h"
 #include "bat_ble_server.h"
 #include "bat_gatts_fsm_helpers.h"
+#include "bat_trace.h"
 
 static const char *TAG = "bat_gatts_fsm";
 
@@ -31,146 +32,115 @@ static const char *TAG = "bat_gatts_fsm";
  */
 esp_err_t bat_gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *pParam)
 {
-    ESP_LOGI(TAG, "GATTS event: %d, gatts_if: %d", event, gatts_if);
-    
     if (pParam == NULL) 
     {
         ESP_LOGE(TAG, "Invalid GATTS callback parameters (NULL)");
         return ESP_ERR_INVALID_ARG;
     }
 
+    // Events are traced, not logged, see bat_trace.h. bat_trace_dump prints them.
     switch (event) 
     {
         // Registration events (typically first)
         case ESP_GATTS_REG_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_REG_EVT received, app_id: %d, status: %d", 
-                    pParam->reg.app_id, pParam->reg.status);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->reg.app_id, BAT_TRACE_NO_CONN, pParam->reg.status);
             break;
             
         // Service creation events
         case ESP_GATTS_CREATE_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_CREATE_EVT received, status: %d, service_handle: %d", 
-                    pParam->create.status, pParam->create.service_handle);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->create.service_handle, BAT_TRACE_NO_CONN, pParam->create.status);
             break;
 
         case ESP_GATTS_ADD_INCL_SRVC_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_ADD_INCL_SRVC_EVT received, status: %d, service_handle: %d", 
-                    pParam->add_incl_srvc.status, pParam->add_incl_srvc.service_handle);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->add_incl_srvc.service_handle, BAT_TRACE_NO_CONN, pParam->add_incl_srvc.status);
             break;
             
         case ESP_GATTS_ADD_CHAR_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_ADD_CHAR_EVT received, status: %d, attr_handle: %d, service_handle: %d", 
-                    pParam->add_char.status, pParam->add_char.attr_handle, pParam->add_char.service_handle);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->add_char.attr_handle, BAT_TRACE_NO_CONN, pParam->add_char.status);
             break;
             
         case ESP_GATTS_ADD_CHAR_DESCR_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_ADD_CHAR_DESCR_EVT received, status: %d, attr_handle: %d", 
-                    pParam->add_char_descr.status, pParam->add_char_descr.attr_handle);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->add_char_descr.attr_handle, BAT_TRACE_NO_CONN, pParam->add_char_descr.status);
             break;
         
         case ESP_GATTS_CREAT_ATTR_TAB_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_CREAT_ATTR_TAB_EVT received, status: %d, num_handle: %d", 
-                    pParam->add_attr_tab.status, pParam->add_attr_tab.num_handle);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, 0, BAT_TRACE_NO_CONN, pParam->add_attr_tab.status);
             break;
             
         // Service start/stop events
         case ESP_GATTS_START_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_START_EVT received, status: %d, service_handle: %d", 
-                    pParam->start.status, pParam->start.service_handle);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->start.service_handle, BAT_TRACE_NO_CONN, pParam->start.status);
             break;
             
         case ESP_GATTS_STOP_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_STOP_EVT received, status: %d, service_handle: %d", 
-                    pParam->stop.status, pParam->stop.service_handle);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->stop.service_handle, BAT_TRACE_NO_CONN, pParam->stop.status);
             break;
             
         // Connection events
         case ESP_GATTS_CONNECT_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_CONNECT_EVT received, conn_id: %d", 
-                    pParam->connect.conn_id);
-            ESP_LOGI(TAG, "Remote device address: %02x:%02x:%02x:%02x:%02x:%02x",
-                    pParam->connect.remote_bda[0], pParam->connect.remote_bda[1],
-                    pParam->connect.remote_bda[2], pParam->connect.remote_bda[3],
-                    pParam->connect.remote_bda[4], pParam->connect.remote_bda[5]);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, 0, pParam->connect.conn_id, 0);
             break;
             
         case ESP_GATTS_DISCONNECT_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_DISCONNECT_EVT received, conn_id: %d, reason: 0x%x", 
-                    pParam->disconnect.conn_id, pParam->disconnect.reason);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, 0, pParam->disconnect.conn_id, pParam->disconnect.reason);
             break;
             
         // MTU exchange event
         case ESP_GATTS_MTU_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_MTU_EVT received, conn_id: %d, mtu: %d", 
-                    pParam->mtu.conn_id, pParam->mtu.mtu);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, 0, pParam->mtu.conn_id, pParam->mtu.mtu);
             break;
             
         // Data exchange events
         case ESP_GATTS_READ_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_READ_EVT received, conn_id: %d, handle: %d", 
-                    pParam->read.conn_id, pParam->read.handle);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->read.handle, pParam->read.conn_id, 0);
             break;
             
         case ESP_GATTS_WRITE_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_WRITE_EVT received, conn_id: %d, handle: %d, len: %d", 
-                    pParam->write.conn_id, pParam->write.handle, pParam->write.len);
-            if (pParam->write.is_prep)
-            {
-                ESP_LOGI(TAG, "Write is prepare write operation");
-            }
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->write.handle, pParam->write.conn_id, pParam->write.is_prep);
             break;
             
         case ESP_GATTS_EXEC_WRITE_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_EXEC_WRITE_EVT received, conn_id: %d, exec_write_flag: %d", 
-                    pParam->exec_write.conn_id, pParam->exec_write.exec_write_flag);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, 0, pParam->exec_write.conn_id, pParam->exec_write.exec_write_flag);
             break;
             
         case ESP_GATTS_RESPONSE_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_RESPONSE_EVT received, status: %d, handle: %d", 
-                    pParam->rsp.status, pParam->rsp.handle);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->rsp.handle, BAT_TRACE_NO_CONN, pParam->rsp.status);
             break;
             
         // Confirmation events
         case ESP_GATTS_CONF_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_CONF_EVT received, conn_id: %d, handle: %d, status: %d", 
-                    pParam->conf.conn_id, pParam->conf.handle, pParam->conf.status);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->conf.handle, pParam->conf.conn_id, pParam->conf.status);
             break;
             
         // Other events
         case ESP_GATTS_SET_ATTR_VAL_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_SET_ATTR_VAL_EVT received, status: %d", 
-                    pParam->set_attr_val.status);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, pParam->set_attr_val.attr_handle, BAT_TRACE_NO_CONN, pParam->set_attr_val.status);
             break;
             
         case ESP_GATTS_SEND_SERVICE_CHANGE_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_SEND_SERVICE_CHANGE_EVT received, status: %d", 
-                    pParam->service_change.status);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, 0, BAT_TRACE_NO_CONN, pParam->service_change.status);
             break;
             
         case ESP_GATTS_OPEN_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_OPEN_EVT received, status: %d", pParam->open.status);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, 0, BAT_TRACE_NO_CONN, pParam->open.status);
             break;
             
         case ESP_GATTS_CLOSE_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_CLOSE_EVT received, status: %d", pParam->close.status);
-            break;
-            
-        case ESP_GATTS_LISTEN_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_LISTEN_EVT received");
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, 0, BAT_TRACE_NO_CONN, pParam->close.status);
             break;
             
         case ESP_GATTS_CONGEST_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_CONGEST_EVT received, conn_id: %d, congested: %d", 
-                    pParam->congest.conn_id, pParam->congest.congested);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, 0, pParam->congest.conn_id, pParam->congest.congested);
             break;
             
         // Clean-up events
         case ESP_GATTS_DELETE_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_DELETE_EVT received, status: %d", pParam->del.status);
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, 0, BAT_TRACE_NO_CONN, pParam->del.status);
             break;
             
+        case ESP_GATTS_LISTEN_EVT:
         case ESP_GATTS_UNREG_EVT:
-            ESP_LOGI(TAG, "ESP_GATTS_UNREG_EVT received");
+            BAT_TRACE(BAT_TRACE_SRC_GATTS_FSM, event, 0, BAT_TRACE_NO_CONN, 0);
             break;
             
         default:
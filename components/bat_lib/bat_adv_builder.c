@@ -0,0 +1,145 @@
+#include "bat_adv_builder.h"
+#include <string.h>
+
+// Reserves an AD structure of data_len bytes and returns where its data goes, or NULL if it does not fit.
+static uint8_t *bat_adv_reserve(bat_adv_buf_t *pBuf, uint8_t type, size_t data_len)
+{
+    if (2 + data_len > bat_adv_buf_remaining(pBuf))
+        return NULL;
+
+    uint8_t *pField = &pBuf->data[pBuf->len];
+    pField[0] = (uint8_t)(1 + data_len);
+    pField[1] = type;
+    pBuf->len += (uint8_t)(2 + data_len);
+    return pField + 2;
+}
+
+static void bat_adv_put_le16(uint8_t *pDest, uint16_t value)
+{
+    pDest[0] = (uint8_t)(value & 0xff);
+    pDest[1] = (uint8_t)(value >> 8);
+}
+
+esp_err_t bat_adv_add_field(bat_adv_buf_t *pBuf, uint8_t type, const uint8_t *pData, size_t len)
+{
+    if (pBuf == NULL || (len != 0 && pData == NULL))
+        return ESP_ERR_INVALID_ARG;
+
+    uint8_t *pDest = bat_adv_reserve(pBuf, type, len);
+    if (pDest == NULL)
+        return ESP_ERR_INVALID_SIZE;
+
+    if (len != 0)
+        memcpy(pDest, pData, len);
+    return ESP_OK;
+}
+
+esp_err_t bat_adv_add_flags(bat_adv_buf_t *pBuf, uint8_t flags)
+{
+    return bat_adv_add_field(pBuf, ESP_BLE_AD_TYPE_FLAG, &flags, 1);
+}
+
+esp_err_t bat_adv_add_uuid16s(bat_adv_buf_t *pBuf, const uint16_t *pUuids, size_t count, bool complete)
+{
+    if (pBuf == NULL || pUuids == NULL || count == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    uint8_t *pDest = bat_adv_reserve(pBuf, complete ? ESP_BLE_AD_TYPE_16SRV_CMPL : ESP_BLE_AD_TYPE_16SRV_PART, count * 2);
+    if (pDest == NULL)
+        return ESP_ERR_INVALID_SIZE;
+
+    for (size_t i = 0; i < count; ++i)
+        bat_adv_put_le16(pDest + i * 2, pUuids[i]);
+    return ESP_OK;
+}
+
+esp_err_t bat_adv_add_uuid128s(bat_adv_buf_t *pBuf, const bat_ble_uuid128_t *pUuids, size_t count, bool complete)
+{
+    if (pUuids == NULL || count == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    // bat_ble_uuid128_t holds the bytes in advertised (little endian) order.
+    return bat_adv_add_field(pBuf, complete ? ESP_BLE_AD_TYPE_128SRV_CMPL : ESP_BLE_AD_TYPE_128SRV_PART,
+                             pUuids[0].uuid, count * ESP_UUID_LEN_128);
+}
+
+esp_err_t bat_adv_add_name(bat_adv_buf_t *pBuf, const char *pszName, bool allow_short)
+{
+    if (pBuf == NULL || pszName == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    size_t len = strlen(pszName);
+    if (2 + len <= bat_adv_buf_remaining(pBuf))
+        return bat_adv_add_field(pBuf, ESP_BLE_AD_TYPE_NAME_CMPL, (const uint8_t *)pszName, len);
+
+    if (!allow_short || bat_adv_buf_remaining(pBuf) < 3)
+        return ESP_ERR_INVALID_SIZE;
+
+    return bat_adv_add_field(pBuf, ESP_BLE_AD_TYPE_NAME_SHORT, (const uint8_t *)pszName, bat_adv_buf_remaining(pBuf) - 2);
+}
+
+esp_err_t bat_adv_add_appearance(bat_adv_buf_t *pBuf, uint16_t appearance)
+{
+    uint8_t data[2];
+    bat_adv_put_le16(data, appearance);
+    return bat_adv_add_field(pBuf, ESP_BLE_AD_TYPE_APPEARANCE, data, sizeof(data));
+}
+
+esp_err_t bat_adv_add_tx_power(bat_adv_buf_t *pBuf, int8_t dbm)
+{
+    uint8_t data = (uint8_t)dbm;
+    return bat_adv_add_field(pBuf, ESP_BLE_AD_TYPE_TX_PWR, &data, 1);
+}
+
+esp_err_t bat_adv_add_conn_interval(bat_adv_buf_t *pBuf, uint16_t min_interval, uint16_t max_interval)
+{
+    uint8_t data[4];
+    bat_adv_put_le16(data, min_interval);
+    bat_adv_put_le16(data + 2, max_interval);
+    return bat_adv_add_field(pBuf, ESP_BLE_AD_TYPE_INT_RANGE, data, sizeof(data));
+}
+
+esp_err_t bat_adv_add_manufacturer(bat_adv_buf_t *pBuf, uint16_t company_id, const uint8_t *pData, size_t len)
+{
+    if (pBuf == NULL || (len != 0 && pData == NULL))
+        return ESP_ERR_INVALID_ARG;
+
+    uint8_t *pDest = bat_adv_reserve(pBuf, ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE, 2 + len);
+    if (pDest == NULL)
+        return ESP_ERR_INVALID_SIZE;
+
+    bat_adv_put_le16(pDest, company_id);
+    if (len != 0)
+        memcpy(pDest + 2, pData, len);
+    return ESP_OK;
+}
+
+esp_err_t bat_adv_add_service_data16(bat_adv_buf_t *pBuf, uint16_t uuid, const uint8_t *pData, size_t len)
+{
+    if (pBuf == NULL || (len != 0 && pData == NULL))
+        return ESP_ERR_INVALID_ARG;
+
+    uint8_t *pDest = bat_adv_reserve(pBuf, ESP_BLE_AD_TYPE_SERVICE_DATA, 2 + len);
+    if (pDest == NULL)
+        return ESP_ERR_INVALID_SIZE;
+
+    bat_adv_put_le16(pDest, uuid);
+    if (len != 0)
+        memcpy(pDest + 2, pData, len);
+    return ESP_OK;
+}
+
+esp_err_t bat_adv_add_service_data128(bat_adv_buf_t *pBuf, const bat_ble_uuid128_t *pUuid, const uint8_t *pData, size_t len)
+{
+    if (pBuf == NULL || pUuid == NULL || (len != 0 && pData == NULL))
+        return ESP_ERR_INVALID_ARG;
+
+    uint8_t *pDest = bat_adv_reserve(pBuf, ESP_BLE_AD_TYPE_128SERVICE_DATA, ESP_UUID_LEN_128 + len);
+    if (pDest == NULL)
+        return ESP_ERR_INVALID_SIZE;
+
+    memcpy(pDest, pUuid->uuid, ESP_UUID_LEN_128);
+    if (len != 0)
+        memcpy(pDest + ESP_UUID_LEN_128, pData, len);
+    return ESP_OK;
+}
@@ -0,0 +1,107 @@
+#include "bat_adv_parser.h"
+#include <string.h>
+#include "esp_gap_ble_api.h"
+
+esp_err_t bat_adv_parse(const uint8_t *pData, size_t len, bat_adv_index_t *pIndex)
+{
+    if (pIndex == NULL || (pData == NULL && len != 0))
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pIndex->types, 0, sizeof(pIndex->types));
+    pIndex->pData = pData;
+    pIndex->count = 0;
+
+    // Offsets are stored in a byte.
+    if (len > UINT8_MAX)
+        len = UINT8_MAX;
+
+    size_t pos = 0;
+    while (pos < len && pIndex->count < BAT_ADV_MAX_FIELDS)
+    {
+        uint8_t field_len = pData[pos];
+        if (field_len == 0) // Padding, the rest of the payload is unused.
+            break;
+
+        if (pos + 1 + field_len > len)
+            return ESP_ERR_INVALID_SIZE;
+
+        uint8_t type = pData[pos + 1];
+        bat_adv_field_t *pField = &pIndex->fields[pIndex->count++];
+        pField->type = type;
+        pField->offset = (uint8_t)(pos + 2);
+        pField->len = field_len - 1;
+        pIndex->types[type >> 5] |= 1u << (type & 31);
+
+        pos += 1 + field_len;
+    }
+
+    return ESP_OK;
+}
+
+const uint8_t *bat_adv_find(const bat_adv_index_t *pIndex, uint8_t type, uint8_t *pLen)
+{
+    if (pLen != NULL)
+        *pLen = 0;
+
+    if (pIndex == NULL || !bat_adv_has_type(pIndex, type))
+        return NULL;
+
+    for (uint8_t i = 0; i < pIndex->count; ++i)
+    {
+        if (pIndex->fields[i].type == type)
+        {
+            if (pLen != NULL)
+                *pLen = pIndex->fields[i].len;
+            return pIndex->pData + pIndex->fields[i].offset;
+        }
+    }
+
+    return NULL;
+}
+
+esp_err_t bat_adv_get_name(const bat_adv_index_t *pIndex, char *pszName, size_t size)
+{
+    if (pszName == NULL || size == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    pszName[0] = '\0';
+
+    // Try to get the complete name, fall back to the short name.
+    uint8_t name_len = 0;
+    const uint8_t *pName = bat_adv_find(pIndex, ESP_BLE_AD_TYPE_NAME_CMPL, &name_len);
+    if (pName == NULL || name_len == 0)
+        pName = bat_adv_find(pIndex, ESP_BLE_AD_TYPE_NAME_SHORT, &name_len);
+
+    if (pName == NULL || name_len == 0)
+        return ESP_ERR_NOT_FOUND;
+
+    size_t copy_len = (name_len < size - 1) ? name_len : size - 1;
+    memcpy(pszName, pName, copy_len);
+    pszName[copy_len] = '\0';
+    return ESP_OK;
+}
+
+bool bat_adv_has_uuid128(const bat_adv_index_t *pIndex, const uint8_t *pUuid)
+{
+    if (pIndex == NULL || pUuid == NULL)
+        return false;
+
+    if (!bat_adv_has_type(pIndex, ESP_BLE_AD_TYPE_128SRV_CMPL) && !bat_adv_has_type(pIndex, ESP_BLE_AD_TYPE_128SRV_PART))
+        return false;
+
+    for (uint8_t i = 0; i < pIndex->count; ++i)
+    {
+        const bat_adv_field_t *pField = &pIndex->fields[i];
+        if (pField->type != ESP_BLE_AD_TYPE_128SRV_CMPL && pField->type != ESP_BLE_AD_TYPE_128SRV_PART)
+            continue;
+
+        const uint8_t *pList = pIndex->pData + pField->offset;
+        for (uint8_t pos = 0; pos + ESP_UUID_LEN_128 <= pField->len; pos += ESP_UUID_LEN_128)
+        {
+            if (memcmp(&pList[pos], pUuid, ESP_UUID_LEN_128) == 0)
+                return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,103 @@
+#include "bat_bench.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "bat_lib:bench";
+
+static int bat_bench_compare(const void *pA, const void *pB)
+{
+    uint32_t a = *(const uint32_t *)pA;
+    uint32_t b = *(const uint32_t *)pB;
+    return (a > b) - (a < b);
+}
+
+// Nearest rank on sorted samples.
+static uint32_t bat_bench_percentile(const uint32_t *pSorted, size_t count, unsigned percent)
+{
+    if (count == 0)
+        return 0;
+
+    size_t rank = (count * percent + 99) / 100;
+    return pSorted[rank == 0 ? 0 : rank - 1];
+}
+
+esp_err_t bat_bench_init(bat_bench_t *pBench, size_t capacity)
+{
+    if (pBench == NULL || capacity == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pBench, 0, sizeof(*pBench));
+    pBench->pSamples = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+    if (pBench->pSamples == NULL)
+        return ESP_ERR_NO_MEM;
+
+    pBench->capacity = capacity;
+    return ESP_OK;
+}
+
+void bat_bench_free(bat_bench_t *pBench)
+{
+    if (pBench == NULL)
+        return;
+
+    free(pBench->pSamples);
+    memset(pBench, 0, sizeof(*pBench));
+}
+
+void bat_bench_start(bat_bench_t *pBench)
+{
+    pBench->sample_count = 0;
+    pBench->ops = 0;
+    pBench->bytes = 0;
+    pBench->stop_us = 0;
+    pBench->start_us = esp_timer_get_time();
+}
+
+void bat_bench_record(bat_bench_t *pBench, uint32_t latency_us, size_t bytes)
+{
+    if (pBench->sample_count < pBench->capacity)
+        pBench->pSamples[pBench->sample_count++] = latency_us;
+    pBench->ops++;
+    pBench->bytes += bytes;
+}
+
+void bat_bench_stop(bat_bench_t *pBench)
+{
+    pBench->stop_us = esp_timer_get_time();
+}
+
+esp_err_t bat_bench_get_report(bat_bench_t *pBench, bat_bench_report_t *pReport)
+{
+    if (pBench == NULL || pReport == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pReport, 0, sizeof(*pReport));
+    int64_t end_us = (pBench->stop_us != 0) ? pBench->stop_us : esp_timer_get_time();
+    pReport->ops = pBench->ops;
+    pReport->bytes = pBench->bytes;
+    pReport->elapsed_us = end_us - pBench->start_us;
+    if (pReport->elapsed_us > 0)
+    {
+        pReport->bytes_per_sec = (uint32_t)(pBench->bytes * 1000000ULL / (uint64_t)pReport->elapsed_us);
+        pReport->ops_per_sec = (uint32_t)((uint64_t)pBench->ops * 1000000ULL / (uint64_t)pReport->elapsed_us);
+    }
+
+    size_t count = pBench->sample_count;
+    qsort(pBench->pSamples, count, sizeof(uint32_t), bat_bench_compare);
+    pReport->p50_us = bat_bench_percentile(pBench->pSamples, count, 50);
+    pReport->p90_us = bat_bench_percentile(pBench->pSamples, count, 90);
+    pReport->p99_us = bat_bench_percentile(pBench->pSamples, count, 99);
+    pReport->max_us = (count != 0) ? pBench->pSamples[count - 1] : 0;
+    return ESP_OK;
+}
+
+void bat_bench_log_report(const char *pszName, const bat_bench_report_t *pReport)
+{
+    ESP_LOGI(TAG, "%s: %lu ops, %llu bytes in %lld us, %lu B/s, %lu ops/s, latency p50 %lu us, p90 %lu us, p99 %lu us, max %lu us",
+             pszName, (unsigned long)pReport->ops, (unsigned long long)pReport->bytes, (long long)pReport->elapsed_us,
+             (unsigned long)pReport->bytes_per_sec, (unsigned long)pReport->ops_per_sec,
+             (unsigned long)pReport->p50_us, (unsigned long)pReport->p90_us, (unsigned long)pReport->p99_us,
+             (unsigned long)pReport->max_us);
+}
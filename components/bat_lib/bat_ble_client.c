@@ -4,6 +4,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "driver/ledc.h"
@@ -16,9 +17,12 @@
 #include "esp_gatt_defs.h" // Added for ESP_UUID_LEN_XX and potentially esp_bt_uuid_t resolution
 
 #include "bat_lib.h"
-#include "bat_hash_table.h"
+#include "bat_peer_store.h"
+#include "bat_scan_dedup.h"
+#include "bat_scan_worker.h"
 #include "bat_ble_client.h"
 #include "bat_ble_client_logging.h"
+#include "bat_trace.h"
 
 // See: /docs/ble_intro.md
 // Connection Process:
@@ -28,17 +32,57 @@
 // 4. If advertiser accepts (e.g., not using a Filter Accept List or initiator is on the list), connection is established.
 static const char *TAG = "bat_lib:ble_client";
 
+#define BAT_BDA_CONTEXT_EVICT_BATCH 8                                  // Stale evictions per hold of g_peers_mutex
+
 typedef struct
 {
-    void *pContext;
-    uint8_t bda[ESP_BD_ADDR_LEN]; // Bluetooth Device Address (BDA)
-} gap_bda_callback_entry_t;
-
-#define GAP_CB_TABLE_SIZE 16
-static gap_bda_callback_entry_t gap_cb_table[GAP_CB_TABLE_SIZE] = {0}; // Array for per-BDA callbacks
+    esp_bd_addr_t bda;
+    void *pValue;
+} bat_bda_evicted_t;                                                   // An eviction awaiting the application's callback
+
+static bat_peer_store_t gap_peer_store = {0};                          // Per-BDA contexts, hashed on the BDA with LRU eviction
+static SemaphoreHandle_t g_peers_mutex = NULL;                         // Guards gap_peer_store, looked up on the Bluedroid task and changed from app tasks
+static bat_peer_store_evict_cb_t g_peers_evict_cb = NULL;              // The application's eviction callback, called with g_peers_mutex released
+static void *g_peers_evict_context = NULL;
+static bat_bda_evicted_t g_peers_evicted[BAT_BDA_CONTEXT_EVICT_BATCH]; // Evictions collected under g_peers_mutex
+static size_t g_peers_evicted_count = 0;
+static bat_scan_dedup_t gap_scan_dedup = {0};                          // Drops unchanged advertisements ahead of on_scan_result
+static bool g_scan_dedup_disabled = false;
+static SemaphoreHandle_t g_scan_mutex = NULL;                          // Guards gap_scan_dedup and gap_scan_worker against reconfiguration while results arrive
+static bat_scan_worker_t gap_scan_worker = {0};                        // Optional, runs on_scan_result off the Bluedroid task
+static bool g_scan_worker_stopping = false;                            // Set while the worker drains, the GAP handler leaves it alone
 static esp_gatt_if_t g_gattc_handles[GATTC_APPLAST + 1];               // AppIds to GATT Client handles mapping
 
 static bat_gapc_callbacks_t *g_pGapCallbacks = NULL;
+static bat_gattc_callbacks_t *g_pGattcCallbacks = NULL;               // Optional, see bat_ble_gattc_callbacks_init
+static bat_gattc_conn_table_t g_links;                                 // Links opened by bat_ble_client_connect
+static SemaphoreHandle_t g_links_mutex = NULL;                         // Guards g_links, g_cache, g_queues and g_subs, apps connect from their own tasks
+static volatile bool g_scanning = false;                               // Opens wait for the scan to stop
+static bat_gattc_cache_t g_cache;                                      // Attribute databases of known peers, persisted to NVS
+static bat_gattc_queue_t g_queues[BAT_GATTC_CONN_MAX];                 // Request queue of each g_links slot
+static bat_gattc_sub_t g_subs[BAT_GATTC_NOTIFY_SUBS];                  // Notification subscriptions, their rings are lock free
+static uint32_t g_sub_seq = 0;                                         // Registrations issued, see bat_gattc_sub_t::seq
+static const uint8_t g_cccd_notify[2] = {0x01, 0x00};                  // CCCD values, written from the request queue
+static const uint8_t g_cccd_indicate[2] = {0x02, 0x00};
+static const uint8_t g_cccd_off[2] = {0x00, 0x00};
+
+static void bat_ble_client_open_next(void);
+static bool bat_ble_client_open_from_cache(esp_gatt_if_t gattc_if, uint16_t conn_id, bat_gattc_link_t **ppReady);
+static void bat_ble_client_cache_discovery(esp_gatt_if_t gattc_if, uint16_t conn_id);
+static bool bat_ble_client_on_hash_read(esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
+static bool bat_ble_client_queue_event(uint16_t conn_id, bool is_read, uint16_t handle, esp_gatt_status_t status,
+                                       const uint8_t *pValue, uint16_t value_len);
+static void bat_ble_client_queue_run(uint16_t conn_id);
+static void bat_ble_client_queue_set_congested(uint16_t conn_id, bool congested);
+static void bat_ble_client_queue_flush(uint16_t conn_id);
+static void bat_ble_client_on_reg_for_notify(esp_gatt_if_t gattc_if, uint16_t handle, esp_gatt_status_t status);
+static void bat_ble_client_on_notify(uint16_t conn_id, uint16_t handle, const uint8_t *pValue, uint16_t value_len);
+static void bat_ble_client_close_subs(uint16_t conn_id);
+
+static inline bat_gattc_queue_t *bat_ble_client_link_queue(const bat_gattc_link_t *pLink)
+{
+    return &g_queues[pLink - g_links.links];
+}
 
 // GAP (Generic Access Profile) events notify about BLE advertising, scanning, connection management, and security events.
 // Common events include:
@@ -81,6 +125,45 @@ static bat_gapc_callbacks_t *g_pGapCallbacks = NULL;
 // 10. ESP_GATTC_GET_CHAR_EVT - Characteristic information received
 // 11. esp_ble_gattc_read_char() / esp_ble_gattc_write_char() - Read or write characteristics
 
+// Before bat_ble_client_init no GAP or GATTC event can arrive and there is no mutex to take.
+static void bat_bda_context_lock(void)
+{
+    if (g_peers_mutex != NULL)
+        xSemaphoreTake(g_peers_mutex, portMAX_DELAY);
+}
+
+// Releases the lock, then reports the evictions collected while it was held.
+static void bat_bda_context_unlock(void)
+{
+    bat_bda_evicted_t evicted[BAT_BDA_CONTEXT_EVICT_BATCH];
+    size_t count = g_peers_evicted_count;
+    bat_peer_store_evict_cb_t evict_cb = g_peers_evict_cb;
+    void *pContext = g_peers_evict_context;
+    memcpy(evicted, g_peers_evicted, count * sizeof(evicted[0]));
+    g_peers_evicted_count = 0;
+
+    if (g_peers_mutex != NULL)
+        xSemaphoreGive(g_peers_mutex);
+
+    if (evict_cb == NULL)
+        return;
+    for (size_t i = 0; i < count; ++i)
+        evict_cb(evicted[i].bda, evicted[i].pValue, pContext);
+}
+
+// Before bat_ble_client_init no scan result can arrive and there is no mutex to take.
+static void bat_ble_client_scan_lock(void)
+{
+    if (g_scan_mutex != NULL)
+        xSemaphoreTake(g_scan_mutex, portMAX_DELAY);
+}
+
+static void bat_ble_client_scan_unlock(void)
+{
+    if (g_scan_mutex != NULL)
+        xSemaphoreGive(g_scan_mutex);
+}
+
 static void bat_gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *pParam)
 {
     assert(g_pGapCallbacks != NULL); // call bat_ble_gapc_callbacks_init!
@@ -88,37 +171,82 @@ static void bat_gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_p
     switch (event)
     {
     case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT:
-        ESP_LOGI(TAG, "ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT");
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, pParam->scan_param_cmpl.status);
         g_pGapCallbacks->on_scan_param_set_complete(g_pGapCallbacks, pParam);
         break;
 
     case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT:
-        ESP_LOGI(TAG, "ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT");
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, pParam->scan_start_cmpl.status);
+        if (pParam->scan_start_cmpl.status != ESP_BT_STATUS_SUCCESS)
+            g_scanning = false;
         g_pGapCallbacks->on_scan_start_complete(g_pGapCallbacks, pParam);
         break;
 
     case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
-        ESP_LOGI(TAG, "ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT");
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, pParam->update_conn_params.conn_int, BAT_TRACE_NO_CONN,
+                  pParam->update_conn_params.status);
+        bat_ble_throughput_on_gap_event(event, pParam);
         g_pGapCallbacks->on_update_conn_params(g_pGapCallbacks, pParam);
         break;
 
+    case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, pParam->pkt_data_length_cmpl.params.tx_len, BAT_TRACE_NO_CONN,
+                  pParam->pkt_data_length_cmpl.status);
+        bat_ble_throughput_on_gap_event(event, pParam);
+        break;
+
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, pParam->phy_update.status);
+        bat_ble_throughput_on_gap_event(event, pParam);
+        break;
+#endif
+
     case ESP_GAP_BLE_SEC_REQ_EVT:
-        ESP_LOGI(TAG, "ESP_GAP_BLE_SEC_REQ_EVT");
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, 0);
         g_pGapCallbacks->on_sec_req(g_pGapCallbacks, pParam);
         break;
 
     case ESP_GAP_BLE_SCAN_RESULT_EVT:
-        ESP_LOGI(TAG, "ESP_GAP_BLE_SCAN_RESULT_EVT");
-        g_pGapCallbacks->on_scan_result(g_pGapCallbacks, pParam);
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, pParam->scan_rst.search_evt);
+        if (pParam->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_CMPL_EVT)
+        {
+            g_scanning = false; // The scan duration ran out, there is no stop event.
+            bat_ble_client_open_next();
+        }
+        // Scanning runs with BLE_SCAN_DUPLICATE_DISABLE, drop repeats before logging them.
+        if (pParam->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT)
+        {
+            bat_ble_client_scan_lock();
+            bool fresh = bat_scan_dedup_check(&gap_scan_dedup, pParam->scan_rst.bda, pParam->scan_rst.ble_adv,
+                                              pParam->scan_rst.adv_data_len + pParam->scan_rst.scan_rsp_len,
+                                              pParam->scan_rst.rssi);
+            bat_ble_client_scan_unlock();
+            if (!fresh)
+                break;
+        }
+
+        // Queued results reach on_scan_result from the worker task, in order. Posting never blocks,
+        // the mutex only keeps the worker from being stopped and freed underneath.
+        bat_ble_client_scan_lock();
+        bool queued = gap_scan_worker.task != NULL && !g_scan_worker_stopping;
+        if (queued)
+            bat_scan_worker_post(&gap_scan_worker, pParam);
+        bat_ble_client_scan_unlock();
+
+        if (!queued)
+            g_pGapCallbacks->on_scan_result(g_pGapCallbacks, pParam);
         break;
 
     case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT:
-        ESP_LOGI(TAG, "ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT");
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, pParam->scan_stop_cmpl.status);
+        g_scanning = false;
         g_pGapCallbacks->on_scan_stop_complete(g_pGapCallbacks, pParam);
+        bat_ble_client_open_next();
         break;
 
     default:
-        ESP_LOGI(TAG, "GAP Event: %d", event);
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, 0);
         break;
     }
 }
@@ -137,16 +265,14 @@ static void bat_gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_p
 // https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/bluetooth/esp_gattc.html#_CPPv426esp_gattc_cb_event_t
 static void bat_gattc_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
 {
-    ESP_LOGI(TAG, "GATTC Event: %d, gattc_if %d", event, gattc_if);
-
     switch (event)
     {
 
     case ESP_GATTC_REG_EVT:
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, param->reg.app_id, BAT_TRACE_NO_CONN, param->reg.status);
         if (param->reg.status == ESP_GATT_OK)
         {
             g_gattc_handles[param->reg.app_id] = gattc_if;
-            ESP_LOGI(TAG, "GATTC app_id %d registered successfully, gattc_if %d stored", param->reg.app_id, gattc_if);
         }
         else
         {
@@ -158,11 +284,7 @@ static void bat_gattc_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t ga
     {
         // This event indicates the BLE physical link is established.
         // The status of the GATT connection itself will be in ESP_GATTC_OPEN_EVT.
-        ESP_LOGI(TAG, "ESP_GATTC_CONNECT_EVT: conn_id %d, if %d, remote_bda: %02x:%02x:%02x:%02x:%02x:%02x",
-                 param->connect.conn_id,
-                 gattc_if,
-                 param->connect.remote_bda[0], param->connect.remote_bda[1], param->connect.remote_bda[2],
-                 param->connect.remote_bda[3], param->connect.remote_bda[4], param->connect.remote_bda[5]);
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, 0, param->connect.conn_id, 0);
         // The actual GATT connection status and service discovery initiation should be handled in ESP_GATTC_OPEN_EVT
 
         bat_bda_context_lookup(&param->connect.remote_bda); // TODO
@@ -170,46 +292,94 @@ static void bat_gattc_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t ga
     }
 
     case ESP_GATTC_OPEN_EVT:
+    {
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, param->open.mtu, param->open.conn_id, param->open.status);
+        xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+        bat_gattc_link_t *pLink = bat_gattc_conn_on_open(&g_links, param->open.remote_bda, param->open.conn_id,
+                                                         param->open.mtu, param->open.status == ESP_GATT_OK);
+        if (pLink != NULL && param->open.status == ESP_GATT_OK)
+            bat_gattc_queue_open(bat_ble_client_link_queue(pLink), gattc_if, param->open.conn_id);
+        xSemaphoreGive(g_links_mutex);
+        bat_gattc_link_t *pCached = NULL;
+
         if (param->open.status != ESP_GATT_OK)
         {
             ESP_LOGE(TAG, "GATTC open failed, status %d, conn_id %d", param->open.status, param->open.conn_id);
         }
         else
         {
-            ESP_LOGI(TAG, "GATTC open success, conn_id %d, mtu %d", param->open.conn_id, param->open.mtu);
-            ESP_LOGI(TAG, "Connected to remote device: %02x:%02x:%02x:%02x:%02x:%02x",
-                     param->open.remote_bda[0], param->open.remote_bda[1], param->open.remote_bda[2],
-                     param->open.remote_bda[3], param->open.remote_bda[4], param->open.remote_bda[5]);
-            // Discover services after successful GATT open
-            esp_err_t err = esp_ble_gattc_search_service(gattc_if, param->open.conn_id, NULL);
-            if (err != ESP_OK)
+            // MTU, data length, PHY and interval are requested together, see bat_ble_throughput.h.
+            bat_ble_throughput_link_up(param->open.remote_bda, param->open.conn_id, gattc_if);
+
+            // Discover services after successful GATT open, unless the peer's are cached.
+            if (!bat_ble_client_open_from_cache(gattc_if, param->open.conn_id, &pCached))
             {
-                ESP_LOGE(TAG, "esp_ble_gattc_search_service error, status %d", err);
+                esp_err_t err = esp_ble_gattc_search_service(gattc_if, param->open.conn_id, NULL);
+                if (err != ESP_OK)
+                {
+                    ESP_LOGE(TAG, "esp_ble_gattc_search_service error, status %d", err);
+                    if (pLink != NULL)
+                        esp_ble_gattc_close(gattc_if, param->open.conn_id);
+                }
             }
         }
 
         bat_bda_context_lookup(&param->open.remote_bda);
+        if (g_pGattcCallbacks != NULL)
+        {
+            g_pGattcCallbacks->on_open(g_pGattcCallbacks, gattc_if, param);
+            if (pCached != NULL)
+                g_pGattcCallbacks->on_link_ready(g_pGattcCallbacks, pCached);
+        }
+
+        // The controller is free to create the next connection.
+        bat_ble_client_open_next();
+        break;
+    }
+
+    case ESP_GATTC_CFG_MTU_EVT:
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, param->cfg_mtu.mtu, param->cfg_mtu.conn_id, param->cfg_mtu.status);
+        if (param->cfg_mtu.status == ESP_GATT_OK)
+        {
+            bat_ble_throughput_on_mtu(param->cfg_mtu.conn_id, param->cfg_mtu.mtu);
+            xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+            bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, param->cfg_mtu.conn_id);
+            if (pLink != NULL)
+                pLink->mtu = param->cfg_mtu.mtu;
+            xSemaphoreGive(g_links_mutex);
+        }
+        if (g_pGattcCallbacks != NULL)
+            g_pGattcCallbacks->on_cfg_mtu(g_pGattcCallbacks, gattc_if, param);
         break;
 
     case ESP_GATTC_DISCONNECT_EVT:
-        ESP_LOGI(TAG, "ESP_GATTC_DISCONNECT_EVT, conn_id %d, reason %d", param->disconnect.conn_id, param->disconnect.reason);
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, 0, param->disconnect.conn_id, param->disconnect.reason);
         // You might want to re-scan or attempt to reconnect here
 
+        bat_ble_throughput_link_down(param->disconnect.remote_bda);
         bat_bda_context_lookup(&param->disconnect.remote_bda);
+        bat_ble_client_close_subs(param->disconnect.conn_id);  // Before the flush fails their CCCD writes.
+        bat_ble_client_queue_flush(param->disconnect.conn_id); // Fails what was still queued.
+        if (g_pGattcCallbacks != NULL)
+            g_pGattcCallbacks->on_disconnect(g_pGattcCallbacks, gattc_if, param);
+
+        xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+        bat_gattc_conn_on_close(&g_links, param->disconnect.remote_bda);
+        xSemaphoreGive(g_links_mutex);
         break;
 
     case ESP_GATTC_SEARCH_RES_EVT:
     {
-        ESP_LOGI(TAG, "ESP_GATTC_SEARCH_RES_EVT: conn_id = %x, is_primary = %d", param->search_res.conn_id, param->search_res.is_primary);
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, param->search_res.start_handle, param->search_res.conn_id, param->search_res.is_primary);
 
         esp_bt_uuid_t *srvc_uuid = &param->search_res.srvc_id.uuid;
         if (srvc_uuid->len == ESP_UUID_LEN_16)
         {
-            ESP_LOGI(TAG, "SERVICE UUID (16-bit): 0x%04x", srvc_uuid->uuid.uuid16);
+            ESP_LOGD(TAG, "SERVICE UUID (16-bit): 0x%04x", srvc_uuid->uuid.uuid16);
         }
         else if (srvc_uuid->len == ESP_UUID_LEN_32)
         {
-            ESP_LOGI(TAG, "SERVICE UUID (32-bit): 0x%08lx", (unsigned long)srvc_uuid->uuid.uuid32); // Use lx for uint32_t
+            ESP_LOGD(TAG, "SERVICE UUID (32-bit): 0x%08lx", (unsigned long)srvc_uuid->uuid.uuid32); // Use lx for uint32_t
         }
         else if (srvc_uuid->len == ESP_UUID_LEN_128)
         {
@@ -231,15 +401,34 @@ static void bat_gattc_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t ga
     }
 
     case ESP_GATTC_SEARCH_CMPL_EVT:
+    {
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, 0, param->search_cmpl.conn_id, param->search_cmpl.status);
+        xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+        bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, param->search_cmpl.conn_id);
+        if (param->search_cmpl.status == ESP_GATT_OK)
+            pLink = bat_gattc_conn_on_ready(&g_links, param->search_cmpl.conn_id);
+        xSemaphoreGive(g_links_mutex);
+        if (pLink != NULL && param->search_cmpl.status == ESP_GATT_OK)
+            bat_ble_client_cache_discovery(gattc_if, param->search_cmpl.conn_id);
+
         if (param->search_cmpl.status != ESP_GATT_OK)
         {
             ESP_LOGE(TAG, "search service failed, error status = %x", param->search_cmpl.status);
+            if (pLink != NULL)
+                esp_ble_gattc_close(gattc_if, param->search_cmpl.conn_id);
             break;
         }
-        ESP_LOGI(TAG, "ESP_GATTC_SEARCH_CMPL_EVT");
         // After services are found, you would get characteristics for the desired service
         // esp_ble_gattc_get_char_by_uuid(...);
+        if (g_pGattcCallbacks != NULL)
+        {
+            g_pGattcCallbacks->on_search_cmpl(g_pGattcCallbacks, gattc_if, param);
+            // Links are only freed on this task, pLink stays valid through the callback.
+            if (pLink != NULL)
+                g_pGattcCallbacks->on_link_ready(g_pGattcCallbacks, pLink);
+        }
         break;
+    }
 
         // This events are causing compilation errors, it might need 'menuconfig'
         // Removing them for now.
@@ -258,23 +447,94 @@ static void bat_gattc_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t ga
         //     break;    
 
     case ESP_GATTC_READ_CHAR_EVT:
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, param->read.handle, param->read.conn_id, param->read.status);
+        // Database Hash reads belong to the attribute cache, not to the application.
+        if (bat_ble_client_on_hash_read(gattc_if, param))
+            break;
         if (param->read.status != ESP_GATT_OK)
         {
             ESP_LOGE(TAG, "read char failed, error status = %x", param->read.status);
-            break;
         }
-        ESP_LOGI(TAG, "ESP_GATTC_READ_CHAR_EVT: handle %d, value len %d", param->read.handle, param->read.value_len);
-        ESP_LOG_BUFFER_HEX(TAG, param->read.value, param->read.value_len);
-        // Process the received IP address and port here
+        else
+        {
+            ESP_LOG_BUFFER_HEX_LEVEL(TAG, param->read.value, param->read.value_len, ESP_LOG_DEBUG);
+        }
+        if (bat_ble_client_queue_event(param->read.conn_id, true, param->read.handle, param->read.status,
+                                       param->read.value, param->read.value_len))
+            break;
+        if (g_pGattcCallbacks != NULL)
+            g_pGattcCallbacks->on_read_char(g_pGattcCallbacks, gattc_if, param);
+        break;
+
+    case ESP_GATTC_WRITE_CHAR_EVT:
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, param->write.handle, param->write.conn_id, param->write.status);
+        if (param->write.status != ESP_GATT_OK)
+            ESP_LOGE(TAG, "write char failed, handle %d, error status = %x", param->write.handle, param->write.status);
+        if (bat_ble_client_queue_event(param->write.conn_id, false, param->write.handle, param->write.status, NULL, 0))
+            break;
+        if (g_pGattcCallbacks != NULL)
+            g_pGattcCallbacks->on_write_char(g_pGattcCallbacks, gattc_if, param);
+        break;
+
+    case ESP_GATTC_CONGEST_EVT:
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, 0, param->congest.conn_id, param->congest.congested);
+        bat_ble_client_queue_set_congested(param->congest.conn_id, param->congest.congested);
         break;
 
-    // Add cases for other GATTC events like ESP_GATTC_WRITE_CHAR_EVT, ESP_GATTC_NOTIFY_EVT etc.
+    case ESP_GATTC_REG_FOR_NOTIFY_EVT:
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, param->reg_for_notify.handle, BAT_TRACE_NO_CONN, param->reg_for_notify.status);
+        bat_ble_client_on_reg_for_notify(gattc_if, param->reg_for_notify.handle, param->reg_for_notify.status);
+        break;
+
+    case ESP_GATTC_NOTIFY_EVT:
+        // Sensor streams arrive at the connection event rate: copied into the ring, no logging, no callback.
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, param->notify.handle, param->notify.conn_id, param->notify.is_notify);
+        bat_ble_client_on_notify(param->notify.conn_id, param->notify.handle, param->notify.value, param->notify.value_len);
+        break;
+
+    case ESP_GATTC_SRVC_CHG_EVT:
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, 0, BAT_TRACE_NO_CONN, 0);
+        // The server's database changed, its next connection discovers it again.
+        xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+        bat_gattc_cache_invalidate(&g_cache, param->srvc_chg.remote_bda);
+        xSemaphoreGive(g_links_mutex);
+        break;
+
+    // Add cases for other GATTC events here.
     default:
+        BAT_TRACE(BAT_TRACE_SRC_GATTC, event, 0, BAT_TRACE_NO_CONN, 0);
         break;
     }
 }
 
 // See: /docs/ble_client_on_esp.md
+static void bat_bda_context_evicted(const esp_bd_addr_t bda, void *pValue, void *pContext)
+{
+    ESP_LOGW(TAG, "Evicted least recently used BDA context: %02x:%02x:%02x:%02x:%02x:%02x",
+             bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+}
+
+// The store's eviction callback, runs under g_peers_mutex: set evicts at most one peer, stale
+// evictions are done in batches of BAT_BDA_CONTEXT_EVICT_BATCH.
+static void bat_bda_context_collect_evicted(const esp_bd_addr_t bda, void *pValue, void *pContext)
+{
+    if (g_peers_evicted_count == BAT_BDA_CONTEXT_EVICT_BATCH)
+        return;
+    memcpy(g_peers_evicted[g_peers_evicted_count].bda, bda, ESP_BD_ADDR_LEN);
+    g_peers_evicted[g_peers_evicted_count].pValue = pValue;
+    g_peers_evicted_count++;
+}
+
+static esp_err_t bat_bda_context_init_store(const bat_peer_store_config_t *pConfig)
+{
+    bat_peer_store_config_t config = *pConfig;
+    g_peers_evict_cb = config.evict_cb;
+    g_peers_evict_context = config.pContext;
+    config.evict_cb = bat_bda_context_collect_evicted;
+    config.pContext = NULL;
+    return bat_peer_store_init(&gap_peer_store, &config);
+}
+
 esp_err_t bat_ble_client_init()
 {
     ESP_LOGI(TAG, "Initializing BLE system");
@@ -283,6 +543,40 @@ esp_err_t bat_ble_client_init()
     for (int n = GATTC_APPFIRST; n <= GATTC_APPLAST; n++)
         g_gattc_handles[n] = ESP_GATT_IF_NONE;
 
+    // Looked up on GAP/GATTC events, so it must exist before the callbacks are registered.
+    if (gap_peer_store.pEntries == NULL)
+    {
+        bat_peer_store_config_t peer_config = {
+            .capacity = BAT_BDA_CONTEXT_DEFAULT_CAPACITY,
+            .evict_cb = bat_bda_context_evicted,
+        };
+        ESP_ERROR_CHECK(bat_bda_context_init_store(&peer_config));
+    }
+    if (g_peers_mutex == NULL)
+    {
+        g_peers_mutex = xSemaphoreCreateMutex();
+        if (g_peers_mutex == NULL)
+            return ESP_ERR_NO_MEM;
+    }
+
+    if (g_scan_mutex == NULL)
+    {
+        g_scan_mutex = xSemaphoreCreateMutex();
+        if (g_scan_mutex == NULL)
+            return ESP_ERR_NO_MEM;
+    }
+    if (gap_scan_dedup.pEntries == NULL && !g_scan_dedup_disabled)
+        ESP_ERROR_CHECK(bat_scan_dedup_init(&gap_scan_dedup, NULL));
+
+    if (g_links_mutex == NULL)
+    {
+        g_links_mutex = xSemaphoreCreateMutex();
+        if (g_links_mutex == NULL)
+            return ESP_ERR_NO_MEM;
+        ESP_ERROR_CHECK(bat_gattc_conn_table_init(&g_links, BAT_GATTC_CONN_DEFAULT_RETRIES, 0));
+        bat_gattc_cache_init(&g_cache, true); // bat_lib_init has initialized NVS.
+    }
+
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
     esp_err_t ret = esp_bt_controller_init(&bt_cfg);
     if (ret)
@@ -326,6 +620,7 @@ esp_err_t bat_ble_client_init()
         return ret;
     }
 
+    // bat_ble_throughput_set_profile replaces this with the MTU of the profile.
     esp_err_t local_mtu_ret = esp_ble_gatt_set_local_mtu(500);
     if (local_mtu_ret)
     {
@@ -336,16 +631,24 @@ esp_err_t bat_ble_client_init()
     return ESP_OK;
 }
 
-static bool bat_ble_find_service_uuid_by_type(bat_scan_result_t *pScanResult, bat_ble_uuid128_t *pId, uint8_t type)
+esp_err_t bat_ble_client_index_adv(const bat_scan_result_t *pScanResult, bat_adv_index_t *pIndex)
+{
+    assert(pScanResult != NULL);
+
+    // The scan response follows the advertising data in ble_adv.
+    return bat_adv_parse(pScanResult->ble_adv, pScanResult->adv_data_len + pScanResult->scan_rsp_len, pIndex);
+}
+
+static bool bat_ble_find_service_uuid_by_type(const bat_adv_index_t *pIndex, bat_ble_uuid128_t *pId, uint8_t type)
 {
     uint8_t adv_data_len = 0;
-    uint8_t *adv_data = esp_ble_resolve_adv_data(pScanResult->ble_adv, type, &adv_data_len);
+    const uint8_t *adv_data = bat_adv_find(pIndex, type, &adv_data_len);
 
     //ESP_LOGI(TAG, "Resolved advert length: %d", adv_data_len);
 
     if (adv_data != NULL && adv_data_len > 0)
     {
-        for (int i = 0; i < adv_data_len; i += ESP_UUID_LEN_128)
+        for (int i = 0; i + ESP_UUID_LEN_128 <= adv_data_len; i += ESP_UUID_LEN_128)
         {
             //bat_ble_log_uuid128("Checking UUID", &adv_data[i]);
             if (memcmp(&adv_data[i], pId, ESP_UUID_LEN_128) == 0)
@@ -363,13 +666,16 @@ bool bat_ble_client_find_service_uuid(bat_scan_result_t *pScanResult, bat_ble_uu
 {
     //bat_ble_log_uuid128("Looking for UUID", pId->uuid);
 
-    if (bat_ble_find_service_uuid_by_type(pScanResult, pId, ESP_BLE_AD_TYPE_128SRV_CMPL))
+    bat_adv_index_t index;
+    bat_ble_client_index_adv(pScanResult, &index);
+
+    if (bat_ble_find_service_uuid_by_type(&index, pId, ESP_BLE_AD_TYPE_128SRV_CMPL))
     {
         ESP_LOGI(TAG, "Found custom service UUID in complete list");
         return true;
     }
 
-    if (bat_ble_find_service_uuid_by_type(pScanResult, pId, ESP_BLE_AD_TYPE_128SRV_PART))
+    if (bat_ble_find_service_uuid_by_type(&index, pId, ESP_BLE_AD_TYPE_128SRV_PART))
     {
         ESP_LOGI(TAG, "Found custom service UUID in partial list");
         return true;
@@ -388,6 +694,11 @@ esp_err_t bat_ble_register_gattc(bat_gattc_app_id_t app_id)
     return ret;
 }
 
+esp_gatt_if_t bat_ble_client_get_gattc_if(bat_gattc_app_id_t app_id)
+{
+    return (app_id <= GATTC_APPLAST) ? g_gattc_handles[app_id] : ESP_GATT_IF_NONE;
+}
+
 esp_err_t bat_ble_unregister_gattc(bat_gattc_app_id_t app_id)
 {
     if (g_gattc_handles[app_id] == ESP_GATT_IF_NONE)
@@ -465,6 +776,31 @@ esp_err_t bat_ble_client_deinit()
     }
     ESP_LOGI(TAG, "BT controller deinitialized");
 
+    bat_scan_worker_deinit(&gap_scan_worker);
+    bat_peer_store_deinit(&gap_peer_store);
+    if (g_peers_mutex != NULL)
+    {
+        vSemaphoreDelete(g_peers_mutex);
+        g_peers_mutex = NULL;
+    }
+    bat_scan_dedup_deinit(&gap_scan_dedup);
+    if (g_scan_mutex != NULL)
+    {
+        vSemaphoreDelete(g_scan_mutex);
+        g_scan_mutex = NULL;
+    }
+    if (g_links_mutex != NULL)
+    {
+        bat_gattc_conn_table_deinit(&g_links);
+        bat_gattc_cache_deinit(&g_cache);
+        for (size_t i = 0; i < BAT_GATTC_NOTIFY_SUBS; ++i)
+            if (g_subs[i].state != BAT_GATTC_SUB_FREE)
+                bat_gattc_notify_close(&g_subs[i]);
+        vSemaphoreDelete(g_links_mutex);
+        g_links_mutex = NULL;
+    }
+    g_scanning = false;
+
     // Release controller memory if it was taken by ESP_BT_MODE_BLE
     // This is often done if you want to reconfigure for Classic BT or completely free resources.
     // ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_BLE));
@@ -506,6 +842,13 @@ esp_err_t bat_ble_client_set_scan_params()
 
 esp_err_t bat_ble_start_scanning(uint32_t scan_duration_secs)
 {
+    // Every device is reported afresh by a new scan.
+    bat_ble_client_scan_lock();
+    bat_scan_dedup_clear(&gap_scan_dedup);
+    bat_ble_client_scan_unlock();
+
+    // Set before the call so bat_ble_client_connect does not open while the scan starts.
+    g_scanning = true;
     esp_err_t ret = esp_ble_gap_start_scanning(scan_duration_secs);
 
     if (ret == ESP_OK)
@@ -515,6 +858,7 @@ esp_err_t bat_ble_start_scanning(uint32_t scan_duration_secs)
     else
     {
         ESP_LOGE(TAG, "esp_ble_gap_start_scanning failed, error code = %x", ret);
+        g_scanning = false;
     }
 
     return ret;
@@ -542,32 +886,739 @@ esp_err_t bat_ble_client_stop_scanning()
     return ret;
 }
 
-esp_err_t bat_ble_client_get_advertised_name(bat_scan_result_t *pScanResult, bat_advertised_name_t *pAdvertisedName)
+// Opens the oldest waiting link, unless the controller is scanning or creating another connection.
+static void bat_ble_client_open_next(void)
 {
-    assert(pScanResult != NULL);
-    assert(pAdvertisedName != NULL);
+    if (g_links_mutex == NULL)
+        return;
 
-    pAdvertisedName->name[0] = '\0';
+    while (!g_scanning)
+    {
+        xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+        bat_gattc_link_t *pLink = bat_gattc_conn_next_to_open(&g_links);
+        bat_gattc_link_t link;
+        if (pLink != NULL)
+            link = *pLink;
+        xSemaphoreGive(g_links_mutex);
+        if (pLink == NULL)
+            return;
+
+        // ESP_GATTC_OPEN_EVT reports the outcome and opens the next one.
+        esp_err_t err = esp_ble_gattc_open(link.gattc_if, link.bda, link.addr_type, true);
+        if (err == ESP_OK)
+            return;
+
+        ESP_LOGW(TAG, "Open of %02x:%02x:%02x:%02x:%02x:%02x failed: %s", link.bda[0], link.bda[1], link.bda[2],
+                 link.bda[3], link.bda[4], link.bda[5], esp_err_to_name(err));
+        xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+        bat_gattc_conn_on_open(&g_links, link.bda, BAT_GATTC_CONN_NONE, 0, false);
+        xSemaphoreGive(g_links_mutex);
+    }
+}
+
+// Known peers skip the discovery. Returns false if the link has to discover its services, otherwise the
+// link is ready (*ppReady) or waits for the Database Hash read that confirms the cached database.
+static bool bat_ble_client_open_from_cache(esp_gatt_if_t gattc_if, uint16_t conn_id, bat_gattc_link_t **ppReady)
+{
+    uint16_t hash_handle = 0;
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, conn_id);
+    bat_gattc_cache_entry_t *pEntry = (pLink != NULL) ? bat_gattc_cache_lookup(&g_cache, pLink->bda) : NULL;
+    if (pLink != NULL && pEntry == NULL)
+        bat_gattc_cache_on_miss(&g_cache);
+
+    if (pEntry != NULL && pEntry->has_hash)
+    {
+        hash_handle = pEntry->hash_handle;
+        pLink->hash_read_handle = hash_handle;
+    }
+    else if (pEntry != NULL)
+    {
+        // No Database Hash on the peer, the entry stands until a Service Changed indication.
+        pLink = bat_gattc_conn_on_ready(&g_links, conn_id);
+        pLink->cached = true;
+        pLink->discovery_saved_us = bat_gattc_cache_on_hit(&g_cache, pEntry, (uint32_t)(pLink->ready_us - pLink->open_us));
+        *ppReady = pLink;
+    }
+    xSemaphoreGive(g_links_mutex);
+
+    if (pEntry == NULL)
+        return false;
+    if (hash_handle == 0)
+    {
+        ESP_LOGI(TAG, "conn_id %d ready from the attribute cache, %lu us of discovery saved", conn_id,
+                 (unsigned long)(*ppReady)->discovery_saved_us);
+        return true;
+    }
+
+    // ESP_GATTC_READ_CHAR_EVT continues in bat_ble_client_on_hash_read.
+    if (esp_ble_gattc_read_char(gattc_if, conn_id, hash_handle, ESP_GATT_AUTH_REQ_NONE) == ESP_OK)
+        return true;
+
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    pLink = bat_gattc_conn_get(&g_links, conn_id);
+    if (pLink != NULL)
+        pLink->hash_read_handle = 0;
+    bat_gattc_cache_on_miss(&g_cache);
+    xSemaphoreGive(g_links_mutex);
+    return false;
+}
+
+// Copies the database of a link that completed its discovery into the cache, then reads its Database Hash.
+static void bat_ble_client_cache_discovery(esp_gatt_if_t gattc_if, uint16_t conn_id)
+{
+    uint16_t hash_handle = 0;
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, conn_id);
+    bat_gattc_cache_entry_t *pEntry = NULL;
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    if (pLink != NULL)
+        err = bat_gattc_cache_store(&g_cache, gattc_if, conn_id, pLink->bda, (uint32_t)(pLink->ready_us - pLink->open_us), &pEntry);
+    if (err == ESP_OK)
+    {
+        bat_gattc_cache_persist(&g_cache, pEntry);
+        hash_handle = pEntry->hash_handle;
+        pLink->hash_read_handle = hash_handle;
+    }
+    xSemaphoreGive(g_links_mutex);
+
+    if (err == ESP_ERR_INVALID_SIZE)
+        ESP_LOGW(TAG, "conn_id %d: database larger than %d attributes, not cached", conn_id, BAT_GATTC_CACHE_ATTRS);
+    if (hash_handle == 0 || esp_ble_gattc_read_char(gattc_if, conn_id, hash_handle, ESP_GATT_AUTH_REQ_NONE) == ESP_OK)
+        return;
+
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    pLink = bat_gattc_conn_get(&g_links, conn_id);
+    if (pLink != NULL)
+        pLink->hash_read_handle = 0;
+    xSemaphoreGive(g_links_mutex);
+}
+
+// Handles the Database Hash reads issued for the cache, returns false for any other read.
+static bool bat_ble_client_on_hash_read(esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
+{
+    if (g_links_mutex == NULL)
+        return false;
+
+    bool discover = false;
+    bat_gattc_link_t *pReady = NULL;
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, param->read.conn_id);
+    if (pLink == NULL || pLink->hash_read_handle == 0 || pLink->hash_read_handle != param->read.handle)
+    {
+        xSemaphoreGive(g_links_mutex);
+        return false;
+    }
 
-    if (pScanResult->adv_data_len > 0)
+    pLink->hash_read_handle = 0;
+    bool read_ok = (param->read.status == ESP_GATT_OK);
+    bat_gattc_cache_entry_t *pEntry = bat_gattc_cache_lookup(&g_cache, pLink->bda);
+    if (pLink->state == BAT_GATTC_LINK_READY)
     {
-        // Try to get the complete name or short name.
-        uint8_t adv_name_len_val = 0;
-        uint8_t *adv_name_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_NAME_CMPL, &adv_name_len_val);
+        // Follows a discovery, the entry gets the hash to check on the next connection.
+        if (pEntry != NULL && read_ok)
+            bat_gattc_cache_set_hash(&g_cache, pEntry, param->read.value, param->read.value_len);
+    }
+    else if (pEntry != NULL && read_ok && bat_gattc_cache_hash_matches(pEntry, param->read.value, param->read.value_len))
+    {
+        pReady = bat_gattc_conn_on_ready(&g_links, param->read.conn_id);
+        pReady->cached = true;
+        pReady->discovery_saved_us = bat_gattc_cache_on_hit(&g_cache, pEntry, (uint32_t)(pReady->ready_us - pReady->open_us));
+    }
+    else
+    {
+        bat_gattc_cache_invalidate(&g_cache, pLink->bda);
+        bat_gattc_cache_on_miss(&g_cache);
+        discover = true;
+    }
+    xSemaphoreGive(g_links_mutex);
+
+    if (pReady != NULL)
+    {
+        ESP_LOGI(TAG, "conn_id %d ready from the attribute cache, %lu us of discovery saved", param->read.conn_id,
+                 (unsigned long)pReady->discovery_saved_us);
+        if (g_pGattcCallbacks != NULL)
+            g_pGattcCallbacks->on_link_ready(g_pGattcCallbacks, pReady);
+    }
+    else if (discover)
+    {
+        ESP_LOGI(TAG, "conn_id %d: database changed, discovering it again", param->read.conn_id);
+        esp_err_t err = esp_ble_gattc_search_service(gattc_if, param->read.conn_id, NULL);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "esp_ble_gattc_search_service error, status %d", err);
+            esp_ble_gattc_close(gattc_if, param->read.conn_id);
+        }
+    }
+    return true;
+}
 
-        // If complete name not found or is empty, try short name
-        if (adv_name_ptr == NULL || adv_name_len_val == 0)
-            adv_name_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_NAME_SHORT, &adv_name_len_val);
+// Completes a queued operation from its event and issues the next one before running the operation's callback,
+// so the link is busy again while the application handles the result. Returns false for other operations.
+static bool bat_ble_client_queue_event(uint16_t conn_id, bool is_read, uint16_t handle, esp_gatt_status_t status,
+                                       const uint8_t *pValue, uint16_t value_len)
+{
+    if (g_links_mutex == NULL)
+        return false;
+
+    bat_gattc_op_result_t result;
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, conn_id);
+    bool completed = (pLink != NULL &&
+                      bat_gattc_queue_complete(bat_ble_client_link_queue(pLink), is_read, handle, status, pValue, value_len, &result));
+    if (completed && status == ESP_GATT_OK)
+        bat_gattc_conn_record(&g_links, pLink, result.latency_us, is_read ? value_len : result.op.len);
+    xSemaphoreGive(g_links_mutex);
+    if (!completed)
+        return false;
+
+    if (status == ESP_GATT_OK)
+        bat_ble_throughput_on_traffic(conn_id, is_read ? value_len : result.op.len);
+    bat_ble_client_queue_run(conn_id);
+    if (result.op.cb != NULL)
+        result.op.cb(&result);
+    return true;
+}
 
-        if (adv_name_ptr != NULL && adv_name_len_val > 0)
+// Issues the next queued operation of a link. Operations the stack refuses are failed until one goes out.
+// Runs under the mutex so only one operation is in flight, esp_ble_gattc_* only post to the Bluedroid task.
+static void bat_ble_client_queue_run(uint16_t conn_id)
+{
+    for (;;)
+    {
+        bat_gattc_op_result_t failed;
+        esp_err_t err = ESP_OK;
+        xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+        bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, conn_id);
+        if (pLink != NULL)
+            err = bat_gattc_queue_issue(bat_ble_client_link_queue(pLink), &failed);
+        xSemaphoreGive(g_links_mutex);
+        if (err == ESP_OK)
+            return;
+
+        ESP_LOGW(TAG, "conn_id %d: operation on handle %d not issued: %s", conn_id, failed.op.handle, esp_err_to_name(err));
+        if (failed.op.cb != NULL)
+            failed.op.cb(&failed);
+    }
+}
+
+static void bat_ble_client_queue_set_congested(uint16_t conn_id, bool congested)
+{
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, conn_id);
+    if (pLink != NULL)
+        bat_gattc_queue_set_congested(bat_ble_client_link_queue(pLink), congested);
+    xSemaphoreGive(g_links_mutex);
+
+    if (!congested)
+        bat_ble_client_queue_run(conn_id);
+}
+
+static void bat_ble_client_queue_flush(uint16_t conn_id)
+{
+    if (g_links_mutex == NULL)
+        return;
+
+    for (;;)
+    {
+        bat_gattc_op_result_t failed;
+        bool flushed = false;
+        xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+        bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, conn_id);
+        if (pLink != NULL)
         {
-            uint8_t copy_len = adv_name_len_val < (ADVERTISED_NAME_BUFFER_LEN - 1) ? adv_name_len_val : (ADVERTISED_NAME_BUFFER_LEN - 1);
-            memcpy(pAdvertisedName->name, adv_name_ptr, copy_len);
-            pAdvertisedName->name[copy_len] = '\0';
+            bat_gattc_queue_t *pQueue = bat_ble_client_link_queue(pLink);
+            bat_gattc_queue_close(pQueue);
+            flushed = bat_gattc_queue_flush(pQueue, &failed);
         }
+        xSemaphoreGive(g_links_mutex);
+        if (!flushed)
+            return;
+
+        if (failed.op.cb != NULL)
+            failed.op.cb(&failed);
     }
+}
 
-    return (pAdvertisedName->name[0] == '\0') ? ESP_ERR_NOT_FOUND : ESP_OK;
+// Writes without response go out with a response where the cached properties do not allow them.
+static esp_err_t bat_ble_client_check_op(const bat_gattc_link_t *pLink, const bat_gattc_cache_entry_t *pEntry, bat_gattc_op_t *pOp)
+{
+    if (pOp->type != BAT_GATTC_OP_READ && pOp->len != 0 && pOp->pData == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (pOp->type != BAT_GATTC_OP_WRITE_NO_RSP)
+        return ESP_OK;
+
+    const bat_gattc_cache_attr_t *pAttr = (pEntry != NULL) ? bat_gattc_cache_find_handle(pEntry, pOp->handle) : NULL;
+    if (pAttr != NULL && pAttr->type == ESP_GATT_DB_CHARACTERISTIC && (pAttr->properties & ESP_GATT_CHAR_PROP_BIT_WRITE_NR) == 0)
+        pOp->type = BAT_GATTC_OP_WRITE;
+    else if (pOp->len > pLink->mtu - 3)
+        return ESP_ERR_INVALID_SIZE;
+    return ESP_OK;
+}
+
+// The live subscription of a characteristic on a link, NULL if none.
+static bat_gattc_sub_t *bat_ble_client_find_sub(uint16_t conn_id, uint16_t handle)
+{
+    for (size_t i = 0; i < BAT_GATTC_NOTIFY_SUBS; ++i)
+    {
+        bat_gattc_sub_t *pSub = &g_subs[i];
+        if (pSub->state != BAT_GATTC_SUB_FREE && pSub->state != BAT_GATTC_SUB_CLOSED &&
+            pSub->conn_id == conn_id && pSub->handle == handle)
+            return pSub;
+    }
+    return NULL;
+}
+
+// The CCCD of a characteristic, from the cache or from Bluedroid's database. Switches *pIndicate where the cached
+// properties only allow the other kind.
+static esp_err_t bat_ble_client_find_cccd(const bat_gattc_link_t *pLink, uint16_t handle, bool *pIndicate, uint16_t *pCccdHandle)
+{
+    bat_gattc_cache_entry_t *pEntry = bat_gattc_cache_lookup(&g_cache, pLink->bda);
+    if (pEntry != NULL)
+    {
+        bat_ble_uuid128_t cccd_uuid;
+        bat_ble_uuid16_to_uuid128(ESP_GATT_UUID_CHAR_CLIENT_CONFIG, &cccd_uuid);
+        const bat_gattc_cache_attr_t *pChar = bat_gattc_cache_find_handle(pEntry, handle);
+        const bat_gattc_cache_attr_t *pService = (pChar != NULL) ? bat_gattc_cache_find_owner(pEntry, handle) : NULL;
+        const bat_gattc_cache_attr_t *pCccd = (pService != NULL) ? bat_gattc_cache_find_descr(pEntry, pService, pChar, &cccd_uuid) : NULL;
+        if (pChar == NULL || pChar->type != ESP_GATT_DB_CHARACTERISTIC || pCccd == NULL)
+            return ESP_ERR_NOT_FOUND;
+
+        uint8_t wanted = *pIndicate ? ESP_GATT_CHAR_PROP_BIT_INDICATE : ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+        if ((pChar->properties & (ESP_GATT_CHAR_PROP_BIT_NOTIFY | ESP_GATT_CHAR_PROP_BIT_INDICATE)) == 0)
+            return ESP_ERR_NOT_SUPPORTED;
+        if ((pChar->properties & wanted) == 0)
+            *pIndicate = !*pIndicate;
+        *pCccdHandle = pCccd->handle;
+        return ESP_OK;
+    }
+    if (pLink->cached)
+        return ESP_ERR_NOT_FOUND;
+
+    // A database too large for the cache is still in Bluedroid's.
+    esp_bt_uuid_t cccd_uuid = {.len = ESP_UUID_LEN_16, .uuid.uuid16 = ESP_GATT_UUID_CHAR_CLIENT_CONFIG};
+    esp_gattc_descr_elem_t descr;
+    uint16_t count = 1;
+    if (esp_ble_gattc_get_descr_by_char_handle(pLink->gattc_if, pLink->conn_id, handle, cccd_uuid, &descr, &count) != ESP_GATT_OK ||
+        count == 0)
+        return ESP_ERR_NOT_FOUND;
+    *pCccdHandle = descr.handle;
+    return ESP_OK;
+}
+
+static void bat_ble_client_report_sub(bat_gattc_sub_t *pSub)
+{
+    if (pSub->status == ESP_GATT_OK)
+        ESP_LOGI(TAG, "conn_id %d: subscribed to handle %d (%s)", pSub->conn_id, pSub->handle,
+                 pSub->indicate ? "indications" : "notifications");
+    else
+        ESP_LOGE(TAG, "conn_id %d: subscription to handle %d failed, status %x", pSub->conn_id, pSub->handle, pSub->status);
+    if (g_pGattcCallbacks != NULL)
+        g_pGattcCallbacks->on_subscribe(g_pGattcCallbacks, pSub);
+}
+
+// Completes the CCCD write that enables a subscription.
+static void bat_ble_client_on_cccd_written(const bat_gattc_op_result_t *pResult)
+{
+    bat_gattc_sub_t *pSub = NULL;
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < BAT_GATTC_NOTIFY_SUBS && pSub == NULL; ++i)
+    {
+        if (g_subs[i].state == BAT_GATTC_SUB_ENABLING && g_subs[i].conn_id == pResult->conn_id &&
+            g_subs[i].cccd_handle == pResult->op.handle)
+            pSub = &g_subs[i];
+    }
+    if (pSub != NULL)
+    {
+        pSub->state = (pResult->status == ESP_GATT_OK) ? BAT_GATTC_SUB_ACTIVE : BAT_GATTC_SUB_CLOSED;
+        pSub->status = pResult->status;
+    }
+    xSemaphoreGive(g_links_mutex);
+
+    // Unsubscribed or link lost meanwhile.
+    if (pSub != NULL)
+        bat_ble_client_report_sub(pSub);
+}
+
+// Bluedroid routes the characteristic's values to the interface from now on, the CCCD write asks the server for them.
+static void bat_ble_client_on_reg_for_notify(esp_gatt_if_t gattc_if, uint16_t handle, esp_gatt_status_t status)
+{
+    if (g_links_mutex == NULL)
+        return;
+
+    // The event names no connection, registrations complete in order: the oldest of the handle is the one.
+    bat_gattc_sub_t *pSub = NULL;
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < BAT_GATTC_NOTIFY_SUBS; ++i)
+    {
+        bat_gattc_sub_t *pCandidate = &g_subs[i];
+        if (pCandidate->state == BAT_GATTC_SUB_REGISTERING && pCandidate->gattc_if == gattc_if && pCandidate->handle == handle &&
+            (pSub == NULL || (int32_t)(pCandidate->seq - pSub->seq) < 0))
+            pSub = pCandidate;
+    }
+    bat_gattc_op_t op = {0};
+    uint16_t conn_id = 0;
+    if (pSub != NULL)
+    {
+        pSub->state = (status == ESP_GATT_OK) ? BAT_GATTC_SUB_ENABLING : BAT_GATTC_SUB_CLOSED;
+        pSub->status = status;
+        conn_id = pSub->conn_id;
+        op.type = BAT_GATTC_OP_WRITE;
+        op.handle = pSub->cccd_handle;
+        op.len = sizeof(g_cccd_notify);
+        op.pData = pSub->indicate ? g_cccd_indicate : g_cccd_notify;
+        op.cb = bat_ble_client_on_cccd_written;
+    }
+    xSemaphoreGive(g_links_mutex);
+    if (pSub == NULL)
+        return;
+
+    if (status == ESP_GATT_OK)
+    {
+        esp_err_t err = bat_ble_client_submit(conn_id, &op, 1);
+        if (err == ESP_OK)
+            return;
+
+        ESP_LOGW(TAG, "conn_id %d: CCCD write not queued: %s", conn_id, esp_err_to_name(err));
+        xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+        bool failed = (pSub->state == BAT_GATTC_SUB_ENABLING);
+        if (failed)
+        {
+            pSub->state = BAT_GATTC_SUB_CLOSED;
+            pSub->status = ESP_GATT_ERROR;
+        }
+        xSemaphoreGive(g_links_mutex);
+        if (!failed)
+            return;
+    }
+    bat_ble_client_report_sub(pSub);
+}
+
+// Runs on the Bluedroid task for every value, keep it short.
+static void bat_ble_client_on_notify(uint16_t conn_id, uint16_t handle, const uint8_t *pValue, uint16_t value_len)
+{
+    if (g_links_mutex == NULL)
+        return;
+
+    // The mutex only keeps the ring from being freed under the push, the consumer never takes it.
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_sub_t *pSub = bat_ble_client_find_sub(conn_id, handle);
+    if (pSub != NULL)
+        bat_gattc_notify_push(pSub, pValue, value_len);
+    xSemaphoreGive(g_links_mutex);
+    bat_ble_throughput_on_traffic(conn_id, value_len);
+
+    if (pSub == NULL)
+        ESP_LOGD(TAG, "conn_id %d: value of handle %d without subscription", conn_id, handle);
+}
+
+// The link is gone: its subscriptions stop receiving, their rings stay readable until unsubscribed.
+static void bat_ble_client_close_subs(uint16_t conn_id)
+{
+    if (g_links_mutex == NULL)
+        return;
+
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < BAT_GATTC_NOTIFY_SUBS; ++i)
+    {
+        bat_gattc_sub_t *pSub = &g_subs[i];
+        if (pSub->state != BAT_GATTC_SUB_FREE && pSub->state != BAT_GATTC_SUB_CLOSED && pSub->conn_id == conn_id)
+        {
+            if (pSub->state != BAT_GATTC_SUB_ACTIVE)
+                pSub->status = ESP_GATT_ERROR;
+            pSub->state = BAT_GATTC_SUB_CLOSED;
+        }
+    }
+    xSemaphoreGive(g_links_mutex);
+}
+
+esp_err_t bat_ble_client_connect(bat_gattc_app_id_t app_id, const esp_bd_addr_t bda, esp_ble_addr_type_t addr_type,
+                                 void *pContext)
+{
+    if (app_id < GATTC_APPFIRST || app_id > GATTC_APPLAST || bda == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (g_links_mutex == NULL || g_gattc_handles[app_id] == ESP_GATT_IF_NONE)
+        return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pLink = bat_gattc_conn_add(&g_links, bda, addr_type, g_gattc_handles[app_id], pContext);
+    xSemaphoreGive(g_links_mutex);
+    if (pLink == NULL)
+        return ESP_ERR_NO_MEM;
+
+    bat_ble_client_open_next();
+    return ESP_OK;
+}
+
+esp_err_t bat_ble_client_get_link(uint16_t conn_id, bat_gattc_link_t *pLink)
+{
+    if (pLink == NULL || g_links_mutex == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pFound = bat_gattc_conn_get(&g_links, conn_id);
+    if (pFound != NULL)
+    {
+        *pLink = *pFound;
+        err = ESP_OK;
+    }
+    xSemaphoreGive(g_links_mutex);
+    return err;
+}
+
+void bat_ble_client_record_op(uint16_t conn_id, uint32_t latency_us, size_t bytes)
+{
+    if (g_links_mutex == NULL)
+        return;
+
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, conn_id);
+    if (pLink != NULL)
+        bat_gattc_conn_record(&g_links, pLink, latency_us, bytes);
+    xSemaphoreGive(g_links_mutex);
+    bat_ble_throughput_on_traffic(conn_id, bytes);
+}
+
+esp_err_t bat_ble_client_get_link_stats(bat_gattc_conn_stats_t *pStats, bool reset_traffic)
+{
+    if (pStats == NULL || g_links_mutex == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_conn_get_stats(&g_links, pStats);
+    if (reset_traffic)
+        bat_gattc_conn_reset_traffic(&g_links);
+    xSemaphoreGive(g_links_mutex);
+    return ESP_OK;
+}
+
+esp_err_t bat_ble_client_submit(uint16_t conn_id, const bat_gattc_op_t *pOps, size_t count)
+{
+    if (pOps == NULL || count == 0 || g_links_mutex == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, conn_id);
+    bat_gattc_queue_t *pQueue = (pLink != NULL) ? bat_ble_client_link_queue(pLink) : NULL;
+    if (pLink == NULL || pLink->state != BAT_GATTC_LINK_READY)
+        err = ESP_ERR_INVALID_STATE;
+    else if (bat_gattc_queue_space(pQueue) < count)
+        err = ESP_ERR_NO_MEM;
+
+    // The whole batch is checked before any of it is queued.
+    bat_gattc_cache_entry_t *pEntry = (err == ESP_OK) ? bat_gattc_cache_lookup(&g_cache, pLink->bda) : NULL;
+    for (size_t i = 0; i < count && err == ESP_OK; ++i)
+    {
+        bat_gattc_op_t op = pOps[i];
+        err = bat_ble_client_check_op(pLink, pEntry, &op);
+    }
+    for (size_t i = 0; i < count && err == ESP_OK; ++i)
+    {
+        bat_gattc_op_t op = pOps[i];
+        bat_ble_client_check_op(pLink, pEntry, &op);
+        bat_gattc_queue_push(pQueue, &op);
+    }
+    xSemaphoreGive(g_links_mutex);
+
+    if (err == ESP_OK)
+        bat_ble_client_queue_run(conn_id);
+    return err;
+}
+
+esp_err_t bat_ble_client_get_queue_stats(uint16_t conn_id, bat_gattc_queue_stats_t *pStats)
+{
+    if (pStats == NULL || g_links_mutex == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, conn_id);
+    if (pLink != NULL)
+    {
+        bat_gattc_queue_get_stats(bat_ble_client_link_queue(pLink), pStats);
+        err = ESP_OK;
+    }
+    xSemaphoreGive(g_links_mutex);
+    return err;
+}
+
+esp_err_t bat_ble_client_subscribe(uint16_t conn_id, uint16_t handle, const bat_gattc_sub_config_t *pConfig,
+                                   bat_gattc_sub_t **ppSub)
+{
+    if (ppSub == NULL || g_links_mutex == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    bat_gattc_sub_config_t config = {0};
+    if (pConfig != NULL)
+        config = *pConfig;
+
+    esp_err_t err = ESP_OK;
+    bat_gattc_sub_t *pSub = NULL;
+    uint16_t cccd_handle = 0;
+    esp_gatt_if_t gattc_if = ESP_GATT_IF_NONE;
+    esp_bd_addr_t bda;
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, conn_id);
+    if (pLink == NULL || pLink->state != BAT_GATTC_LINK_READY || bat_ble_client_find_sub(conn_id, handle) != NULL)
+        err = ESP_ERR_INVALID_STATE;
+    else
+        err = bat_ble_client_find_cccd(pLink, handle, &config.indicate, &cccd_handle);
+
+    for (size_t i = 0; i < BAT_GATTC_NOTIFY_SUBS && err == ESP_OK && pSub == NULL; ++i)
+    {
+        if (g_subs[i].state == BAT_GATTC_SUB_FREE)
+            pSub = &g_subs[i];
+    }
+    if (err == ESP_OK && pSub == NULL)
+        err = ESP_ERR_NO_MEM;
+
+    if (err == ESP_OK)
+    {
+        if (config.slot_size == 0)
+            config.slot_size = pLink->mtu - 3;
+        err = bat_gattc_notify_open(pSub, &config);
+    }
+    if (err == ESP_OK)
+    {
+        pSub->state = BAT_GATTC_SUB_REGISTERING;
+        pSub->status = ESP_GATT_OK;
+        pSub->gattc_if = pLink->gattc_if;
+        pSub->conn_id = conn_id;
+        memcpy(pSub->bda, pLink->bda, sizeof(esp_bd_addr_t));
+        pSub->handle = handle;
+        pSub->cccd_handle = cccd_handle;
+        pSub->seq = ++g_sub_seq;
+        gattc_if = pLink->gattc_if;
+        memcpy(bda, pLink->bda, sizeof(esp_bd_addr_t));
+    }
+    xSemaphoreGive(g_links_mutex);
+    if (err != ESP_OK)
+        return err;
+
+    // ESP_GATTC_REG_FOR_NOTIFY_EVT continues in bat_ble_client_on_reg_for_notify.
+    err = esp_ble_gattc_register_for_notify(gattc_if, bda, handle);
+    if (err != ESP_OK)
+    {
+        xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+        bat_gattc_notify_close(pSub);
+        xSemaphoreGive(g_links_mutex);
+        return err;
+    }
+
+    *ppSub = pSub;
+    return ESP_OK;
+}
+
+esp_err_t bat_ble_client_unsubscribe(bat_gattc_sub_t *pSub)
+{
+    if (pSub < g_subs || pSub >= g_subs + BAT_GATTC_NOTIFY_SUBS || g_links_mutex == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_sub_state_t state = pSub->state;
+    esp_gatt_if_t gattc_if = pSub->gattc_if;
+    uint16_t conn_id = pSub->conn_id;
+    uint16_t handle = pSub->handle;
+    esp_bd_addr_t bda;
+    memcpy(bda, pSub->bda, sizeof(esp_bd_addr_t));
+    bat_gattc_op_t op = {.type = BAT_GATTC_OP_WRITE, .handle = pSub->cccd_handle, .len = sizeof(g_cccd_off), .pData = g_cccd_off};
+    if (state != BAT_GATTC_SUB_FREE)
+        bat_gattc_notify_close(pSub);
+    xSemaphoreGive(g_links_mutex);
+    if (state == BAT_GATTC_SUB_FREE)
+        return ESP_ERR_INVALID_STATE;
+
+    // The server stops sending, then Bluedroid stops routing. Both are best effort on a link that is going away.
+    if (state == BAT_GATTC_SUB_ENABLING || state == BAT_GATTC_SUB_ACTIVE)
+        bat_ble_client_submit(conn_id, &op, 1);
+    esp_ble_gattc_unregister_for_notify(gattc_if, bda, handle);
+    return ESP_OK;
+}
+
+esp_err_t bat_ble_client_find_char(uint16_t conn_id, const bat_ble_uuid128_t *pService, const bat_ble_uuid128_t *pChar,
+                                   uint16_t *pHandle)
+{
+    if (pService == NULL || pChar == NULL || pHandle == NULL || g_links_mutex == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_link_t *pLink = bat_gattc_conn_get(&g_links, conn_id);
+    bat_gattc_cache_entry_t *pEntry = (pLink != NULL) ? bat_gattc_cache_lookup(&g_cache, pLink->bda) : NULL;
+    if (pEntry != NULL)
+    {
+        const bat_gattc_cache_attr_t *pServiceAttr = bat_gattc_cache_find_service(pEntry, pService);
+        const bat_gattc_cache_attr_t *pCharAttr = (pServiceAttr != NULL) ? bat_gattc_cache_find_char(pEntry, pServiceAttr, pChar) : NULL;
+        if (pCharAttr != NULL)
+        {
+            *pHandle = pCharAttr->handle;
+            err = ESP_OK;
+        }
+    }
+    bool discovered = (pLink != NULL && pEntry == NULL && !pLink->cached);
+    esp_gatt_if_t gattc_if = (pLink != NULL) ? pLink->gattc_if : ESP_GATT_IF_NONE;
+    xSemaphoreGive(g_links_mutex);
+
+    // A database too large for the cache is still in Bluedroid's.
+    if (!discovered)
+        return err;
+
+    esp_bt_uuid_t service_uuid = {.len = ESP_UUID_LEN_128};
+    memcpy(service_uuid.uuid.uuid128, pService->uuid, ESP_UUID_LEN_128);
+    esp_bt_uuid_t char_uuid = {.len = ESP_UUID_LEN_128};
+    memcpy(char_uuid.uuid.uuid128, pChar->uuid, ESP_UUID_LEN_128);
+
+    esp_gattc_service_elem_t service;
+    esp_gattc_char_elem_t characteristic;
+    uint16_t count = 1;
+    if (esp_ble_gattc_get_service(gattc_if, conn_id, &service_uuid, &service, &count, 0) != ESP_GATT_OK || count == 0)
+        return ESP_ERR_NOT_FOUND;
+
+    count = 1;
+    if (esp_ble_gattc_get_char_by_uuid(gattc_if, conn_id, service.start_handle, service.end_handle, char_uuid,
+                                       &characteristic, &count) != ESP_GATT_OK || count == 0)
+        return ESP_ERR_NOT_FOUND;
+
+    *pHandle = characteristic.char_handle;
+    return ESP_OK;
+}
+
+esp_err_t bat_ble_client_get_cache_stats(bat_gattc_cache_stats_t *pStats)
+{
+    if (pStats == NULL || g_links_mutex == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    bat_gattc_cache_get_stats(&g_cache, pStats);
+    xSemaphoreGive(g_links_mutex);
+    return ESP_OK;
+}
+
+esp_err_t bat_ble_client_clear_cache(void)
+{
+    if (g_links_mutex == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(g_links_mutex, portMAX_DELAY);
+    esp_err_t err = bat_gattc_cache_clear(&g_cache);
+    xSemaphoreGive(g_links_mutex);
+    return err;
+}
+
+esp_err_t bat_ble_client_get_advertised_name(bat_scan_result_t *pScanResult, bat_advertised_name_t *pAdvertisedName)
+{
+    assert(pScanResult != NULL);
+    assert(pAdvertisedName != NULL);
+
+    pAdvertisedName->name[0] = '\0';
+    if (pScanResult->adv_data_len == 0)
+        return ESP_ERR_NOT_FOUND;
+
+    bat_adv_index_t index;
+    bat_ble_client_index_adv(pScanResult, &index);
+    return bat_adv_get_name(&index, pAdvertisedName->name, sizeof(pAdvertisedName->name));
 }
 
 bool bat_ble_advname_matches(bat_scan_result_t * pScanResult, const char *pszName)
@@ -586,46 +1637,141 @@ bool bat_ble_advname_matches(bat_scan_result_t * pScanResult, const char *pszNam
     return false;
 }
 
+esp_err_t bat_bda_context_configure(const bat_peer_store_config_t *pConfig)
+{
+    if (pConfig == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    bat_bda_context_lock();
+    bat_peer_store_deinit(&gap_peer_store);
+    esp_err_t err = bat_bda_context_init_store(pConfig);
+    bat_bda_context_unlock();
+    return err;
+}
+
 void *bat_bda_context_lookup(const esp_bd_addr_t *pbda)
 {
-    for (int i = 0; i < GAP_CB_TABLE_SIZE; ++i)
-    {
-        if (gap_cb_table[i].pContext != NULL && memcmp(gap_cb_table[i].bda, pbda, ESP_BD_ADDR_LEN) == 0)
-            return gap_cb_table[i].pContext;
-    }
-    return NULL;
+    bat_bda_context_lock();
+    void *pContext = bat_peer_store_lookup(&gap_peer_store, *pbda);
+    bat_bda_context_unlock();
+    return pContext;
 }
 
 esp_err_t bat_bda_context_set(const esp_bd_addr_t *pbda, void *pContext)
 {
-    for (int i = 0; i < GAP_CB_TABLE_SIZE; ++i)
+    // A NULL context marks a free slot, as with the reset below.
+    if (pContext == NULL)
     {
-        if (gap_cb_table[i].pContext == NULL)
-        {
-            memcpy(gap_cb_table[i].bda, pbda, ESP_BD_ADDR_LEN);
-            gap_cb_table[i].pContext = pContext;
-            return ESP_OK;
-        }
+        bat_bda_context_reset(pbda);
+        return ESP_OK;
     }
 
-    ESP_LOGE(TAG, "No space in GAP callback table for BDA: %02x:%02x:%02x:%02x:%02x:%02x",
-             (unsigned int)pbda[0], (unsigned int)pbda[1], (unsigned int)pbda[2],
-             (unsigned int)pbda[3], (unsigned int)pbda[4], (unsigned int)pbda[5]);
+    bat_bda_context_lock();
+    esp_err_t err = bat_peer_store_set(&gap_peer_store, *pbda, pContext);
+    bat_bda_context_unlock();
+    if (err != ESP_OK)
+    {
+        const uint8_t *bda = *pbda;
+        ESP_LOGE(TAG, "No space in GAP peer store for BDA: %02x:%02x:%02x:%02x:%02x:%02x",
+                 (unsigned int)bda[0], (unsigned int)bda[1], (unsigned int)bda[2],
+                 (unsigned int)bda[3], (unsigned int)bda[4], (unsigned int)bda[5]);
+    }
 
-    return ESP_ERR_INVALID_STATE;
+    return err;
 }
 
 void bat_bda_context_reset(const esp_bd_addr_t *pbda)
 {
-    for (int i = 0; i < GAP_CB_TABLE_SIZE; ++i)
+    bat_bda_context_lock();
+    bat_peer_store_remove(&gap_peer_store, *pbda);
+    bat_bda_context_unlock();
+}
+
+size_t bat_bda_context_evict_stale(void)
+{
+    // In batches, the eviction callback runs between them with the lock released.
+    size_t total = 0;
+    size_t evicted;
+    do
     {
-        if (memcmp(gap_cb_table[i].bda, pbda, ESP_BD_ADDR_LEN) == 0)
-        {
-            memset(gap_cb_table[i].bda, 0, ESP_BD_ADDR_LEN);
-            gap_cb_table[i].pContext = NULL;
-            break;
-        }
-    }
+        bat_bda_context_lock();
+        evicted = bat_peer_store_evict_stale_max(&gap_peer_store, BAT_BDA_CONTEXT_EVICT_BATCH);
+        bat_bda_context_unlock();
+        total += evicted;
+    } while (evicted == BAT_BDA_CONTEXT_EVICT_BATCH);
+
+    return total;
+}
+
+esp_err_t bat_ble_client_configure_scan_dedup(const bat_scan_dedup_config_t *pConfig)
+{
+    esp_err_t err = ESP_OK;
+
+    // The GAP handler checks results against the cache on the Bluedroid task, it must not see it freed.
+    bat_ble_client_scan_lock();
+    bat_scan_dedup_deinit(&gap_scan_dedup);
+    g_scan_dedup_disabled = (pConfig == NULL);
+    if (!g_scan_dedup_disabled)
+        err = bat_scan_dedup_init(&gap_scan_dedup, pConfig);
+    bat_ble_client_scan_unlock();
+    return err;
+}
+
+esp_err_t bat_ble_client_get_scan_dedup_stats(bat_scan_dedup_stats_t *pStats)
+{
+    bat_ble_client_scan_lock();
+    esp_err_t err = bat_scan_dedup_get_stats(&gap_scan_dedup, pStats);
+    bat_ble_client_scan_unlock();
+    return err;
+}
+
+static void bat_scan_worker_dispatch(esp_ble_gap_cb_param_t *pParam, void *pContext)
+{
+    g_pGapCallbacks->on_scan_result(g_pGapCallbacks, pParam);
+}
+
+esp_err_t bat_ble_client_start_scan_worker(const bat_scan_worker_config_t *pConfig)
+{
+    bat_scan_worker_config_t config = {0};
+    if (pConfig != NULL)
+        config = *pConfig;
+    config.process_cb = bat_scan_worker_dispatch;
+    config.pContext = NULL;
+
+    // The GAP handler reads the worker on the Bluedroid task, it sees it either whole or not at all.
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    bat_ble_client_scan_lock();
+    if (gap_scan_worker.task == NULL && !g_scan_worker_stopping)
+        err = bat_scan_worker_init(&gap_scan_worker, &config);
+    bat_ble_client_scan_unlock();
+    return err;
+}
+
+void bat_ble_client_stop_scan_worker(void)
+{
+    // The GAP handler stops posting first. The drain runs without the mutex: on_scan_result may
+    // start a scan, which takes it.
+    bat_ble_client_scan_lock();
+    bool stop = gap_scan_worker.task != NULL && !g_scan_worker_stopping;
+    if (stop)
+        g_scan_worker_stopping = true;
+    bat_ble_client_scan_unlock();
+    if (!stop)
+        return;
+
+    bat_scan_worker_deinit(&gap_scan_worker);
+
+    bat_ble_client_scan_lock();
+    g_scan_worker_stopping = false;
+    bat_ble_client_scan_unlock();
+}
+
+esp_err_t bat_ble_client_get_scan_worker_stats(bat_scan_worker_stats_t *pStats)
+{
+    bat_ble_client_scan_lock();
+    esp_err_t err = g_scan_worker_stopping ? ESP_ERR_INVALID_STATE : bat_scan_worker_get_stats(&gap_scan_worker, pStats);
+    bat_ble_client_scan_unlock();
+    return err;
 }
 
 void bat_gapc_no_op(struct bat_gapc_callbacks_t *pCb, esp_ble_gap_cb_param_t *pParam)
@@ -651,3 +1797,39 @@ void bat_ble_gapc_callbacks_init(bat_gapc_callbacks_t *pCb, void *pContext)
     if (g_pGapCallbacks->on_scan_param_set_complete == NULL)
         g_pGapCallbacks->on_scan_param_set_complete = bat_gapc_no_op;
 }
+
+void bat_gattc_no_op(struct bat_gattc_callbacks_t *pCb, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *pParam)
+{
+}
+
+static void bat_gattc_link_no_op(struct bat_gattc_callbacks_t *pCb, bat_gattc_link_t *pLink)
+{
+}
+
+static void bat_gattc_sub_no_op(struct bat_gattc_callbacks_t *pCb, bat_gattc_sub_t *pSub)
+{
+}
+
+void bat_ble_gattc_callbacks_init(bat_gattc_callbacks_t *pCb, void *pContext)
+{
+    assert(pCb != NULL);
+
+    pCb->pContext = pContext;
+    if (pCb->on_open == NULL)
+        pCb->on_open = bat_gattc_no_op;
+    if (pCb->on_disconnect == NULL)
+        pCb->on_disconnect = bat_gattc_no_op;
+    if (pCb->on_cfg_mtu == NULL)
+        pCb->on_cfg_mtu = bat_gattc_no_op;
+    if (pCb->on_search_cmpl == NULL)
+        pCb->on_search_cmpl = bat_gattc_no_op;
+    if (pCb->on_read_char == NULL)
+        pCb->on_read_char = bat_gattc_no_op;
+    if (pCb->on_write_char == NULL)
+        pCb->on_write_char = bat_gattc_no_op;
+    if (pCb->on_link_ready == NULL)
+        pCb->on_link_ready = bat_gattc_link_no_op;
+    if (pCb->on_subscribe == NULL)
+        pCb->on_subscribe = bat_gattc_sub_no_op;
+    g_pGattcCallbacks = pCb;
+}
@@ -21,12 +21,79 @@
 
 static const char *TAG = "bat_lib:ble_client_logging";
 
+typedef struct
+{
+    uint8_t type;
+    uint8_t uuid_len;
+    const char *pszKind;
+} bat_uuid_list_desc_t;
+
+static const bat_uuid_list_desc_t uuid_lists[] = {
+    {ESP_BLE_AD_TYPE_16SRV_CMPL, ESP_UUID_LEN_16, "Complete"},
+    {ESP_BLE_AD_TYPE_16SRV_PART, ESP_UUID_LEN_16, "Incomplete"},
+    {ESP_BLE_AD_TYPE_32SRV_CMPL, ESP_UUID_LEN_32, "Complete"},
+    {ESP_BLE_AD_TYPE_32SRV_PART, ESP_UUID_LEN_32, "Incomplete"},
+    {ESP_BLE_AD_TYPE_128SRV_CMPL, ESP_UUID_LEN_128, "Complete"},
+    {ESP_BLE_AD_TYPE_128SRV_PART, ESP_UUID_LEN_128, "Incomplete"},
+};
+
+// BLE UUIDs are Little Endian.
+static void bat_log_uuid(const char *pszIndent, const uint8_t *p, uint8_t uuid_len)
+{
+    if (uuid_len == ESP_UUID_LEN_16)
+    {
+        ESP_LOGI(TAG, "%s- 0x%04x", pszIndent, (p[1] << 8) | p[0]);
+    }
+    else if (uuid_len == ESP_UUID_LEN_32)
+    {
+        uint32_t service_uuid = ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[0];
+        ESP_LOGI(TAG, "%s- 0x%08lx", pszIndent, (unsigned long)service_uuid);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "%s- %02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x", pszIndent,
+                 p[15], p[14], p[13], p[12], p[11], p[10], p[9], p[8],
+                 p[7], p[6], p[5], p[4], p[3], p[2], p[1], p[0]);
+    }
+}
+
+// Logs the 16, 32 and 128-bit service UUID lists found in the index.
+static void bat_log_uuid_lists(const bat_adv_index_t *pIndex, bool verbose)
+{
+    for (size_t n = 0; n < sizeof(uuid_lists) / sizeof(uuid_lists[0]); ++n)
+    {
+        const bat_uuid_list_desc_t *pDesc = &uuid_lists[n];
+        int bits = pDesc->uuid_len * 8;
+
+        uint8_t data_len = 0;
+        const uint8_t *data_ptr = bat_adv_find(pIndex, pDesc->type, &data_len);
+        if (verbose)
+            ESP_LOGD(TAG, "DEBUG: %d-bit %s UUIDs - ptr=%p, len=%d", bits, pDesc->pszKind, data_ptr, data_len);
+
+        if (data_ptr != NULL && data_len > 0 && (data_len % pDesc->uuid_len == 0))
+        {
+            ESP_LOGI(TAG, "%s%s %d-bit Service UUIDs (count %d):", verbose ? "" : "  ", pDesc->pszKind, bits, data_len / pDesc->uuid_len);
+            for (int i = 0; i < data_len; i += pDesc->uuid_len)
+                bat_log_uuid(verbose ? "  " : "    ", &data_ptr[i], pDesc->uuid_len);
+        }
+        else if (verbose && data_ptr != NULL)
+        {
+            ESP_LOGW(TAG, "WARNING: %d-bit %s UUIDs data length mismatch (len=%d, expected multiple of %d)",
+                     bits, pDesc->pszKind, data_len, pDesc->uuid_len);
+        }
+    }
+}
+
 void bat_log_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdvertisedName) // Changed type to esp_ble_scan_result_evt_param_t
 {
     assert(pScanResult != NULL);
 
+    // Index the advertising data once, every lookup below uses the index.
+    bat_adv_index_t index;
+    bat_ble_client_index_adv(pScanResult, &index);
+
     bat_advertised_name_t advertised_name;
-    if ((bat_ble_client_get_advertised_name(pScanResult, &advertised_name) != ESP_OK) && ignoreNoAdvertisedName)
+    if ((bat_adv_get_name(&index, advertised_name.name, sizeof(advertised_name.name)) != ESP_OK) && ignoreNoAdvertisedName)
         return;
 
     ESP_LOGI(TAG, "Device found (ptr): ADDR: %02x:%02x:%02x:%02x:%02x:%02x",
@@ -44,86 +111,7 @@ void bat_log_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdvertisedNam
     ESP_LOGI(TAG, "  Advertised Name: %s", advertised_name.name);
 
     // Log advertised service UUIDs
-    uint8_t *uuid_data_ptr = NULL;
-    uint8_t uuid_data_len = 0;
-
-    // --- 16-bit Service UUIDs ---
-    // Complete list
-    uuid_data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_16SRV_CMPL, &uuid_data_len);
-    if (uuid_data_ptr != NULL && uuid_data_len > 0 && (uuid_data_len % ESP_UUID_LEN_16 == 0))
-    {
-        ESP_LOGI(TAG, "  Complete 16-bit Service UUIDs (count %d):", uuid_data_len / ESP_UUID_LEN_16);
-        for (int i = 0; i < uuid_data_len; i += ESP_UUID_LEN_16)
-        {
-            uint16_t service_uuid = (uuid_data_ptr[i + 1] << 8) | uuid_data_ptr[i]; // BLE UUIDs are Little Endian
-            ESP_LOGI(TAG, "    - 0x%04x", service_uuid);
-        }
-    }
-    // Partial list
-    uuid_data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_16SRV_PART, &uuid_data_len);
-    if (uuid_data_ptr != NULL && uuid_data_len > 0 && (uuid_data_len % ESP_UUID_LEN_16 == 0))
-    {
-        ESP_LOGI(TAG, "  Incomplete 16-bit Service UUIDs (count %d):", uuid_data_len / ESP_UUID_LEN_16);
-        for (int i = 0; i < uuid_data_len; i += ESP_UUID_LEN_16)
-        {
-            uint16_t service_uuid = (uuid_data_ptr[i + 1] << 8) | uuid_data_ptr[i]; // BLE UUIDs are Little Endian
-            ESP_LOGI(TAG, "    - 0x%04x", service_uuid);
-        }
-    }
-
-    // --- 32-bit Service UUIDs ---
-    // Complete list
-    uuid_data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_32SRV_CMPL, &uuid_data_len);
-    if (uuid_data_ptr != NULL && uuid_data_len > 0 && (uuid_data_len % ESP_UUID_LEN_32 == 0))
-    {
-        ESP_LOGI(TAG, "  Complete 32-bit Service UUIDs (count %d):", uuid_data_len / ESP_UUID_LEN_32);
-        for (int i = 0; i < uuid_data_len; i += ESP_UUID_LEN_32)
-        {
-            uint32_t service_uuid = ((uint32_t)uuid_data_ptr[i + 3] << 24) | ((uint32_t)uuid_data_ptr[i + 2] << 16) | ((uint32_t)uuid_data_ptr[i + 1] << 8) | (uint32_t)uuid_data_ptr[i]; // BLE UUIDs are Little Endian
-            ESP_LOGI(TAG, "    - 0x%08lx", (unsigned long)service_uuid);
-        }
-    }
-    // Partial list
-    uuid_data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_32SRV_PART, &uuid_data_len);
-    if (uuid_data_ptr != NULL && uuid_data_len > 0 && (uuid_data_len % ESP_UUID_LEN_32 == 0))
-    {
-        ESP_LOGI(TAG, "  Incomplete 32-bit Service UUIDs (count %d):", uuid_data_len / ESP_UUID_LEN_32);
-        for (int i = 0; i < uuid_data_len; i += ESP_UUID_LEN_32)
-        {
-            uint32_t service_uuid = ((uint32_t)uuid_data_ptr[i + 3] << 24) | ((uint32_t)uuid_data_ptr[i + 2] << 16) | ((uint32_t)uuid_data_ptr[i + 1] << 8) | (uint32_t)uuid_data_ptr[i]; // BLE UUIDs are Little Endian
-            ESP_LOGI(TAG, "    - 0x%08lx", (unsigned long)service_uuid);
-        }
-    }
-
-    // --- 128-bit Service UUIDs ---
-    // Complete list
-    uuid_data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_128SRV_CMPL, &uuid_data_len);
-    if (uuid_data_ptr != NULL && uuid_data_len > 0 && (uuid_data_len % ESP_UUID_LEN_128 == 0))
-    {
-        ESP_LOGI(TAG, "  Complete 128-bit Service UUIDs (count %d):", uuid_data_len / ESP_UUID_LEN_128);
-        for (int i = 0; i < uuid_data_len; i += ESP_UUID_LEN_128)
-        {
-            ESP_LOGI(TAG, "    - %02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
-                     uuid_data_ptr[i + 15], uuid_data_ptr[i + 14], uuid_data_ptr[i + 13], uuid_data_ptr[i + 12],
-                     uuid_data_ptr[i + 11], uuid_data_ptr[i + 10], uuid_data_ptr[i + 9], uuid_data_ptr[i + 8],
-                     uuid_data_ptr[i + 7], uuid_data_ptr[i + 6], uuid_data_ptr[i + 5], uuid_data_ptr[i + 4],
-                     uuid_data_ptr[i + 3], uuid_data_ptr[i + 2], uuid_data_ptr[i + 1], uuid_data_ptr[i + 0]);
-        }
-    }
-    // Partial list
-    uuid_data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_128SRV_PART, &uuid_data_len);
-    if (uuid_data_ptr != NULL && uuid_data_len > 0 && (uuid_data_len % ESP_UUID_LEN_128 == 0))
-    {
-        ESP_LOGI(TAG, "  Incomplete 128-bit Service UUIDs (count %d):", uuid_data_len / ESP_UUID_LEN_128);
-        for (int i = 0; i < uuid_data_len; i += ESP_UUID_LEN_128)
-        {
-            ESP_LOGI(TAG, "    - %02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
-                     uuid_data_ptr[i + 15], uuid_data_ptr[i + 14], uuid_data_ptr[i + 13], uuid_data_ptr[i + 12],
-                     uuid_data_ptr[i + 11], uuid_data_ptr[i + 10], uuid_data_ptr[i + 9], uuid_data_ptr[i + 8],
-                     uuid_data_ptr[i + 7], uuid_data_ptr[i + 6], uuid_data_ptr[i + 5], uuid_data_ptr[i + 4],
-                     uuid_data_ptr[i + 3], uuid_data_ptr[i + 2], uuid_data_ptr[i + 1], uuid_data_ptr[i + 0]);
-        }
-    }
+    bat_log_uuid_lists(&index, false);
 
     // Log scan response data (if present, usually for active scans)
     if (pScanResult->scan_rsp_len > 0)
@@ -138,8 +126,12 @@ void bat_log_verbose_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdver
 {
     assert(pScanResult != NULL);
 
+    // Index the advertising data once, every lookup below uses the index.
+    bat_adv_index_t index;
+    bat_ble_client_index_adv(pScanResult, &index);
+
     bat_advertised_name_t advertised_name;
-    if ((bat_ble_client_get_advertised_name(pScanResult, &advertised_name) != ESP_OK) && ignoreNoAdvertisedName)
+    if ((bat_adv_get_name(&index, advertised_name.name, sizeof(advertised_name.name)) != ESP_OK) && ignoreNoAdvertisedName)
         return;
 
     ESP_LOGI(TAG, "=== COMPREHENSIVE BLE DEVICE SCAN RESULT ===");
@@ -167,11 +159,11 @@ void bat_log_verbose_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdver
     ESP_LOGI(TAG, "Advertised Name: %s", advertised_name.name);
 
     // Helper function to log advertising data with debug info
-    uint8_t *data_ptr = NULL;
+    const uint8_t *data_ptr = NULL;
     uint8_t data_len = 0;
 
     // === FLAGS ===
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_FLAG, &data_len);
+    data_ptr = bat_adv_find(&index, ESP_BLE_AD_TYPE_FLAG, &data_len);
     if (data_ptr != NULL && data_len > 0)
     {
         ESP_LOGI(TAG, "Flags (len %d): 0x%02x", data_len, data_ptr[0]);
@@ -192,7 +184,7 @@ void bat_log_verbose_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdver
     }
 
     // === TX POWER LEVEL ===
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_TX_PWR, &data_len);
+    data_ptr = bat_adv_find(&index, ESP_BLE_AD_TYPE_TX_PWR, &data_len);
     if (data_ptr != NULL && data_len > 0)
     {
         int8_t tx_power = (int8_t)data_ptr[0];
@@ -204,7 +196,7 @@ void bat_log_verbose_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdver
     }
 
     // === APPEARANCE ===
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_APPEARANCE, &data_len);
+    data_ptr = bat_adv_find(&index, ESP_BLE_AD_TYPE_APPEARANCE, &data_len);
     if (data_ptr != NULL && data_len >= 2)
     {
         uint16_t appearance = (data_ptr[1] << 8) | data_ptr[0]; // Little endian
@@ -216,7 +208,7 @@ void bat_log_verbose_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdver
     }
 
     // === MANUFACTURER DATA ===
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE, &data_len);
+    data_ptr = bat_adv_find(&index, ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE, &data_len);
     if (data_ptr != NULL && data_len >= 2)
     {
         uint16_t company_id = (data_ptr[1] << 8) | data_ptr[0]; // Little endian        
@@ -235,7 +227,7 @@ void bat_log_verbose_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdver
 
     // === SERVICE DATA ===
     // 16-bit Service Data
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_SERVICE_DATA, &data_len);
+    data_ptr = bat_adv_find(&index, ESP_BLE_AD_TYPE_SERVICE_DATA, &data_len);
     if (data_ptr != NULL && data_len >= 2)
     {
         uint16_t service_uuid = (data_ptr[1] << 8) | data_ptr[0]; // Little endian        
@@ -253,7 +245,7 @@ void bat_log_verbose_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdver
     }
 
     // 32-bit Service Data
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_32SERVICE_DATA, &data_len);
+    data_ptr = bat_adv_find(&index, ESP_BLE_AD_TYPE_32SERVICE_DATA, &data_len);
     if (data_ptr != NULL && data_len >= 4)
     {
         uint32_t service_uuid = ((uint32_t)data_ptr[3] << 24) | ((uint32_t)data_ptr[2] << 16) |
@@ -272,7 +264,7 @@ void bat_log_verbose_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdver
     }
 
     // 128-bit Service Data
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_128SERVICE_DATA, &data_len);
+    data_ptr = bat_adv_find(&index, ESP_BLE_AD_TYPE_128SERVICE_DATA, &data_len);
     if (data_ptr != NULL && data_len >= 16)
     {        
         ESP_LOGI(TAG, "128-bit Service Data (len %d):", data_len);
@@ -295,124 +287,7 @@ void bat_log_verbose_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdver
     // === SERVICE UUIDs (using existing logic but with enhanced debugging) ===
     ESP_LOGI(TAG, "=== SERVICE UUIDs ===");
 
-    // --- 16-bit Service UUIDs ---
-    // Complete list
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_16SRV_CMPL, &data_len);
-    ESP_LOGD(TAG, "DEBUG: 16-bit Complete UUIDs - ptr=%p, len=%d", data_ptr, data_len);
-    if (data_ptr != NULL && data_len > 0 && (data_len % ESP_UUID_LEN_16 == 0))
-    {
-        ESP_LOGI(TAG, "Complete 16-bit Service UUIDs (count %d):", data_len / ESP_UUID_LEN_16);
-        for (int i = 0; i < data_len; i += ESP_UUID_LEN_16)
-        {
-            uint16_t service_uuid = (data_ptr[i + 1] << 8) | data_ptr[i]; // Little endian
-            ESP_LOGI(TAG, "  - 0x%04x", service_uuid);
-        }
-    }
-    else if (data_ptr != NULL)
-    {
-        ESP_LOGW(TAG, "WARNING: 16-bit Complete UUIDs data length mismatch (len=%d, expected multiple of %d)",
-                 data_len, ESP_UUID_LEN_16);
-    }
-
-    // Partial list
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_16SRV_PART, &data_len);
-    ESP_LOGD(TAG, "DEBUG: 16-bit Incomplete UUIDs - ptr=%p, len=%d", data_ptr, data_len);
-    if (data_ptr != NULL && data_len > 0 && (data_len % ESP_UUID_LEN_16 == 0))
-    {
-        ESP_LOGI(TAG, "Incomplete 16-bit Service UUIDs (count %d):", data_len / ESP_UUID_LEN_16);
-        for (int i = 0; i < data_len; i += ESP_UUID_LEN_16)
-        {
-            uint16_t service_uuid = (data_ptr[i + 1] << 8) | data_ptr[i]; // Little endian
-            ESP_LOGI(TAG, "  - 0x%04x", service_uuid);
-        }
-    }
-    else if (data_ptr != NULL)
-    {
-        ESP_LOGW(TAG, "WARNING: 16-bit Incomplete UUIDs data length mismatch (len=%d, expected multiple of %d)",
-                 data_len, ESP_UUID_LEN_16);
-    }
-
-    // --- 32-bit Service UUIDs ---
-    // Complete list
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_32SRV_CMPL, &data_len);
-    ESP_LOGD(TAG, "DEBUG: 32-bit Complete UUIDs - ptr=%p, len=%d", data_ptr, data_len);
-    if (data_ptr != NULL && data_len > 0 && (data_len % ESP_UUID_LEN_32 == 0))
-    {
-        ESP_LOGI(TAG, "Complete 32-bit Service UUIDs (count %d):", data_len / ESP_UUID_LEN_32);
-        for (int i = 0; i < data_len; i += ESP_UUID_LEN_32)
-        {
-            uint32_t service_uuid = ((uint32_t)data_ptr[i + 3] << 24) | ((uint32_t)data_ptr[i + 2] << 16) |
-                                    ((uint32_t)data_ptr[i + 1] << 8) | (uint32_t)data_ptr[i]; // Little endian
-            ESP_LOGI(TAG, "  - 0x%08lx", (unsigned long)service_uuid);
-        }
-    }
-    else if (data_ptr != NULL)
-    {
-        ESP_LOGW(TAG, "WARNING: 32-bit Complete UUIDs data length mismatch (len=%d, expected multiple of %d)",
-                 data_len, ESP_UUID_LEN_32);
-    }
-
-    // Partial list
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_32SRV_PART, &data_len);
-    ESP_LOGD(TAG, "DEBUG: 32-bit Incomplete UUIDs - ptr=%p, len=%d", data_ptr, data_len);
-    if (data_ptr != NULL && data_len > 0 && (data_len % ESP_UUID_LEN_32 == 0))
-    {
-        ESP_LOGI(TAG, "Incomplete 32-bit Service UUIDs (count %d):", data_len / ESP_UUID_LEN_32);
-        for (int i = 0; i < data_len; i += ESP_UUID_LEN_32)
-        {
-            uint32_t service_uuid = ((uint32_t)data_ptr[i + 3] << 24) | ((uint32_t)data_ptr[i + 2] << 16) |
-                                    ((uint32_t)data_ptr[i + 1] << 8) | (uint32_t)data_ptr[i]; // Little endian
-            ESP_LOGI(TAG, "  - 0x%08lx", (unsigned long)service_uuid);
-        }
-    }
-    else if (data_ptr != NULL)
-    {
-        ESP_LOGW(TAG, "WARNING: 32-bit Incomplete UUIDs data length mismatch (len=%d, expected multiple of %d)",
-                 data_len, ESP_UUID_LEN_32);
-    }
-
-    // --- 128-bit Service UUIDs ---
-    // Complete list
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_128SRV_CMPL, &data_len);
-    ESP_LOGD(TAG, "DEBUG: 128-bit Complete UUIDs - ptr=%p, len=%d", data_ptr, data_len);
-    if (data_ptr != NULL && data_len > 0 && (data_len % ESP_UUID_LEN_128 == 0))
-    {
-        ESP_LOGI(TAG, "Complete 128-bit Service UUIDs (count %d):", data_len / ESP_UUID_LEN_128);
-        for (int i = 0; i < data_len; i += ESP_UUID_LEN_128)
-        {
-            ESP_LOGI(TAG, "  - %02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
-                     data_ptr[i + 15], data_ptr[i + 14], data_ptr[i + 13], data_ptr[i + 12],
-                     data_ptr[i + 11], data_ptr[i + 10], data_ptr[i + 9], data_ptr[i + 8],
-                     data_ptr[i + 7], data_ptr[i + 6], data_ptr[i + 5], data_ptr[i + 4],
-                     data_ptr[i + 3], data_ptr[i + 2], data_ptr[i + 1], data_ptr[i + 0]);
-        }
-    }
-    else if (data_ptr != NULL)
-    {
-        ESP_LOGW(TAG, "WARNING: 128-bit Complete UUIDs data length mismatch (len=%d, expected multiple of %d)",
-                 data_len, ESP_UUID_LEN_128);
-    }
-
-    // Partial list
-    data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, ESP_BLE_AD_TYPE_128SRV_PART, &data_len);
-    ESP_LOGD(TAG, "DEBUG: 128-bit Incomplete UUIDs - ptr=%p, len=%d", data_ptr, data_len);
-    if (data_ptr != NULL && data_len > 0 && (data_len % ESP_UUID_LEN_128 == 0))
-    {
-        ESP_LOGI(TAG, "Incomplete 128-bit Service UUIDs (count %d):", data_len / ESP_UUID_LEN_128);
-        for (int i = 0; i < data_len; i += ESP_UUID_LEN_128)
-        {
-            ESP_LOGI(TAG, "  - %02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
-                     data_ptr[i + 15], data_ptr[i + 14], data_ptr[i + 13], data_ptr[i + 12],
-                     data_ptr[i + 11], data_ptr[i + 10], data_ptr[i + 9], data_ptr[i + 8],
-                     data_ptr[i + 7], data_ptr[i + 6], data_ptr[i + 5], data_ptr[i + 4],
-                     data_ptr[i + 3], data_ptr[i + 2], data_ptr[i + 1], data_ptr[i + 0]);
-        }
-    }
-    else if (data_ptr != NULL)
-    {
-        ESP_LOGW(TAG, "WARNING: 128-bit Incomplete UUIDs data length mismatch (len=%d, expected multiple of %d)",
-                 data_len, ESP_UUID_LEN_128);
-    }
+    bat_log_uuid_lists(&index, true);
 
     // === SCAN RESPONSE DATA ===
     if (pScanResult->scan_rsp_len > 0)
@@ -427,7 +302,7 @@ void bat_log_verbose_ble_scan(bat_scan_result_t *pScanResult, bool ignoreNoAdver
 
 void bat_debug_esp_ble_resolve_adv_data(bat_scan_result_t *pScanResult)
 {
-    ESP_LOGI(TAG, "=== DEBUG esp_ble_resolve_adv_data FUNCTION ===");
+    ESP_LOGI(TAG, "=== DEBUG ADVERTISING DATA INDEX ===");
     ESP_LOGI(TAG, "Device Address: %02x:%02x:%02x:%02x:%02x:%02x",
              pScanResult->bda[0], pScanResult->bda[1],
              pScanResult->bda[2], pScanResult->bda[3],
@@ -443,7 +318,9 @@ void bat_debug_esp_ble_resolve_adv_data(bat_scan_result_t *pScanResult)
     }
 
     ESP_LOGI(TAG, "Raw advertising data:");
-    ESP_LOG_BUFFER_HEX(TAG, pScanResult->ble_adv, pScanResult->adv_data_len);    // Test all common advertising data types
+    ESP_LOG_BUFFER_HEX(TAG, pScanResult->ble_adv, pScanResult->adv_data_len);
+
+    // Names of the common advertising data types.
     const uint8_t test_types[] = {
         ESP_BLE_AD_TYPE_FLAG,
         ESP_BLE_AD_TYPE_16SRV_PART,
@@ -482,24 +359,37 @@ void bat_debug_esp_ble_resolve_adv_data(bat_scan_result_t *pScanResult)
         "128SERVICE_DATA",
         "MANUFACTURER_SPECIFIC"};
 
-    for (int i = 0; i < sizeof(test_types) / sizeof(test_types[0]); i++)
+    // One pass over advertising data and scan response, then list what was found.
+    bat_adv_index_t index;
+    esp_err_t err = bat_ble_client_index_adv(pScanResult, &index);
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "WARNING: Advertising data is truncated (%s)", esp_err_to_name(err));
+
+    ESP_LOGI(TAG, "AD structures: %d", index.count);
+    for (int i = 0; i < index.count; i++)
     {
-        uint8_t *data_ptr = NULL;
-        uint8_t data_len = 0;
+        const bat_adv_field_t *pField = &index.fields[i];
 
-        data_ptr = esp_ble_resolve_adv_data(pScanResult->ble_adv, test_types[i], &data_len);
+        const char *type_name = "UNKNOWN";
+        for (int t = 0; t < sizeof(test_types) / sizeof(test_types[0]); t++)
+        {
+            if (test_types[t] == pField->type)
+            {
+                type_name = type_names[t];
+                break;
+            }
+        }
 
-        ESP_LOGI(TAG, "Type 0x%02x (%s): ptr=%p, len=%d",
-                 test_types[i], type_names[i], data_ptr, data_len);
+        ESP_LOGI(TAG, "Type 0x%02x (%s): offset=%d, len=%d", pField->type, type_name, pField->offset, pField->len);
 
-        if (data_ptr != NULL && data_len > 0)
+        if (pField->len > 0)
         {
             ESP_LOGI(TAG, "  Data: ");
-            ESP_LOG_BUFFER_HEX(TAG, data_ptr, data_len);
+            ESP_LOG_BUFFER_HEX(TAG, index.pData + pField->offset, pField->len);
         }
-        else if (data_ptr != NULL && data_len == 0)
+        else
         {
-            ESP_LOGW(TAG, "  WARNING: Non-null pointer but zero length!");
+            ESP_LOGW(TAG, "  WARNING: Zero length data!");
         }
     }
 
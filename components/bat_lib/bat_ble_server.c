@@ -10,10 +10,12 @@
 #include "esp_gatt_common_api.h"
 #include "esp_bt_defs.h"
 #include "esp_gatt_defs.h"
+#include "esp_timer.h"
 
 #include "bat_ble.h"
 #include "bat_hash_table.h"
 #include "bat_ble_server.h"
+#include "bat_trace.h"
 
 // See: /docs/ble_intro.md
 // GATT Server implementation for Bitman's BLE server
@@ -21,8 +23,20 @@ static const char *TAG = "bat_lib:ble_server";
 
 // The GATTS interface is a unique identifier for each GATT server instance, we get that during registration.
 static bat_hash_table_t app_cb_table;   // Hash table to map app IDs to GATTS callbacks.
-static bat_hash_table_t gatts_cb_table; // Hash table to map GATTS interfaces to callbacks.
+static bat_gatts_callbacks_t *gatts_cb_by_if[BAT_GATTS_IF_MAX]; // GATTS interface to callbacks, indexed directly.
 static bat_gaps_callbacks_t *g_pGapCallbacks = NULL;
+static bat_gatts_conn_table_t g_conn_table;  // Connections of every interface, indexed by conn_id.
+static bat_gatts_prep_write_t g_prep_write;  // Reassembly buffers for prepared writes, one per connection.
+static int64_t g_register_us = 0;          // First bat_gatts_register call.
+static int64_t g_startup_latency_us = 0;   // First bat_gatts_register to first advertising start.
+static int g_adv_data_pending = 0;         // Raw payloads configured but not yet confirmed.
+static bool g_adv_data_failed = false;     // The stack rejected one of the pending payloads.
+static bool g_adv_cache_valid = false;     // The cached payloads are what the controller holds.
+static bool g_adv_cache_has_scan_rsp = false;
+static bat_adv_buf_t g_adv_cache;          // Last applied advertising payload.
+static bat_adv_buf_t g_scan_rsp_cache;     // Last applied scan response payload.
+
+static bool bat_gatts_advert_is_applied(const bat_adv_buf_t *pAdv, const bat_adv_buf_t *pScanRsp);
 
 static esp_ble_adv_params_t adv_params = {
     .adv_int_min = 0x20,
@@ -49,22 +63,53 @@ static void bat_gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_p
     switch (event)
     {
     case ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT:
-        ESP_LOGI(TAG, "ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT");
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, pParam->adv_data_cmpl.status);
         g_pGapCallbacks->on_advert_data_set(g_pGapCallbacks, pParam);
         break;
 
+    // Both raw statuses sit at the same offset, on_advert_data_set sees the last one.
+    case ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT:
+    case ESP_GAP_BLE_SCAN_RSP_DATA_RAW_SET_COMPLETE_EVT:
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, pParam->adv_data_raw_cmpl.status);
+        if (pParam->adv_data_raw_cmpl.status != ESP_BT_STATUS_SUCCESS)
+        {
+            ESP_LOGE(TAG, "Raw advertising data rejected, event: %d, status: %d", event, pParam->adv_data_raw_cmpl.status);
+            g_adv_data_failed = true;
+        }
+        if (g_adv_data_pending > 0 && --g_adv_data_pending == 0)
+        {
+            g_adv_cache_valid = !g_adv_data_failed;
+            g_pGapCallbacks->on_advert_data_set(g_pGapCallbacks, pParam);
+        }
+        break;
+
     case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
-        ESP_LOGI(TAG, "ESP_GAP_BLE_ADV_START_COMPLETE_EVT");
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, pParam->adv_start_cmpl.status);
+        if (g_startup_latency_us == 0 && g_register_us != 0 && pParam->adv_start_cmpl.status == ESP_BT_STATUS_SUCCESS)
+        {
+            g_startup_latency_us = esp_timer_get_time() - g_register_us;
+            ESP_LOGI(TAG, "Registration to advertising: %lld us", (long long)g_startup_latency_us);
+        }
         g_pGapCallbacks->on_advert_start(g_pGapCallbacks, pParam);
         break;
 
     case ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT:
-        ESP_LOGI(TAG, "ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT");
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, pParam->adv_stop_cmpl.status);
         g_pGapCallbacks->on_advert_stop(g_pGapCallbacks, pParam);
         break;
 
+    // Answers to the throughput profile requests, see bat_ble_throughput.h.
+    case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+    case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+#endif
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, 0);
+        bat_ble_throughput_on_gap_event(event, pParam);
+        break;
+
     default:
-        ESP_LOGD(TAG, "Unhandled GAP event: %d", event);
+        BAT_TRACE(BAT_TRACE_SRC_GAP, event, 0, BAT_TRACE_NO_CONN, 0);
         break;
     }
 }
@@ -77,14 +122,18 @@ static bat_gatts_callbacks_t *bat_gatts_callbacks_create_mapping(
 
     if (err == ESP_OK && pCallbacks != NULL)
     {
-        err = bat_hash_table_set(&gatts_cb_table, gatts_if, pCallbacks);
-        if (err == ESP_OK)
+        if (gatts_if < BAT_GATTS_IF_MAX)
         {
+            gatts_cb_by_if[gatts_if] = pCallbacks;
             ESP_LOGI(TAG, "Callback registered for appId: %d, gatts_if: %d", app_id, gatts_if);
             pCallbacks->service_handle = 0;
+            pCallbacks->pPendingTable = NULL;
             pCallbacks->gatts_if = gatts_if;
             return pCallbacks;
         }
+
+        ESP_LOGE(TAG, "gatts_if: %d out of range for appId: %d", gatts_if, app_id);
+        return NULL;
     }
 
     ESP_LOGW(TAG, "No callback registered for appId: %d, gatts_if: %d", app_id, gatts_if);
@@ -94,6 +143,7 @@ static bat_gatts_callbacks_t *bat_gatts_callbacks_create_mapping(
 // Note that this type of esp log...
 //    W (3601141) BT_BTM: BTM_BleWriteAdvData, Partial data write into ADV
 // .. indicates that the packet is not big enough to hold all the advertised data.
+// The payloads are now built with bat_adv_builder.h, which fails instead of truncating.
 // This means that passive scanners which don't listen for an additional scam response packet will only
 // see a subset of what you are advertising.
 // The order priority is:
@@ -151,42 +201,33 @@ esp_err_t bat_gatts_begin_advert_data_set(const char *pszAdvName, uint8_t *pId,
     // For example we might just include the service UUID which means that *passive* scan can find 
     // if they are interested in the service quicker and without handshaking.
 
-    esp_ble_adv_data_t adv_data = {
-        .p_service_uuid = pId,
-        .service_uuid_len = idLen,
-        .set_scan_rsp = false,
-        .include_name = false, // Don't include name in adv packet
-        .include_txpower = false,
-        .min_interval = 0x0006,
-        .max_interval = 0x0010,
-        .appearance = 0x0944, // Headphones
-        .manufacturer_len = 0,
-        .p_manufacturer_data = NULL,
-        .service_data_len = 0,
-        .p_service_data = NULL,
-        .flag = (ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT),
-    };
-
-    // Set main advertisement data.
-    err = esp_ble_gap_config_adv_data(&adv_data);
+    // Advertising data, exactly 31 bytes with a 128-bit UUID: flags (3), UUID (18), appearance (4), interval (6).
+    bat_adv_buf_t adv;
+    bat_adv_buf_init(&adv);
+    err = bat_adv_add_flags(&adv, ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT);
+    if (err == ESP_OK && pId != NULL && idLen != 0)
+    {
+        if (idLen % ESP_UUID_LEN_128 != 0)
+            return ESP_ERR_INVALID_ARG;
+        err = bat_adv_add_uuid128s(&adv, (const bat_ble_uuid128_t *)pId, idLen / ESP_UUID_LEN_128, true);
+    }
+    if (err == ESP_OK)
+        err = bat_adv_add_appearance(&adv, 0x0944); // Headphones
+    if (err == ESP_OK)
+        err = bat_adv_add_conn_interval(&adv, 0x0006, 0x0010);
     if (err != ESP_OK)
     {
-        ESP_LOGE(TAG, "Failed to configure advertising data: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Advertising data does not fit: %s", esp_err_to_name(err));
         return err;
     }
 
+    // We can send one (optional) additional `Scan response` packet.
+    // This packet can include more data than the main advertisement packet but won't be seen by
+    // passive scanners.
+    bat_adv_buf_t scan_rsp;
+    bat_adv_buf_init(&scan_rsp);
     if (pszAdvName != NULL)
     {
-        // We can send one (optional) additional `Scan response` packet.
-        // This packet can include more data than the main advertisement packet but won't be seen by
-        // passive scanners.
-        esp_ble_adv_data_t scan_rsp_data = {
-            .set_scan_rsp = true,
-            .include_name = true, // Include name in scan response (pszAdvertisedName)
-            .include_txpower = false,
-            .flag = 0 // No flags in scan response
-        };
-
         err = esp_ble_gap_set_device_name(pszAdvName);
         if (err != ESP_OK)
         {
@@ -194,15 +235,73 @@ esp_err_t bat_gatts_begin_advert_data_set(const char *pszAdvName, uint8_t *pId,
             return err;
         }
 
-        err = esp_ble_gap_config_adv_data(&scan_rsp_data);
+        // A name longer than 29 bytes is advertised shortened, like the stack did.
+        err = bat_adv_add_name(&scan_rsp, pszAdvName, true);
+        if (err != ESP_OK)
+            return err;
+    }
+
+    const bat_adv_buf_t *pScanRsp = (pszAdvName != NULL) ? &scan_rsp : NULL;
+    if (bat_gatts_advert_is_applied(&adv, pScanRsp))
+    {
+        // Same bytes as last time, skip the upload and its two completion events.
+        ESP_LOGD(TAG, "Advertising data unchanged, restarting advertising");
+        return bat_gatts_readvertise();
+    }
+
+    return bat_gatts_set_advert_raw(&adv, pScanRsp);
+}
+
+// Whether the controller already holds exactly these payloads.
+static bool bat_gatts_advert_is_applied(const bat_adv_buf_t *pAdv, const bat_adv_buf_t *pScanRsp)
+{
+    if (!g_adv_cache_valid || g_adv_data_pending != 0 || g_adv_cache_has_scan_rsp != (pScanRsp != NULL))
+        return false;
+
+    if (pAdv->len != g_adv_cache.len || memcmp(pAdv->data, g_adv_cache.data, pAdv->len) != 0)
+        return false;
+
+    return pScanRsp == NULL ||
+           (pScanRsp->len == g_scan_rsp_cache.len && memcmp(pScanRsp->data, g_scan_rsp_cache.data, pScanRsp->len) == 0);
+}
+
+esp_err_t bat_gatts_set_advert_raw(const bat_adv_buf_t *pAdv, const bat_adv_buf_t *pScanRsp)
+{
+    if (pAdv == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    // Cached now, trusted once the stack confirms it, see bat_gatts_readvertise.
+    g_adv_cache = *pAdv;
+    g_adv_cache_has_scan_rsp = pScanRsp != NULL;
+    if (pScanRsp != NULL)
+        g_scan_rsp_cache = *pScanRsp;
+    g_adv_cache_valid = false;
+    g_adv_data_failed = false;
+
+    // Both are queued before either completes, on_advert_data_set follows the last completion.
+    g_adv_data_pending = (pScanRsp != NULL) ? 2 : 1;
+    esp_err_t err = esp_ble_gap_config_adv_data_raw((uint8_t *)pAdv->data, pAdv->len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to configure advertising data: %s", esp_err_to_name(err));
+        g_adv_data_pending = 0;
+        return err;
+    }
+
+    if (pScanRsp != NULL)
+    {
+        err = esp_ble_gap_config_scan_rsp_data_raw((uint8_t *)pScanRsp->data, pScanRsp->len);
         if (err != ESP_OK)
         {
             ESP_LOGE(TAG, "Failed to configure scan response data: %s", esp_err_to_name(err));
+            // The advertising data still completes, the cache must not be trusted when it does.
+            g_adv_data_failed = true;
+            g_adv_data_pending = 1;
             return err;
         }
     }
 
-    ESP_LOGV(TAG, "Advertising data setup succeeded");
+    ESP_LOGV(TAG, "Advertising data setup succeeded, %d + %d bytes", pAdv->len, (pScanRsp != NULL) ? pScanRsp->len : 0);
     return ESP_OK;
 }
 
@@ -252,6 +351,19 @@ esp_err_t bat_gatts_start_advertising()
     return ESP_OK;
 }
 
+esp_err_t bat_gatts_readvertise()
+{
+    // The controller keeps the payloads across connections and advertising stops, and adv_params is
+    // passed with every start, so a restart is a single stack call and a single event.
+    if (!g_adv_cache_valid || g_adv_data_pending != 0)
+    {
+        ESP_LOGW(TAG, "No confirmed advertising data to readvertise");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return bat_gatts_start_advertising();
+}
+
 // Permissions control what operations a client is allowed to perform on the characteristic value.
 //   - ESP_GATT_PERM_READ:   Client can read the value.
 //   - ESP_GATT_PERM_WRITE:  Client can write the value.
@@ -320,19 +432,107 @@ esp_err_t bat_gatts_add_cccd(uint16_t service_handle, uint16_t char_handle)
     return err;
 }
 
-static bat_gatts_callbacks_t *bat_gatts_callbacks_lookup(esp_gatt_if_t gatts_if)
+esp_err_t bat_gatts_create_attr_table(bat_gatts_callbacks_t *pCallbacks, const bat_gatts_service_def_t *pDef, bat_gatts_table_t *pTable)
 {
-    bat_gatts_callbacks_t *pCallbacks = NULL;
-    esp_err_t err = bat_hash_table_get(&gatts_cb_table, gatts_if, (void **)&pCallbacks);
+    if (pCallbacks == NULL || pTable == NULL)
+        return ESP_ERR_INVALID_ARG;
 
-    if (err == ESP_OK && pCallbacks != NULL)
+    // One table at a time per app, the creation event does not say which request it answers.
+    if (pCallbacks->pPendingTable != NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = bat_gatts_table_build(pTable, pDef);
+    if (err != ESP_OK)
     {
-        ESP_LOGV(TAG, "Got callback for gatts_if: %d", gatts_if);
-        return pCallbacks;
+        ESP_LOGE(TAG, "Failed to build attribute table: %s", esp_err_to_name(err));
+        return err;
     }
 
-    ESP_LOGW(TAG, "No callback registered for gatts_if: %d", gatts_if);
-    return NULL;
+    pCallbacks->pPendingTable = pTable;
+    err = esp_ble_gatts_create_attr_tab(pTable->pDb, pCallbacks->gatts_if, pTable->attr_count, pDef->inst_id);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create attribute table: %s", esp_err_to_name(err));
+        pCallbacks->pPendingTable = NULL;
+        bat_gatts_table_free(pTable);
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Attribute table requested: %d attributes", pTable->attr_count);
+    return ESP_OK;
+}
+
+static void bat_gatts_on_attr_tab_created(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    bat_gatts_table_t *pTable = pCallbacks->pPendingTable;
+    pCallbacks->pPendingTable = NULL;
+    if (pTable == NULL)
+    {
+        ESP_LOGW(TAG, "Unexpected attribute table for gatts_if: %d", pCallbacks->gatts_if);
+        return;
+    }
+
+    if (pParam->add_attr_tab.status != ESP_GATT_OK)
+    {
+        ESP_LOGE(TAG, "Attribute table creation failed, status: 0x%x", pParam->add_attr_tab.status);
+        bat_gatts_table_release_db(pTable);
+        return;
+    }
+
+    esp_err_t err = bat_gatts_table_set_handles(pTable, pParam->add_attr_tab.handles, pParam->add_attr_tab.num_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Attribute table has %d handles, expected %d",
+                 pParam->add_attr_tab.num_handle, pTable->attr_count);
+        return;
+    }
+
+    ESP_LOGI(TAG, "Attribute table created in %lld us, service_handle=%d",
+             (long long)(pTable->created_us - pTable->requested_us), pTable->service_handle);
+    pCallbacks->service_handle = pTable->service_handle;
+    bat_gatts_start_service(pTable->service_handle);
+}
+
+esp_err_t bat_gatts_set_value(uint16_t handle, const uint8_t *pValue, uint16_t len)
+{
+    if (handle == 0 || (len != 0 && pValue == NULL))
+        return ESP_ERR_INVALID_ARG;
+
+    // The stack copies the value, ESP_GATTS_SET_ATTR_VAL_EVT only reports failures worth logging.
+    esp_err_t err = esp_ble_gatts_set_attr_value(handle, len, pValue);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "Failed to set value of handle: %d, %s", handle, esp_err_to_name(err));
+    return err;
+}
+
+int64_t bat_gatts_get_startup_latency_us(void)
+{
+    return g_startup_latency_us;
+}
+
+bat_gatts_conn_table_t *bat_gatts_get_conn_table(void)
+{
+    return &g_conn_table;
+}
+
+bat_gatts_conn_t *bat_gatts_get_conn(uint16_t conn_id)
+{
+    return bat_gatts_conn_get(&g_conn_table, conn_id);
+}
+
+const bat_gatts_prep_write_t *bat_gatts_get_prep_write(void)
+{
+    return &g_prep_write;
+}
+
+esp_err_t bat_gatts_set_max_connections(size_t max_conns)
+{
+    if (max_conns == 0 || max_conns > BAT_GATTS_CONN_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    // Open connections are kept, new ones are refused until the count drops below the limit.
+    g_conn_table.max_conns = max_conns;
+    return ESP_OK;
 }
 
 esp_err_t bat_gatts_start_service(bat_gatts_service_handle service_handle)
@@ -374,7 +574,12 @@ esp_err_t bat_gatts_send_response(
     }
     else
     {
-        ESP_LOGI(TAG, "Response sent successfully");
+        ESP_LOGD(TAG, "Response sent successfully");
+        bat_gatts_conn_t *pConn = bat_gatts_conn_get(&g_conn_table, conn_id);
+        if (pConn != NULL && pResponse != NULL)
+            pConn->tx_bytes += pResponse->attr_value.len;
+        if (pResponse != NULL)
+            bat_ble_throughput_on_traffic(conn_id, pResponse->attr_value.len);
     }
     return ESP_OK;
 }
@@ -390,6 +595,243 @@ esp_err_t bat_gatts_send_uint8(
     return bat_gatts_send_response(gatts_if, conn_id, trans_id, status, &response);
 }
 
+static void bat_gatts_create_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_CREATE_EVT, pParam->create.service_handle, BAT_TRACE_NO_CONN, pParam->create.status);
+    pCallbacks->service_handle = pParam->create.service_handle;
+    pCallbacks->on_create(pCallbacks, pParam);
+}
+
+static void bat_gatts_creat_attr_tab_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_CREAT_ATTR_TAB_EVT, 0, BAT_TRACE_NO_CONN, pParam->add_attr_tab.status);
+    bat_gatts_on_attr_tab_created(pCallbacks, pParam);
+    pCallbacks->on_create_attr_tab(pCallbacks, pParam);
+}
+
+static void bat_gatts_add_char_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_ADD_CHAR_EVT, pParam->add_char.attr_handle, BAT_TRACE_NO_CONN, pParam->add_char.status);
+    pCallbacks->on_add_char(pCallbacks, pParam);
+}
+
+static void bat_gatts_add_char_descr_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_ADD_CHAR_DESCR_EVT, pParam->add_char_descr.attr_handle, BAT_TRACE_NO_CONN,
+              pParam->add_char_descr.status);
+    pCallbacks->on_add_char_descr(pCallbacks, pParam);
+}
+
+static void bat_gatts_start_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_START_EVT, pParam->start.service_handle, BAT_TRACE_NO_CONN, pParam->start.status);
+    pCallbacks->on_start(pCallbacks, pParam);
+}
+
+static void bat_gatts_connect_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_CONNECT_EVT, 0, pParam->connect.conn_id, 0);
+
+    bool opened = false;
+    bat_gatts_conn_t *pConn = bat_gatts_conn_open(
+        &g_conn_table, pCallbacks->gatts_if, pParam->connect.conn_id, pParam->connect.remote_bda, &opened);
+    if (pConn == NULL)
+    {
+        ESP_LOGW(TAG, "No connection slot for conn_id: %d, closing it", pParam->connect.conn_id);
+        esp_ble_gatts_close(pCallbacks->gatts_if, pParam->connect.conn_id);
+        return;
+    }
+
+    if (pCallbacks->pNotify != NULL)
+        bat_gatts_notify_on_connect(pCallbacks->pNotify, pParam->connect.conn_id);
+
+    // The stack stops advertising on connection, keep accepting centrals while slots remain.
+    if (opened && bat_gatts_conn_has_free_slot(&g_conn_table))
+        bat_gatts_readvertise();
+
+    // The client starts the MTU exchange, the server requests data length, PHY and interval.
+    if (opened)
+        bat_ble_throughput_link_up(pParam->connect.remote_bda, pParam->connect.conn_id, ESP_GATT_IF_NONE);
+
+    pCallbacks->on_connect(pCallbacks, pParam);
+}
+
+static void bat_gatts_disconnect_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_DISCONNECT_EVT, 0, pParam->disconnect.conn_id, pParam->disconnect.reason);
+    if (pCallbacks->pNotify != NULL)
+        bat_gatts_notify_on_disconnect(pCallbacks->pNotify, pParam->disconnect.conn_id);
+
+    // The entry is still there for on_disconnect to read the counters.
+    pCallbacks->on_disconnect(pCallbacks, pParam);
+
+    bat_gatts_prep_write_release(&g_prep_write, bat_gatts_conn_get(&g_conn_table, pParam->disconnect.conn_id), false);
+    bat_ble_throughput_link_down(pParam->disconnect.remote_bda);
+    bool was_full = !bat_gatts_conn_has_free_slot(&g_conn_table);
+    if (bat_gatts_conn_close(&g_conn_table, pParam->disconnect.conn_id) && was_full)
+        bat_gatts_readvertise();
+}
+
+static void bat_gatts_read_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_READ_EVT, pParam->read.handle, pParam->read.conn_id, pParam->read.need_rsp);
+    bat_gatts_conn_t *pConn = bat_gatts_conn_get(&g_conn_table, pParam->read.conn_id);
+    if (pConn != NULL)
+        pConn->reads++;
+
+    // Auto-response attributes were already answered by the stack from the value set by bat_gatts_set_value.
+    if (!pParam->read.need_rsp)
+        return;
+    pCallbacks->on_read(pCallbacks, pParam);
+
+    // Respond with dummy data
+    // {
+    //     uint8_t value[4] = {0x42, 0x43, 0x44, 0x45};
+    //     esp_gatt_rsp_t rsp = {0};
+    //     rsp.attr_value.handle = pParam->read.handle;
+    //     rsp.attr_value.len = 4;
+    //     memcpy(rsp.attr_value.value, value, 4);
+    //     esp_ble_gatts_send_response(gatts_if, pParam->read.conn_id, pParam->read.trans_id, ESP_GATT_OK, &rsp);
+    // }
+}
+
+// A Prepare Write fragment is queued and echoed back, on_write only sees the reassembled value.
+static void bat_gatts_prep_write_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    bat_gatts_conn_t *pConn = bat_gatts_conn_get(&g_conn_table, pParam->write.conn_id);
+    if (pConn != NULL)
+        pConn->rx_bytes += pParam->write.len;
+    bat_ble_throughput_on_traffic(pParam->write.conn_id, pParam->write.len);
+
+    esp_gatt_status_t status = bat_gatts_prep_write_append(&g_prep_write, pConn, pParam);
+    if (!pParam->write.need_rsp)
+        return;
+
+    // The response echoes the fragment so the client can check it arrived intact.
+    esp_gatt_rsp_t rsp = {0};
+    rsp.attr_value.handle = pParam->write.handle;
+    rsp.attr_value.offset = pParam->write.offset;
+    rsp.attr_value.len = pParam->write.len;
+    rsp.attr_value.auth_req = ESP_GATT_AUTH_REQ_NONE;
+    memcpy(rsp.attr_value.value, pParam->write.value, pParam->write.len);
+    esp_ble_gatts_send_response(pCallbacks->gatts_if, pParam->write.conn_id, pParam->write.trans_id, status, &rsp);
+}
+
+static void bat_gatts_write_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_WRITE_EVT, pParam->write.handle, pParam->write.conn_id, pParam->write.len);
+    if (pParam->write.is_prep)
+    {
+        bat_gatts_prep_write_evt(pCallbacks, pParam);
+        return;
+    }
+
+    bat_gatts_conn_t *pConn = bat_gatts_conn_get(&g_conn_table, pParam->write.conn_id);
+    if (pConn != NULL)
+    {
+        pConn->writes++;
+        pConn->rx_bytes += pParam->write.len;
+    }
+    bat_ble_throughput_on_traffic(pParam->write.conn_id, pParam->write.len);
+
+    // CCCD writes are recorded for the notification engine, the app still sees them.
+    // Table CCCDs are answered by the stack, everything else is answered by on_write when need_rsp is set.
+    if (pCallbacks->pNotify != NULL)
+        bat_gatts_notify_on_write(pCallbacks->pNotify, pParam);
+    pCallbacks->on_write(pCallbacks, pParam);
+}
+
+// The queued fragments reach on_write as one write at offset 0, then the Execute Write is answered.
+static void bat_gatts_exec_write_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_EXEC_WRITE_EVT, 0, pParam->exec_write.conn_id, pParam->exec_write.exec_write_flag);
+    bat_gatts_conn_t *pConn = bat_gatts_conn_get(&g_conn_table, pParam->exec_write.conn_id);
+
+    esp_gatt_status_t status = ESP_GATT_OK;
+    bool executed = false;
+    if (pParam->exec_write.exec_write_flag == ESP_GATT_PREP_WRITE_EXEC)
+    {
+        esp_ble_gatts_cb_param_t joined;
+        executed = bat_gatts_prep_write_take(pConn, pParam, &joined, &status);
+        if (executed)
+        {
+            pConn->writes++;
+            if (pCallbacks->pNotify != NULL)
+                bat_gatts_notify_on_write(pCallbacks->pNotify, &joined);
+            pCallbacks->on_write(pCallbacks, &joined);
+        }
+    }
+
+    bat_gatts_prep_write_release(&g_prep_write, pConn, executed);
+    esp_ble_gatts_send_response(pCallbacks->gatts_if, pParam->exec_write.conn_id, pParam->exec_write.trans_id, status, NULL);
+}
+
+static void bat_gatts_mtu_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_MTU_EVT, 0, pParam->mtu.conn_id, pParam->mtu.mtu);
+    bat_gatts_conn_t *pConn = bat_gatts_conn_get(&g_conn_table, pParam->mtu.conn_id);
+    if (pConn != NULL)
+        pConn->mtu = pParam->mtu.mtu;
+    bat_ble_throughput_on_mtu(pParam->mtu.conn_id, pParam->mtu.mtu);
+}
+
+static void bat_gatts_conf_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_CONF_EVT, pParam->conf.handle, pParam->conf.conn_id, pParam->conf.status);
+    if (pCallbacks->pNotify != NULL)
+        bat_gatts_notify_on_conf(pCallbacks->pNotify, pParam->conf.conn_id, pParam->conf.status);
+}
+
+static void bat_gatts_congest_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_CONGEST_EVT, 0, pParam->congest.conn_id, pParam->congest.congested);
+    if (pCallbacks->pNotify != NULL)
+        bat_gatts_notify_on_congest(pCallbacks->pNotify, pParam->congest.conn_id, pParam->congest.congested);
+}
+
+static void bat_gatts_set_attr_val_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_SET_ATTR_VAL_EVT, pParam->set_attr_val.attr_handle, BAT_TRACE_NO_CONN,
+              pParam->set_attr_val.status);
+    if (pParam->set_attr_val.status != ESP_GATT_OK)
+        ESP_LOGW(TAG, "ESP_GATTS_SET_ATTR_VAL_EVT, handle: %d, status: 0x%x",
+                 pParam->set_attr_val.attr_handle, pParam->set_attr_val.status);
+}
+
+static void bat_gatts_stop_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_STOP_EVT, pParam->stop.service_handle, BAT_TRACE_NO_CONN, pParam->stop.status);
+    pCallbacks->on_stop(pCallbacks, pParam);
+}
+
+static void bat_gatts_unreg_evt(bat_gatts_callbacks_t *pCallbacks, esp_ble_gatts_cb_param_t *pParam)
+{
+    BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_UNREG_EVT, 0, BAT_TRACE_NO_CONN, 0);
+    pCallbacks->on_unreg(pCallbacks, pParam);
+    gatts_cb_by_if[pCallbacks->gatts_if] = NULL;
+}
+
+// Per-event handlers, indexed by esp_gatts_cb_event_t. Events without a handler are ignored.
+typedef void (*bat_gatts_event_fn_t)(bat_gatts_callbacks_t *, esp_ble_gatts_cb_param_t *);
+static const bat_gatts_event_fn_t gatts_event_handlers[] = {
+    [ESP_GATTS_CREATE_EVT] = bat_gatts_create_evt,
+    [ESP_GATTS_CREAT_ATTR_TAB_EVT] = bat_gatts_creat_attr_tab_evt,
+    [ESP_GATTS_ADD_CHAR_EVT] = bat_gatts_add_char_evt,
+    [ESP_GATTS_ADD_CHAR_DESCR_EVT] = bat_gatts_add_char_descr_evt,
+    [ESP_GATTS_START_EVT] = bat_gatts_start_evt,
+    [ESP_GATTS_CONNECT_EVT] = bat_gatts_connect_evt,
+    [ESP_GATTS_DISCONNECT_EVT] = bat_gatts_disconnect_evt,
+    [ESP_GATTS_READ_EVT] = bat_gatts_read_evt,
+    [ESP_GATTS_WRITE_EVT] = bat_gatts_write_evt,
+    [ESP_GATTS_EXEC_WRITE_EVT] = bat_gatts_exec_write_evt,
+    [ESP_GATTS_MTU_EVT] = bat_gatts_mtu_evt,
+    [ESP_GATTS_CONF_EVT] = bat_gatts_conf_evt,
+    [ESP_GATTS_CONGEST_EVT] = bat_gatts_congest_evt,
+    [ESP_GATTS_SET_ATTR_VAL_EVT] = bat_gatts_set_attr_val_evt,
+    [ESP_GATTS_STOP_EVT] = bat_gatts_stop_evt,
+    [ESP_GATTS_UNREG_EVT] = bat_gatts_unreg_evt,
+};
+
 // GATTS (GATT Server) events notify about BLE server events.
 // These include:
 // - ESP_GATTS_REG_EVT: GATT server profile registered, usually where you create your service.
@@ -401,6 +843,7 @@ esp_err_t bat_gatts_send_uint8(
 // - ESP_GATTS_DISCONNECT_EVT: A client has disconnected, often restart advertising.
 // - ESP_GATTS_READ_EVT: A client is reading a characteristic or descriptor value.
 // - ESP_GATTS_WRITE_EVT: A client is writing to a characteristic or descriptor value.
+// - ESP_GATTS_EXEC_WRITE_EVT: A client commits (or cancels) its queue of prepared writes.
 // https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/bluetooth/esp_gatts.html#_CPPv426esp_gatts_cb_event_t
 
 // Order of Operations: The correct order of operations is:
@@ -409,102 +852,29 @@ esp_err_t bat_gatts_send_uint8(
 // ESP_GATTS_ADD_CHAR_EVT: The characteristic is added. Now add descriptors (like CCCD).
 // ESP_GATTS_ADD_CHAR_DESCR_EVT: The descriptor is added. Now start the service.
 // ESP_GATTS_START_EVT: The service is started. Now start advertising.
+//
+// Dispatch is two loads and an indirect call: gatts_if indexes the callbacks, the event indexes the handler.
 static void bat_gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *pParam)
 {
-    bat_gatts_callbacks_t *pCallbacks = NULL;
-
     if (event == ESP_GATTS_REG_EVT)
     {
-        ESP_LOGI(TAG, "ESP_GATTS_REG_EVT, Service registered");
-        pCallbacks = bat_gatts_callbacks_create_mapping(gatts_if, pParam->reg.app_id);
+        BAT_TRACE(BAT_TRACE_SRC_GATTS, ESP_GATTS_REG_EVT, pParam->reg.app_id, BAT_TRACE_NO_CONN, pParam->reg.status);
+        bat_gatts_callbacks_t *pCallbacks = bat_gatts_callbacks_create_mapping(gatts_if, pParam->reg.app_id);
         if (pCallbacks != NULL)
             pCallbacks->on_reg(pCallbacks, pParam);
         return;
     }
 
-    pCallbacks = bat_gatts_callbacks_lookup(gatts_if);
-
-    switch (event)
+    bat_gatts_callbacks_t *pCallbacks = (gatts_if < BAT_GATTS_IF_MAX) ? gatts_cb_by_if[gatts_if] : NULL;
+    if (pCallbacks == NULL)
     {
-    case ESP_GATTS_CREATE_EVT:
-        ESP_LOGI(TAG, "ESP_GATTS_CREATE_EVT, Service created");
-        if (pCallbacks != NULL)
-        {
-            pCallbacks->service_handle = pParam->create.service_handle;
-            pCallbacks->on_create(pCallbacks, pParam);
-        }
-        break;
-
-    case ESP_GATTS_ADD_CHAR_EVT:
-        ESP_LOGI(TAG, "ESP_GATTS_ADD_CHAR_EVT, Characteristic added");
-        if (pCallbacks != NULL)
-            pCallbacks->on_add_char(pCallbacks, pParam);
-        break;
-
-    case ESP_GATTS_ADD_CHAR_DESCR_EVT:
-        ESP_LOGI(TAG, "ESP_GATTS_ADD_CHAR_DESCR_EVT, Descriptor added");
-        if (pCallbacks != NULL)
-            pCallbacks->on_add_char_descr(pCallbacks, pParam);
-        break;
-
-    case ESP_GATTS_START_EVT:
-        ESP_LOGI(TAG, "ESP_GATTS_START_EVT, Service started");
-        if (pCallbacks != NULL)
-            pCallbacks->on_start(pCallbacks, pParam);
-        break;
-
-    case ESP_GATTS_CONNECT_EVT:
-        ESP_LOGI(TAG, "ESP_GATTS_CONNECT_EVT, Client connected");
-        if (pCallbacks != NULL)
-            pCallbacks->on_connect(pCallbacks, pParam);
-        break;
-
-    case ESP_GATTS_DISCONNECT_EVT:
-        ESP_LOGI(TAG, "ESP_GATTS_DISCONNECT_EVT, Client disconnected");
-        if (pCallbacks != NULL)
-            pCallbacks->on_disconnect(pCallbacks, pParam);
-        break;
-
-    case ESP_GATTS_READ_EVT:
-        ESP_LOGI(TAG, "ESP_GATTS_READ_EVT, Read event");
-        if (pCallbacks != NULL)
-            pCallbacks->on_read(pCallbacks, pParam);
-        break;
-
-        // Respond with dummy data
-        // {
-        //     uint8_t value[4] = {0x42, 0x43, 0x44, 0x45};
-        //     esp_gatt_rsp_t rsp = {0};
-        //     rsp.attr_value.handle = pParam->read.handle;
-        //     rsp.attr_value.len = 4;
-        //     memcpy(rsp.attr_value.value, value, 4);
-        //     esp_ble_gatts_send_response(gatts_if, pParam->read.conn_id, pParam->read.trans_id, ESP_GATT_OK, &rsp);
-        // }
-        break;
-
-    case ESP_GATTS_WRITE_EVT:
-        ESP_LOGI(TAG, "ESP_GATTS_WRITE_EVT, Write event");
-
-        // Optionally process param->write.value
-        // esp_ble_gatts_send_response(gatts_if, pParam->write.conn_id, pParam->write.trans_id, ESP_GATT_OK, NULL);
-        break;
-
-    case ESP_GATTS_STOP_EVT:
-        ESP_LOGI(TAG, "ESP_GATTS_STOP_EVT, Service stopped");
-        if (pCallbacks != NULL)
-            pCallbacks->on_stop(pCallbacks, pParam);
-        break;
-
-    case ESP_GATTS_UNREG_EVT:
-        ESP_LOGI(TAG, "ESP_GATTS_UNREG_EVT, unregistering app");
-        if (pCallbacks != NULL)
-            pCallbacks->on_unreg(pCallbacks, pParam);
-        bat_hash_table_remove(&gatts_cb_table, gatts_if);
-        break;
-
-    default:
-        break;
+        BAT_TRACE(BAT_TRACE_SRC_GATTS, event, 0, BAT_TRACE_NO_CONN, 0);
+        return;
     }
+
+    if ((size_t)event < sizeof(gatts_event_handlers) / sizeof(gatts_event_handlers[0]) &&
+        gatts_event_handlers[event] != NULL)
+        gatts_event_handlers[event](pCallbacks, pParam);
 }
 
 esp_err_t bat_ble_server_init()
@@ -536,8 +906,10 @@ esp_err_t bat_ble_server_init()
     if (ret)
         return ret;
 
-    // Initialize hash tables for GATT callbacks
-    ret = bat_hash_table_init(&gatts_cb_table, 16, NULL, NULL);
+    // App IDs are only looked up on registration, GATTS interfaces index gatts_cb_by_if directly.
+    memset(gatts_cb_by_if, 0, sizeof(gatts_cb_by_if));
+    bat_gatts_conn_table_init(&g_conn_table, 0);
+    ret = bat_gatts_prep_write_init(&g_prep_write, 0);
     if (ret)
         return ret;
 
@@ -569,7 +941,13 @@ esp_err_t bat_ble_server_deinit()
     esp_bt_controller_deinit();
 
     bat_hash_table_cleanup(&app_cb_table);
-    bat_hash_table_cleanup(&gatts_cb_table);
+    memset(gatts_cb_by_if, 0, sizeof(gatts_cb_by_if));
+    bat_gatts_conn_table_init(&g_conn_table, 0);
+    bat_gatts_prep_write_deinit(&g_prep_write);
+
+    // The controller forgets the payloads with it.
+    g_adv_cache_valid = false;
+    g_adv_data_pending = 0;
 
     return ESP_OK;
 }
@@ -581,6 +959,7 @@ void bitman_gatts_no_op(bat_gatts_callbacks_t *pCb, esp_ble_gatts_cb_param_t *pP
 void bat_ble_gatts_callbacks_init(bat_gatts_callbacks_t *pCallbacks, void *pContext)
 {
     pCallbacks->service_handle = 0;
+    pCallbacks->pPendingTable = NULL;
     pCallbacks->pContext = pContext;
     pCallbacks->gatts_if = ESP_GATT_IF_NONE;
 
@@ -606,6 +985,8 @@ void bat_ble_gatts_callbacks_init(bat_gatts_callbacks_t *pCallbacks, void *pCont
         pCallbacks->on_disconnect = bitman_gatts_no_op;
     if (pCallbacks->on_add_char_descr == NULL)
         pCallbacks->on_add_char_descr = bitman_gatts_no_op;
+    if (pCallbacks->on_create_attr_tab == NULL)
+        pCallbacks->on_create_attr_tab = bitman_gatts_no_op;
 }
 
 esp_err_t bat_gatts_register(bat_gatts_app_id app_id, bat_gatts_callbacks_t *pCallbacks, void *pContext)
@@ -616,6 +997,9 @@ esp_err_t bat_gatts_register(bat_gatts_app_id app_id, bat_gatts_callbacks_t *pCa
         return ESP_ERR_INVALID_ARG;
 
     pCallbacks->pContext = pContext;
+    if (g_register_us == 0)
+        g_register_us = esp_timer_get_time();
+
     esp_err_t ret = bat_hash_table_set(&app_cb_table, app_id, pCallbacks);
     if (ret != ESP_OK)
         return ret;
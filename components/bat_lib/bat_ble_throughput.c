@@ -0,0 +1,740 @@
+#include "bat_ble_throughput.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_gattc_api.h"
+#include "esp_gatt_common_api.h"
+
+static const char *TAG = "bat_lib:ble_throughput";
+
+// The L2CAP and LL procedures time out after 30 s, an update still unanswered by then never will be.
+#define BAT_BLE_CONN_SWITCH_TIMEOUT_US (30 * 1000 * 1000)
+
+// Airtime outside the payload of an LL packet: preamble, access address, header and CRC, in octets.
+#define BAT_BLE_LL_OVERHEAD_OCTETS 10
+#define BAT_BLE_LL_IFS_US 150
+
+typedef struct {
+    bool in_use;
+    bat_ble_link_params_t params;
+
+    bat_ble_conn_usage_t usage[BAT_BLE_CONN_PROFILE_COUNT];
+    int64_t accounted_us;                // Time up to which usage is counted.
+    uint64_t unaccounted_bytes;          // Traffic since then.
+    uint64_t window_bytes;               // Traffic in the current policy window.
+    uint8_t idle_windows;                // Idle policy windows in a row.
+    uint8_t retry_windows;               // Policy windows left before a switch may be asked for again.
+    int64_t switch_us;                   // esp_timer time a profile was asked for, 0 if none is pending.
+} bat_ble_link_t;
+
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+static bat_ble_link_t g_links[BAT_BLE_LINK_MAX];
+static bat_ble_throughput_profile_t g_profile;
+static bool g_profile_set = false;
+
+static bat_ble_conn_params_t g_conn_params[BAT_BLE_CONN_PROFILE_COUNT] = {
+    [BAT_BLE_CONN_PROFILE_BULK] = BAT_BLE_CONN_PARAMS_BULK,
+    [BAT_BLE_CONN_PROFILE_INTERACTIVE] = BAT_BLE_CONN_PARAMS_INTERACTIVE,
+    [BAT_BLE_CONN_PROFILE_LOW_POWER] = BAT_BLE_CONN_PARAMS_LOW_POWER,
+};
+static bat_ble_conn_policy_t g_policy;
+static bool g_policy_set = false;
+static esp_timer_handle_t g_policy_timer = NULL;
+
+static const char *g_profile_names[BAT_BLE_CONN_PROFILE_COUNT] = {
+    [BAT_BLE_CONN_PROFILE_DEFAULT] = "default",
+    [BAT_BLE_CONN_PROFILE_BULK] = "bulk",
+    [BAT_BLE_CONN_PROFILE_INTERACTIVE] = "interactive",
+    [BAT_BLE_CONN_PROFILE_LOW_POWER] = "low power",
+};
+
+// Called with the lock held.
+static bat_ble_link_t *bat_ble_link_find_bda(const esp_bd_addr_t bda)
+{
+    for (size_t i = 0; i < BAT_BLE_LINK_MAX; ++i)
+    {
+        if (g_links[i].in_use && memcmp(g_links[i].params.bda, bda, sizeof(esp_bd_addr_t)) == 0)
+            return &g_links[i];
+    }
+    return NULL;
+}
+
+// Called with the lock held.
+static bat_ble_link_t *bat_ble_link_find_conn(uint16_t conn_id)
+{
+    for (size_t i = 0; i < BAT_BLE_LINK_MAX; ++i)
+    {
+        if (g_links[i].in_use && g_links[i].params.conn_id == conn_id)
+            return &g_links[i];
+    }
+    return NULL;
+}
+
+// Called with the lock held, returns true when the last pending request was just answered.
+static bool bat_ble_link_answered(bat_ble_link_t *pLink, uint8_t pending_bit)
+{
+    bool was_pending = pLink->params.pending != 0;
+    pLink->params.pending &= ~pending_bit;
+    if (!was_pending || pLink->params.pending != 0)
+        return false;
+
+    pLink->params.settled_us = esp_timer_get_time();
+    return true;
+}
+
+// Airtime of one octet on a PHY, in us.
+static uint32_t bat_ble_phy_octet_us(uint8_t phy)
+{
+    switch (phy)
+    {
+    case BAT_BLE_PHY_2M:
+        return 4;
+    case BAT_BLE_PHY_CODED:
+        return 64; // S=8, the worst case.
+    default:
+        return 8;
+    }
+}
+
+// Estimated radio time of a span with the link's parameters, see the file description.
+static uint64_t bat_ble_link_radio_us(const bat_ble_link_params_t *pParams, int64_t elapsed_us, uint64_t bytes)
+{
+    if (pParams->interval == 0 || elapsed_us <= 0)
+        return 0;
+
+    uint32_t tx_us = bat_ble_phy_octet_us(pParams->tx_phy);
+    uint32_t rx_us = bat_ble_phy_octet_us(pParams->rx_phy);
+    uint64_t events = (uint64_t)elapsed_us / ((uint32_t)pParams->interval * 1250);
+
+    // A peripheral with nothing to send may skip `latency` events in a row, a central attends every one.
+    if (!pParams->is_client && bytes == 0)
+        events /= (uint64_t)pParams->latency + 1;
+
+    // Every attended event exchanges at least one empty packet each way.
+    uint64_t radio_us = events * (BAT_BLE_LL_OVERHEAD_OCTETS * (tx_us + rx_us) + 2 * BAT_BLE_LL_IFS_US);
+
+    // Each data packet adds its payload and overhead, and an empty acknowledgement.
+    uint16_t octets = (pParams->tx_octets != 0) ? pParams->tx_octets : 27;
+    uint64_t packets = (bytes + octets - 1) / octets;
+    radio_us += bytes * tx_us +
+                packets * (BAT_BLE_LL_OVERHEAD_OCTETS * (tx_us + rx_us) + 2 * BAT_BLE_LL_IFS_US);
+    return radio_us;
+}
+
+// Called with the lock held, counts the span since the last call against the profile in effect.
+static void bat_ble_link_account(bat_ble_link_t *pLink, int64_t now_us)
+{
+    bat_ble_conn_usage_t *pUsage = &pLink->usage[pLink->params.profile];
+    int64_t elapsed_us = now_us - pLink->accounted_us;
+    if (elapsed_us <= 0)
+        return;
+
+    pUsage->time_us += (uint64_t)elapsed_us;
+    pUsage->bytes += pLink->unaccounted_bytes;
+    pUsage->radio_us += bat_ble_link_radio_us(&pLink->params, elapsed_us, pLink->unaccounted_bytes);
+    pLink->accounted_us = now_us;
+    pLink->unaccounted_bytes = 0;
+}
+
+// Called with the lock held, the profile whose parameters the link has, DEFAULT if none.
+static bat_ble_conn_profile_t bat_ble_conn_profile_match(uint16_t interval, uint16_t latency)
+{
+    for (int i = BAT_BLE_CONN_PROFILE_BULK; i < BAT_BLE_CONN_PROFILE_COUNT; ++i)
+    {
+        const bat_ble_conn_params_t *pParams = &g_conn_params[i];
+        if (interval >= pParams->min_interval && interval <= pParams->max_interval && latency == pParams->latency)
+            return (bat_ble_conn_profile_t)i;
+    }
+    return BAT_BLE_CONN_PROFILE_DEFAULT;
+}
+
+static void bat_ble_link_log_usage(const bat_ble_link_t *pLink)
+{
+    for (int i = 0; i < BAT_BLE_CONN_PROFILE_COUNT; ++i)
+    {
+        const bat_ble_conn_usage_t *pUsage = &pLink->usage[i];
+        if (pUsage->time_us == 0)
+            continue;
+
+        // Radio duty cycle in 0.1 % steps.
+        uint64_t duty = pUsage->radio_us * 1000 / pUsage->time_us;
+        ESP_LOGI(TAG, "conn_id: %d %s profile: %llu ms, %llu bytes, %llu bytes/s, radio duty ~%llu.%llu%% (estimate), "
+                      "entered %lu times",
+                 pLink->params.conn_id, g_profile_names[i], (unsigned long long)(pUsage->time_us / 1000),
+                 (unsigned long long)pUsage->bytes, (unsigned long long)(pUsage->bytes * 1000000 / pUsage->time_us),
+                 (unsigned long long)(duty / 10), (unsigned long long)(duty % 10), (unsigned long)pUsage->entered);
+    }
+}
+
+static void bat_ble_link_log(const bat_ble_link_params_t *pParams)
+{
+    ESP_LOGI(TAG, "conn_id: %d negotiated in %lld us: mtu %d, octets tx/rx %d/%d, phy tx/rx 0x%x/0x%x, "
+                  "interval %d (x1.25 ms), latency %d, timeout %d (x10 ms)",
+             pParams->conn_id, (long long)(pParams->settled_us - pParams->up_us), pParams->mtu,
+             pParams->tx_octets, pParams->rx_octets, pParams->tx_phy, pParams->rx_phy,
+             pParams->interval, pParams->latency, pParams->timeout);
+}
+
+esp_err_t bat_ble_throughput_set_profile(const bat_ble_throughput_profile_t *pProfile)
+{
+    if (pProfile == NULL)
+    {
+        g_profile_set = false;
+        return ESP_OK;
+    }
+
+    if ((pProfile->mtu != 0 && (pProfile->mtu < ESP_GATT_DEF_BLE_MTU_SIZE || pProfile->mtu > ESP_GATT_MAX_MTU_SIZE)) ||
+        (pProfile->tx_octets != 0 && (pProfile->tx_octets < 27 || pProfile->tx_octets > 251)) ||
+        pProfile->min_interval > pProfile->max_interval)
+        return ESP_ERR_INVALID_ARG;
+
+    if (pProfile->mtu != 0)
+    {
+        esp_err_t err = esp_ble_gatt_set_local_mtu(pProfile->mtu);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to set local MTU %d: %s", pProfile->mtu, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    g_profile = *pProfile;
+    g_profile_set = true;
+    return ESP_OK;
+}
+
+esp_err_t bat_ble_throughput_link_up(const esp_bd_addr_t bda, uint16_t conn_id, esp_gatt_if_t gattc_if)
+{
+    bat_ble_link_t *pLink = NULL;
+    uint8_t pending = 0;
+    bat_ble_throughput_profile_t profile = g_profile;
+    bool requested = g_profile_set;
+
+    if (requested)
+    {
+        if (profile.mtu != 0 && gattc_if != ESP_GATT_IF_NONE)
+            pending |= BAT_BLE_LINK_PENDING_MTU;
+        if (profile.tx_octets != 0)
+            pending |= BAT_BLE_LINK_PENDING_DLE;
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+        if (profile.phy_mask != 0)
+            pending |= BAT_BLE_LINK_PENDING_PHY;
+#endif
+        if (profile.max_interval != 0)
+            pending |= BAT_BLE_LINK_PENDING_CONN_PARAMS;
+    }
+
+    portENTER_CRITICAL(&g_lock);
+    pLink = bat_ble_link_find_bda(bda);
+    for (size_t i = 0; pLink == NULL && i < BAT_BLE_LINK_MAX; ++i)
+    {
+        if (!g_links[i].in_use)
+            pLink = &g_links[i];
+    }
+    if (pLink != NULL)
+    {
+        memset(pLink, 0, sizeof(*pLink));
+        pLink->in_use = true;
+        memcpy(pLink->params.bda, bda, sizeof(esp_bd_addr_t));
+        pLink->params.conn_id = conn_id;
+        pLink->params.is_client = gattc_if != ESP_GATT_IF_NONE;
+        pLink->params.mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+        pLink->params.tx_octets = 27;
+        pLink->params.rx_octets = 27;
+        pLink->params.tx_phy = BAT_BLE_PHY_1M;
+        pLink->params.rx_phy = BAT_BLE_PHY_1M;
+        pLink->params.pending = pending;
+        pLink->params.up_us = esp_timer_get_time();
+        pLink->accounted_us = pLink->params.up_us;
+        pLink->usage[BAT_BLE_CONN_PROFILE_DEFAULT].entered = 1;
+    }
+    portEXIT_CRITICAL(&g_lock);
+
+    if (pLink == NULL)
+    {
+        ESP_LOGW(TAG, "No link slot for conn_id: %d", conn_id);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Failed requests are logged and left pending, the link keeps the stack's defaults.
+    esp_err_t err = ESP_OK;
+    if (pending & BAT_BLE_LINK_PENDING_MTU)
+    {
+        err = esp_ble_gattc_send_mtu_req(gattc_if, conn_id);
+        if (err != ESP_OK)
+            ESP_LOGW(TAG, "MTU request on conn_id: %d failed: %s", conn_id, esp_err_to_name(err));
+    }
+
+    if (pending & BAT_BLE_LINK_PENDING_DLE)
+    {
+        err = esp_ble_gap_set_pkt_data_len((uint8_t *)bda, profile.tx_octets);
+        if (err != ESP_OK)
+            ESP_LOGW(TAG, "Data length request on conn_id: %d failed: %s", conn_id, esp_err_to_name(err));
+    }
+
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    if (pending & BAT_BLE_LINK_PENDING_PHY)
+    {
+        err = esp_ble_gap_set_preferred_phy((uint8_t *)bda, 0, profile.phy_mask, profile.phy_mask,
+                                            ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+        if (err != ESP_OK)
+            ESP_LOGW(TAG, "PHY request on conn_id: %d failed: %s", conn_id, esp_err_to_name(err));
+    }
+#endif
+
+    if (pending & BAT_BLE_LINK_PENDING_CONN_PARAMS)
+    {
+        esp_ble_conn_update_params_t conn_params = {
+            .min_int = profile.min_interval,
+            .max_int = profile.max_interval,
+            .latency = profile.latency,
+            .timeout = profile.timeout,
+        };
+        memcpy(conn_params.bda, bda, sizeof(esp_bd_addr_t));
+        err = esp_ble_gap_update_conn_params(&conn_params);
+        if (err != ESP_OK)
+            ESP_LOGW(TAG, "Connection parameter request on conn_id: %d failed: %s", conn_id, esp_err_to_name(err));
+    }
+
+    return ESP_OK;
+}
+
+void bat_ble_throughput_link_down(const esp_bd_addr_t bda)
+{
+    bat_ble_link_t closed;
+    bool log = false;
+
+    portENTER_CRITICAL(&g_lock);
+    bat_ble_link_t *pLink = bat_ble_link_find_bda(bda);
+    if (pLink != NULL)
+    {
+        bat_ble_link_account(pLink, esp_timer_get_time());
+        pLink->in_use = false;
+        closed = *pLink;
+        log = true;
+    }
+    portEXIT_CRITICAL(&g_lock);
+
+    if (log)
+        bat_ble_link_log_usage(&closed);
+}
+
+void bat_ble_throughput_on_mtu(uint16_t conn_id, uint16_t mtu)
+{
+    bat_ble_link_params_t settled;
+    bool log = false;
+
+    portENTER_CRITICAL(&g_lock);
+    bat_ble_link_t *pLink = bat_ble_link_find_conn(conn_id);
+    if (pLink != NULL)
+    {
+        pLink->params.mtu = mtu;
+        log = bat_ble_link_answered(pLink, BAT_BLE_LINK_PENDING_MTU);
+        settled = pLink->params;
+    }
+    portEXIT_CRITICAL(&g_lock);
+
+    if (log)
+        bat_ble_link_log(&settled);
+}
+
+void bat_ble_throughput_on_gap_event(esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t *pParam)
+{
+    bat_ble_link_params_t settled;
+    bat_ble_link_t *pLink = NULL;
+    bool log = false;
+    bool updated = false;
+    bool requested = false;
+    esp_bt_status_t status = ESP_BT_STATUS_SUCCESS;
+    int64_t answer_us = 0;
+
+    switch (event)
+    {
+    case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+        // The event does not say which link it answers, requests are answered in order.
+        portENTER_CRITICAL(&g_lock);
+        for (size_t i = 0; pLink == NULL && i < BAT_BLE_LINK_MAX; ++i)
+        {
+            if (g_links[i].in_use && (g_links[i].params.pending & BAT_BLE_LINK_PENDING_DLE))
+                pLink = &g_links[i];
+        }
+        if (pLink != NULL)
+        {
+            if (pParam->pkt_data_length_cmpl.status == ESP_BT_STATUS_SUCCESS)
+            {
+                pLink->params.tx_octets = pParam->pkt_data_length_cmpl.params.tx_len;
+                pLink->params.rx_octets = pParam->pkt_data_length_cmpl.params.rx_len;
+            }
+            log = bat_ble_link_answered(pLink, BAT_BLE_LINK_PENDING_DLE);
+            settled = pLink->params;
+        }
+        portEXIT_CRITICAL(&g_lock);
+        break;
+
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+        portENTER_CRITICAL(&g_lock);
+        pLink = bat_ble_link_find_bda(pParam->phy_update.bda);
+        if (pLink != NULL)
+        {
+            // The event reports PHY numbers (1M = 1, 2M = 2, Coded = 3), the link keeps mask bits.
+            if (pParam->phy_update.status == ESP_BT_STATUS_SUCCESS)
+            {
+                pLink->params.tx_phy = (uint8_t)(1u << (pParam->phy_update.tx_phy - 1));
+                pLink->params.rx_phy = (uint8_t)(1u << (pParam->phy_update.rx_phy - 1));
+            }
+            log = bat_ble_link_answered(pLink, BAT_BLE_LINK_PENDING_PHY);
+            settled = pLink->params;
+        }
+        portEXIT_CRITICAL(&g_lock);
+        break;
+#endif
+
+    case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+        portENTER_CRITICAL(&g_lock);
+        pLink = bat_ble_link_find_bda(pParam->update_conn_params.bda);
+        if (pLink != NULL)
+        {
+            int64_t now_us = esp_timer_get_time();
+            status = pParam->update_conn_params.status;
+            bat_ble_conn_profile_t profile = pLink->params.profile;
+
+            // The span up to the update ran with the old parameters.
+            bat_ble_link_account(pLink, now_us);
+            if (status == ESP_BT_STATUS_SUCCESS)
+            {
+                pLink->params.interval = pParam->update_conn_params.conn_int;
+                pLink->params.latency = pParam->update_conn_params.latency;
+                pLink->params.timeout = pParam->update_conn_params.timeout;
+                profile = bat_ble_conn_profile_match(pLink->params.interval, pLink->params.latency);
+            }
+
+            if (pLink->switch_us != 0)
+            {
+                // Answers a profile switch. A central may grant other parameters than asked for,
+                // they still serve the profile.
+                requested = true;
+                answer_us = now_us - pLink->switch_us;
+                pLink->switch_us = 0;
+                pLink->params.pending &= ~BAT_BLE_LINK_PENDING_CONN_PARAMS;
+                if (status != ESP_BT_STATUS_SUCCESS)
+                    pLink->retry_windows = BAT_BLE_CONN_POLICY_RETRY_WINDOWS;
+                else if (profile == BAT_BLE_CONN_PROFILE_DEFAULT)
+                    profile = pLink->params.requested;
+            }
+            else
+            {
+                // Answers the request of link up, or the peer changed the parameters.
+                log = bat_ble_link_answered(pLink, BAT_BLE_LINK_PENDING_CONN_PARAMS);
+                updated = !log && status == ESP_BT_STATUS_SUCCESS;
+            }
+
+            if (profile != pLink->params.profile)
+            {
+                pLink->params.profile = profile;
+                pLink->usage[profile].entered++;
+            }
+            pLink->params.requested = profile;
+            settled = pLink->params;
+        }
+        portEXIT_CRITICAL(&g_lock);
+        break;
+
+    default:
+        break;
+    }
+
+    if (log)
+        bat_ble_link_log(&settled);
+
+    if (requested && status != ESP_BT_STATUS_SUCCESS)
+        ESP_LOGW(TAG, "conn_id: %d connection parameter update refused in %lld us, status 0x%x, stays %s",
+                 settled.conn_id, (long long)answer_us, status, bat_ble_conn_profile_name(settled.profile));
+    else if (requested || updated)
+        ESP_LOGI(TAG, "conn_id: %d %s profile %s in %lld us: interval %d (x1.25 ms), latency %d, timeout %d (x10 ms)",
+                 settled.conn_id, bat_ble_conn_profile_name(settled.profile),
+                 requested ? "achieved" : "set by the peer", (long long)answer_us, settled.interval,
+                 settled.latency, settled.timeout);
+}
+
+esp_err_t bat_ble_throughput_set_conn_params(bat_ble_conn_profile_t profile, const bat_ble_conn_params_t *pParams)
+{
+    if (profile <= BAT_BLE_CONN_PROFILE_DEFAULT || profile >= BAT_BLE_CONN_PROFILE_COUNT || pParams == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    // Ranges of the Core specification, the timeout must outlast twice the longest the peripheral may stay away.
+    if (pParams->min_interval < 6 || pParams->min_interval > pParams->max_interval || pParams->max_interval > 3200 ||
+        pParams->latency > 499 || pParams->timeout < 10 || pParams->timeout > 3200 ||
+        (uint32_t)pParams->timeout * 4 <= ((uint32_t)pParams->latency + 1) * pParams->max_interval)
+        return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&g_lock);
+    g_conn_params[profile] = *pParams;
+    portEXIT_CRITICAL(&g_lock);
+    return ESP_OK;
+}
+
+esp_err_t bat_ble_throughput_request_conn_profile(uint16_t conn_id, bat_ble_conn_profile_t profile)
+{
+    if (profile <= BAT_BLE_CONN_PROFILE_DEFAULT || profile >= BAT_BLE_CONN_PROFILE_COUNT)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_ble_conn_update_params_t conn_params = {0};
+    esp_err_t err = ESP_OK;
+
+    portENTER_CRITICAL(&g_lock);
+    bat_ble_link_t *pLink = bat_ble_link_find_conn(conn_id);
+    if (pLink == NULL)
+        err = ESP_ERR_NOT_FOUND;
+    else if (pLink->params.pending & BAT_BLE_LINK_PENDING_CONN_PARAMS)
+        err = ESP_ERR_INVALID_STATE;
+    else
+    {
+        memcpy(conn_params.bda, pLink->params.bda, sizeof(esp_bd_addr_t));
+        conn_params.min_int = g_conn_params[profile].min_interval;
+        conn_params.max_int = g_conn_params[profile].max_interval;
+        conn_params.latency = g_conn_params[profile].latency;
+        conn_params.timeout = g_conn_params[profile].timeout;
+        pLink->params.requested = profile;
+        pLink->params.pending |= BAT_BLE_LINK_PENDING_CONN_PARAMS;
+        pLink->switch_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&g_lock);
+
+    if (err != ESP_OK)
+        return err;
+
+    err = esp_ble_gap_update_conn_params(&conn_params);
+    if (err != ESP_OK)
+    {
+        portENTER_CRITICAL(&g_lock);
+        pLink = bat_ble_link_find_conn(conn_id);
+        if (pLink != NULL)
+        {
+            pLink->params.requested = pLink->params.profile;
+            pLink->params.pending &= ~BAT_BLE_LINK_PENDING_CONN_PARAMS;
+            pLink->switch_us = 0;
+            pLink->retry_windows = BAT_BLE_CONN_POLICY_RETRY_WINDOWS;
+        }
+        portEXIT_CRITICAL(&g_lock);
+        ESP_LOGW(TAG, "%s profile request on conn_id: %d failed: %s", bat_ble_conn_profile_name(profile), conn_id,
+                 esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "conn_id: %d asks for the %s profile: interval %d-%d (x1.25 ms), latency %d, timeout %d (x10 ms)",
+             conn_id, bat_ble_conn_profile_name(profile), conn_params.min_int, conn_params.max_int,
+             conn_params.latency, conn_params.timeout);
+    return ESP_OK;
+}
+
+// Called with the lock held, the profile the traffic of the window calls for.
+static bat_ble_conn_profile_t bat_ble_conn_policy_target(bat_ble_link_t *pLink, const bat_ble_conn_policy_t *pPolicy)
+{
+    uint64_t rate = pLink->window_bytes * 1000 / pPolicy->window_ms;
+    bool idle = (pPolicy->idle_bytes_per_sec == 0) ? pLink->window_bytes == 0 : rate <= pPolicy->idle_bytes_per_sec;
+    bat_ble_conn_profile_t current = pLink->params.requested;
+
+    if (!idle)
+    {
+        pLink->idle_windows = 0;
+        return (rate >= pPolicy->bulk_bytes_per_sec) ? BAT_BLE_CONN_PROFILE_BULK : BAT_BLE_CONN_PROFILE_INTERACTIVE;
+    }
+
+    if (pLink->idle_windows < UINT8_MAX)
+        pLink->idle_windows++;
+    if (pLink->idle_windows >= pPolicy->idle_windows)
+        return BAT_BLE_CONN_PROFILE_LOW_POWER;
+
+    // A burst has ended, step down but keep answers quick until the link stays idle.
+    if (current == BAT_BLE_CONN_PROFILE_BULK || current == BAT_BLE_CONN_PROFILE_DEFAULT)
+        return BAT_BLE_CONN_PROFILE_INTERACTIVE;
+    return current;
+}
+
+static void bat_ble_conn_policy_tick(void *pArg)
+{
+    uint16_t conn_ids[BAT_BLE_LINK_MAX];
+    bat_ble_conn_profile_t targets[BAT_BLE_LINK_MAX];
+    uint64_t rates[BAT_BLE_LINK_MAX];
+    size_t count = 0;
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&g_lock);
+    bat_ble_conn_policy_t policy = g_policy;
+    for (size_t i = 0; g_policy_set && i < BAT_BLE_LINK_MAX; ++i)
+    {
+        bat_ble_link_t *pLink = &g_links[i];
+        if (!pLink->in_use)
+            continue;
+
+        bat_ble_link_account(pLink, now_us);
+        if (pLink->switch_us != 0 && now_us - pLink->switch_us > BAT_BLE_CONN_SWITCH_TIMEOUT_US)
+        {
+            // Never answered, the peer ignored the request.
+            pLink->params.requested = pLink->params.profile;
+            pLink->params.pending &= ~BAT_BLE_LINK_PENDING_CONN_PARAMS;
+            pLink->switch_us = 0;
+            pLink->retry_windows = BAT_BLE_CONN_POLICY_RETRY_WINDOWS;
+        }
+
+        uint64_t rate = pLink->window_bytes * 1000 / policy.window_ms;
+        bat_ble_conn_profile_t target = bat_ble_conn_policy_target(pLink, &policy);
+        pLink->window_bytes = 0;
+
+        if (pLink->retry_windows != 0)
+        {
+            pLink->retry_windows--;
+            continue;
+        }
+
+        if ((pLink->params.pending & BAT_BLE_LINK_PENDING_CONN_PARAMS) || target == pLink->params.requested)
+            continue;
+
+        conn_ids[count] = pLink->params.conn_id;
+        targets[count] = target;
+        rates[count] = rate;
+        count++;
+    }
+    portEXIT_CRITICAL(&g_lock);
+
+    // Requests leave the critical section, the GAP API posts to the Bluedroid task.
+    for (size_t i = 0; i < count; ++i)
+    {
+        ESP_LOGI(TAG, "conn_id: %d moves %llu bytes/s, switching to the %s profile", conn_ids[i],
+                 (unsigned long long)rates[i], bat_ble_conn_profile_name(targets[i]));
+        bat_ble_throughput_request_conn_profile(conn_ids[i], targets[i]);
+    }
+}
+
+esp_err_t bat_ble_throughput_set_conn_policy(const bat_ble_conn_policy_t *pPolicy)
+{
+    if (pPolicy == NULL)
+    {
+        portENTER_CRITICAL(&g_lock);
+        g_policy_set = false;
+        portEXIT_CRITICAL(&g_lock);
+        if (g_policy_timer != NULL)
+            esp_timer_stop(g_policy_timer);
+        return ESP_OK;
+    }
+
+    bat_ble_conn_policy_t policy = *pPolicy;
+    if (policy.window_ms == 0)
+        policy.window_ms = BAT_BLE_CONN_POLICY_DEFAULT_WINDOW_MS;
+    if (policy.bulk_bytes_per_sec == 0)
+        policy.bulk_bytes_per_sec = BAT_BLE_CONN_POLICY_DEFAULT_BULK_BPS;
+    if (policy.idle_windows == 0)
+        policy.idle_windows = BAT_BLE_CONN_POLICY_DEFAULT_IDLE_WINDOWS;
+    if (policy.bulk_bytes_per_sec <= policy.idle_bytes_per_sec)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_OK;
+    if (g_policy_timer == NULL)
+    {
+        const esp_timer_create_args_t args = {
+            .callback = bat_ble_conn_policy_tick,
+            .name = "bat_conn_policy",
+        };
+        err = esp_timer_create(&args, &g_policy_timer);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to create the connection policy timer: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+    else
+    {
+        esp_timer_stop(g_policy_timer);
+    }
+
+    // Windows restart with the new thresholds.
+    portENTER_CRITICAL(&g_lock);
+    g_policy = policy;
+    g_policy_set = true;
+    for (size_t i = 0; i < BAT_BLE_LINK_MAX; ++i)
+    {
+        g_links[i].window_bytes = 0;
+        g_links[i].idle_windows = 0;
+    }
+    portEXIT_CRITICAL(&g_lock);
+
+    err = esp_timer_start_periodic(g_policy_timer, (uint64_t)policy.window_ms * 1000);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "Failed to start the connection policy timer: %s", esp_err_to_name(err));
+    return err;
+}
+
+void bat_ble_throughput_on_traffic(uint16_t conn_id, size_t bytes)
+{
+    portENTER_CRITICAL(&g_lock);
+    bat_ble_link_t *pLink = bat_ble_link_find_conn(conn_id);
+    if (pLink != NULL)
+    {
+        pLink->unaccounted_bytes += bytes;
+        pLink->window_bytes += bytes;
+    }
+    portEXIT_CRITICAL(&g_lock);
+}
+
+esp_err_t bat_ble_throughput_get_usage(uint16_t conn_id, bat_ble_conn_usage_t *pUsage)
+{
+    if (pUsage == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    portENTER_CRITICAL(&g_lock);
+    bat_ble_link_t *pLink = bat_ble_link_find_conn(conn_id);
+    if (pLink != NULL)
+    {
+        bat_ble_link_account(pLink, esp_timer_get_time());
+        memcpy(pUsage, pLink->usage, sizeof(pLink->usage));
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&g_lock);
+    return err;
+}
+
+void bat_ble_throughput_log_usage(uint16_t conn_id)
+{
+    bat_ble_link_t copy;
+    bool log = false;
+
+    portENTER_CRITICAL(&g_lock);
+    bat_ble_link_t *pLink = bat_ble_link_find_conn(conn_id);
+    if (pLink != NULL)
+    {
+        bat_ble_link_account(pLink, esp_timer_get_time());
+        copy = *pLink;
+        log = true;
+    }
+    portEXIT_CRITICAL(&g_lock);
+
+    if (log)
+        bat_ble_link_log_usage(&copy);
+}
+
+const char *bat_ble_conn_profile_name(bat_ble_conn_profile_t profile)
+{
+    if (profile < 0 || profile >= BAT_BLE_CONN_PROFILE_COUNT)
+        return "unknown";
+    return g_profile_names[profile];
+}
+
+esp_err_t bat_ble_throughput_get_link(uint16_t conn_id, bat_ble_link_params_t *pParams)
+{
+    if (pParams == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    portENTER_CRITICAL(&g_lock);
+    bat_ble_link_t *pLink = bat_ble_link_find_conn(conn_id);
+    if (pLink != NULL)
+    {
+        *pParams = pLink->params;
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&g_lock);
+    return err;
+}
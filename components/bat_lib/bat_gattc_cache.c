@@ -0,0 +1,393 @@
+#include "bat_gattc_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+static const char *TAG = "bat_lib:gattc_cache";
+
+#define BAT_GATTC_CACHE_VERSION 1
+#define BAT_GATTC_CACHE_HEADER_LEN offsetof(bat_gattc_cache_entry_t, attrs)
+
+// Scratch space kept off the Bluedroid task stack, callers serialize access to the cache.
+static esp_gattc_db_elem_t s_db[BAT_GATTC_CACHE_ATTRS];
+static bat_gattc_cache_entry_t s_blob;
+
+// NVS keys are at most 15 characters, the BDA in hex takes 12.
+static void bat_gattc_cache_key(const esp_bd_addr_t bda, char *pszKey, size_t len)
+{
+    snprintf(pszKey, len, "%02x%02x%02x%02x%02x%02x", bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+}
+
+static size_t bat_gattc_cache_blob_len(const bat_gattc_cache_entry_t *pEntry)
+{
+    return BAT_GATTC_CACHE_HEADER_LEN + pEntry->count * sizeof(bat_gattc_cache_attr_t);
+}
+
+static void bat_gattc_cache_uuid128(const esp_bt_uuid_t *pUuid, uint8_t *pOut)
+{
+    bat_ble_uuid128_t uuid;
+    if (pUuid->len == ESP_UUID_LEN_128)
+    {
+        memcpy(pOut, pUuid->uuid.uuid128, ESP_UUID_LEN_128);
+        return;
+    }
+
+    // 16 and 32-bit UUIDs sit at bytes 12 to 15 of the Bluetooth Base UUID.
+    bat_ble_uuid16_to_uuid128(0, &uuid);
+    uint32_t value = (pUuid->len == ESP_UUID_LEN_32) ? pUuid->uuid.uuid32 : pUuid->uuid.uuid16;
+    uuid.uuid[12] = (uint8_t)value;
+    uuid.uuid[13] = (uint8_t)(value >> 8);
+    uuid.uuid[14] = (uint8_t)(value >> 16);
+    uuid.uuid[15] = (uint8_t)(value >> 24);
+    memcpy(pOut, uuid.uuid, ESP_UUID_LEN_128);
+}
+
+static bat_gattc_cache_entry_t *bat_gattc_cache_find_ram(bat_gattc_cache_t *pCache, const esp_bd_addr_t bda)
+{
+    for (size_t i = 0; i < BAT_GATTC_CACHE_PEERS; ++i)
+    {
+        bat_gattc_cache_entry_t *pEntry = &pCache->entries[i];
+        if (pEntry->count != 0 && memcmp(pEntry->bda, bda, sizeof(esp_bd_addr_t)) == 0)
+            return pEntry;
+    }
+    return NULL;
+}
+
+// A free slot, else the least recently used one. Evicted entries stay in NVS.
+static bat_gattc_cache_entry_t *bat_gattc_cache_victim(bat_gattc_cache_t *pCache)
+{
+    bat_gattc_cache_entry_t *pVictim = &pCache->entries[0];
+    for (size_t i = 0; i < BAT_GATTC_CACHE_PEERS; ++i)
+    {
+        bat_gattc_cache_entry_t *pEntry = &pCache->entries[i];
+        if (pEntry->count == 0)
+            return pEntry;
+        if (pEntry->last_used_us < pVictim->last_used_us)
+            pVictim = pEntry;
+    }
+    return pVictim;
+}
+
+static void bat_gattc_cache_erase_nvs(bat_gattc_cache_t *pCache, const esp_bd_addr_t bda)
+{
+    nvs_handle_t handle;
+    char key[16];
+    if (nvs_open(BAT_GATTC_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        pCache->nvs_errors++;
+        return;
+    }
+
+    bat_gattc_cache_key(bda, key, sizeof(key));
+    esp_err_t err = nvs_erase_key(handle, key);
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+        pCache->nvs_errors++;
+    nvs_close(handle);
+}
+
+static bat_gattc_cache_entry_t *bat_gattc_cache_load(bat_gattc_cache_t *pCache, const esp_bd_addr_t bda)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(BAT_GATTC_CACHE_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK)
+    {
+        // The namespace does not exist until the first entry is written.
+        if (err != ESP_ERR_NVS_NOT_FOUND)
+            pCache->nvs_errors++;
+        return NULL;
+    }
+
+    char key[16];
+    bat_gattc_cache_key(bda, key, sizeof(key));
+    size_t len = sizeof(s_blob);
+    memset(&s_blob, 0, sizeof(s_blob));
+    err = nvs_get_blob(handle, key, &s_blob, &len);
+    nvs_close(handle);
+
+    bool valid = (err == ESP_OK && len >= BAT_GATTC_CACHE_HEADER_LEN && s_blob.version == BAT_GATTC_CACHE_VERSION &&
+                  s_blob.count != 0 && s_blob.count <= BAT_GATTC_CACHE_ATTRS && len == bat_gattc_cache_blob_len(&s_blob) &&
+                  memcmp(s_blob.bda, bda, sizeof(esp_bd_addr_t)) == 0);
+    if (valid)
+    {
+        bat_gattc_cache_entry_t *pEntry = bat_gattc_cache_victim(pCache);
+        *pEntry = s_blob;
+        return pEntry;
+    }
+
+    if (err == ESP_OK)
+    {
+        ESP_LOGW(TAG, "Dropping cached database %s of another layout", key);
+        bat_gattc_cache_erase_nvs(pCache, bda);
+    }
+    else if (err != ESP_ERR_NVS_NOT_FOUND)
+    {
+        pCache->nvs_errors++;
+    }
+    return NULL;
+}
+
+esp_err_t bat_gattc_cache_init(bat_gattc_cache_t *pCache, bool persist)
+{
+    if (pCache == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pCache, 0, sizeof(*pCache));
+    pCache->persist = persist;
+    return ESP_OK;
+}
+
+void bat_gattc_cache_deinit(bat_gattc_cache_t *pCache)
+{
+    if (pCache == NULL)
+        return;
+
+    memset(pCache, 0, sizeof(*pCache));
+}
+
+bat_gattc_cache_entry_t *bat_gattc_cache_lookup(bat_gattc_cache_t *pCache, const esp_bd_addr_t bda)
+{
+    bat_gattc_cache_entry_t *pEntry = bat_gattc_cache_find_ram(pCache, bda);
+    if (pEntry == NULL && pCache->persist)
+        pEntry = bat_gattc_cache_load(pCache, bda);
+
+    if (pEntry != NULL)
+        pEntry->last_used_us = esp_timer_get_time();
+    return pEntry;
+}
+
+esp_err_t bat_gattc_cache_store(bat_gattc_cache_t *pCache, esp_gatt_if_t gattc_if, uint16_t conn_id,
+                                const esp_bd_addr_t bda, uint32_t discovery_us, bat_gattc_cache_entry_t **ppEntry)
+{
+    uint16_t count = 0;
+    if (esp_ble_gattc_get_attr_count(gattc_if, conn_id, ESP_GATT_DB_ALL, 0x0001, 0xffff, 0, &count) != ESP_GATT_OK ||
+        count == 0)
+        return ESP_FAIL;
+    if (count > BAT_GATTC_CACHE_ATTRS)
+        return ESP_ERR_INVALID_SIZE;
+    if (esp_ble_gattc_get_db(gattc_if, conn_id, 0x0001, 0xffff, s_db, &count) != ESP_GATT_OK || count == 0)
+        return ESP_FAIL;
+
+    bat_gattc_cache_entry_t *pEntry = bat_gattc_cache_find_ram(pCache, bda);
+    if (pEntry == NULL)
+        pEntry = bat_gattc_cache_victim(pCache);
+
+    memset(pEntry, 0, sizeof(*pEntry));
+    pEntry->version = BAT_GATTC_CACHE_VERSION;
+    memcpy(pEntry->bda, bda, sizeof(esp_bd_addr_t));
+    pEntry->discovery_us = discovery_us;
+    pEntry->last_used_us = esp_timer_get_time();
+    pEntry->count = count;
+
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        const esp_gattc_db_elem_t *pElem = &s_db[i];
+        bat_gattc_cache_attr_t *pAttr = &pEntry->attrs[i];
+        bat_gattc_cache_uuid128(&pElem->uuid, pAttr->uuid);
+        pAttr->type = (uint8_t)pElem->type;
+        if (pElem->type == ESP_GATT_DB_PRIMARY_SERVICE || pElem->type == ESP_GATT_DB_SECONDARY_SERVICE)
+        {
+            pAttr->handle = pElem->start_handle;
+            pAttr->end_handle = pElem->end_handle;
+        }
+        else
+        {
+            pAttr->handle = pElem->attribute_handle;
+            pAttr->end_handle = pElem->attribute_handle;
+            if (pElem->type == ESP_GATT_DB_CHARACTERISTIC)
+                pAttr->properties = (uint8_t)pElem->properties;
+        }
+
+        if (pElem->type == ESP_GATT_DB_CHARACTERISTIC && pElem->uuid.len == ESP_UUID_LEN_16 &&
+            pElem->uuid.uuid.uuid16 == BAT_GATTC_CACHE_HASH_UUID)
+            pEntry->hash_handle = pAttr->handle;
+    }
+
+    *ppEntry = pEntry;
+    return ESP_OK;
+}
+
+esp_err_t bat_gattc_cache_persist(bat_gattc_cache_t *pCache, const bat_gattc_cache_entry_t *pEntry)
+{
+    if (!pCache->persist)
+        return ESP_OK;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(BAT_GATTC_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        char key[16];
+        bat_gattc_cache_key(pEntry->bda, key, sizeof(key));
+        err = nvs_set_blob(handle, key, pEntry, bat_gattc_cache_blob_len(pEntry));
+        if (err == ESP_OK)
+            err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    if (err != ESP_OK)
+    {
+        pCache->nvs_errors++;
+        ESP_LOGW(TAG, "Cached database not persisted: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t bat_gattc_cache_set_hash(bat_gattc_cache_t *pCache, bat_gattc_cache_entry_t *pEntry,
+                                   const uint8_t *pHash, uint16_t len)
+{
+    if (pHash == NULL || len != BAT_GATTC_CACHE_HASH_LEN)
+        return ESP_ERR_INVALID_SIZE;
+
+    memcpy(pEntry->db_hash, pHash, BAT_GATTC_CACHE_HASH_LEN);
+    pEntry->has_hash = true;
+    return bat_gattc_cache_persist(pCache, pEntry);
+}
+
+bool bat_gattc_cache_hash_matches(const bat_gattc_cache_entry_t *pEntry, const uint8_t *pHash, uint16_t len)
+{
+    return pEntry->has_hash && pHash != NULL && len == BAT_GATTC_CACHE_HASH_LEN &&
+           memcmp(pEntry->db_hash, pHash, BAT_GATTC_CACHE_HASH_LEN) == 0;
+}
+
+bool bat_gattc_cache_invalidate(bat_gattc_cache_t *pCache, const esp_bd_addr_t bda)
+{
+    bool found = false;
+    bat_gattc_cache_entry_t *pEntry = bat_gattc_cache_find_ram(pCache, bda);
+    if (pEntry != NULL)
+    {
+        memset(pEntry, 0, sizeof(*pEntry));
+        found = true;
+    }
+
+    // The peer may only be in NVS.
+    if (pCache->persist)
+        bat_gattc_cache_erase_nvs(pCache, bda);
+
+    pCache->invalidations++;
+    return found;
+}
+
+esp_err_t bat_gattc_cache_clear(bat_gattc_cache_t *pCache)
+{
+    memset(pCache->entries, 0, sizeof(pCache->entries));
+    if (!pCache->persist)
+        return ESP_OK;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(BAT_GATTC_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+        return err;
+
+    err = nvs_erase_all(handle);
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+    nvs_close(handle);
+    return err;
+}
+
+uint32_t bat_gattc_cache_on_hit(bat_gattc_cache_t *pCache, const bat_gattc_cache_entry_t *pEntry, uint32_t spent_us)
+{
+    uint32_t saved_us = (pEntry->discovery_us > spent_us) ? pEntry->discovery_us - spent_us : 0;
+    pCache->hits++;
+    pCache->saved_us += saved_us;
+    pCache->last_saved_us = saved_us;
+    return saved_us;
+}
+
+void bat_gattc_cache_on_miss(bat_gattc_cache_t *pCache)
+{
+    pCache->misses++;
+}
+
+void bat_gattc_cache_get_stats(const bat_gattc_cache_t *pCache, bat_gattc_cache_stats_t *pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+    for (size_t i = 0; i < BAT_GATTC_CACHE_PEERS; ++i)
+    {
+        if (pCache->entries[i].count != 0)
+            pStats->entries++;
+    }
+
+    pStats->hits = pCache->hits;
+    pStats->misses = pCache->misses;
+    pStats->invalidations = pCache->invalidations;
+    pStats->nvs_errors = pCache->nvs_errors;
+    pStats->saved_us = pCache->saved_us;
+    pStats->last_saved_us = pCache->last_saved_us;
+}
+
+const bat_gattc_cache_attr_t *bat_gattc_cache_find_handle(const bat_gattc_cache_entry_t *pEntry, uint16_t handle)
+{
+    for (uint16_t i = 0; i < pEntry->count; ++i)
+    {
+        const bat_gattc_cache_attr_t *pAttr = &pEntry->attrs[i];
+        if (pAttr->handle == handle && pAttr->type != ESP_GATT_DB_PRIMARY_SERVICE && pAttr->type != ESP_GATT_DB_SECONDARY_SERVICE)
+            return pAttr;
+    }
+    return NULL;
+}
+
+const bat_gattc_cache_attr_t *bat_gattc_cache_find_owner(const bat_gattc_cache_entry_t *pEntry, uint16_t handle)
+{
+    for (uint16_t i = 0; i < pEntry->count; ++i)
+    {
+        const bat_gattc_cache_attr_t *pAttr = &pEntry->attrs[i];
+        if ((pAttr->type == ESP_GATT_DB_PRIMARY_SERVICE || pAttr->type == ESP_GATT_DB_SECONDARY_SERVICE) &&
+            handle >= pAttr->handle && handle <= pAttr->end_handle)
+            return pAttr;
+    }
+    return NULL;
+}
+
+const bat_gattc_cache_attr_t *bat_gattc_cache_find_service(const bat_gattc_cache_entry_t *pEntry,
+                                                           const bat_ble_uuid128_t *pUuid)
+{
+    for (uint16_t i = 0; i < pEntry->count; ++i)
+    {
+        const bat_gattc_cache_attr_t *pAttr = &pEntry->attrs[i];
+        if (pAttr->type == ESP_GATT_DB_PRIMARY_SERVICE && memcmp(pAttr->uuid, pUuid->uuid, ESP_UUID_LEN_128) == 0)
+            return pAttr;
+    }
+    return NULL;
+}
+
+const bat_gattc_cache_attr_t *bat_gattc_cache_find_char(const bat_gattc_cache_entry_t *pEntry,
+                                                        const bat_gattc_cache_attr_t *pService,
+                                                        const bat_ble_uuid128_t *pUuid)
+{
+    for (uint16_t i = 0; i < pEntry->count; ++i)
+    {
+        const bat_gattc_cache_attr_t *pAttr = &pEntry->attrs[i];
+        if (pAttr->type == ESP_GATT_DB_CHARACTERISTIC && pAttr->handle >= pService->handle &&
+            pAttr->handle <= pService->end_handle && memcmp(pAttr->uuid, pUuid->uuid, ESP_UUID_LEN_128) == 0)
+            return pAttr;
+    }
+    return NULL;
+}
+
+const bat_gattc_cache_attr_t *bat_gattc_cache_find_descr(const bat_gattc_cache_entry_t *pEntry,
+                                                         const bat_gattc_cache_attr_t *pService,
+                                                         const bat_gattc_cache_attr_t *pChar,
+                                                         const bat_ble_uuid128_t *pUuid)
+{
+    // A characteristic's descriptors run up to the next characteristic of the service.
+    uint16_t end_handle = pService->end_handle;
+    for (uint16_t i = 0; i < pEntry->count; ++i)
+    {
+        const bat_gattc_cache_attr_t *pAttr = &pEntry->attrs[i];
+        if (pAttr->type == ESP_GATT_DB_CHARACTERISTIC && pAttr->handle > pChar->handle && pAttr->handle <= end_handle)
+            end_handle = pAttr->handle - 1;
+    }
+
+    for (uint16_t i = 0; i < pEntry->count; ++i)
+    {
+        const bat_gattc_cache_attr_t *pAttr = &pEntry->attrs[i];
+        if (pAttr->type == ESP_GATT_DB_DESCRIPTOR && pAttr->handle > pChar->handle && pAttr->handle <= end_handle &&
+            memcmp(pAttr->uuid, pUuid->uuid, ESP_UUID_LEN_128) == 0)
+            return pAttr;
+    }
+    return NULL;
+}
@@ -0,0 +1,216 @@
+#include "bat_gattc_conn.h"
+#include <string.h>
+#include "esp_timer.h"
+
+static void bat_gattc_conn_free(bat_gattc_conn_table_t *pTable, bat_gattc_link_t *pLink)
+{
+    if (pTable->pOpening == pLink)
+        pTable->pOpening = NULL;
+    memset(pLink, 0, sizeof(*pLink));
+    pTable->count--;
+}
+
+esp_err_t bat_gattc_conn_table_init(bat_gattc_conn_table_t *pTable, uint8_t max_retries, size_t samples)
+{
+    if (pTable == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pTable, 0, sizeof(*pTable));
+    pTable->max_retries = max_retries;
+    return bat_bench_init(&pTable->traffic, (samples == 0) ? BAT_GATTC_CONN_DEFAULT_SAMPLES : samples);
+}
+
+void bat_gattc_conn_table_deinit(bat_gattc_conn_table_t *pTable)
+{
+    if (pTable == NULL)
+        return;
+
+    bat_bench_free(&pTable->traffic);
+    memset(pTable, 0, sizeof(*pTable));
+}
+
+bat_gattc_link_t *bat_gattc_conn_find(bat_gattc_conn_table_t *pTable, const esp_bd_addr_t bda)
+{
+    for (size_t i = 0; i < BAT_GATTC_CONN_MAX; ++i)
+    {
+        bat_gattc_link_t *pLink = &pTable->links[i];
+        if (pLink->state != BAT_GATTC_LINK_FREE && memcmp(pLink->bda, bda, sizeof(esp_bd_addr_t)) == 0)
+            return pLink;
+    }
+    return NULL;
+}
+
+bat_gattc_link_t *bat_gattc_conn_get(bat_gattc_conn_table_t *pTable, uint16_t conn_id)
+{
+    if (conn_id == BAT_GATTC_CONN_NONE)
+        return NULL;
+
+    for (size_t i = 0; i < BAT_GATTC_CONN_MAX; ++i)
+    {
+        bat_gattc_link_t *pLink = &pTable->links[i];
+        if (pLink->state >= BAT_GATTC_LINK_DISCOVERING && pLink->conn_id == conn_id)
+            return pLink;
+    }
+    return NULL;
+}
+
+bat_gattc_link_t *bat_gattc_conn_add(bat_gattc_conn_table_t *pTable, const esp_bd_addr_t bda,
+                                     esp_ble_addr_type_t addr_type, esp_gatt_if_t gattc_if, void *pContext)
+{
+    bat_gattc_link_t *pLink = bat_gattc_conn_find(pTable, bda);
+    if (pLink != NULL)
+        return pLink;
+
+    for (size_t i = 0; i < BAT_GATTC_CONN_MAX; ++i)
+    {
+        pLink = &pTable->links[i];
+        if (pLink->state != BAT_GATTC_LINK_FREE)
+            continue;
+
+        memset(pLink, 0, sizeof(*pLink));
+        pLink->state = BAT_GATTC_LINK_SCAN_HIT;
+        memcpy(pLink->bda, bda, sizeof(esp_bd_addr_t));
+        pLink->addr_type = addr_type;
+        pLink->gattc_if = gattc_if;
+        pLink->conn_id = BAT_GATTC_CONN_NONE;
+        pLink->mtu = BAT_GATTC_CONN_DEFAULT_MTU;
+        pLink->retries_left = pTable->max_retries;
+        pLink->pContext = pContext;
+        pLink->hit_us = esp_timer_get_time();
+        pTable->count++;
+        return pLink;
+    }
+    return NULL;
+}
+
+bat_gattc_link_t *bat_gattc_conn_next_to_open(bat_gattc_conn_table_t *pTable)
+{
+    if (pTable->pOpening != NULL)
+        return NULL;
+
+    // Oldest scan hit first.
+    bat_gattc_link_t *pNext = NULL;
+    for (size_t i = 0; i < BAT_GATTC_CONN_MAX; ++i)
+    {
+        bat_gattc_link_t *pLink = &pTable->links[i];
+        if (pLink->state == BAT_GATTC_LINK_SCAN_HIT && (pNext == NULL || pLink->hit_us < pNext->hit_us))
+            pNext = pLink;
+    }
+
+    if (pNext != NULL)
+    {
+        pNext->state = BAT_GATTC_LINK_CONNECTING;
+        pTable->pOpening = pNext;
+    }
+    return pNext;
+}
+
+bat_gattc_link_t *bat_gattc_conn_on_open(bat_gattc_conn_table_t *pTable, const esp_bd_addr_t bda,
+                                         uint16_t conn_id, uint16_t mtu, bool success)
+{
+    bat_gattc_link_t *pLink = bat_gattc_conn_find(pTable, bda);
+    if (pLink == NULL)
+        return NULL;
+    if (pTable->pOpening == pLink)
+        pTable->pOpening = NULL;
+
+    if (!success)
+    {
+        pTable->connect_failures++;
+        if (pLink->state == BAT_GATTC_LINK_CONNECTING && pLink->retries_left > 0)
+        {
+            pLink->retries_left--;
+            pLink->state = BAT_GATTC_LINK_SCAN_HIT;
+            return pLink;
+        }
+
+        bat_gattc_conn_free(pTable, pLink);
+        return NULL;
+    }
+
+    pLink->state = BAT_GATTC_LINK_DISCOVERING;
+    pLink->conn_id = conn_id;
+    pLink->mtu = mtu;
+    pLink->open_us = esp_timer_get_time();
+    return pLink;
+}
+
+bat_gattc_link_t *bat_gattc_conn_on_ready(bat_gattc_conn_table_t *pTable, uint16_t conn_id)
+{
+    bat_gattc_link_t *pLink = bat_gattc_conn_get(pTable, conn_id);
+    if (pLink == NULL || pLink->state == BAT_GATTC_LINK_READY)
+        return pLink;
+
+    pLink->state = BAT_GATTC_LINK_READY;
+    pLink->ready_us = esp_timer_get_time();
+
+    uint32_t connect_us = (uint32_t)(pLink->ready_us - pLink->hit_us);
+    pTable->connects++;
+    pTable->connect_sum_us += connect_us;
+    if (connect_us > pTable->connect_max_us)
+        pTable->connect_max_us = connect_us;
+    return pLink;
+}
+
+bool bat_gattc_conn_on_close(bat_gattc_conn_table_t *pTable, const esp_bd_addr_t bda)
+{
+    bat_gattc_link_t *pLink = bat_gattc_conn_find(pTable, bda);
+    if (pLink == NULL)
+        return false;
+
+    if (pLink->state >= BAT_GATTC_LINK_DISCOVERING)
+        pTable->disconnects++;
+    bat_gattc_conn_free(pTable, pLink);
+    return true;
+}
+
+void bat_gattc_conn_record(bat_gattc_conn_table_t *pTable, bat_gattc_link_t *pLink, uint32_t latency_us, size_t bytes)
+{
+    pLink->ops++;
+    pLink->bytes += bytes;
+    pLink->latency_sum_us += latency_us;
+    if (latency_us > pLink->latency_max_us)
+        pLink->latency_max_us = latency_us;
+
+    // The clock starts with the first operation after a reset.
+    if (pTable->traffic.start_us == 0)
+        bat_bench_start(&pTable->traffic);
+    bat_bench_record(&pTable->traffic, latency_us, bytes);
+}
+
+void bat_gattc_conn_get_stats(bat_gattc_conn_table_t *pTable, bat_gattc_conn_stats_t *pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+    pStats->links = pTable->count;
+    for (size_t i = 0; i < BAT_GATTC_CONN_MAX; ++i)
+    {
+        if (pTable->links[i].state == BAT_GATTC_LINK_READY)
+            pStats->ready++;
+    }
+
+    pStats->connects = pTable->connects;
+    pStats->connect_failures = pTable->connect_failures;
+    pStats->disconnects = pTable->disconnects;
+    pStats->connect_max_us = pTable->connect_max_us;
+    if (pTable->connects != 0)
+        pStats->connect_avg_us = (uint32_t)(pTable->connect_sum_us / pTable->connects);
+    if (pTable->traffic.start_us != 0)
+        bat_bench_get_report(&pTable->traffic, &pStats->traffic);
+}
+
+void bat_gattc_conn_reset_traffic(bat_gattc_conn_table_t *pTable)
+{
+    pTable->traffic.sample_count = 0;
+    pTable->traffic.ops = 0;
+    pTable->traffic.bytes = 0;
+    pTable->traffic.start_us = 0;
+    pTable->traffic.stop_us = 0;
+    for (size_t i = 0; i < BAT_GATTC_CONN_MAX; ++i)
+    {
+        bat_gattc_link_t *pLink = &pTable->links[i];
+        pLink->ops = 0;
+        pLink->bytes = 0;
+        pLink->latency_sum_us = 0;
+        pLink->latency_max_us = 0;
+    }
+}
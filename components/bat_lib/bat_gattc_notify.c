@@ -0,0 +1,126 @@
+#include "bat_gattc_notify.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+
+esp_err_t bat_gattc_notify_open(bat_gattc_sub_t *pSub, const bat_gattc_sub_config_t *pConfig)
+{
+    if (pSub == NULL || pConfig == NULL || pConfig->slot_size == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    size_t slots = (pConfig->slots != 0) ? pConfig->slots : BAT_GATTC_NOTIFY_DEFAULT_SLOTS;
+    if ((slots & (slots - 1)) != 0 || slots > UINT32_MAX / 2)
+        return ESP_ERR_INVALID_ARG;
+
+    // Slot bookkeeping first, int64_t aligned, then the value bytes.
+    uint8_t *pBlock = (uint8_t *)calloc(slots, sizeof(bat_gattc_notify_slot_t) + pConfig->slot_size);
+    if (pBlock == NULL)
+        return ESP_ERR_NO_MEM;
+
+    memset(pSub, 0, sizeof(*pSub));
+    pSub->consumer = pConfig->consumer;
+    pSub->pContext = pConfig->pContext;
+    pSub->indicate = pConfig->indicate;
+    pSub->ring.pSlots = (bat_gattc_notify_slot_t *)pBlock;
+    pSub->ring.pData = pBlock + slots * sizeof(bat_gattc_notify_slot_t);
+    pSub->ring.mask = (uint32_t)(slots - 1);
+    pSub->ring.slot_size = pConfig->slot_size;
+    return ESP_OK;
+}
+
+void bat_gattc_notify_close(bat_gattc_sub_t *pSub)
+{
+    free(pSub->ring.pSlots);
+    memset(pSub, 0, sizeof(*pSub));
+}
+
+bool bat_gattc_notify_push(bat_gattc_sub_t *pSub, const uint8_t *pValue, uint16_t len)
+{
+    bat_gattc_notify_ring_t *pRing = &pSub->ring;
+    uint32_t head = pRing->head;
+    uint32_t tail = __atomic_load_n(&pRing->tail, __ATOMIC_ACQUIRE);
+    pSub->received++;
+    if (head - tail > pRing->mask)
+    {
+        pSub->dropped++;
+        return false;
+    }
+
+    uint32_t index = head & pRing->mask;
+    bat_gattc_notify_slot_t *pSlot = &pRing->pSlots[index];
+    pSlot->received_us = esp_timer_get_time();
+    pSlot->value_len = len;
+    pSlot->len = (len <= pRing->slot_size) ? len : pRing->slot_size;
+    if (pSlot->len < len)
+        pSub->truncated++;
+    memcpy(&pRing->pData[(size_t)index * pRing->slot_size], pValue, pSlot->len);
+
+    // The slot is written before the consumer can see it.
+    __atomic_store_n(&pRing->head, head + 1, __ATOMIC_RELEASE);
+    if (head + 1 - tail > pSub->high_water)
+        pSub->high_water = head + 1 - tail;
+
+    // A consumer finding the ring non-empty drains it before waiting again, only the first value wakes it.
+    if (head == tail && pSub->consumer != NULL)
+        xTaskNotifyGive(pSub->consumer);
+    return true;
+}
+
+size_t bat_gattc_notify_peek(const bat_gattc_sub_t *pSub, bat_gattc_notify_msg_t *pMsgs, size_t max_msgs)
+{
+    const bat_gattc_notify_ring_t *pRing = &pSub->ring;
+    uint32_t tail = pRing->tail;
+    uint32_t head = __atomic_load_n(&pRing->head, __ATOMIC_ACQUIRE);
+    size_t count = head - tail;
+    if (count > max_msgs)
+        count = max_msgs;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t index = (tail + (uint32_t)i) & pRing->mask;
+        const bat_gattc_notify_slot_t *pSlot = &pRing->pSlots[index];
+        pMsgs[i].pValue = &pRing->pData[(size_t)index * pRing->slot_size];
+        pMsgs[i].len = pSlot->len;
+        pMsgs[i].value_len = pSlot->value_len;
+        pMsgs[i].received_us = pSlot->received_us;
+    }
+    return count;
+}
+
+void bat_gattc_notify_release(bat_gattc_sub_t *pSub, size_t count)
+{
+    bat_gattc_notify_ring_t *pRing = &pSub->ring;
+    uint32_t tail = pRing->tail;
+    uint32_t head = __atomic_load_n(&pRing->head, __ATOMIC_ACQUIRE);
+    if (count > head - tail)
+        count = head - tail;
+
+    // The values are read before the producer may overwrite them.
+    __atomic_store_n(&pRing->tail, tail + (uint32_t)count, __ATOMIC_RELEASE);
+}
+
+size_t bat_gattc_notify_pending(const bat_gattc_sub_t *pSub)
+{
+    return __atomic_load_n(&pSub->ring.head, __ATOMIC_ACQUIRE) - __atomic_load_n(&pSub->ring.tail, __ATOMIC_ACQUIRE);
+}
+
+size_t bat_gattc_notify_wait(const bat_gattc_sub_t *pSub, TickType_t ticks_to_wait)
+{
+    size_t pending = bat_gattc_notify_pending(pSub);
+    if (pending != 0)
+        return pending;
+
+    // The producer gives the notification for a value pushed into the empty ring, even one pushed
+    // since the check above, so it cannot be slept through.
+    ulTaskNotifyTake(pdTRUE, ticks_to_wait);
+    return bat_gattc_notify_pending(pSub);
+}
+
+void bat_gattc_notify_get_stats(const bat_gattc_sub_t *pSub, bat_gattc_notify_stats_t *pStats)
+{
+    pStats->received = pSub->received;
+    pStats->dropped = pSub->dropped;
+    pStats->truncated = pSub->truncated;
+    pStats->pending = bat_gattc_notify_pending(pSub);
+    pStats->high_water = pSub->high_water;
+}
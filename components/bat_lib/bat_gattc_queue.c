@@ -0,0 +1,128 @@
+#include "bat_gattc_queue.h"
+#include <string.h>
+#include "esp_timer.h"
+
+static void bat_gattc_queue_pop(bat_gattc_queue_t *pQueue, bat_gattc_op_result_t *pResult, esp_gatt_status_t status)
+{
+    memset(pResult, 0, sizeof(*pResult));
+    pResult->op = pQueue->ops[pQueue->head];
+    pResult->conn_id = pQueue->conn_id;
+    pResult->status = status;
+
+    pQueue->head = (pQueue->head + 1) % BAT_GATTC_QUEUE_DEPTH;
+    pQueue->count--;
+    pQueue->in_flight = false;
+    if (status == ESP_GATT_OK)
+        pQueue->completed++;
+    else
+        pQueue->failed++;
+}
+
+void bat_gattc_queue_open(bat_gattc_queue_t *pQueue, esp_gatt_if_t gattc_if, uint16_t conn_id)
+{
+    memset(pQueue, 0, sizeof(*pQueue));
+    pQueue->open = true;
+    pQueue->gattc_if = gattc_if;
+    pQueue->conn_id = conn_id;
+}
+
+void bat_gattc_queue_close(bat_gattc_queue_t *pQueue)
+{
+    pQueue->open = false;
+}
+
+size_t bat_gattc_queue_space(const bat_gattc_queue_t *pQueue)
+{
+    return pQueue->open ? BAT_GATTC_QUEUE_DEPTH - pQueue->count : 0;
+}
+
+esp_err_t bat_gattc_queue_push(bat_gattc_queue_t *pQueue, const bat_gattc_op_t *pOp)
+{
+    if (!pQueue->open)
+        return ESP_ERR_INVALID_STATE;
+    if (pQueue->count == BAT_GATTC_QUEUE_DEPTH)
+        return ESP_ERR_NO_MEM;
+
+    pQueue->ops[(pQueue->head + pQueue->count) % BAT_GATTC_QUEUE_DEPTH] = *pOp;
+    pQueue->count++;
+    if (pQueue->count > pQueue->high_water)
+        pQueue->high_water = pQueue->count;
+    return ESP_OK;
+}
+
+esp_err_t bat_gattc_queue_issue(bat_gattc_queue_t *pQueue, bat_gattc_op_result_t *pFailed)
+{
+    if (!pQueue->open || pQueue->in_flight || pQueue->count == 0)
+        return ESP_OK;
+    if (pQueue->congested)
+    {
+        pQueue->congestion_stalls++;
+        return ESP_OK;
+    }
+
+    // Bluedroid copies write data into its own message, the buffer is only read here.
+    const bat_gattc_op_t *pOp = &pQueue->ops[pQueue->head];
+    esp_err_t err;
+    if (pOp->type == BAT_GATTC_OP_READ)
+        err = esp_ble_gattc_read_char(pQueue->gattc_if, pQueue->conn_id, pOp->handle, ESP_GATT_AUTH_REQ_NONE);
+    else
+        err = esp_ble_gattc_write_char(pQueue->gattc_if, pQueue->conn_id, pOp->handle, pOp->len, (uint8_t *)pOp->pData,
+                                       (pOp->type == BAT_GATTC_OP_WRITE_NO_RSP) ? ESP_GATT_WRITE_TYPE_NO_RSP : ESP_GATT_WRITE_TYPE_RSP,
+                                       ESP_GATT_AUTH_REQ_NONE);
+
+    if (err != ESP_OK)
+    {
+        bat_gattc_queue_pop(pQueue, pFailed, ESP_GATT_ERROR);
+        return err;
+    }
+
+    pQueue->in_flight = true;
+    pQueue->issued_us = esp_timer_get_time();
+    pQueue->issued++;
+    return ESP_OK;
+}
+
+bool bat_gattc_queue_complete(bat_gattc_queue_t *pQueue, bool is_read, uint16_t handle, esp_gatt_status_t status,
+                              const uint8_t *pValue, uint16_t value_len, bat_gattc_op_result_t *pResult)
+{
+    if (!pQueue->in_flight)
+        return false;
+
+    const bat_gattc_op_t *pOp = &pQueue->ops[pQueue->head];
+    if (pOp->handle != handle || (pOp->type == BAT_GATTC_OP_READ) != is_read)
+        return false;
+
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - pQueue->issued_us);
+    bat_gattc_queue_pop(pQueue, pResult, status);
+    pResult->latency_us = latency_us;
+    if (is_read && status == ESP_GATT_OK)
+    {
+        pResult->pValue = pValue;
+        pResult->value_len = value_len;
+    }
+    return true;
+}
+
+void bat_gattc_queue_set_congested(bat_gattc_queue_t *pQueue, bool congested)
+{
+    pQueue->congested = congested;
+}
+
+bool bat_gattc_queue_flush(bat_gattc_queue_t *pQueue, bat_gattc_op_result_t *pResult)
+{
+    if (pQueue->open || pQueue->count == 0)
+        return false;
+
+    bat_gattc_queue_pop(pQueue, pResult, ESP_GATT_ERROR);
+    return true;
+}
+
+void bat_gattc_queue_get_stats(const bat_gattc_queue_t *pQueue, bat_gattc_queue_stats_t *pStats)
+{
+    pStats->queued = pQueue->count;
+    pStats->high_water = pQueue->high_water;
+    pStats->issued = pQueue->issued;
+    pStats->completed = pQueue->completed;
+    pStats->failed = pQueue->failed;
+    pStats->congestion_stalls = pQueue->congestion_stalls;
+}
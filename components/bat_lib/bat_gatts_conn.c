@@ -0,0 +1,71 @@
+#include "bat_gatts_conn.h"
+#include <string.h>
+#include "esp_timer.h"
+
+// Clears the fields the table and the server own. The CCCD and pacing fields are left to the
+// notification engine, which changes them under its lock.
+static void bat_gatts_conn_clear(bat_gatts_conn_t *pConn)
+{
+    pConn->in_use = false;
+    pConn->gatts_if = 0;
+    pConn->conn_id = 0;
+    memset(pConn->remote_bda, 0, sizeof(pConn->remote_bda));
+    pConn->mtu = 0;
+    pConn->connected_us = 0;
+
+    pConn->reads = 0;
+    pConn->writes = 0;
+    pConn->rx_bytes = 0;
+    pConn->tx_bytes = 0;
+
+    pConn->pPrepBuf = NULL;
+    pConn->prep_handle = 0;
+    pConn->prep_len = 0;
+    pConn->prep_status = ESP_GATT_OK;
+}
+
+void bat_gatts_conn_table_init(bat_gatts_conn_table_t *pTable, size_t max_conns)
+{
+    memset(pTable, 0, sizeof(*pTable));
+    pTable->max_conns = (max_conns == 0 || max_conns > BAT_GATTS_CONN_MAX) ? BAT_GATTS_CONN_MAX : max_conns;
+}
+
+bat_gatts_conn_t *bat_gatts_conn_open(bat_gatts_conn_table_t *pTable, esp_gatt_if_t gatts_if, uint16_t conn_id,
+                                      const esp_bd_addr_t remote_bda, bool *pOpened)
+{
+    if (pOpened != NULL)
+        *pOpened = false;
+    if (conn_id >= BAT_GATTS_CONN_MAX)
+        return NULL;
+
+    // Every registered interface reports the same link, only the first one opens it.
+    bat_gatts_conn_t *pConn = &pTable->slots[conn_id];
+    if (pConn->in_use)
+        return pConn;
+    if (!bat_gatts_conn_has_free_slot(pTable))
+        return NULL;
+
+    bat_gatts_conn_clear(pConn);
+    pConn->in_use = true;
+    pConn->gatts_if = gatts_if;
+    pConn->conn_id = conn_id;
+    memcpy(pConn->remote_bda, remote_bda, sizeof(esp_bd_addr_t));
+    pConn->mtu = BAT_GATTS_CONN_DEFAULT_MTU;
+    pConn->connected_us = esp_timer_get_time();
+    pTable->count++;
+
+    if (pOpened != NULL)
+        *pOpened = true;
+    return pConn;
+}
+
+bool bat_gatts_conn_close(bat_gatts_conn_table_t *pTable, uint16_t conn_id)
+{
+    bat_gatts_conn_t *pConn = bat_gatts_conn_get(pTable, conn_id);
+    if (pConn == NULL)
+        return false;
+
+    bat_gatts_conn_clear(pConn);
+    pTable->count--;
+    return true;
+}
@@ -0,0 +1,515 @@
+#include "bat_gatts_notify.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "bat_ble_server.h"
+#include "bat_ble_throughput.h"
+
+static const char *TAG = "bat_lib:gatts_notify";
+
+#define BAT_CCCD_NOTIFY 0x0001
+#define BAT_CCCD_INDICATE 0x0002
+
+static int bat_gatts_notify_find_char(const bat_gatts_notify_t *pNotify, uint16_t value_handle)
+{
+    for (size_t c = 0; c < pNotify->char_count; ++c)
+    {
+        if (pNotify->pChars[c].value_handle == value_handle)
+            return (int)c;
+    }
+    return -1;
+}
+
+// First set bit at or after start, wrapping around. mask must not be 0.
+static size_t bat_gatts_notify_pick(uint32_t mask, size_t start)
+{
+    uint32_t from_start = mask & ~((1u << start) - 1u);
+    return (size_t)__builtin_ctz(from_start != 0 ? from_start : mask);
+}
+
+// Values up to this length are copied to a local buffer for the send, longer ones to the heap.
+#define BAT_GATTS_NOTIFY_INLINE_LEN 64
+
+/**
+ * @brief A value claimed for sending, copied out so the lock can be released during the send.
+ */
+typedef struct {
+    esp_gatt_if_t gatts_if;
+    uint16_t conn_id;
+    uint16_t value_handle;
+    uint16_t len;
+    uint8_t char_index;
+    bool indicate;
+    uint8_t *pValue;                     ///< `inline_value` or a heap copy.
+    uint8_t inline_value[BAT_GATTS_NOTIFY_INLINE_LEN];
+} bat_gatts_notify_send_t;
+
+// Starts the retry timer unless it already runs. Called with the lock held.
+static void bat_gatts_notify_arm_retry(bat_gatts_notify_t *pNotify)
+{
+    if (pNotify->retry_armed || pNotify->retry_timer == NULL)
+        return;
+    if (esp_timer_start_once(pNotify->retry_timer, pNotify->retry_us) == ESP_OK)
+        pNotify->retry_armed = true;
+}
+
+// Picks the next pending value of a connection and reserves its send slot, so a concurrent pump
+// neither sends it twice nor overruns the window. Called with the lock held.
+static bool bat_gatts_notify_claim(bat_gatts_notify_t *pNotify, uint16_t conn_id, bat_gatts_notify_send_t *pSend)
+{
+    bat_gatts_conn_t *pConn = bat_gatts_conn_get(pNotify->pConnTable, conn_id);
+    if (pConn == NULL || pConn->pending_mask == 0 || pConn->congested || pConn->in_flight >= pNotify->max_in_flight)
+        return false;
+
+    uint32_t sendable = pConn->pending_mask;
+    if (pConn->indication_pending)
+        sendable &= pConn->notify_mask;
+    if (sendable == 0)
+        return false;
+
+    size_t c = bat_gatts_notify_pick(sendable, pConn->next_char);
+    uint32_t bit = 1u << c;
+    bat_gatts_notify_char_t *pChar = &pNotify->pChars[c];
+
+    pSend->pValue = (pChar->len <= sizeof(pSend->inline_value)) ? pSend->inline_value : (uint8_t *)malloc(pChar->len);
+    if (pSend->pValue == NULL)
+    {
+        // The value stays pending for the retry.
+        pNotify->send_errors++;
+        bat_gatts_notify_arm_retry(pNotify);
+        return false;
+    }
+    memcpy(pSend->pValue, pChar->pValue, pChar->len);
+    pSend->gatts_if = pConn->gatts_if;
+    pSend->conn_id = conn_id;
+    pSend->value_handle = pChar->value_handle;
+    pSend->len = pChar->len;
+    pSend->char_index = (uint8_t)c;
+    // A client subscribed to both gets notifications, they do not wait for a confirmation.
+    pSend->indicate = (pConn->notify_mask & bit) == 0;
+
+    pConn->pending_mask &= ~bit;
+    pConn->next_char = (uint8_t)((c + 1) % BAT_GATTS_NOTIFY_MAX_CHARS);
+    pConn->in_flight++;
+    if (pSend->indicate)
+        pConn->indication_pending = true;
+    return true;
+}
+
+// Accounts for a claimed send once the stack took or refused it. Called with the lock held.
+static bool bat_gatts_notify_finish(bat_gatts_notify_t *pNotify, const bat_gatts_notify_send_t *pSend, esp_err_t err)
+{
+    bat_gatts_conn_t *pConn = bat_gatts_conn_get(pNotify->pConnTable, pSend->conn_id);
+    if (err == ESP_OK)
+    {
+        if (pConn != NULL)
+            pConn->tx_bytes += pSend->len;
+        if (pSend->indicate)
+            pNotify->indicated++;
+        else
+            pNotify->notified++;
+        return true;
+    }
+
+    pNotify->send_errors++;
+    if (pConn != NULL)
+    {
+        // Give the slot back. The value goes pending again unless the client unsubscribed meanwhile,
+        // if a newer one was published since, that one is sent instead.
+        uint32_t bit = 1u << pSend->char_index;
+        if ((pConn->notify_mask | pConn->indicate_mask) & bit)
+            pConn->pending_mask |= bit;
+        if (pConn->in_flight > 0)
+            pConn->in_flight--;
+        if (pSend->indicate)
+            pConn->indication_pending = false;
+    }
+    bat_gatts_notify_arm_retry(pNotify);
+    return false;
+}
+
+// Sends pending values round robin until the link cannot take more. Called without the lock: it is
+// released while the stack is handed a value, the BT task takes it for every event the engine handles.
+static void bat_gatts_notify_pump(bat_gatts_notify_t *pNotify, uint16_t conn_id)
+{
+    bat_gatts_notify_send_t send;
+    xSemaphoreTake(pNotify->lock, portMAX_DELAY);
+
+    while (bat_gatts_notify_claim(pNotify, conn_id, &send))
+    {
+        xSemaphoreGive(pNotify->lock);
+
+        esp_err_t err = esp_ble_gatts_send_indicate(send.gatts_if, send.conn_id, send.value_handle, send.len, send.pValue, send.indicate);
+        if (err == ESP_OK)
+            bat_ble_throughput_on_traffic(send.conn_id, send.len);
+        else
+            ESP_LOGW(TAG, "Send to conn_id: %d, handle: %d failed: %s", send.conn_id, send.value_handle, esp_err_to_name(err));
+        if (send.pValue != send.inline_value)
+            free(send.pValue);
+
+        xSemaphoreTake(pNotify->lock, portMAX_DELAY);
+        if (!bat_gatts_notify_finish(pNotify, &send, err))
+            break;
+    }
+
+    xSemaphoreGive(pNotify->lock);
+}
+
+// Connections with something pending. Called with the lock held.
+static size_t bat_gatts_notify_collect_pending(bat_gatts_notify_t *pNotify, uint16_t *pConnIds)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < BAT_GATTS_CONN_MAX; ++i)
+    {
+        const bat_gatts_conn_t *pConn = &pNotify->pConnTable->slots[i];
+        if (pConn->in_use && pConn->pending_mask != 0)
+            pConnIds[count++] = pConn->conn_id;
+    }
+    return count;
+}
+
+// Sends what the stack refused earlier, the link may have room again.
+static void bat_gatts_notify_retry_cb(void *pArg)
+{
+    bat_gatts_notify_t *pNotify = (bat_gatts_notify_t *)pArg;
+    uint16_t conn_ids[BAT_GATTS_CONN_MAX];
+
+    xSemaphoreTake(pNotify->lock, portMAX_DELAY);
+    pNotify->retry_armed = false;
+    size_t count = bat_gatts_notify_collect_pending(pNotify, conn_ids);
+    xSemaphoreGive(pNotify->lock);
+
+    for (size_t i = 0; i < count; ++i)
+        bat_gatts_notify_pump(pNotify, conn_ids[i]);
+}
+
+esp_err_t bat_gatts_notify_init(bat_gatts_notify_t *pNotify, const bat_gatts_notify_config_t *pConfig)
+{
+    if (pNotify == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    bat_gatts_notify_config_t config = {0};
+    if (pConfig != NULL)
+        config = *pConfig;
+    if (config.pConnTable == NULL)
+        config.pConnTable = bat_gatts_get_conn_table();
+    if (config.max_chars == 0)
+        config.max_chars = BAT_GATTS_NOTIFY_DEFAULT_MAX_CHARS;
+    if (config.max_in_flight == 0)
+        config.max_in_flight = BAT_GATTS_NOTIFY_DEFAULT_MAX_IN_FLIGHT;
+    if (config.retry_us == 0)
+        config.retry_us = BAT_GATTS_NOTIFY_DEFAULT_RETRY_US;
+    if (config.max_chars > BAT_GATTS_NOTIFY_MAX_CHARS)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pNotify, 0, sizeof(*pNotify));
+    pNotify->pChars = (bat_gatts_notify_char_t *)calloc(config.max_chars, sizeof(bat_gatts_notify_char_t));
+    pNotify->lock = xSemaphoreCreateMutex();
+    esp_timer_create_args_t timer_args = {
+        .callback = bat_gatts_notify_retry_cb,
+        .arg = pNotify,
+        .name = "gatts_notify",
+    };
+    if (pNotify->pChars == NULL || pNotify->lock == NULL || esp_timer_create(&timer_args, &pNotify->retry_timer) != ESP_OK)
+    {
+        free(pNotify->pChars);
+        if (pNotify->lock != NULL)
+            vSemaphoreDelete(pNotify->lock);
+        memset(pNotify, 0, sizeof(*pNotify));
+        return ESP_ERR_NO_MEM;
+    }
+
+    pNotify->pConnTable = config.pConnTable;
+    pNotify->max_chars = config.max_chars;
+    pNotify->max_in_flight = config.max_in_flight;
+    pNotify->retry_us = config.retry_us;
+    return ESP_OK;
+}
+
+void bat_gatts_notify_deinit(bat_gatts_notify_t *pNotify)
+{
+    if (pNotify == NULL || pNotify->lock == NULL)
+        return;
+
+    esp_timer_stop(pNotify->retry_timer);
+    esp_timer_delete(pNotify->retry_timer);
+    for (size_t c = 0; c < pNotify->char_count; ++c)
+        free(pNotify->pChars[c].pValue);
+
+    vSemaphoreDelete(pNotify->lock);
+    free(pNotify->pChars);
+    memset(pNotify, 0, sizeof(*pNotify));
+}
+
+esp_err_t bat_gatts_notify_add_char(bat_gatts_notify_t *pNotify, uint16_t value_handle, uint16_t cccd_handle, uint16_t max_len)
+{
+    if (pNotify == NULL || pNotify->lock == NULL || value_handle == 0 || cccd_handle == 0 || max_len == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(pNotify->lock, portMAX_DELAY);
+
+    if (bat_gatts_notify_find_char(pNotify, value_handle) >= 0)
+    {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    else if (pNotify->char_count == pNotify->max_chars)
+    {
+        err = ESP_ERR_NO_MEM;
+    }
+    else
+    {
+        uint8_t *pValue = (uint8_t *)malloc(max_len);
+        if (pValue == NULL)
+        {
+            err = ESP_ERR_NO_MEM;
+        }
+        else
+        {
+            bat_gatts_notify_char_t *pChar = &pNotify->pChars[pNotify->char_count++];
+            pChar->value_handle = value_handle;
+            pChar->cccd_handle = cccd_handle;
+            pChar->max_len = max_len;
+            pChar->len = 0;
+            pChar->pValue = pValue;
+        }
+    }
+
+    xSemaphoreGive(pNotify->lock);
+    return err;
+}
+
+esp_err_t bat_gatts_notify_add_table(bat_gatts_notify_t *pNotify, const bat_gatts_table_t *pTable)
+{
+    if (pTable == NULL || pTable->pDef == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    for (size_t c = 0; c < pTable->pDef->char_count; ++c)
+    {
+        uint16_t cccd_handle = bat_gatts_table_cccd_handle(pTable, c);
+        if (cccd_handle == 0)
+            continue;
+
+        const bat_gatts_char_def_t *pChar = &pTable->pDef->pChars[c];
+        uint16_t max_len = (pChar->max_len != 0) ? pChar->max_len : pChar->len;
+        esp_err_t err = bat_gatts_notify_add_char(pNotify, bat_gatts_table_value_handle(pTable, c), cccd_handle, max_len);
+        if (err != ESP_OK)
+            return err;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t bat_gatts_notify_update(bat_gatts_notify_t *pNotify, uint16_t value_handle, const uint8_t *pValue, uint16_t len)
+{
+    if (pNotify == NULL || pNotify->lock == NULL || (len != 0 && pValue == NULL))
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_OK;
+    uint16_t conn_ids[BAT_GATTS_CONN_MAX];
+    size_t conn_count = 0;
+    xSemaphoreTake(pNotify->lock, portMAX_DELAY);
+
+    int c = bat_gatts_notify_find_char(pNotify, value_handle);
+    if (c < 0)
+    {
+        err = ESP_ERR_NOT_FOUND;
+    }
+    else if (len > pNotify->pChars[c].max_len)
+    {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    else
+    {
+        // Last value wins: whatever was pending is simply overwritten.
+        bat_gatts_notify_char_t *pChar = &pNotify->pChars[c];
+        memcpy(pChar->pValue, pValue, len);
+        pChar->len = len;
+        pNotify->updates++;
+
+        uint32_t bit = 1u << c;
+        for (size_t i = 0; i < BAT_GATTS_CONN_MAX; ++i)
+        {
+            bat_gatts_conn_t *pConn = &pNotify->pConnTable->slots[i];
+            if (!pConn->in_use || ((pConn->notify_mask | pConn->indicate_mask) & bit) == 0)
+                continue;
+
+            if (pConn->pending_mask & bit)
+                pNotify->coalesced++;
+            pConn->pending_mask |= bit;
+            conn_ids[conn_count++] = pConn->conn_id;
+        }
+    }
+
+    xSemaphoreGive(pNotify->lock);
+
+    for (size_t i = 0; i < conn_count; ++i)
+        bat_gatts_notify_pump(pNotify, conn_ids[i]);
+    return err;
+}
+
+// Clears the CCCD and pacing fields of a connection entry. Called with the lock held.
+static void bat_gatts_notify_reset_conn(bat_gatts_notify_t *pNotify, uint16_t conn_id)
+{
+    bat_gatts_conn_t *pConn = bat_gatts_conn_get(pNotify->pConnTable, conn_id);
+    if (pConn == NULL)
+        return;
+
+    pConn->notify_mask = 0;
+    pConn->indicate_mask = 0;
+    pConn->pending_mask = 0;
+    pConn->indication_pending = false;
+    pConn->congested = false;
+    pConn->in_flight = 0;
+    pConn->next_char = 0;
+}
+
+void bat_gatts_notify_on_connect(bat_gatts_notify_t *pNotify, uint16_t conn_id)
+{
+    if (pNotify == NULL || pNotify->lock == NULL)
+        return;
+
+    xSemaphoreTake(pNotify->lock, portMAX_DELAY);
+    bat_gatts_notify_reset_conn(pNotify, conn_id);
+    xSemaphoreGive(pNotify->lock);
+}
+
+void bat_gatts_notify_on_disconnect(bat_gatts_notify_t *pNotify, uint16_t conn_id)
+{
+    if (pNotify == NULL || pNotify->lock == NULL)
+        return;
+
+    xSemaphoreTake(pNotify->lock, portMAX_DELAY);
+    bat_gatts_notify_reset_conn(pNotify, conn_id);
+    xSemaphoreGive(pNotify->lock);
+}
+
+bool bat_gatts_notify_on_write(bat_gatts_notify_t *pNotify, const esp_ble_gatts_cb_param_t *pParam)
+{
+    if (pNotify == NULL || pNotify->lock == NULL || pParam == NULL)
+        return false;
+
+    bool handled = false;
+    bool pump = false;
+    xSemaphoreTake(pNotify->lock, portMAX_DELAY);
+
+    for (size_t c = 0; c < pNotify->char_count; ++c)
+    {
+        if (pNotify->pChars[c].cccd_handle != pParam->write.handle)
+            continue;
+
+        handled = true;
+        bat_gatts_conn_t *pConn = bat_gatts_conn_get(pNotify->pConnTable, pParam->write.conn_id);
+        if (pConn == NULL || pParam->write.is_prep || pParam->write.len != 2)
+            break;
+
+        uint16_t cccd = (uint16_t)(pParam->write.value[0] | (pParam->write.value[1] << 8));
+        uint32_t bit = 1u << c;
+        bool was_subscribed = ((pConn->notify_mask | pConn->indicate_mask) & bit) != 0;
+
+        pConn->notify_mask = (cccd & BAT_CCCD_NOTIFY) ? (pConn->notify_mask | bit) : (pConn->notify_mask & ~bit);
+        pConn->indicate_mask = (cccd & BAT_CCCD_INDICATE) ? (pConn->indicate_mask | bit) : (pConn->indicate_mask & ~bit);
+        ESP_LOGI(TAG, "conn_id: %d, handle: %d, CCCD: 0x%04x", pConn->conn_id, pNotify->pChars[c].value_handle, cccd);
+
+        if (cccd == 0)
+        {
+            pConn->pending_mask &= ~bit;
+        }
+        else if (!was_subscribed && pNotify->pChars[c].len != 0)
+        {
+            // A new subscriber starts from the current value.
+            pConn->pending_mask |= bit;
+            pump = true;
+        }
+        break;
+    }
+
+    xSemaphoreGive(pNotify->lock);
+
+    if (pump)
+        bat_gatts_notify_pump(pNotify, pParam->write.conn_id);
+    return handled;
+}
+
+void bat_gatts_notify_on_conf(bat_gatts_notify_t *pNotify, uint16_t conn_id, esp_gatt_status_t status)
+{
+    if (pNotify == NULL || pNotify->lock == NULL)
+        return;
+
+    bool pump = false;
+    xSemaphoreTake(pNotify->lock, portMAX_DELAY);
+
+    bat_gatts_conn_t *pConn = bat_gatts_conn_get(pNotify->pConnTable, conn_id);
+    if (pConn != NULL)
+    {
+        if (status != ESP_GATT_OK)
+            ESP_LOGD(TAG, "conn_id: %d, confirmation status: %d", conn_id, status);
+
+        // Notifications are confirmed as the stack takes them, so confirmations arrive in send order
+        // and an outstanding indication is only confirmed once nothing sent before it is in flight.
+        pNotify->confirmed++;
+        if (pConn->in_flight > 0)
+            pConn->in_flight--;
+        if (pConn->in_flight == 0)
+            pConn->indication_pending = false;
+        pump = true;
+    }
+
+    xSemaphoreGive(pNotify->lock);
+
+    if (pump)
+        bat_gatts_notify_pump(pNotify, conn_id);
+}
+
+void bat_gatts_notify_on_congest(bat_gatts_notify_t *pNotify, uint16_t conn_id, bool congested)
+{
+    if (pNotify == NULL || pNotify->lock == NULL)
+        return;
+
+    bool pump = false;
+    xSemaphoreTake(pNotify->lock, portMAX_DELAY);
+
+    bat_gatts_conn_t *pConn = bat_gatts_conn_get(pNotify->pConnTable, conn_id);
+    if (pConn != NULL)
+    {
+        if (congested && !pConn->congested)
+            pNotify->congestions++;
+        pConn->congested = congested;
+        pump = !congested;
+    }
+
+    xSemaphoreGive(pNotify->lock);
+
+    if (pump)
+        bat_gatts_notify_pump(pNotify, conn_id);
+}
+
+esp_err_t bat_gatts_notify_get_stats(bat_gatts_notify_t *pNotify, bat_gatts_notify_stats_t *pStats)
+{
+    if (pNotify == NULL || pStats == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (pNotify->lock == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    memset(pStats, 0, sizeof(*pStats));
+    xSemaphoreTake(pNotify->lock, portMAX_DELAY);
+
+    pStats->updates = pNotify->updates;
+    pStats->coalesced = pNotify->coalesced;
+    pStats->notified = pNotify->notified;
+    pStats->indicated = pNotify->indicated;
+    pStats->confirmed = pNotify->confirmed;
+    pStats->congestions = pNotify->congestions;
+    pStats->send_errors = pNotify->send_errors;
+    for (size_t i = 0; i < BAT_GATTS_CONN_MAX; ++i)
+    {
+        const bat_gatts_conn_t *pConn = &pNotify->pConnTable->slots[i];
+        if (!pConn->in_use)
+            continue;
+        pStats->connections++;
+        pStats->subscriptions += (size_t)__builtin_popcount(pConn->notify_mask | pConn->indicate_mask);
+    }
+
+    xSemaphoreGive(pNotify->lock);
+    return ESP_OK;
+}
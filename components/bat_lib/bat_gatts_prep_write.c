@@ -0,0 +1,108 @@
+#include "bat_gatts_prep_write.h"
+#include <string.h>
+#include "esp_log.h"
+
+static const char *TAG = "bat_lib:gatts_prep_write";
+
+esp_err_t bat_gatts_prep_write_init(bat_gatts_prep_write_t *pPrep, size_t max_queues)
+{
+    if (pPrep == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pPrep, 0, sizeof(*pPrep));
+    if (max_queues == 0 || max_queues > BAT_GATTS_CONN_MAX)
+        max_queues = BAT_GATTS_CONN_MAX;
+
+    // A single slab: every buffer is carved from one allocation made here.
+    return bat_pool_init(&pPrep->pool, BAT_GATTS_PREP_WRITE_MAX, max_queues, 1);
+}
+
+void bat_gatts_prep_write_deinit(bat_gatts_prep_write_t *pPrep)
+{
+    if (pPrep != NULL)
+        bat_pool_deinit(&pPrep->pool);
+}
+
+esp_gatt_status_t bat_gatts_prep_write_append(bat_gatts_prep_write_t *pPrep, bat_gatts_conn_t *pConn,
+                                              const esp_ble_gatts_cb_param_t *pParam)
+{
+    if (pPrep == NULL || pConn == NULL || pParam == NULL)
+        return ESP_GATT_NO_RESOURCES;
+
+    esp_gatt_status_t status = ESP_GATT_OK;
+    uint16_t offset = pParam->write.offset;
+    uint16_t len = pParam->write.len;
+
+    if (pConn->prep_status != ESP_GATT_OK)
+        status = pConn->prep_status;
+    else if (pConn->pPrepBuf != NULL && pConn->prep_handle != pParam->write.handle)
+        status = ESP_GATT_PREPARE_Q_FULL;
+    else if (offset > pConn->prep_len)
+        status = ESP_GATT_INVALID_OFFSET;
+    else if ((size_t)offset + len > BAT_GATTS_PREP_WRITE_MAX)
+        status = ESP_GATT_INVALID_ATTR_LEN;
+
+    if (status == ESP_GATT_OK && pConn->pPrepBuf == NULL)
+    {
+        pConn->pPrepBuf = (uint8_t *)bat_pool_alloc(&pPrep->pool);
+        if (pConn->pPrepBuf == NULL)
+            status = ESP_GATT_NO_RESOURCES;
+        else
+            pConn->prep_handle = pParam->write.handle;
+    }
+
+    if (status != ESP_GATT_OK)
+    {
+        ESP_LOGW(TAG, "conn_id: %d, handle: %d, offset: %d, len: %d refused: 0x%x",
+                 pConn->conn_id, pParam->write.handle, offset, len, status);
+        pConn->prep_status = status;
+        pPrep->rejected++;
+        return status;
+    }
+
+    memcpy(pConn->pPrepBuf + offset, pParam->write.value, len);
+    if (offset + len > pConn->prep_len)
+        pConn->prep_len = offset + len;
+    pPrep->fragments++;
+    return ESP_GATT_OK;
+}
+
+bool bat_gatts_prep_write_take(const bat_gatts_conn_t *pConn, const esp_ble_gatts_cb_param_t *pExec,
+                               esp_ble_gatts_cb_param_t *pWrite, esp_gatt_status_t *pStatus)
+{
+    *pStatus = (pConn != NULL) ? pConn->prep_status : ESP_GATT_OK;
+    if (pConn == NULL || pConn->pPrepBuf == NULL || pConn->prep_status != ESP_GATT_OK)
+        return false;
+
+    memset(pWrite, 0, sizeof(*pWrite));
+    pWrite->write.conn_id = pExec->exec_write.conn_id;
+    pWrite->write.trans_id = pExec->exec_write.trans_id;
+    memcpy(pWrite->write.bda, pExec->exec_write.bda, sizeof(esp_bd_addr_t));
+    pWrite->write.handle = pConn->prep_handle;
+    pWrite->write.offset = 0;
+    pWrite->write.need_rsp = false;
+    pWrite->write.is_prep = false;
+    pWrite->write.len = pConn->prep_len;
+    pWrite->write.value = pConn->pPrepBuf;
+    return true;
+}
+
+void bat_gatts_prep_write_release(bat_gatts_prep_write_t *pPrep, bat_gatts_conn_t *pConn, bool executed)
+{
+    if (pPrep == NULL || pConn == NULL)
+        return;
+
+    if (pConn->pPrepBuf != NULL)
+    {
+        bat_pool_free(&pPrep->pool, pConn->pPrepBuf);
+        if (executed)
+            pPrep->executed++;
+        else
+            pPrep->cancelled++;
+    }
+
+    pConn->pPrepBuf = NULL;
+    pConn->prep_handle = 0;
+    pConn->prep_len = 0;
+    pConn->prep_status = ESP_GATT_OK;
+}
@@ -0,0 +1,245 @@
+#include "bat_gatts_table.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+
+// The stack keeps pointers to these until the table is created, so they are static.
+static const uint16_t primary_service_uuid = ESP_GATT_UUID_PRI_SERVICE;
+static const uint16_t secondary_service_uuid = ESP_GATT_UUID_SEC_SERVICE;
+static const uint16_t char_declare_uuid = ESP_GATT_UUID_CHAR_DECLARE;
+static const uint16_t cccd_uuid = ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
+static const uint8_t cccd_default[2] = {0x00, 0x00};
+
+static bool bat_gatts_has_cccd(const bat_gatts_char_def_t *pChar)
+{
+    return (pChar->properties & (ESP_GATT_CHAR_PROP_BIT_NOTIFY | ESP_GATT_CHAR_PROP_BIT_INDICATE)) != 0;
+}
+
+static void bat_gatts_set_uuid(esp_attr_desc_t *pDesc, const bat_gatts_uuid_t *pUuid)
+{
+    if (pUuid->pUuid128 != NULL)
+    {
+        pDesc->uuid_length = ESP_UUID_LEN_128;
+        pDesc->uuid_p = (uint8_t *)pUuid->pUuid128->uuid;
+    }
+    else
+    {
+        pDesc->uuid_length = ESP_UUID_LEN_16;
+        pDesc->uuid_p = (uint8_t *)&pUuid->uuid16;
+    }
+}
+
+// Adds one attribute and records where it comes from.
+static esp_gatts_attr_db_t *bat_gatts_add_attr(bat_gatts_table_t *pTable, uint16_t *pIndex,
+                                               bat_gatts_attr_role_t role, size_t char_index, size_t descr_index)
+{
+    uint16_t index = (*pIndex)++;
+    pTable->pAttrs[index].char_index = (uint16_t)char_index;
+    pTable->pAttrs[index].role = (uint8_t)role;
+    pTable->pAttrs[index].descr_index = (uint8_t)descr_index;
+
+    // Everything is answered by the stack from its copy of the value, values may opt out (rsp_by_app).
+    esp_gatts_attr_db_t *pAttr = &pTable->pDb[index];
+    pAttr->attr_control.auto_rsp = ESP_GATT_AUTO_RSP;
+    return pAttr;
+}
+
+static esp_err_t bat_gatts_set_attr_value(esp_attr_desc_t *pDesc, uint16_t max_len, uint16_t len, const uint8_t *pValue)
+{
+    if (max_len == 0)
+        max_len = len;
+    if (len > max_len || (len != 0 && pValue == NULL))
+        return ESP_ERR_INVALID_ARG;
+
+    pDesc->max_length = max_len;
+    pDesc->length = len;
+    pDesc->value = (uint8_t *)pValue;
+    return ESP_OK;
+}
+
+esp_err_t bat_gatts_table_build(bat_gatts_table_t *pTable, const bat_gatts_service_def_t *pDef)
+{
+    if (pTable == NULL || pDef == NULL || (pDef->char_count != 0 && pDef->pChars == NULL))
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pTable, 0, sizeof(*pTable));
+
+    size_t attr_count = 1;
+    for (size_t c = 0; c < pDef->char_count; ++c)
+    {
+        const bat_gatts_char_def_t *pChar = &pDef->pChars[c];
+        if ((pChar->descr_count != 0 && pChar->pDescrs == NULL) || pChar->descr_count > UINT8_MAX)
+            return ESP_ERR_INVALID_ARG;
+
+        attr_count += 2 + (bat_gatts_has_cccd(pChar) ? 1 : 0) + pChar->descr_count;
+    }
+
+    // esp_ble_gatts_create_attr_tab refuses larger tables (CONFIG_BT_GATT_MAX_SR_ATTRIBUTES, 100 by default),
+    // report it here rather than in ESP_GATTS_CREAT_ATTR_TAB_EVT.
+    if (attr_count > ESP_GATT_ATTR_HANDLE_MAX)
+        return ESP_ERR_INVALID_SIZE;
+
+    // The stack's copy of the array lives until the table is created, the map lives with the table.
+    uint8_t *pDbBlock = (uint8_t *)calloc(1, attr_count * sizeof(esp_gatts_attr_db_t) + pDef->char_count);
+    uint8_t *pMapBlock = (uint8_t *)calloc(1, attr_count * (sizeof(bat_gatts_attr_info_t) + sizeof(uint16_t)) +
+                                              pDef->char_count * sizeof(uint16_t));
+    if (pDbBlock == NULL || pMapBlock == NULL)
+    {
+        free(pDbBlock);
+        free(pMapBlock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    pTable->pDef = pDef;
+    pTable->attr_count = (uint16_t)attr_count;
+    pTable->pDb = (esp_gatts_attr_db_t *)pDbBlock;
+    pTable->pCharProps = pDbBlock + attr_count * sizeof(esp_gatts_attr_db_t);
+    pTable->pAttrs = (bat_gatts_attr_info_t *)pMapBlock;
+    pTable->pHandles = (uint16_t *)(pMapBlock + attr_count * sizeof(bat_gatts_attr_info_t));
+    pTable->pValueIndex = pTable->pHandles + attr_count;
+
+    uint16_t index = 0;
+    esp_gatts_attr_db_t *pAttr = bat_gatts_add_attr(pTable, &index, BAT_GATTS_ATTR_SERVICE, 0, 0);
+    pAttr->att_desc.uuid_length = ESP_UUID_LEN_16;
+    pAttr->att_desc.uuid_p = (uint8_t *)(pDef->secondary ? &secondary_service_uuid : &primary_service_uuid);
+    pAttr->att_desc.perm = ESP_GATT_PERM_READ;
+    esp_attr_desc_t service_uuid = {0};
+    bat_gatts_set_uuid(&service_uuid, &pDef->uuid);
+    bat_gatts_set_attr_value(&pAttr->att_desc, 0, service_uuid.uuid_length, service_uuid.uuid_p);
+
+    esp_err_t err = ESP_OK;
+    for (size_t c = 0; c < pDef->char_count && err == ESP_OK; ++c)
+    {
+        const bat_gatts_char_def_t *pChar = &pDef->pChars[c];
+
+        pTable->pCharProps[c] = pChar->properties;
+        pAttr = bat_gatts_add_attr(pTable, &index, BAT_GATTS_ATTR_CHAR_DECL, c, 0);
+        pAttr->att_desc.uuid_length = ESP_UUID_LEN_16;
+        pAttr->att_desc.uuid_p = (uint8_t *)&char_declare_uuid;
+        pAttr->att_desc.perm = ESP_GATT_PERM_READ;
+        bat_gatts_set_attr_value(&pAttr->att_desc, 0, 1, &pTable->pCharProps[c]);
+
+        pTable->pValueIndex[c] = index;
+        pAttr = bat_gatts_add_attr(pTable, &index, BAT_GATTS_ATTR_VALUE, c, 0);
+        bat_gatts_set_uuid(&pAttr->att_desc, &pChar->uuid);
+        pAttr->att_desc.perm = pChar->perm;
+        err = bat_gatts_set_attr_value(&pAttr->att_desc, pChar->max_len, pChar->len, pChar->pValue);
+        if (pChar->rsp_by_app)
+            pAttr->attr_control.auto_rsp = ESP_GATT_RSP_BY_APP;
+
+        if (bat_gatts_has_cccd(pChar))
+        {
+            pAttr = bat_gatts_add_attr(pTable, &index, BAT_GATTS_ATTR_CCCD, c, 0);
+            pAttr->att_desc.uuid_length = ESP_UUID_LEN_16;
+            pAttr->att_desc.uuid_p = (uint8_t *)&cccd_uuid;
+            pAttr->att_desc.perm = ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE;
+            bat_gatts_set_attr_value(&pAttr->att_desc, 0, sizeof(cccd_default), cccd_default);
+        }
+
+        for (size_t d = 0; d < pChar->descr_count && err == ESP_OK; ++d)
+        {
+            const bat_gatts_descr_def_t *pDescr = &pChar->pDescrs[d];
+            pAttr = bat_gatts_add_attr(pTable, &index, BAT_GATTS_ATTR_DESCR, c, d);
+            bat_gatts_set_uuid(&pAttr->att_desc, &pDescr->uuid);
+            pAttr->att_desc.perm = pDescr->perm;
+            err = bat_gatts_set_attr_value(&pAttr->att_desc, pDescr->max_len, pDescr->len, pDescr->pValue);
+        }
+    }
+
+    if (err != ESP_OK)
+    {
+        bat_gatts_table_free(pTable);
+        return err;
+    }
+
+    pTable->requested_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+esp_err_t bat_gatts_table_set_handles(bat_gatts_table_t *pTable, const uint16_t *pHandles, size_t count)
+{
+    if (pTable == NULL || pTable->pHandles == NULL || pHandles == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    bat_gatts_table_release_db(pTable);
+
+    if (count != pTable->attr_count)
+        return ESP_ERR_INVALID_SIZE;
+
+    memcpy(pTable->pHandles, pHandles, count * sizeof(uint16_t));
+    pTable->service_handle = pHandles[0];
+    pTable->created_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+void bat_gatts_table_release_db(bat_gatts_table_t *pTable)
+{
+    if (pTable == NULL)
+        return;
+
+    free(pTable->pDb); // pCharProps shares the block.
+    pTable->pDb = NULL;
+    pTable->pCharProps = NULL;
+}
+
+void bat_gatts_table_free(bat_gatts_table_t *pTable)
+{
+    if (pTable == NULL)
+        return;
+
+    bat_gatts_table_release_db(pTable);
+    free(pTable->pAttrs); // pHandles and pValueIndex share the block.
+    memset(pTable, 0, sizeof(*pTable));
+}
+
+uint16_t bat_gatts_table_value_handle(const bat_gatts_table_t *pTable, size_t char_index)
+{
+    if (pTable == NULL || pTable->pDef == NULL || char_index >= pTable->pDef->char_count)
+        return 0;
+
+    return pTable->pHandles[pTable->pValueIndex[char_index]];
+}
+
+uint16_t bat_gatts_table_cccd_handle(const bat_gatts_table_t *pTable, size_t char_index)
+{
+    if (pTable == NULL || pTable->pDef == NULL || char_index >= pTable->pDef->char_count)
+        return 0;
+
+    // The CCCD, when present, directly follows the value.
+    if (!bat_gatts_has_cccd(&pTable->pDef->pChars[char_index]))
+        return 0;
+
+    return pTable->pHandles[pTable->pValueIndex[char_index] + 1];
+}
+
+uint16_t bat_gatts_table_descr_handle(const bat_gatts_table_t *pTable, size_t char_index, size_t descr_index)
+{
+    if (pTable == NULL || pTable->pDef == NULL || char_index >= pTable->pDef->char_count)
+        return 0;
+
+    const bat_gatts_char_def_t *pChar = &pTable->pDef->pChars[char_index];
+    if (descr_index >= pChar->descr_count)
+        return 0;
+
+    size_t index = pTable->pValueIndex[char_index] + 1 + (bat_gatts_has_cccd(pChar) ? 1 : 0) + descr_index;
+    return pTable->pHandles[index];
+}
+
+const bat_gatts_attr_info_t *bat_gatts_table_lookup(const bat_gatts_table_t *pTable, uint16_t handle)
+{
+    if (pTable == NULL || pTable->pHandles == NULL || pTable->service_handle == 0 || handle < pTable->service_handle)
+        return NULL;
+
+    // Handles are normally allocated consecutively from the service handle, so try that first.
+    size_t index = handle - pTable->service_handle;
+    if (index < pTable->attr_count && pTable->pHandles[index] == handle)
+        return &pTable->pAttrs[index];
+
+    for (size_t i = 0; i < pTable->attr_count; ++i)
+    {
+        if (pTable->pHandles[i] == handle)
+            return &pTable->pAttrs[i];
+    }
+
+    return NULL;
+}
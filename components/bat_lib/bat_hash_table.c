@@ -16,33 +16,63 @@ uint16_t bat_rs_hash_uint16(uint16_t key, size_t size)
     return (uint16_t)(hash % size);
 }
 
-esp_err_t bat_hash_table_init(
-    bat_hash_table_t *pTable, size_t size,
-    bat_hash_value_cleanup_cb_t value_cleanup_cb, void *pContext)
+uint32_t bat_hash_uint32(uint32_t key)
 {
-    if (pTable == NULL || size == 0)
-        return ESP_ERR_INVALID_ARG;
+    uint32_t hash = key * 0x9E3779B1u;
+    return hash ^ (hash >> 16);
+}
+
+static inline uint32_t bat_rotl32(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+uint32_t bat_hash_bytes(const void *pKey, size_t len)
+{
+    const uint32_t c1 = 0xCC9E2D51u;
+    const uint32_t c2 = 0x1B873593u;
+    const uint8_t *pData = (const uint8_t *)pKey;
+    uint32_t hash = 0;
+    uint32_t k;
 
-    pTable->pEntries = (bat_hash_entry_t *)calloc(size, sizeof(bat_hash_entry_t));
-    if (pTable->pEntries != NULL)
+    size_t words = len / 4;
+    for (size_t i = 0; i < words; ++i, pData += 4)
     {
-        size_t bitmap_size = (size / 8) + ((size % 8) ? 1 : 0);
-        pTable->pUsedEntries = (uint8_t *)calloc(bitmap_size, 1);
-        if (pTable->pUsedEntries != NULL)
-        {
-            pTable->size = size;
-            pTable->pContext = pContext;
-            pTable->value_cleanup_cb = value_cleanup_cb;
-            return ESP_OK;
-        }
+        memcpy(&k, pData, sizeof(k)); // Keys need not be aligned.
+        k *= c1;
+        k = bat_rotl32(k, 15);
+        k *= c2;
+
+        hash ^= k;
+        hash = bat_rotl32(hash, 13);
+        hash = hash * 5 + 0xE6546B64u;
     }
 
-    free(pTable->pEntries);
-    pTable->pEntries = NULL;
-    pTable->pUsedEntries = NULL;
-    pTable->value_cleanup_cb = NULL;
+    k = 0;
+    switch (len & 3)
+    {
+    case 3:
+        k ^= (uint32_t)pData[2] << 16;
+        // fall through
+    case 2:
+        k ^= (uint32_t)pData[1] << 8;
+        // fall through
+    case 1:
+        k ^= pData[0];
+        k *= c1;
+        k = bat_rotl32(k, 15);
+        k *= c2;
+        hash ^= k;
+    }
 
-    return ESP_ERR_NO_MEM;
+    // Final avalanche.
+    hash ^= (uint32_t)len;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    return hash;
 }
 
 // Helper macros check the bitmap for used/unused entries.
@@ -50,55 +80,179 @@ esp_err_t bat_hash_table_init(
 #define BAT_SET_BUCKET_USED(bitmap, idx) (bitmap[(idx) / 8] |= (1 << ((idx) % 8)))
 #define BAT_SET_BUCKET_UNUSED(bitmap, idx) (bitmap[(idx) / 8] &= ~(1 << ((idx) % 8)))
 
-void bat_hash_table_cleanup(bat_hash_table_t *pTable)
+#define BAT_OPEN_NOT_FOUND SIZE_MAX
+
+// Bucket counts are powers of two, so the bucket index is a mask instead of a modulo.
+#define BAT_BUCKET_INDEX(pBuckets, hash) ((size_t)(hash) & ((pBuckets)->size - 1))
+
+#define BAT_KEY_WORDS(key_size) (((key_size) + sizeof(uint32_t) - 1) / sizeof(uint32_t))
+#define BAT_MAX_KEY_WORDS BAT_KEY_WORDS(BAT_HASH_TABLE_MAX_KEY_SIZE)
+
+// Chained entries carry their key inline, so they are addressed by stride rather than by index.
+#define BAT_CHAINED_ENTRY(pTable, pBuckets, idx) \
+    ((bat_hash_entry_t *)((pBuckets)->pEntries + (idx) * (pTable)->entry_size))
+
+#define BAT_OPEN_KEY(pTable, pBuckets, idx) (&(pBuckets)->pKeys[(idx) * (pTable)->key_words])
+
+static size_t bat_hash_round_pow2(size_t size)
 {
-    if (pTable != NULL && pTable->pEntries != NULL)
+    size_t rounded = 1;
+    while (rounded < size)
+        rounded <<= 1;
+    return rounded;
+}
+
+static void bat_hash_buckets_free(bat_hash_buckets_t *pBuckets)
+{
+    free(pBuckets->pEntries);
+    free(pBuckets->pUsedEntries);
+    free(pBuckets->pKeys);
+    free(pBuckets->pValues);
+    memset(pBuckets, 0, sizeof(*pBuckets));
+}
+
+static esp_err_t bat_hash_buckets_alloc(const bat_hash_table_t *pTable, bat_hash_buckets_t *pBuckets, size_t size)
+{
+    memset(pBuckets, 0, sizeof(*pBuckets));
+
+    size_t bitmap_size = (size / 8) + ((size % 8) ? 1 : 0);
+    pBuckets->pUsedEntries = (uint8_t *)calloc(bitmap_size, 1);
+    if (pBuckets->pUsedEntries != NULL)
     {
-        for (size_t i = 0; i < pTable->size; ++i)
+        bool allocated = false;
+        if (pTable->type == BAT_HASH_TABLE_CHAINED)
+        {
+            pBuckets->pEntries = (uint8_t *)calloc(size, pTable->entry_size);
+            allocated = (pBuckets->pEntries != NULL);
+        }
+        else
         {
-            if (!BAT_IS_BUCKET_USED(pTable->pUsedEntries, i))
-                continue;    
+            pBuckets->pKeys = (uint32_t *)calloc(size * pTable->key_words, sizeof(uint32_t));
+            pBuckets->pValues = (void **)calloc(size, sizeof(void *));
+            allocated = (pBuckets->pKeys != NULL && pBuckets->pValues != NULL);
+        }
 
-            bat_hash_entry_t *pFirstEntry = &pTable->pEntries[i];
+        if (allocated)
+        {
+            pBuckets->size = size;
+            return ESP_OK;
+        }
+    }
+
+    bat_hash_buckets_free(pBuckets);
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t bat_hash_table_init(
+    bat_hash_table_t *pTable, size_t size,
+    bat_hash_value_cleanup_cb_t value_cleanup_cb, void *pContext)
+{
+    bat_hash_table_config_t config = {
+        .type = BAT_HASH_TABLE_CHAINED,
+        .size = size,
+        .value_cleanup_cb = value_cleanup_cb,
+        .pContext = pContext,
+    };
+    return bat_hash_table_init_ex(pTable, &config);
+}
+
+esp_err_t bat_hash_table_init_ex(bat_hash_table_t *pTable, const bat_hash_table_config_t *pConfig)
+{
+    if (pTable == NULL || pConfig == NULL || pConfig->size == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    if (pConfig->type != BAT_HASH_TABLE_CHAINED && pConfig->type != BAT_HASH_TABLE_OPEN)
+        return ESP_ERR_INVALID_ARG;
 
-            if (pTable->value_cleanup_cb != NULL)
-                pTable->value_cleanup_cb(pFirstEntry->pValue, pTable->pContext);
+    size_t key_size = (pConfig->key_size != 0) ? pConfig->key_size : sizeof(uint16_t);
+    if (key_size > BAT_HASH_TABLE_MAX_KEY_SIZE)
+        return ESP_ERR_INVALID_SIZE;
 
-            bat_hash_entry_t *pEntry = pFirstEntry->pNext;
-            while (pEntry != NULL)
-            {
-                bat_hash_entry_t *pNext = pEntry->pNext;
+    // Open addressing cannot hold more entries than buckets.
+    uint16_t max_load_percent = pConfig->max_load_percent;
+    if (max_load_percent == 0 || (pConfig->type == BAT_HASH_TABLE_OPEN && max_load_percent >= 100))
+        max_load_percent = BAT_HASH_TABLE_DEFAULT_LOAD_PERCENT;
 
-                if (pTable->value_cleanup_cb != NULL)
-                    pTable->value_cleanup_cb(pEntry->pValue, pTable->pContext);
+    memset(pTable, 0, sizeof(*pTable));
+    pTable->type = pConfig->type;
+    pTable->key_size = key_size;
+    pTable->key_words = BAT_KEY_WORDS(key_size);
+    pTable->entry_size = sizeof(bat_hash_entry_t) + pTable->key_words * sizeof(uint32_t);
+    pTable->entry_size = (pTable->entry_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1); // Keep entries pointer aligned.
 
-                free(pEntry);
-                pEntry = pNext;
-            }
+    esp_err_t err = bat_hash_buckets_alloc(pTable, &pTable->buckets, bat_hash_round_pow2(pConfig->size));
+    if (err != ESP_OK)
+        return err;
+
+    if (pConfig->type == BAT_HASH_TABLE_CHAINED)
+    {
+        err = bat_pool_init(&pTable->entry_pool, pTable->entry_size, pConfig->pool_blocks_per_slab, 0);
+        if (err != ESP_OK)
+        {
+            bat_hash_buckets_free(&pTable->buckets);
+            return err;
         }
+    }
 
-        free(pTable->pEntries);
-        free(pTable->pUsedEntries);
+    pTable->hash_fn = pConfig->hash_fn;
+    pTable->pContext = pConfig->pContext;
+    pTable->value_cleanup_cb = pConfig->value_cleanup_cb;
+    pTable->max_load_percent = pConfig->fixed_size ? 0 : max_load_percent;
+    return ESP_OK;
+}
+
+static bool bat_hash_table_is_valid(const bat_hash_table_t *pTable)
+{
+    return pTable != NULL && pTable->buckets.size != 0;
+}
 
-        pTable->size = 0;
-        pTable->pEntries = NULL;
-        pTable->pUsedEntries = NULL;
+static inline bool bat_hash_table_is_rehashing(const bat_hash_table_t *pTable)
+{
+    return pTable->old.size != 0;
+}
+
+// Copies a caller's key into zero padded, word aligned storage.
+static inline void bat_hash_table_load_key(const bat_hash_table_t *pTable, const void *pKey, uint32_t *pWords)
+{
+    pWords[pTable->key_words - 1] = 0;
+    memcpy(pWords, pKey, pTable->key_size);
+}
+
+static inline bool bat_hash_key_equal(const bat_hash_table_t *pTable, const uint32_t *pA, const uint32_t *pB)
+{
+    for (size_t i = 0; i < pTable->key_words; ++i)
+    {
+        if (pA[i] != pB[i])
+            return false;
     }
+    return true;
 }
 
+static inline uint32_t bat_hash_table_hash(const bat_hash_table_t *pTable, const uint32_t *pKey)
+{
+    if (pTable->hash_fn != NULL)
+        return pTable->hash_fn(pKey, pTable->key_size);
+
+    return (pTable->key_words == 1) ? bat_hash_uint32(pKey[0]) : bat_hash_bytes(pKey, pTable->key_size);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Separate chaining engine.
+
 typedef struct
 {
     bat_hash_entry_t *pPrev;
     bat_hash_entry_t *pFound;
 } bat_hash_find_result_t;
 
-static bat_hash_find_result_t bat_hash_table_find_entry(bat_hash_entry_t *pEntry, uint16_t key)
+static bat_hash_find_result_t bat_hash_table_find_entry(
+    const bat_hash_table_t *pTable, bat_hash_entry_t *pEntry, const uint32_t *pKey)
 {
     bat_hash_find_result_t result = {NULL, NULL};
 
     for (; pEntry != NULL; pEntry = pEntry->pNext)
     {
-        if (pEntry->key == key)
+        if (bat_hash_key_equal(pTable, pEntry->key, pKey))
         {
             result.pFound = pEntry;
             return result;
@@ -111,121 +265,558 @@ static bat_hash_find_result_t bat_hash_table_find_entry(bat_hash_entry_t *pEntry
     return result;
 }
 
+static bat_hash_entry_t *bat_hash_chained_find(
+    const bat_hash_table_t *pTable, const bat_hash_buckets_t *pBuckets, const uint32_t *pKey, uint32_t hash)
+{
+    size_t idx = BAT_BUCKET_INDEX(pBuckets, hash);
+    if (!BAT_IS_BUCKET_USED(pBuckets->pUsedEntries, idx))
+        return NULL;
+
+    return bat_hash_table_find_entry(pTable, BAT_CHAINED_ENTRY(pTable, pBuckets, idx), pKey).pFound;
+}
+
+// Adds a key that is known not to be present.
+// `pNode` is an overflow entry taken from the pool that may be reused (or NULL).
+static esp_err_t bat_hash_chained_insert(
+    bat_hash_table_t *pTable, bat_hash_buckets_t *pBuckets,
+    const uint32_t *pKey, uint32_t hash, void *pValue, bat_hash_entry_t *pNode)
+{
+    size_t idx = BAT_BUCKET_INDEX(pBuckets, hash);
+    bat_hash_entry_t *pFirstEntry = BAT_CHAINED_ENTRY(pTable, pBuckets, idx);
+
+    // Optimal case.
+    if (!BAT_IS_BUCKET_USED(pBuckets->pUsedEntries, idx))
+    {
+        memmove(pFirstEntry->key, pKey, pTable->key_words * sizeof(uint32_t));
+        pFirstEntry->pNext = NULL;
+        pFirstEntry->pValue = pValue;
+        BAT_SET_BUCKET_USED(pBuckets->pUsedEntries, idx);
+        bat_pool_free(&pTable->entry_pool, pNode);
+        return ESP_OK;
+    }
+
+    if (pNode == NULL)
+    {
+        pNode = (bat_hash_entry_t *)bat_pool_alloc(&pTable->entry_pool);
+        if (pNode == NULL)
+            return ESP_ERR_NO_MEM;
+    }
+
+    memmove(pNode->key, pKey, pTable->key_words * sizeof(uint32_t));
+    pNode->pValue = pValue;
+    pNode->pNext = pFirstEntry->pNext;
+    pFirstEntry->pNext = pNode;
+    return ESP_OK;
+}
+
 static void bat_hash_table_free_entry(bat_hash_table_t *pTable, bat_hash_entry_t *pPrev, bat_hash_entry_t *pEntry)
 {
     if (pTable->value_cleanup_cb != NULL)
         pTable->value_cleanup_cb(pEntry->pValue, pTable->pContext);
 
-    if (pPrev != NULL) 
+    if (pPrev != NULL)
     {
         pPrev->pNext = pEntry->pNext;
-        free(pEntry);
+        bat_pool_free(&pTable->entry_pool, pEntry);
+    }
+    else if (pEntry->pNext != NULL) // Pull the second entry into the pre-allocated slot.
+    {
+        bat_hash_entry_t *pNext = pEntry->pNext;
+        memcpy(pEntry, pNext, pTable->entry_size);
+        bat_pool_free(&pTable->entry_pool, pNext);
     }
     else // Don't free the first entry.
     {
-        pEntry->key = 0;
-        pEntry->pNext = NULL;
-        pEntry->pValue = NULL;
+        memset(pEntry, 0, pTable->entry_size);
     }
 }
 
-esp_err_t bat_hash_table_remove(bat_hash_table_t *pTable, uint16_t key)
+static bool bat_hash_chained_remove(
+    bat_hash_table_t *pTable, bat_hash_buckets_t *pBuckets, const uint32_t *pKey, uint32_t hash)
 {
-    if (pTable == NULL || pTable->pEntries == NULL || pTable->pUsedEntries == NULL)
-        return ESP_ERR_INVALID_ARG;
+    size_t idx = BAT_BUCKET_INDEX(pBuckets, hash);
+    if (!BAT_IS_BUCKET_USED(pBuckets->pUsedEntries, idx))
+        return false;
+
+    bat_hash_entry_t *pFirstEntry = BAT_CHAINED_ENTRY(pTable, pBuckets, idx);
+    bat_hash_find_result_t findResult = bat_hash_table_find_entry(pTable, pFirstEntry, pKey);
+    if (findResult.pFound == NULL)
+        return false;
+
+    // We were the first *AND* last...
+    bool emptied = (findResult.pPrev == NULL && pFirstEntry->pNext == NULL);
+    bat_hash_table_free_entry(pTable, findResult.pPrev, findResult.pFound);
+
+    if (emptied)
+        BAT_SET_BUCKET_UNUSED(pBuckets->pUsedEntries, idx);
+    return true;
+}
+
+// Moves one bucket of the old set into the current set.
+// Overflow entries are relinked, so only the pre-allocated first entry can need an allocation.
+static esp_err_t bat_hash_chained_migrate(bat_hash_table_t *pTable, size_t idx)
+{
+    bat_hash_buckets_t *pOld = &pTable->old;
+    if (!BAT_IS_BUCKET_USED(pOld->pUsedEntries, idx))
+        return ESP_OK;
 
-    uint16_t idx = bat_rs_hash_uint16(key, pTable->size);
-    if (BAT_IS_BUCKET_USED(pTable->pUsedEntries, idx))
+    bat_hash_entry_t *pFirstEntry = BAT_CHAINED_ENTRY(pTable, pOld, idx);
+    while (pFirstEntry->pNext != NULL)
     {
-        bat_hash_entry_t *pFirstEntry = &pTable->pEntries[idx];
-        bat_hash_find_result_t findResult = bat_hash_table_find_entry(pFirstEntry, key);
+        bat_hash_entry_t *pNode = pFirstEntry->pNext;
+        pFirstEntry->pNext = pNode->pNext;
+        bat_hash_chained_insert(pTable, &pTable->buckets, pNode->key,
+                                bat_hash_table_hash(pTable, pNode->key), pNode->pValue, pNode);
+    }
+
+    esp_err_t err = bat_hash_chained_insert(pTable, &pTable->buckets, pFirstEntry->key,
+                                            bat_hash_table_hash(pTable, pFirstEntry->key), pFirstEntry->pValue, NULL);
+    if (err != ESP_OK)
+        return err;
+
+    memset(pFirstEntry, 0, pTable->entry_size);
+    BAT_SET_BUCKET_UNUSED(pOld->pUsedEntries, idx);
+    return ESP_OK;
+}
 
-        if (findResult.pFound != NULL)
+// Overflow entries are released all at once with the pool, only their values need cleaning up.
+static void bat_hash_chained_cleanup(bat_hash_table_t *pTable, bat_hash_buckets_t *pBuckets)
+{
+    if (pTable->value_cleanup_cb == NULL)
+        return;
+
+    for (size_t i = 0; i < pBuckets->size; ++i)
+    {
+        if (!BAT_IS_BUCKET_USED(pBuckets->pUsedEntries, i))
+            continue;
+
+        for (bat_hash_entry_t *pEntry = BAT_CHAINED_ENTRY(pTable, pBuckets, i); pEntry != NULL; pEntry = pEntry->pNext)
+            pTable->value_cleanup_cb(pEntry->pValue, pTable->pContext);
+    }
+}
+
+static size_t bat_hash_chained_max_chain(const bat_hash_table_t *pTable, const bat_hash_buckets_t *pBuckets)
+{
+    size_t max_len = 0;
+    for (size_t i = 0; i < pBuckets->size; ++i)
+    {
+        if (!BAT_IS_BUCKET_USED(pBuckets->pUsedEntries, i))
+            continue;
+
+        size_t len = 0;
+        for (const bat_hash_entry_t *pEntry = BAT_CHAINED_ENTRY(pTable, pBuckets, i); pEntry != NULL; pEntry = pEntry->pNext)
+            ++len;
+
+        if (len > max_len)
+            max_len = len;
+    }
+    return max_len;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Open addressing engine.
+// Keys and values live in separate arrays so that probing only walks the (small) key array, the
+// value array is touched once, on a hit.
+//
+// While a table grows, the old set is drained from bucket 0 upwards. Drained buckets are left
+// empty, so lookups in the old set must probe past empty buckets below `rehash_idx` rather than
+// stopping there.
+
+static inline size_t bat_hash_open_next(const bat_hash_buckets_t *pBuckets, size_t idx)
+{
+    return (idx + 1 == pBuckets->size) ? 0 : idx + 1;
+}
+
+static size_t bat_hash_open_find(
+    const bat_hash_table_t *pTable, const bat_hash_buckets_t *pBuckets, const uint32_t *pKey, uint32_t hash, size_t drained)
+{
+    size_t idx = BAT_BUCKET_INDEX(pBuckets, hash);
+    for (size_t probes = 0; probes < pBuckets->size; ++probes)
+    {
+        if (!BAT_IS_BUCKET_USED(pBuckets->pUsedEntries, idx))
+        {
+            if (idx >= drained)
+                break;
+        }
+        else if (bat_hash_key_equal(pTable, BAT_OPEN_KEY(pTable, pBuckets, idx), pKey))
         {
-            bat_hash_table_free_entry(pTable, findResult.pPrev, findResult.pFound);
+            return idx;
+        }
+
+        idx = bat_hash_open_next(pBuckets, idx);
+    }
+
+    return BAT_OPEN_NOT_FOUND;
+}
+
+// Adds a key that is known not to be present.
+static esp_err_t bat_hash_open_insert(
+    const bat_hash_table_t *pTable, bat_hash_buckets_t *pBuckets, const uint32_t *pKey, uint32_t hash, void *pValue)
+{
+    size_t idx = BAT_BUCKET_INDEX(pBuckets, hash);
+    for (size_t probes = 0; probes < pBuckets->size; ++probes)
+    {
+        if (!BAT_IS_BUCKET_USED(pBuckets->pUsedEntries, idx))
+        {
+            memcpy(BAT_OPEN_KEY(pTable, pBuckets, idx), pKey, pTable->key_words * sizeof(uint32_t));
+            pBuckets->pValues[idx] = pValue;
+            BAT_SET_BUCKET_USED(pBuckets->pUsedEntries, idx);
+            return ESP_OK;
+        }
+
+        idx = bat_hash_open_next(pBuckets, idx);
+    }
+
+    return ESP_ERR_NO_MEM; // Every bucket is in use.
+}
+
+// Backward-shift deletion: entries after the hole that would no longer be reachable from their
+// home bucket are moved back into it, which keeps probe sequences unbroken without tombstones.
+//
+// In the old set of a growing table the walk goes on past the drained buckets (below `drained`),
+// as lookups do: a probe sequence that wrapped around the end may continue beyond them. Holes are
+// always buckets that were in use, so nothing is ever moved into the drained region.
+static bool bat_hash_open_remove(
+    bat_hash_table_t *pTable, bat_hash_buckets_t *pBuckets, const uint32_t *pKey, uint32_t hash, size_t drained)
+{
+    size_t hole = bat_hash_open_find(pTable, pBuckets, pKey, hash, drained);
+    if (hole == BAT_OPEN_NOT_FOUND)
+        return false;
 
-            // We were the first *AND* last...
-            if (findResult.pPrev == NULL && pFirstEntry->pNext == NULL)
-                BAT_SET_BUCKET_UNUSED(pTable->pUsedEntries, idx);
+    if (pTable->value_cleanup_cb != NULL)
+        pTable->value_cleanup_cb(pBuckets->pValues[hole], pTable->pContext);
+
+    const size_t key_bytes = pTable->key_words * sizeof(uint32_t);
+    size_t idx = hole;
+    for (size_t probes = 1; probes < pBuckets->size; ++probes)
+    {
+        idx = bat_hash_open_next(pBuckets, idx);
+        if (!BAT_IS_BUCKET_USED(pBuckets->pUsedEntries, idx))
+        {
+            if (idx >= drained)
+                break;
+            continue;
         }
+
+        // Leave the entry alone if its home bucket lies cyclically within (hole, idx].
+        size_t home = BAT_BUCKET_INDEX(pBuckets, bat_hash_table_hash(pTable, BAT_OPEN_KEY(pTable, pBuckets, idx)));
+        bool reachable = (hole <= idx) ? (hole < home && home <= idx) : (hole < home || home <= idx);
+        if (reachable)
+            continue;
+
+        memcpy(BAT_OPEN_KEY(pTable, pBuckets, hole), BAT_OPEN_KEY(pTable, pBuckets, idx), key_bytes);
+        pBuckets->pValues[hole] = pBuckets->pValues[idx];
+        hole = idx;
     }
 
+    memset(BAT_OPEN_KEY(pTable, pBuckets, hole), 0, key_bytes);
+    pBuckets->pValues[hole] = NULL;
+    BAT_SET_BUCKET_UNUSED(pBuckets->pUsedEntries, hole);
+    return true;
+}
+
+static esp_err_t bat_hash_open_migrate(bat_hash_table_t *pTable, size_t idx)
+{
+    bat_hash_buckets_t *pOld = &pTable->old;
+    if (!BAT_IS_BUCKET_USED(pOld->pUsedEntries, idx))
+        return ESP_OK;
+
+    const uint32_t *pKey = BAT_OPEN_KEY(pTable, pOld, idx);
+    esp_err_t err = bat_hash_open_insert(pTable, &pTable->buckets, pKey, bat_hash_table_hash(pTable, pKey), pOld->pValues[idx]);
+    if (err != ESP_OK)
+        return err;
+
+    BAT_SET_BUCKET_UNUSED(pOld->pUsedEntries, idx);
     return ESP_OK;
 }
 
-esp_err_t bat_hash_table_set(bat_hash_table_t *pTable, uint16_t key, void *pValue)
+static void bat_hash_open_cleanup(bat_hash_table_t *pTable, bat_hash_buckets_t *pBuckets)
 {
-    if (pTable == NULL || pTable->pEntries == NULL || pTable->pUsedEntries == NULL)
-        return ESP_ERR_INVALID_ARG;
+    if (pTable->value_cleanup_cb == NULL)
+        return;
 
-    uint16_t idx = bat_rs_hash_uint16(key, pTable->size);
-    bat_hash_entry_t *pFirstEntry = &pTable->pEntries[idx];
+    for (size_t i = 0; i < pBuckets->size; ++i)
+    {
+        if (BAT_IS_BUCKET_USED(pBuckets->pUsedEntries, i))
+            pTable->value_cleanup_cb(pBuckets->pValues[i], pTable->pContext);
+    }
+}
 
-    // Optimal case.
-    if (!BAT_IS_BUCKET_USED(pTable->pUsedEntries, idx))
+static size_t bat_hash_open_max_probe(const bat_hash_table_t *pTable, const bat_hash_buckets_t *pBuckets)
+{
+    size_t max_len = 0;
+    for (size_t i = 0; i < pBuckets->size; ++i)
     {
-        pFirstEntry->key = key;
-        pFirstEntry->pNext = NULL;
-        pFirstEntry->pValue = pValue;
-        BAT_SET_BUCKET_USED(pTable->pUsedEntries, idx);
+        if (!BAT_IS_BUCKET_USED(pBuckets->pUsedEntries, i))
+            continue;
+
+        size_t home = BAT_BUCKET_INDEX(pBuckets, bat_hash_table_hash(pTable, BAT_OPEN_KEY(pTable, pBuckets, i)));
+        size_t len = ((i >= home) ? (i - home) : (pBuckets->size - home + i)) + 1;
+        if (len > max_len)
+            max_len = len;
     }
-    else
+    return max_len;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Incremental growth.
+
+// Migrates up to `steps` buckets of the old set, releasing it once it is empty.
+static void bat_hash_table_rehash_step(bat_hash_table_t *pTable, size_t steps)
+{
+    while (steps-- > 0 && pTable->rehash_idx < pTable->old.size)
+    {
+        esp_err_t err = (pTable->type == BAT_HASH_TABLE_OPEN)
+                            ? bat_hash_open_migrate(pTable, pTable->rehash_idx)
+                            : bat_hash_chained_migrate(pTable, pTable->rehash_idx);
+        if (err != ESP_OK)
+            return; // Retry this bucket on the next operation.
+
+        pTable->rehash_idx++;
+    }
+
+    if (pTable->rehash_idx >= pTable->old.size)
     {
-        bat_hash_find_result_t findResult = bat_hash_table_find_entry(pFirstEntry, key);
-        if (findResult.pFound != NULL) // Key already exists, update value
+        bat_hash_buckets_free(&pTable->old);
+        pTable->rehash_idx = 0;
+    }
+}
+
+static void bat_hash_table_maybe_grow(bat_hash_table_t *pTable)
+{
+    if (pTable->max_load_percent == 0 || bat_hash_table_is_rehashing(pTable))
+        return;
+
+    if (pTable->count * 100 <= pTable->buckets.size * pTable->max_load_percent)
+        return;
+
+    bat_hash_buckets_t grown;
+    if (bat_hash_buckets_alloc(pTable, &grown, pTable->buckets.size * 2) != ESP_OK)
+        return; // Keep going at a higher load, we will try again on the next insert.
+
+    pTable->old = pTable->buckets;
+    pTable->buckets = grown;
+    pTable->rehash_idx = 0;
+    pTable->rehash_count++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void bat_hash_table_cleanup(bat_hash_table_t *pTable)
+{
+    if (bat_hash_table_is_valid(pTable))
+    {
+        bat_hash_buckets_t *sets[] = {&pTable->buckets, &pTable->old};
+        for (size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); ++i)
         {
-            if (pTable->value_cleanup_cb != NULL)
-                pTable->value_cleanup_cb(findResult.pFound->pValue, pTable->pContext);
+            if (sets[i]->size == 0)
+                continue;
 
-            findResult.pFound->pValue = pValue;
+            if (pTable->type == BAT_HASH_TABLE_OPEN)
+                bat_hash_open_cleanup(pTable, sets[i]);
+            else
+                bat_hash_chained_cleanup(pTable, sets[i]);
+
+            bat_hash_buckets_free(sets[i]);
         }
-        else
-        {
-            // Key doesn't exist, add new.
-            bat_hash_entry_t *pNewEntry = (bat_hash_entry_t *)calloc(1, sizeof(bat_hash_entry_t));
-            if (pNewEntry == NULL)
-                return ESP_ERR_NO_MEM;
 
-            pNewEntry->key = key;
-            pNewEntry->pValue = pValue;
+        bat_pool_deinit(&pTable->entry_pool);
+        pTable->count = 0;
+        pTable->rehash_idx = 0;
+    }
+}
 
-            if (findResult.pPrev != NULL)
-                findResult.pPrev->pNext = pNewEntry; 
-            else
-            {
-                pNewEntry->pNext = pFirstEntry->pNext;
-                pFirstEntry->pNext = pNewEntry;
-            }
+esp_err_t bat_hash_table_remove_key(bat_hash_table_t *pTable, const void *pKey)
+{
+    if (!bat_hash_table_is_valid(pTable) || pKey == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    if (bat_hash_table_is_rehashing(pTable))
+        bat_hash_table_rehash_step(pTable, BAT_HASH_TABLE_REHASH_STEP);
+
+    uint32_t key[BAT_MAX_KEY_WORDS];
+    bat_hash_table_load_key(pTable, pKey, key);
+    uint32_t hash = bat_hash_table_hash(pTable, key);
+
+    bool removed = false;
+    if (pTable->type == BAT_HASH_TABLE_OPEN)
+    {
+        removed = bat_hash_open_remove(pTable, &pTable->buckets, key, hash, 0);
+        if (!removed && bat_hash_table_is_rehashing(pTable))
+            removed = bat_hash_open_remove(pTable, &pTable->old, key, hash, pTable->rehash_idx);
+    }
+    else
+    {
+        removed = bat_hash_chained_remove(pTable, &pTable->buckets, key, hash);
+        if (!removed && bat_hash_table_is_rehashing(pTable))
+            removed = bat_hash_chained_remove(pTable, &pTable->old, key, hash);
+    }
+
+    if (removed)
+        pTable->count--;
+
+    return ESP_OK;
+}
+
+// The key is hashed once by the caller, both sets use the same hash with a different mask.
+static void **bat_hash_table_find_value(bat_hash_table_t *pTable, const uint32_t *pKey, uint32_t hash)
+{
+    if (pTable->type == BAT_HASH_TABLE_OPEN)
+    {
+        size_t idx = bat_hash_open_find(pTable, &pTable->buckets, pKey, hash, 0);
+        if (idx != BAT_OPEN_NOT_FOUND)
+            return &pTable->buckets.pValues[idx];
+
+        if (bat_hash_table_is_rehashing(pTable))
+        {
+            idx = bat_hash_open_find(pTable, &pTable->old, pKey, hash, pTable->rehash_idx);
+            if (idx != BAT_OPEN_NOT_FOUND)
+                return &pTable->old.pValues[idx];
         }
+        return NULL;
+    }
+
+    bat_hash_entry_t *pFound = bat_hash_chained_find(pTable, &pTable->buckets, pKey, hash);
+    if (pFound == NULL && bat_hash_table_is_rehashing(pTable))
+        pFound = bat_hash_chained_find(pTable, &pTable->old, pKey, hash);
+
+    return (pFound != NULL) ? &pFound->pValue : NULL;
+}
+
+esp_err_t bat_hash_table_set_key(bat_hash_table_t *pTable, const void *pKey, void *pValue)
+{
+    if (!bat_hash_table_is_valid(pTable) || pKey == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    if (bat_hash_table_is_rehashing(pTable))
+        bat_hash_table_rehash_step(pTable, BAT_HASH_TABLE_REHASH_STEP);
+
+    uint32_t key[BAT_MAX_KEY_WORDS];
+    bat_hash_table_load_key(pTable, pKey, key);
+    uint32_t hash = bat_hash_table_hash(pTable, key);
+
+    void **ppSlot = bat_hash_table_find_value(pTable, key, hash);
+    if (ppSlot != NULL) // Key already exists, update value
+    {
+        if (pTable->value_cleanup_cb != NULL)
+            pTable->value_cleanup_cb(*ppSlot, pTable->pContext);
+
+        *ppSlot = pValue;
+        return ESP_OK;
     }
 
+    // Key doesn't exist, add new.
+    esp_err_t err = (pTable->type == BAT_HASH_TABLE_OPEN)
+                        ? bat_hash_open_insert(pTable, &pTable->buckets, key, hash, pValue)
+                        : bat_hash_chained_insert(pTable, &pTable->buckets, key, hash, pValue, NULL);
+    if (err != ESP_OK)
+        return err;
+
+    pTable->count++;
+    bat_hash_table_maybe_grow(pTable);
     return ESP_OK;
 }
 
-esp_err_t bat_hash_table_get(bat_hash_table_t *pTable, uint16_t key, void **ppValue)
+esp_err_t bat_hash_table_get_key(bat_hash_table_t *pTable, const void *pKey, void **ppValue)
 {
-    if (pTable == NULL || pTable->pEntries == NULL || pTable->pUsedEntries == NULL || ppValue == NULL)
+    if (!bat_hash_table_is_valid(pTable) || pKey == NULL || ppValue == NULL)
         return ESP_ERR_INVALID_ARG;
 
-    uint16_t idx = bat_rs_hash_uint16(key, pTable->size);
-    if (BAT_IS_BUCKET_USED(pTable->pUsedEntries, idx))
+    uint32_t key[BAT_MAX_KEY_WORDS];
+    bat_hash_table_load_key(pTable, pKey, key);
+
+    void **ppSlot = bat_hash_table_find_value(pTable, key, bat_hash_table_hash(pTable, key));
+    if (ppSlot != NULL)
     {
-        bat_hash_entry_t *pFirstEntry = &pTable->pEntries[idx];
-        bat_hash_find_result_t findResult = bat_hash_table_find_entry(pFirstEntry, key);
-        if (findResult.pFound != NULL)
-        {
-            *ppValue = findResult.pFound->pValue;
-            return ESP_OK;
-        }
+        *ppValue = *ppSlot;
+        return ESP_OK;
     }
 
     *ppValue = NULL;
     return ESP_ERR_NOT_FOUND;
 }
 
+void *bat_hash_table_try_get_key(bat_hash_table_t *pTable, const void *pKey)
+{
+    void *pValue = NULL;
+    esp_err_t err = bat_hash_table_get_key(pTable, pKey, &pValue);
+    return (err == ESP_OK) ? pValue : NULL;
+}
+
+// The uint16_t API is a thin wrapper over the generic one.
+static inline bool bat_hash_table_has_uint16_keys(const bat_hash_table_t *pTable)
+{
+    return pTable != NULL && pTable->key_size == sizeof(uint16_t);
+}
+
+esp_err_t bat_hash_table_remove(bat_hash_table_t *pTable, uint16_t key)
+{
+    if (!bat_hash_table_has_uint16_keys(pTable))
+        return ESP_ERR_INVALID_ARG;
+
+    return bat_hash_table_remove_key(pTable, &key);
+}
+
+esp_err_t bat_hash_table_set(bat_hash_table_t *pTable, uint16_t key, void *pValue)
+{
+    if (!bat_hash_table_has_uint16_keys(pTable))
+        return ESP_ERR_INVALID_ARG;
+
+    return bat_hash_table_set_key(pTable, &key, pValue);
+}
+
+esp_err_t bat_hash_table_get(bat_hash_table_t *pTable, uint16_t key, void **ppValue)
+{
+    if (!bat_hash_table_has_uint16_keys(pTable))
+        return ESP_ERR_INVALID_ARG;
+
+    return bat_hash_table_get_key(pTable, &key, ppValue);
+}
+
 void * bat_hash_table_try_get(bat_hash_table_t * pTable, uint16_t key)
 {
     void *pValue = NULL;
     esp_err_t err = bat_hash_table_get(pTable, key, &pValue);
     return (err == ESP_OK) ? pValue : NULL;
 }
+
+size_t bat_hash_table_count(const bat_hash_table_t *pTable)
+{
+    return (pTable != NULL) ? pTable->count : 0;
+}
+
+esp_err_t bat_hash_table_get_stats(const bat_hash_table_t *pTable, bat_hash_table_stats_t *pStats)
+{
+    if (!bat_hash_table_is_valid(pTable) || pStats == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    pStats->count = pTable->count;
+    pStats->size = pTable->buckets.size;
+    pStats->rehash_count = pTable->rehash_count;
+    pStats->rehashing = bat_hash_table_is_rehashing(pTable);
+    pStats->overflow_in_use = pTable->entry_pool.in_use;
+    pStats->overflow_high_water = pTable->entry_pool.high_water;
+
+    if (pTable->type == BAT_HASH_TABLE_OPEN)
+    {
+        pStats->max_chain_len = bat_hash_open_max_probe(pTable, &pTable->buckets);
+        if (pStats->rehashing)
+        {
+            size_t old_len = bat_hash_open_max_probe(pTable, &pTable->old);
+            if (old_len > pStats->max_chain_len)
+                pStats->max_chain_len = old_len;
+        }
+    }
+    else
+    {
+        pStats->max_chain_len = bat_hash_chained_max_chain(pTable, &pTable->buckets);
+        if (pStats->rehashing)
+        {
+            size_t old_len = bat_hash_chained_max_chain(pTable, &pTable->old);
+            if (old_len > pStats->max_chain_len)
+                pStats->max_chain_len = old_len;
+        }
+    }
+
+    return ESP_OK;
+}
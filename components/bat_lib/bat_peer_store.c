@@ -0,0 +1,238 @@
+#include "bat_peer_store.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+
+static void bat_peer_store_unlink(bat_peer_store_t *pStore, uint16_t idx)
+{
+    bat_peer_entry_t *pEntry = &pStore->pEntries[idx];
+
+    if (pEntry->prev != BAT_PEER_STORE_NONE)
+        pStore->pEntries[pEntry->prev].next = pEntry->next;
+    else
+        pStore->head = pEntry->next;
+
+    if (pEntry->next != BAT_PEER_STORE_NONE)
+        pStore->pEntries[pEntry->next].prev = pEntry->prev;
+    else
+        pStore->tail = pEntry->prev;
+}
+
+static void bat_peer_store_push_front(bat_peer_store_t *pStore, uint16_t idx)
+{
+    bat_peer_entry_t *pEntry = &pStore->pEntries[idx];
+
+    pEntry->prev = BAT_PEER_STORE_NONE;
+    pEntry->next = pStore->head;
+    if (pStore->head != BAT_PEER_STORE_NONE)
+        pStore->pEntries[pStore->head].prev = idx;
+    else
+        pStore->tail = idx;
+    pStore->head = idx;
+}
+
+static void bat_peer_store_touch(bat_peer_store_t *pStore, bat_peer_entry_t *pEntry)
+{
+    uint16_t idx = (uint16_t)(pEntry - pStore->pEntries);
+    pEntry->last_seen_us = esp_timer_get_time();
+
+    if (pStore->head != idx)
+    {
+        bat_peer_store_unlink(pStore, idx);
+        bat_peer_store_push_front(pStore, idx);
+    }
+}
+
+// Unlinks an entry, drops it from the index and returns it to the free list.
+static void bat_peer_store_release(bat_peer_store_t *pStore, uint16_t idx)
+{
+    bat_peer_entry_t *pEntry = &pStore->pEntries[idx];
+
+    bat_peer_store_unlink(pStore, idx);
+    bat_hash_table_remove_key(&pStore->index, pEntry->bda);
+
+    memset(pEntry, 0, sizeof(*pEntry));
+    pEntry->next = BAT_PEER_STORE_NONE;
+    pEntry->prev = pStore->free_head;
+    pStore->free_head = idx;
+    pStore->count--;
+}
+
+static void bat_peer_store_evict(bat_peer_store_t *pStore, uint16_t idx)
+{
+    bat_peer_entry_t evicted = pStore->pEntries[idx];
+    bat_peer_store_release(pStore, idx);
+
+    if (pStore->evict_cb != NULL)
+        pStore->evict_cb(evicted.bda, evicted.pValue, pStore->pContext);
+}
+
+esp_err_t bat_peer_store_init(bat_peer_store_t *pStore, const bat_peer_store_config_t *pConfig)
+{
+    if (pStore == NULL || pConfig == NULL || pConfig->capacity == 0 || pConfig->capacity >= BAT_PEER_STORE_NONE)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pStore, 0, sizeof(*pStore));
+
+    pStore->pEntries = (bat_peer_entry_t *)calloc(pConfig->capacity, sizeof(bat_peer_entry_t));
+    if (pStore->pEntries == NULL)
+        return ESP_ERR_NO_MEM;
+
+    bat_hash_table_config_t index_config = {
+        .type = BAT_HASH_TABLE_OPEN,
+        .size = pConfig->capacity,
+        .key_size = ESP_BD_ADDR_LEN,
+    };
+    esp_err_t err = bat_hash_table_init_ex(&pStore->index, &index_config);
+    if (err != ESP_OK)
+    {
+        free(pStore->pEntries);
+        pStore->pEntries = NULL;
+        return err;
+    }
+
+    // Thread every entry onto the free list (through `prev`).
+    for (size_t i = 0; i < pConfig->capacity; ++i)
+    {
+        pStore->pEntries[i].next = BAT_PEER_STORE_NONE;
+        pStore->pEntries[i].prev = (i + 1 < pConfig->capacity) ? (uint16_t)(i + 1) : BAT_PEER_STORE_NONE;
+    }
+
+    pStore->capacity = pConfig->capacity;
+    pStore->head = BAT_PEER_STORE_NONE;
+    pStore->tail = BAT_PEER_STORE_NONE;
+    pStore->free_head = 0;
+    pStore->max_age_us = pConfig->max_age_us;
+    pStore->evict_cb = pConfig->evict_cb;
+    pStore->pContext = pConfig->pContext;
+    return ESP_OK;
+}
+
+void bat_peer_store_deinit(bat_peer_store_t *pStore)
+{
+    if (pStore == NULL)
+        return;
+
+    bat_hash_table_cleanup(&pStore->index);
+    free(pStore->pEntries);
+    memset(pStore, 0, sizeof(*pStore));
+}
+
+esp_err_t bat_peer_store_set(bat_peer_store_t *pStore, const esp_bd_addr_t bda, void *pValue)
+{
+    if (pStore == NULL || pStore->pEntries == NULL || bda == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    bat_peer_entry_t *pEntry = (bat_peer_entry_t *)bat_hash_table_try_get_key(&pStore->index, bda);
+    if (pEntry != NULL)
+    {
+        pEntry->pValue = pValue;
+        bat_peer_store_touch(pStore, pEntry);
+        return ESP_OK;
+    }
+
+    // A full store reuses its least recently used entry. The index insert is the step that can
+    // fail, so it goes first: a refused peer leaves the store as it was.
+    bool full = pStore->free_head == BAT_PEER_STORE_NONE;
+    uint16_t idx = full ? pStore->tail : pStore->free_head;
+    pEntry = &pStore->pEntries[idx];
+
+    esp_err_t err = bat_hash_table_set_key(&pStore->index, bda, pEntry);
+    if (err != ESP_OK)
+        return err;
+
+    if (full)
+    {
+        // Drops the old key only, the new one already maps to the entry. Release puts the entry at
+        // the head of the free list.
+        pStore->evictions++;
+        bat_peer_store_evict(pStore, idx);
+    }
+
+    pStore->free_head = pEntry->prev;
+    memcpy(pEntry->bda, bda, ESP_BD_ADDR_LEN);
+    pEntry->pValue = pValue;
+    pEntry->last_seen_us = esp_timer_get_time();
+    bat_peer_store_push_front(pStore, idx);
+
+    pStore->count++;
+    if (pStore->count > pStore->high_water)
+        pStore->high_water = pStore->count;
+    return ESP_OK;
+}
+
+void *bat_peer_store_lookup(bat_peer_store_t *pStore, const esp_bd_addr_t bda)
+{
+    if (pStore == NULL || bda == NULL)
+        return NULL;
+
+    bat_peer_entry_t *pEntry = (bat_peer_entry_t *)bat_hash_table_try_get_key(&pStore->index, bda);
+    if (pEntry == NULL)
+        return NULL;
+
+    bat_peer_store_touch(pStore, pEntry);
+    return pEntry->pValue;
+}
+
+const bat_peer_entry_t *bat_peer_store_peek(bat_peer_store_t *pStore, const esp_bd_addr_t bda)
+{
+    if (pStore == NULL || bda == NULL)
+        return NULL;
+
+    return (const bat_peer_entry_t *)bat_hash_table_try_get_key(&pStore->index, bda);
+}
+
+esp_err_t bat_peer_store_remove(bat_peer_store_t *pStore, const esp_bd_addr_t bda)
+{
+    if (pStore == NULL || bda == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    bat_peer_entry_t *pEntry = (bat_peer_entry_t *)bat_hash_table_try_get_key(&pStore->index, bda);
+    if (pEntry == NULL)
+        return ESP_ERR_NOT_FOUND;
+
+    bat_peer_store_release(pStore, (uint16_t)(pEntry - pStore->pEntries));
+    return ESP_OK;
+}
+
+size_t bat_peer_store_evict_stale(bat_peer_store_t *pStore)
+{
+    return bat_peer_store_evict_stale_max(pStore, SIZE_MAX);
+}
+
+size_t bat_peer_store_evict_stale_max(bat_peer_store_t *pStore, size_t max_evictions)
+{
+    if (pStore == NULL || pStore->max_age_us <= 0)
+        return 0;
+
+    // The LRU list is ordered by last use, so the walk stops at the first fresh entry.
+    int64_t oldest_allowed = esp_timer_get_time() - pStore->max_age_us;
+    size_t evicted = 0;
+    while (evicted < max_evictions && pStore->tail != BAT_PEER_STORE_NONE &&
+           pStore->pEntries[pStore->tail].last_seen_us < oldest_allowed)
+    {
+        bat_peer_store_evict(pStore, pStore->tail);
+        pStore->stale_evictions++;
+        evicted++;
+    }
+
+    return evicted;
+}
+
+size_t bat_peer_store_count(const bat_peer_store_t *pStore)
+{
+    return (pStore != NULL) ? pStore->count : 0;
+}
+
+esp_err_t bat_peer_store_get_stats(const bat_peer_store_t *pStore, bat_peer_store_stats_t *pStats)
+{
+    if (pStore == NULL || pStats == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    pStats->count = pStore->count;
+    pStats->capacity = pStore->capacity;
+    pStats->high_water = pStore->high_water;
+    pStats->evictions = pStore->evictions;
+    pStats->stale_evictions = pStore->stale_evictions;
+    return ESP_OK;
+}
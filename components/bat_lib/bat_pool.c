@@ -0,0 +1,122 @@
+#include "bat_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Blocks must be able to hold the free-list link and keep the next block pointer aligned.
+static size_t bat_pool_round_block_size(size_t block_size)
+{
+    const size_t align = sizeof(void *);
+    if (block_size < sizeof(void *))
+        block_size = sizeof(void *);
+    return (block_size + align - 1) & ~(align - 1);
+}
+
+static esp_err_t bat_pool_add_slab(bat_pool_t *pPool)
+{
+    if (pPool->max_slabs != 0 && pPool->slab_count >= pPool->max_slabs)
+        return ESP_ERR_NO_MEM;
+
+    size_t header_size = bat_pool_round_block_size(sizeof(bat_pool_slab_t));
+    bat_pool_slab_t *pSlab = (bat_pool_slab_t *)malloc(header_size + pPool->block_size * pPool->blocks_per_slab);
+    if (pSlab == NULL)
+        return ESP_ERR_NO_MEM;
+
+    pSlab->pNext = pPool->pSlabs;
+    pPool->pSlabs = pSlab;
+    pPool->slab_count++;
+
+    // Thread the new blocks onto the free-list, lowest address first.
+    uint8_t *pBlocks = (uint8_t *)pSlab + header_size;
+    for (size_t i = pPool->blocks_per_slab; i > 0; --i)
+    {
+        void **pBlock = (void **)(pBlocks + (i - 1) * pPool->block_size);
+        *pBlock = pPool->pFreeList;
+        pPool->pFreeList = pBlock;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t bat_pool_init(bat_pool_t *pPool, size_t block_size, size_t blocks_per_slab, size_t max_slabs)
+{
+    if (pPool == NULL || block_size == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pPool, 0, sizeof(*pPool));
+    pPool->max_slabs = max_slabs;
+    pPool->block_size = bat_pool_round_block_size(block_size);
+    pPool->blocks_per_slab = (blocks_per_slab != 0) ? blocks_per_slab : BAT_POOL_DEFAULT_BLOCKS_PER_SLAB;
+
+    return bat_pool_add_slab(pPool);
+}
+
+void bat_pool_deinit(bat_pool_t *pPool)
+{
+    if (pPool == NULL)
+        return;
+
+    bat_pool_slab_t *pSlab = pPool->pSlabs;
+    while (pSlab != NULL)
+    {
+        bat_pool_slab_t *pNext = pSlab->pNext;
+        free(pSlab);
+        pSlab = pNext;
+    }
+
+    pPool->pSlabs = NULL;
+    pPool->pFreeList = NULL;
+    pPool->slab_count = 0;
+    pPool->in_use = 0;
+}
+
+void *bat_pool_alloc(bat_pool_t *pPool)
+{
+    if (pPool == NULL || pPool->block_size == 0)
+        return NULL;
+
+    if (pPool->pFreeList == NULL && bat_pool_add_slab(pPool) != ESP_OK)
+    {
+        pPool->alloc_failures++;
+        return NULL;
+    }
+
+    void **pBlock = (void **)pPool->pFreeList;
+    pPool->pFreeList = *pBlock;
+
+    pPool->in_use++;
+    if (pPool->in_use > pPool->high_water)
+        pPool->high_water = pPool->in_use;
+
+    memset(pBlock, 0, pPool->block_size);
+    return pBlock;
+}
+
+void bat_pool_free(bat_pool_t *pPool, void *pBlock)
+{
+    if (pPool == NULL || pBlock == NULL)
+        return;
+
+    *(void **)pBlock = pPool->pFreeList;
+    pPool->pFreeList = pBlock;
+    pPool->in_use--;
+}
+
+esp_err_t bat_pool_get_stats(const bat_pool_t *pPool, bat_pool_stats_t *pStats)
+{
+    if (pPool == NULL || pStats == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    pStats->block_size = pPool->block_size;
+    pStats->slab_count = pPool->slab_count;
+    pStats->capacity = pPool->slab_count * pPool->blocks_per_slab;
+    pStats->in_use = pPool->in_use;
+    pStats->high_water = pPool->high_water;
+    pStats->alloc_failures = pPool->alloc_failures;
+    return ESP_OK;
+}
+
+void bat_pool_reset_high_water(bat_pool_t *pPool)
+{
+    if (pPool != NULL)
+        pPool->high_water = pPool->in_use;
+}
@@ -0,0 +1,101 @@
+#include "bat_scan_dedup.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "bat_hash_table.h"
+
+esp_err_t bat_scan_dedup_init(bat_scan_dedup_t *pDedup, const bat_scan_dedup_config_t *pConfig)
+{
+    if (pDedup == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    bat_scan_dedup_config_t config = {
+        .slots = BAT_SCAN_DEDUP_DEFAULT_SLOTS,
+        .window_us = BAT_SCAN_DEDUP_DEFAULT_WINDOW_US,
+        .rssi_threshold = BAT_SCAN_DEDUP_DEFAULT_RSSI_THRESHOLD,
+    };
+    if (pConfig != NULL)
+    {
+        if (pConfig->window_us < 0)
+            return ESP_ERR_INVALID_ARG;
+        if (pConfig->slots != 0)
+            config.slots = pConfig->slots;
+        if (pConfig->window_us != 0)
+            config.window_us = pConfig->window_us;
+        config.rssi_threshold = pConfig->rssi_threshold;
+    }
+
+    // Round up to a power of two, so the entry index is a mask.
+    size_t slots = 1;
+    while (slots < config.slots)
+        slots <<= 1;
+
+    memset(pDedup, 0, sizeof(*pDedup));
+    pDedup->pEntries = (bat_scan_dedup_entry_t *)calloc(slots, sizeof(bat_scan_dedup_entry_t));
+    if (pDedup->pEntries == NULL)
+        return ESP_ERR_NO_MEM;
+
+    pDedup->mask = slots - 1;
+    pDedup->window_us = config.window_us;
+    pDedup->rssi_threshold = config.rssi_threshold;
+    return ESP_OK;
+}
+
+void bat_scan_dedup_deinit(bat_scan_dedup_t *pDedup)
+{
+    if (pDedup == NULL)
+        return;
+
+    free(pDedup->pEntries);
+    memset(pDedup, 0, sizeof(*pDedup));
+}
+
+void bat_scan_dedup_clear(bat_scan_dedup_t *pDedup)
+{
+    if (pDedup == NULL || pDedup->pEntries == NULL)
+        return;
+
+    memset(pDedup->pEntries, 0, (pDedup->mask + 1) * sizeof(bat_scan_dedup_entry_t));
+}
+
+bool bat_scan_dedup_check(bat_scan_dedup_t *pDedup, const esp_bd_addr_t bda, const uint8_t *pData, size_t len, int rssi)
+{
+    if (pDedup == NULL || pDedup->pEntries == NULL || bda == NULL)
+        return true;
+
+    uint32_t payload_hash = bat_hash_bytes(pData, (pData != NULL) ? len : 0);
+
+    uint8_t key[ESP_BD_ADDR_LEN + sizeof(payload_hash)];
+    memcpy(key, bda, ESP_BD_ADDR_LEN);
+    memcpy(&key[ESP_BD_ADDR_LEN], &payload_hash, sizeof(payload_hash));
+    bat_scan_dedup_entry_t *pEntry = &pDedup->pEntries[bat_hash_bytes(key, sizeof(key)) & pDedup->mask];
+
+    int64_t now = esp_timer_get_time();
+    if (pEntry->used &&
+        pEntry->payload_hash == payload_hash &&
+        memcmp(pEntry->bda, bda, ESP_BD_ADDR_LEN) == 0 &&
+        now - pEntry->forwarded_us < pDedup->window_us &&
+        (pDedup->rssi_threshold == 0 || abs(rssi - pEntry->rssi) < pDedup->rssi_threshold))
+    {
+        pDedup->dropped++;
+        return false;
+    }
+
+    memcpy(pEntry->bda, bda, ESP_BD_ADDR_LEN);
+    pEntry->used = true;
+    pEntry->rssi = (int8_t)rssi;
+    pEntry->payload_hash = payload_hash;
+    pEntry->forwarded_us = now;
+    pDedup->forwarded++;
+    return true;
+}
+
+esp_err_t bat_scan_dedup_get_stats(const bat_scan_dedup_t *pDedup, bat_scan_dedup_stats_t *pStats)
+{
+    if (pDedup == NULL || pStats == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    pStats->forwarded = pDedup->forwarded;
+    pStats->dropped = pDedup->dropped;
+    return ESP_OK;
+}
@@ -0,0 +1,289 @@
+#include "bat_scan_filter.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_gap_ble_api.h"
+
+static inline uint16_t bat_read_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t bat_read_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Each compile helper adds `rule` to an existing entry or appends a new one, so a UUID
+// listed by several rules is compared only once per advertised UUID.
+static void bat_scan_filter_add_uuid16(bat_scan_filter_t *pFilter, uint16_t uuid, uint32_t rule)
+{
+    for (size_t i = 0; i < pFilter->uuid16_count; ++i)
+    {
+        if (pFilter->pUuid16[i].uuid == uuid)
+        {
+            pFilter->pUuid16[i].rules |= rule;
+            return;
+        }
+    }
+
+    pFilter->pUuid16[pFilter->uuid16_count].uuid = uuid;
+    pFilter->pUuid16[pFilter->uuid16_count++].rules = rule;
+}
+
+static void bat_scan_filter_add_uuid32(bat_scan_filter_t *pFilter, uint32_t uuid, uint32_t rule)
+{
+    for (size_t i = 0; i < pFilter->uuid32_count; ++i)
+    {
+        if (pFilter->pUuid32[i].uuid == uuid)
+        {
+            pFilter->pUuid32[i].rules |= rule;
+            return;
+        }
+    }
+
+    pFilter->pUuid32[pFilter->uuid32_count].uuid = uuid;
+    pFilter->pUuid32[pFilter->uuid32_count++].rules = rule;
+}
+
+static void bat_scan_filter_add_uuid128(bat_scan_filter_t *pFilter, const bat_ble_uuid128_t *pUuid, uint32_t rule)
+{
+    for (size_t i = 0; i < pFilter->uuid128_count; ++i)
+    {
+        if (memcmp(pFilter->pUuid128[i].uuid.uuid, pUuid->uuid, ESP_UUID_LEN_128) == 0)
+        {
+            pFilter->pUuid128[i].rules |= rule;
+            return;
+        }
+    }
+
+    pFilter->pUuid128[pFilter->uuid128_count].uuid = *pUuid;
+    pFilter->pUuid128[pFilter->uuid128_count++].rules = rule;
+}
+
+esp_err_t bat_scan_filter_compile(bat_scan_filter_t *pFilter, const bat_scan_filter_rule_t *pRules, size_t count)
+{
+    if (pFilter == NULL || pRules == NULL || count == 0 || count > BAT_SCAN_FILTER_MAX_RULES)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pFilter, 0, sizeof(*pFilter));
+
+    // Size the pool for the worst case (no duplicates).
+    size_t uuid16_max = 0, uuid32_max = 0, uuid128_max = 0, names_len = 0;
+    for (size_t r = 0; r < count; ++r)
+    {
+        const bat_scan_filter_rule_t *pRule = &pRules[r];
+        if ((pRule->uuid16_count != 0 && pRule->pUuid16 == NULL) ||
+            (pRule->uuid32_count != 0 && pRule->pUuid32 == NULL) ||
+            (pRule->uuid128_count != 0 && pRule->pUuid128 == NULL))
+            return ESP_ERR_INVALID_ARG;
+
+        if (pRule->pszName != NULL)
+        {
+            size_t len = strlen(pRule->pszName);
+            if (len > UINT8_MAX)
+                return ESP_ERR_INVALID_SIZE;
+            names_len += len;
+        }
+
+        uuid16_max += pRule->uuid16_count;
+        uuid32_max += pRule->uuid32_count;
+        uuid128_max += pRule->uuid128_count;
+    }
+
+    // Largest alignment first, the names go last.
+    size_t pool_size = uuid128_max * sizeof(bat_scan_filter_uuid128_t) +
+                       uuid32_max * sizeof(bat_scan_filter_uuid32_t) +
+                       uuid16_max * sizeof(bat_scan_filter_uuid16_t) +
+                       names_len;
+    uint8_t *pPool = NULL;
+    if (pool_size != 0)
+    {
+        pPool = (uint8_t *)calloc(1, pool_size);
+        if (pPool == NULL)
+            return ESP_ERR_NO_MEM;
+    }
+
+    pFilter->pPool = pPool;
+    pFilter->pUuid128 = (bat_scan_filter_uuid128_t *)pPool;
+    pPool += uuid128_max * sizeof(bat_scan_filter_uuid128_t);
+    pFilter->pUuid32 = (bat_scan_filter_uuid32_t *)pPool;
+    pPool += uuid32_max * sizeof(bat_scan_filter_uuid32_t);
+    pFilter->pUuid16 = (bat_scan_filter_uuid16_t *)pPool;
+    pPool += uuid16_max * sizeof(bat_scan_filter_uuid16_t);
+    char *pNames = (char *)pPool;
+
+    pFilter->rule_count = (uint8_t)count;
+    pFilter->lowest_rssi = INT8_MAX;
+    for (size_t r = 0; r < count; ++r)
+    {
+        const bat_scan_filter_rule_t *pRule = &pRules[r];
+        uint32_t bit = 1u << r;
+
+        // Received signals are below 0 dBm, so a zeroed threshold means no threshold, like the other criteria.
+        int8_t min_rssi = (pRule->min_rssi == 0) ? BAT_SCAN_FILTER_ANY_RSSI : pRule->min_rssi;
+        pFilter->min_rssi[r] = min_rssi;
+        if (min_rssi < pFilter->lowest_rssi)
+            pFilter->lowest_rssi = min_rssi;
+
+        if (pRule->pszName != NULL)
+        {
+            size_t len = strlen(pRule->pszName);
+            memcpy(pNames, pRule->pszName, len);
+            pFilter->pNames[r] = pNames;
+            pFilter->name_len[r] = (uint8_t)len;
+            pNames += len;
+            pFilter->need_name |= bit;
+            if (pRule->name_exact)
+                pFilter->name_exact |= bit;
+        }
+
+        if (pRule->uuid16_count + pRule->uuid32_count + pRule->uuid128_count != 0)
+            pFilter->need_uuid |= bit;
+        for (size_t i = 0; i < pRule->uuid16_count; ++i)
+            bat_scan_filter_add_uuid16(pFilter, pRule->pUuid16[i], bit);
+        for (size_t i = 0; i < pRule->uuid32_count; ++i)
+            bat_scan_filter_add_uuid32(pFilter, pRule->pUuid32[i], bit);
+        for (size_t i = 0; i < pRule->uuid128_count; ++i)
+            bat_scan_filter_add_uuid128(pFilter, &pRule->pUuid128[i], bit);
+
+        if (pRule->match_manufacturer)
+        {
+            pFilter->need_manufacturer |= bit;
+            pFilter->manufacturer_id[r] = pRule->manufacturer_id;
+        }
+    }
+
+    return ESP_OK;
+}
+
+void bat_scan_filter_free(bat_scan_filter_t *pFilter)
+{
+    if (pFilter == NULL)
+        return;
+
+    free(pFilter->pPool);
+    memset(pFilter, 0, sizeof(*pFilter));
+}
+
+static uint32_t bat_scan_filter_match_name(const bat_scan_filter_t *pFilter, uint32_t candidates,
+                                           const uint8_t *pName, uint8_t len)
+{
+    uint32_t hits = 0;
+    for (; candidates != 0; candidates &= candidates - 1)
+    {
+        int r = __builtin_ctz(candidates);
+        uint8_t want = pFilter->name_len[r];
+        if ((pFilter->name_exact & (1u << r)) != 0 && len != want)
+            continue;
+
+        if (len >= want && memcmp(pName, pFilter->pNames[r], want) == 0)
+            hits |= 1u << r;
+    }
+
+    return hits;
+}
+
+uint32_t bat_scan_filter_match(const bat_scan_filter_t *pFilter, const uint8_t *pData, size_t len, int rssi)
+{
+    if (pFilter == NULL || pFilter->rule_count == 0 || rssi < pFilter->lowest_rssi)
+        return 0;
+
+    uint32_t alive = 0;
+    for (uint8_t r = 0; r < pFilter->rule_count; ++r)
+    {
+        if (rssi >= pFilter->min_rssi[r])
+            alive |= 1u << r;
+    }
+
+    uint32_t name_hits = 0;
+    uint32_t uuid_hits = 0;
+    uint32_t manufacturer_hits = 0;
+    uint32_t need_name = pFilter->need_name & alive;
+    uint32_t need_uuid = pFilter->need_uuid & alive;
+    uint32_t need_manufacturer = pFilter->need_manufacturer & alive;
+
+    size_t pos = 0;
+    while (pData != NULL && pos < len && (need_name | need_uuid | need_manufacturer) != 0)
+    {
+        uint8_t field_len = pData[pos];
+        if (field_len == 0 || pos + 1 + field_len > len) // Padding or truncated.
+            break;
+
+        uint8_t type = pData[pos + 1];
+        const uint8_t *pField = &pData[pos + 2];
+        uint8_t data_len = field_len - 1;
+        pos += 1 + field_len;
+
+        switch (type)
+        {
+        case ESP_BLE_AD_TYPE_NAME_CMPL:
+        case ESP_BLE_AD_TYPE_NAME_SHORT:
+            name_hits |= bat_scan_filter_match_name(pFilter, need_name, pField, data_len);
+            need_name &= ~name_hits;
+            break;
+
+        case ESP_BLE_AD_TYPE_16SRV_CMPL:
+        case ESP_BLE_AD_TYPE_16SRV_PART:
+            for (uint8_t i = 0; i + ESP_UUID_LEN_16 <= data_len && need_uuid != 0; i += ESP_UUID_LEN_16)
+            {
+                uint16_t uuid = bat_read_le16(&pField[i]);
+                for (size_t u = 0; u < pFilter->uuid16_count; ++u)
+                {
+                    if (pFilter->pUuid16[u].uuid == uuid)
+                        uuid_hits |= pFilter->pUuid16[u].rules;
+                }
+                need_uuid &= ~uuid_hits;
+            }
+            break;
+
+        case ESP_BLE_AD_TYPE_32SRV_CMPL:
+        case ESP_BLE_AD_TYPE_32SRV_PART:
+            for (uint8_t i = 0; i + ESP_UUID_LEN_32 <= data_len && need_uuid != 0; i += ESP_UUID_LEN_32)
+            {
+                uint32_t uuid = bat_read_le32(&pField[i]);
+                for (size_t u = 0; u < pFilter->uuid32_count; ++u)
+                {
+                    if (pFilter->pUuid32[u].uuid == uuid)
+                        uuid_hits |= pFilter->pUuid32[u].rules;
+                }
+                need_uuid &= ~uuid_hits;
+            }
+            break;
+
+        case ESP_BLE_AD_TYPE_128SRV_CMPL:
+        case ESP_BLE_AD_TYPE_128SRV_PART:
+            for (uint8_t i = 0; i + ESP_UUID_LEN_128 <= data_len && need_uuid != 0; i += ESP_UUID_LEN_128)
+            {
+                for (size_t u = 0; u < pFilter->uuid128_count; ++u)
+                {
+                    if (memcmp(pFilter->pUuid128[u].uuid.uuid, &pField[i], ESP_UUID_LEN_128) == 0)
+                        uuid_hits |= pFilter->pUuid128[u].rules;
+                }
+                need_uuid &= ~uuid_hits;
+            }
+            break;
+
+        case ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE:
+            if (data_len >= 2)
+            {
+                uint16_t id = bat_read_le16(pField);
+                for (uint32_t candidates = need_manufacturer; candidates != 0; candidates &= candidates - 1)
+                {
+                    int r = __builtin_ctz(candidates);
+                    if (pFilter->manufacturer_id[r] == id)
+                        manufacturer_hits |= 1u << r;
+                }
+                need_manufacturer &= ~manufacturer_hits;
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return alive &
+           (name_hits | ~pFilter->need_name) &
+           (uuid_hits | ~pFilter->need_uuid) &
+           (manufacturer_hits | ~pFilter->need_manufacturer);
+}
@@ -0,0 +1,185 @@
+#include "bat_scan_worker.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "bat_lib:scan_worker";
+
+static void bat_scan_worker_task(void *pvParameters)
+{
+    bat_scan_worker_t *pWorker = (bat_scan_worker_t *)pvParameters;
+
+    while (!pWorker->stopping)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (!pWorker->stopping)
+        {
+            // Copy a batch out, so the callbacks run with the ring unlocked.
+            size_t n = 0;
+            taskENTER_CRITICAL(&pWorker->lock);
+            while (n < pWorker->batch_size && pWorker->count > 0)
+            {
+                pWorker->pBatch[n++] = pWorker->pRing[pWorker->head];
+                pWorker->head = (pWorker->head + 1) % pWorker->capacity;
+                pWorker->count--;
+            }
+            taskEXIT_CRITICAL(&pWorker->lock);
+
+            if (n == 0)
+                break;
+
+            int64_t now = esp_timer_get_time();
+            int64_t latency_total = 0;
+            int64_t latency_max = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                int64_t latency = now - pWorker->pBatch[i].posted_us;
+                latency_total += latency;
+                if (latency > latency_max)
+                    latency_max = latency;
+            }
+
+            for (size_t i = 0; i < n; ++i)
+                pWorker->process_cb(&pWorker->pBatch[i].param, pWorker->pContext);
+
+            taskENTER_CRITICAL(&pWorker->lock);
+            pWorker->processed += n;
+            pWorker->batches++;
+            pWorker->latency_total_us += latency_total;
+            if (latency_max > pWorker->latency_max_us)
+                pWorker->latency_max_us = latency_max;
+            taskEXIT_CRITICAL(&pWorker->lock);
+        }
+    }
+
+    xSemaphoreGive(pWorker->stopped);
+    vTaskDelete(NULL);
+}
+
+esp_err_t bat_scan_worker_init(bat_scan_worker_t *pWorker, const bat_scan_worker_config_t *pConfig)
+{
+    if (pWorker == NULL || pConfig == NULL || pConfig->process_cb == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(pWorker, 0, sizeof(*pWorker));
+    pWorker->capacity = (pConfig->capacity != 0) ? pConfig->capacity : BAT_SCAN_WORKER_DEFAULT_CAPACITY;
+    pWorker->batch_size = (pConfig->batch_size != 0) ? pConfig->batch_size : BAT_SCAN_WORKER_DEFAULT_BATCH_SIZE;
+    if (pWorker->batch_size > pWorker->capacity)
+        pWorker->batch_size = pWorker->capacity;
+    pWorker->overflow = pConfig->overflow;
+    pWorker->process_cb = pConfig->process_cb;
+    pWorker->pContext = pConfig->pContext;
+    portMUX_INITIALIZE(&pWorker->lock);
+
+    pWorker->pRing = (bat_scan_worker_item_t *)calloc(pWorker->capacity, sizeof(bat_scan_worker_item_t));
+    pWorker->pBatch = (bat_scan_worker_item_t *)calloc(pWorker->batch_size, sizeof(bat_scan_worker_item_t));
+    pWorker->stopped = xSemaphoreCreateBinary();
+    if (pWorker->pRing == NULL || pWorker->pBatch == NULL || pWorker->stopped == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate a ring of %u events", (unsigned)pWorker->capacity);
+        free(pWorker->pRing);
+        free(pWorker->pBatch);
+        if (pWorker->stopped != NULL)
+            vSemaphoreDelete(pWorker->stopped);
+        memset(pWorker, 0, sizeof(*pWorker));
+        return ESP_ERR_NO_MEM;
+    }
+
+    BaseType_t task_created = xTaskCreate(
+        bat_scan_worker_task,
+        "scan_worker",
+        (pConfig->stack_size != 0) ? pConfig->stack_size : BAT_SCAN_WORKER_DEFAULT_STACK_SIZE,
+        pWorker,
+        (pConfig->priority != 0) ? pConfig->priority : BAT_SCAN_WORKER_DEFAULT_PRIORITY,
+        &pWorker->task);
+
+    if (task_created != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create scan worker task");
+        free(pWorker->pRing);
+        free(pWorker->pBatch);
+        vSemaphoreDelete(pWorker->stopped);
+        memset(pWorker, 0, sizeof(*pWorker));
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+void bat_scan_worker_deinit(bat_scan_worker_t *pWorker)
+{
+    if (pWorker == NULL || pWorker->task == NULL)
+        return;
+
+    pWorker->stopping = true;
+    xTaskNotifyGive(pWorker->task);
+    xSemaphoreTake(pWorker->stopped, portMAX_DELAY);
+
+    vSemaphoreDelete(pWorker->stopped);
+    free(pWorker->pRing);
+    free(pWorker->pBatch);
+    memset(pWorker, 0, sizeof(*pWorker));
+}
+
+esp_err_t bat_scan_worker_post(bat_scan_worker_t *pWorker, const esp_ble_gap_cb_param_t *pParam)
+{
+    if (pWorker == NULL || pParam == NULL || pWorker->task == NULL || pWorker->stopping)
+        return ESP_ERR_INVALID_STATE;
+
+    esp_err_t ret = ESP_OK;
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&pWorker->lock);
+    pWorker->posted++;
+    if (pWorker->count == pWorker->capacity)
+    {
+        pWorker->dropped++;
+        if (pWorker->overflow == BAT_SCAN_WORKER_DROP_NEWEST)
+            ret = ESP_ERR_NO_MEM;
+        else
+        {
+            // Free the oldest slot, the new event goes in at the tail as usual.
+            pWorker->head = (pWorker->head + 1) % pWorker->capacity;
+            pWorker->count--;
+        }
+    }
+
+    if (ret == ESP_OK)
+    {
+        bat_scan_worker_item_t *pItem = &pWorker->pRing[(pWorker->head + pWorker->count) % pWorker->capacity];
+        pItem->param = *pParam;
+        pItem->posted_us = now;
+        pWorker->count++;
+        if (pWorker->count > pWorker->high_water)
+            pWorker->high_water = pWorker->count;
+    }
+    taskEXIT_CRITICAL(&pWorker->lock);
+
+    if (ret == ESP_OK)
+        xTaskNotifyGive(pWorker->task);
+
+    return ret;
+}
+
+esp_err_t bat_scan_worker_get_stats(bat_scan_worker_t *pWorker, bat_scan_worker_stats_t *pStats)
+{
+    if (pWorker == NULL || pStats == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    if (pWorker->task == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    taskENTER_CRITICAL(&pWorker->lock);
+    pStats->posted = pWorker->posted;
+    pStats->dropped = pWorker->dropped;
+    pStats->processed = pWorker->processed;
+    pStats->batches = pWorker->batches;
+    pStats->queued = pWorker->count;
+    pStats->high_water = pWorker->high_water;
+    pStats->latency_avg_us = (pWorker->processed != 0) ? pWorker->latency_total_us / pWorker->processed : 0;
+    pStats->latency_max_us = pWorker->latency_max_us;
+    taskEXIT_CRITICAL(&pWorker->lock);
+    return ESP_OK;
+}
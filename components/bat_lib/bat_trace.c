@@ -0,0 +1,129 @@
+#include "bat_trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "bat_lib:trace";
+
+#if CONFIG_BAT_TRACE
+
+_Static_assert((BAT_TRACE_RECORDS & (BAT_TRACE_RECORDS - 1)) == 0, "CONFIG_BAT_TRACE_RECORDS must be a power of two");
+
+typedef struct {
+    uint32_t head;                       // Slots claimed so far, the next one is head % BAT_TRACE_RECORDS.
+    bat_trace_record_t records[BAT_TRACE_RECORDS];
+} bat_trace_ring_t;
+
+static bat_trace_ring_t g_rings[portNUM_PROCESSORS];
+
+void bat_trace_record(bat_trace_src_t source, uint16_t event, uint16_t handle, uint16_t conn_id, uint16_t status)
+{
+    // Only this core's writers (a task and whatever preempts it) share the ring, the atomic
+    // increment keeps their slots apart even if the task migrates in between.
+    uint8_t core = (uint8_t)xPortGetCoreID();
+    bat_trace_ring_t *pRing = &g_rings[core];
+    uint32_t seq = __atomic_fetch_add(&pRing->head, 1, __ATOMIC_RELAXED);
+
+    bat_trace_record_t *pRecord = &pRing->records[seq & (BAT_TRACE_RECORDS - 1)];
+    pRecord->timestamp_us = (uint32_t)esp_timer_get_time();
+    pRecord->event = event;
+    pRecord->handle = handle;
+    pRecord->conn_id = conn_id;
+    pRecord->status = status;
+    pRecord->source = (uint8_t)source;
+    pRecord->core = core;
+    pRecord->seq = (uint16_t)seq;
+}
+
+// Orders by time, the difference keeps working when the 32-bit timestamp wraps.
+static int bat_trace_compare(const void *pA, const void *pB)
+{
+    int32_t delta = (int32_t)(((const bat_trace_record_t *)pA)->timestamp_us -
+                              ((const bat_trace_record_t *)pB)->timestamp_us);
+    return (delta > 0) - (delta < 0);
+}
+
+size_t bat_trace_snapshot(bat_trace_record_t *pRecords, size_t max_records)
+{
+    if (pRecords == NULL)
+        return 0;
+
+    size_t count = 0;
+    for (size_t core = 0; core < portNUM_PROCESSORS; ++core)
+    {
+        const bat_trace_ring_t *pRing = &g_rings[core];
+        uint32_t head = __atomic_load_n(&pRing->head, __ATOMIC_ACQUIRE);
+        uint32_t available = (head < BAT_TRACE_RECORDS) ? head : BAT_TRACE_RECORDS;
+        for (uint32_t seq = head - available; seq != head && count < max_records; ++seq)
+            pRecords[count++] = pRing->records[seq & (BAT_TRACE_RECORDS - 1)];
+    }
+
+    qsort(pRecords, count, sizeof(bat_trace_record_t), bat_trace_compare);
+    return count;
+}
+
+void bat_trace_clear(void)
+{
+    for (size_t core = 0; core < portNUM_PROCESSORS; ++core)
+        __atomic_store_n(&g_rings[core].head, 0, __ATOMIC_RELEASE);
+}
+
+static const char *bat_trace_src_name(uint8_t source)
+{
+    switch (source)
+    {
+    case BAT_TRACE_SRC_GAP:
+        return "gap";
+    case BAT_TRACE_SRC_GATTS:
+        return "gatts";
+    case BAT_TRACE_SRC_GATTC:
+        return "gattc";
+    case BAT_TRACE_SRC_GATTS_FSM:
+        return "gatts_fsm";
+    default:
+        return "?";
+    }
+}
+
+void bat_trace_dump(void)
+{
+    size_t capacity = (size_t)portNUM_PROCESSORS * BAT_TRACE_RECORDS;
+    bat_trace_record_t *pRecords = (bat_trace_record_t *)malloc(capacity * sizeof(bat_trace_record_t));
+    if (pRecords == NULL)
+    {
+        ESP_LOGE(TAG, "No memory to dump %u records", (unsigned)capacity);
+        return;
+    }
+
+    size_t count = bat_trace_snapshot(pRecords, capacity);
+    ESP_LOGI(TAG, "%u records", (unsigned)count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const bat_trace_record_t *pRecord = &pRecords[i];
+        ESP_LOGI(TAG, "%10lu us core %u #%-5u %-9s event %3u handle %5u conn_id %5u status 0x%04x",
+                 (unsigned long)pRecord->timestamp_us, pRecord->core, pRecord->seq,
+                 bat_trace_src_name(pRecord->source), pRecord->event, pRecord->handle,
+                 pRecord->conn_id, pRecord->status);
+    }
+    free(pRecords);
+}
+
+#else
+
+size_t bat_trace_snapshot(bat_trace_record_t *pRecords, size_t max_records)
+{
+    return 0;
+}
+
+void bat_trace_dump(void)
+{
+    ESP_LOGI(TAG, "Tracing is disabled, see CONFIG_BAT_TRACE");
+}
+
+void bat_trace_clear(void)
+{
+}
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * @file bench.h
+ * @brief Timing and checking helpers shared by the host benchmarks.
+ *
+ * Every program checks its results before timing them and exits non-zero on a mismatch,
+ * so ctest catches a broken build of the library as well as a broken benchmark.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Results are folded in here so the compiler cannot drop the measured work.
+static volatile uintptr_t g_bench_sink;
+static int g_bench_failures;
+
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Small, fixed-seed generator so every run sees the same keys and events.
+static inline uint32_t bench_rand(uint32_t *pState)
+{
+    *pState ^= *pState << 13;
+    *pState ^= *pState >> 17;
+    *pState ^= *pState << 5;
+    return *pState;
+}
+
+#define BENCH_CHECK(cond)                                                              \
+    do                                                                                 \
+    {                                                                                  \
+        if (!(cond))                                                                   \
+        {                                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);   \
+            g_bench_failures++;                                                        \
+        }                                                                              \
+    } while (0)
+
+static inline void bench_report(const char *pszName, uint64_t elapsed_ns, uint64_t ops)
+{
+    printf("  %-40s %8.2f ns/op\n", pszName, ops != 0 ? (double)elapsed_ns / (double)ops : 0.0);
+}
+
+static inline int bench_result(void)
+{
+    if (g_bench_failures != 0)
+        fprintf(stderr, "%d check(s) failed\n", g_bench_failures);
+    return g_bench_failures != 0;
+}
@@ -0,0 +1,223 @@
+/**
+ * @file bench_adv_parser.c
+ * @brief Scan result queries: one `esp_ble_resolve_adv_data` walk per AD type against bat_adv_parse.
+ *
+ * `resolve_adv_data` below follows Bluedroid's BTM_CheckAdvData, the walk behind
+ * esp_ble_resolve_adv_data, over the 62-byte `ble_adv` buffer of a scan result. Recorded
+ * payloads (beacons, a bat_lib server, phones and wearables, with and without scan
+ * response) are put through the queries the client makes per result (name, service
+ * UUID, then what bat_log_verbose_ble_scan prints) both ways, and the answers compared.
+ */
+#include "bat_adv_parser.h"
+#include "bench.h"
+#include "esp_gap_ble_api.h"
+#include <string.h>
+
+#define ADV_BUFFER_LEN 62                // ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX
+#define AD_TYPE_SERVICE_DATA 0x16        // ESP_BLE_AD_TYPE_SERVICE_DATA
+#define ROUNDS 200000
+#define NAME_LEN 32
+
+typedef struct {
+    const char *pszName;
+    uint8_t adv_len;
+    uint8_t scan_rsp_len;
+    uint8_t data[ADV_BUFFER_LEN];        // Advertising data then scan response, as in `ble_adv`.
+} recorded_adv_t;
+
+// Little endian, as advertised.
+static const uint8_t g_service_uuid[16] = {
+    0x4B, 0x91, 0x31, 0xC3, 0xC9, 0xC5, 0xCC, 0x8F, 0x9E, 0x45, 0xB5, 0x1F, 0x01, 0xC2, 0xAF, 0x4F,
+};
+
+static const recorded_adv_t g_recorded[] = {
+    {"bat_lib server", 31, 10, {
+        0x02, 0x01, 0x06,
+        0x11, 0x07, 0x4B, 0x91, 0x31, 0xC3, 0xC9, 0xC5, 0xCC, 0x8F, 0x9E, 0x45, 0xB5, 0x1F, 0x01, 0xC2, 0xAF, 0x4F,
+        0x02, 0x0A, 0x09,
+        0x06, 0x08, 'B', 'A', 'T', '-', '1',
+        0x09, 0x09, 'B', 'A', 'T', '-', '1', 'a', 'b', 'c'}},
+    {"iBeacon", 30, 0, {
+        0x02, 0x01, 0x06,
+        0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15, 0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0,
+        0xF5, 0xA7, 0x10, 0x96, 0xE0, 0x00, 0x01, 0x00, 0x02, 0xC5}},
+    {"Eddystone URL", 24, 0, {
+        0x02, 0x01, 0x06,
+        0x03, 0x03, 0xAA, 0xFE,
+        0x10, AD_TYPE_SERVICE_DATA, 0xAA, 0xFE, 0x10, 0xEB, 0x03, 'e', 's', 'p', 'r', 'e', 's', 's', 'i', 'f', 0x07}},
+    {"heart rate strap", 13, 20, {
+        0x02, 0x01, 0x06,
+        0x05, 0x02, 0x0D, 0x18, 0x0F, 0x18,
+        0x03, 0x19, 0x41, 0x03,
+        0x0D, 0x09, 'H', 'R', 'M', '-', 'P', 'r', 'o', ' ', '2', '0', '4', '8',
+        0x02, 0x0A, 0x04,
+        0x02, 0xFF, 0x59}},
+    {"phone, short name", 17, 0, {
+        0x02, 0x01, 0x1A,
+        0x07, 0x08, 'P', 'i', 'x', 'e', 'l', '8',
+        0x05, 0xFF, 0xE0, 0x00, 0x01, 0x02}},
+    {"sensor, 32-bit UUIDs", 16, 0, {
+        0x02, 0x01, 0x04,
+        0x09, 0x05, 0x78, 0x56, 0x34, 0x12, 0x21, 0x43, 0x65, 0x87,
+        0x02, 0x0A, 0xF4}},
+    {"other 128-bit service", 21, 0, {
+        0x02, 0x01, 0x06,
+        0x11, 0x06, 0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0, 0x93, 0xF3, 0xA3, 0xB5, 0x01, 0x00, 0x40, 0x6E}},
+    {"flags only", 3, 0, {0x02, 0x01, 0x06}},
+};
+
+#define RECORDED_COUNT (sizeof(g_recorded) / sizeof(g_recorded[0]))
+
+// What bat_log_verbose_ble_scan looks up after the name.
+static const uint8_t g_queried_types[] = {
+    ESP_BLE_AD_TYPE_FLAG,        ESP_BLE_AD_TYPE_16SRV_CMPL,  ESP_BLE_AD_TYPE_16SRV_PART,
+    ESP_BLE_AD_TYPE_32SRV_CMPL,  ESP_BLE_AD_TYPE_32SRV_PART,  ESP_BLE_AD_TYPE_128SRV_CMPL,
+    ESP_BLE_AD_TYPE_128SRV_PART, ESP_BLE_AD_TYPE_TX_PWR,      ESP_BLE_AD_TYPE_APPEARANCE,
+    ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE, AD_TYPE_SERVICE_DATA,
+};
+
+#define QUERIED_COUNT sizeof(g_queried_types)
+
+// How many of `g_queried_types` are looked up: none on the plain scan path, all when logging.
+static size_t g_query_count = QUERIED_COUNT;
+
+typedef struct {
+    char name[NAME_LEN];
+    bool has_service;
+    const uint8_t *pFound[QUERIED_COUNT];
+    uint8_t found_len[QUERIED_COUNT];
+} adv_answers_t;
+
+// BTM_CheckAdvData: restart from the first structure for every type asked for.
+static const uint8_t *resolve_adv_data(const uint8_t *pAdv, uint8_t type, uint8_t *pLen)
+{
+    size_t pos = 0;
+    uint8_t length = pAdv[pos++];
+    while (length != 0 && pos + length <= ADV_BUFFER_LEN)
+    {
+        if (pAdv[pos] == type)
+        {
+            *pLen = length - 1;
+            return &pAdv[pos + 1];
+        }
+        pos += length;
+        if (pos >= ADV_BUFFER_LEN)
+            break;
+        length = pAdv[pos++];
+    }
+    *pLen = 0;
+    return NULL;
+}
+
+static bool resolve_has_uuid128(const uint8_t *pAdv, uint8_t type, const uint8_t *pUuid)
+{
+    uint8_t len = 0;
+    const uint8_t *pList = resolve_adv_data(pAdv, type, &len);
+    for (uint8_t pos = 0; pList != NULL && pos + ESP_UUID_LEN_128 <= len; pos += ESP_UUID_LEN_128)
+    {
+        if (memcmp(&pList[pos], pUuid, ESP_UUID_LEN_128) == 0)
+            return true;
+    }
+    return false;
+}
+
+__attribute__((noinline)) static void answer_resolve(const recorded_adv_t *pAdv, adv_answers_t *pAnswers)
+{
+    uint8_t len = 0;
+    const uint8_t *pName = resolve_adv_data(pAdv->data, ESP_BLE_AD_TYPE_NAME_CMPL, &len);
+    if (pName == NULL || len == 0)
+        pName = resolve_adv_data(pAdv->data, ESP_BLE_AD_TYPE_NAME_SHORT, &len);
+    size_t copy_len = (pName == NULL) ? 0 : (len < NAME_LEN - 1) ? len : NAME_LEN - 1;
+    if (copy_len != 0)
+        memcpy(pAnswers->name, pName, copy_len);
+    pAnswers->name[copy_len] = '\0';
+
+    pAnswers->has_service = resolve_has_uuid128(pAdv->data, ESP_BLE_AD_TYPE_128SRV_CMPL, g_service_uuid) ||
+                            resolve_has_uuid128(pAdv->data, ESP_BLE_AD_TYPE_128SRV_PART, g_service_uuid);
+
+    for (size_t i = 0; i < g_query_count; ++i)
+        pAnswers->pFound[i] = resolve_adv_data(pAdv->data, g_queried_types[i], &pAnswers->found_len[i]);
+}
+
+__attribute__((noinline)) static void answer_indexed(const recorded_adv_t *pAdv, adv_answers_t *pAnswers)
+{
+    bat_adv_index_t index;
+    BENCH_CHECK(bat_adv_parse(pAdv->data, pAdv->adv_len + pAdv->scan_rsp_len, &index) == ESP_OK);
+
+    bat_adv_get_name(&index, pAnswers->name, sizeof(pAnswers->name));
+    pAnswers->has_service = bat_adv_has_uuid128(&index, g_service_uuid);
+    for (size_t i = 0; i < g_query_count; ++i)
+        pAnswers->pFound[i] = bat_adv_find(&index, g_queried_types[i], &pAnswers->found_len[i]);
+}
+
+static uint64_t run(void (*answer)(const recorded_adv_t *, adv_answers_t *))
+{
+    adv_answers_t answers;
+    uintptr_t sink = 0;
+    uint64_t start = bench_now_ns();
+    for (int r = 0; r < ROUNDS; ++r)
+        for (size_t i = 0; i < RECORDED_COUNT; ++i)
+        {
+            answer(&g_recorded[i], &answers);
+            sink += (uintptr_t)answers.name[0] + answers.has_service;
+        }
+    g_bench_sink = sink;
+    return bench_now_ns() - start;
+}
+
+static void check_answers(void)
+{
+    for (size_t i = 0; i < RECORDED_COUNT; ++i)
+    {
+        const recorded_adv_t *pAdv = &g_recorded[i];
+        adv_answers_t expected;
+        adv_answers_t actual;
+        memset(&expected, 0, sizeof(expected));
+        memset(&actual, 0, sizeof(actual));
+        answer_resolve(pAdv, &expected);
+        answer_indexed(pAdv, &actual);
+
+        printf("  %-24s name \"%s\"%s\n", pAdv->pszName, actual.name, actual.has_service ? ", service UUID" : "");
+        BENCH_CHECK(strcmp(expected.name, actual.name) == 0);
+        BENCH_CHECK(expected.has_service == actual.has_service);
+        BENCH_CHECK(memcmp(expected.pFound, actual.pFound, sizeof(expected.pFound)) == 0);
+        BENCH_CHECK(memcmp(expected.found_len, actual.found_len, sizeof(expected.found_len)) == 0);
+    }
+
+    // The recordings must exercise both name kinds, the service UUID and the scan response.
+    adv_answers_t answers;
+    answer_indexed(&g_recorded[0], &answers);
+    BENCH_CHECK(strcmp(answers.name, "BAT-1abc") == 0 && answers.has_service);
+    answer_indexed(&g_recorded[4], &answers);
+    BENCH_CHECK(strcmp(answers.name, "Pixel8") == 0 && !answers.has_service);
+    answer_indexed(&g_recorded[6], &answers);
+    BENCH_CHECK(answers.name[0] == '\0' && !answers.has_service);
+
+    // A structure running past the payload is dropped, the ones before it stay indexed.
+    static const uint8_t truncated[] = {0x02, 0x01, 0x06, 0x09, 0x09, 'B', 'A'};
+    bat_adv_index_t index;
+    BENCH_CHECK(bat_adv_parse(truncated, sizeof(truncated), &index) == ESP_ERR_INVALID_SIZE);
+    BENCH_CHECK(index.count == 1 && bat_adv_has_type(&index, ESP_BLE_AD_TYPE_FLAG));
+    BENCH_CHECK(!bat_adv_has_type(&index, ESP_BLE_AD_TYPE_NAME_CMPL));
+}
+
+int main(void)
+{
+    printf("Recorded advertisements\n");
+    check_answers();
+
+    printf("Name and service UUID per result, %zu payloads x %d rounds\n", RECORDED_COUNT, ROUNDS);
+    g_query_count = 0;
+    uint64_t resolve_ns = run(answer_resolve);
+    uint64_t indexed_ns = run(answer_indexed);
+    bench_report("esp_ble_resolve_adv_data per type", resolve_ns, (uint64_t)RECORDED_COUNT * ROUNDS);
+    bench_report("bat_adv_parse + queries", indexed_ns, (uint64_t)RECORDED_COUNT * ROUNDS);
+
+    printf("Plus the %zu AD types of the verbose log\n", QUERIED_COUNT);
+    g_query_count = QUERIED_COUNT;
+    resolve_ns = run(answer_resolve);
+    indexed_ns = run(answer_indexed);
+    bench_report("esp_ble_resolve_adv_data per type", resolve_ns, (uint64_t)RECORDED_COUNT * ROUNDS);
+    bench_report("bat_adv_parse + queries", indexed_ns, (uint64_t)RECORDED_COUNT * ROUNDS);
+    return bench_result();
+}
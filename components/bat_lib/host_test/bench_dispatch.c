@@ -0,0 +1,221 @@
+/**
+ * @file bench_dispatch.c
+ * @brief GATTS event dispatch: hash table lookup and switch against direct-indexed tables.
+ *
+ * Both dispatchers are modelled on bat_gatts_event_handler in bat_ble_server.c, before and
+ * after it moved to `gatts_cb_by_if` and `gatts_event_handlers`. The handler itself needs
+ * Bluedroid, so the event codes and callbacks are stand-ins and the logging is left out.
+ * A synthetic stream, mostly reads and writes over three interfaces with the odd unknown
+ * interface, is driven through both and the callback counts compared.
+ */
+#include "bat_hash_table.h"
+#include "bench.h"
+#include <string.h>
+
+#define GATTS_IF_MAX 32                  // BAT_GATTS_IF_MAX
+#define EVENTS 4096
+#define ROUNDS 500
+
+// Same numbering as esp_gatts_cb_event_t.
+typedef enum {
+    EVT_REG = 0,
+    EVT_READ = 1,
+    EVT_WRITE = 2,
+    EVT_EXEC_WRITE = 3,
+    EVT_MTU = 4,
+    EVT_CONF = 5,
+    EVT_CREATE = 7,
+    EVT_ADD_CHAR = 9,
+    EVT_START = 12,
+    EVT_CONNECT = 14,
+    EVT_DISCONNECT = 15,
+    EVT_CONGEST = 20,
+    EVT_COUNT = 25,
+} bench_event_t;
+
+typedef struct {
+    uint8_t gatts_if;
+    uint8_t event;
+    uint16_t handle;
+} bench_param_t;
+
+typedef struct bench_callbacks_t bench_callbacks_t;
+typedef void (*bench_cb_t)(bench_callbacks_t *pCb, const bench_param_t *pParam);
+
+struct bench_callbacks_t {
+    bench_cb_t on_read;
+    bench_cb_t on_write;
+    bench_cb_t on_exec_write;
+    bench_cb_t on_mtu;
+    bench_cb_t on_conf;
+    bench_cb_t on_create;
+    bench_cb_t on_add_char;
+    bench_cb_t on_start;
+    bench_cb_t on_connect;
+    bench_cb_t on_disconnect;
+    bench_cb_t on_congest;
+    uint32_t calls[EVT_COUNT];
+    uint32_t handle_sum;
+};
+
+static void bench_on_event(bench_callbacks_t *pCb, const bench_param_t *pParam)
+{
+    pCb->calls[pParam->event]++;
+    pCb->handle_sum += pParam->handle;
+}
+
+static void bench_callbacks_init(bench_callbacks_t *pCb)
+{
+    memset(pCb, 0, sizeof(*pCb));
+    pCb->on_read = pCb->on_write = pCb->on_exec_write = pCb->on_mtu = pCb->on_conf = bench_on_event;
+    pCb->on_create = pCb->on_add_char = pCb->on_start = pCb->on_connect = pCb->on_disconnect = bench_on_event;
+    pCb->on_congest = bench_on_event;
+}
+
+// Before: gatts_if hashed through a chained table of 16 buckets, then a switch.
+static bat_hash_table_t g_cb_table;
+
+__attribute__((noinline)) static void dispatch_hashed(const bench_param_t *pParam)
+{
+    bench_callbacks_t *pCb = NULL;
+    if (bat_hash_table_get(&g_cb_table, pParam->gatts_if, (void **)&pCb) != ESP_OK || pCb == NULL)
+        return;
+
+    switch (pParam->event)
+    {
+    case EVT_READ:
+        pCb->on_read(pCb, pParam);
+        break;
+    case EVT_WRITE:
+        pCb->on_write(pCb, pParam);
+        break;
+    case EVT_EXEC_WRITE:
+        pCb->on_exec_write(pCb, pParam);
+        break;
+    case EVT_MTU:
+        pCb->on_mtu(pCb, pParam);
+        break;
+    case EVT_CONF:
+        pCb->on_conf(pCb, pParam);
+        break;
+    case EVT_CREATE:
+        pCb->on_create(pCb, pParam);
+        break;
+    case EVT_ADD_CHAR:
+        pCb->on_add_char(pCb, pParam);
+        break;
+    case EVT_START:
+        pCb->on_start(pCb, pParam);
+        break;
+    case EVT_CONNECT:
+        pCb->on_connect(pCb, pParam);
+        break;
+    case EVT_DISCONNECT:
+        pCb->on_disconnect(pCb, pParam);
+        break;
+    case EVT_CONGEST:
+        pCb->on_congest(pCb, pParam);
+        break;
+    default:
+        break;
+    }
+}
+
+// After: gatts_if indexes the callbacks, the event indexes a const table of handlers.
+static bench_callbacks_t *g_cb_by_if[GATTS_IF_MAX];
+
+static void on_read_evt(bench_callbacks_t *pCb, const bench_param_t *pParam) { pCb->on_read(pCb, pParam); }
+static void on_write_evt(bench_callbacks_t *pCb, const bench_param_t *pParam) { pCb->on_write(pCb, pParam); }
+static void on_exec_write_evt(bench_callbacks_t *pCb, const bench_param_t *pParam) { pCb->on_exec_write(pCb, pParam); }
+static void on_mtu_evt(bench_callbacks_t *pCb, const bench_param_t *pParam) { pCb->on_mtu(pCb, pParam); }
+static void on_conf_evt(bench_callbacks_t *pCb, const bench_param_t *pParam) { pCb->on_conf(pCb, pParam); }
+static void on_create_evt(bench_callbacks_t *pCb, const bench_param_t *pParam) { pCb->on_create(pCb, pParam); }
+static void on_add_char_evt(bench_callbacks_t *pCb, const bench_param_t *pParam) { pCb->on_add_char(pCb, pParam); }
+static void on_start_evt(bench_callbacks_t *pCb, const bench_param_t *pParam) { pCb->on_start(pCb, pParam); }
+static void on_connect_evt(bench_callbacks_t *pCb, const bench_param_t *pParam) { pCb->on_connect(pCb, pParam); }
+static void on_disconnect_evt(bench_callbacks_t *pCb, const bench_param_t *pParam) { pCb->on_disconnect(pCb, pParam); }
+static void on_congest_evt(bench_callbacks_t *pCb, const bench_param_t *pParam) { pCb->on_congest(pCb, pParam); }
+
+static const bench_cb_t g_event_handlers[EVT_COUNT] = {
+    [EVT_READ] = on_read_evt,
+    [EVT_WRITE] = on_write_evt,
+    [EVT_EXEC_WRITE] = on_exec_write_evt,
+    [EVT_MTU] = on_mtu_evt,
+    [EVT_CONF] = on_conf_evt,
+    [EVT_CREATE] = on_create_evt,
+    [EVT_ADD_CHAR] = on_add_char_evt,
+    [EVT_START] = on_start_evt,
+    [EVT_CONNECT] = on_connect_evt,
+    [EVT_DISCONNECT] = on_disconnect_evt,
+    [EVT_CONGEST] = on_congest_evt,
+};
+
+__attribute__((noinline)) static void dispatch_indexed(const bench_param_t *pParam)
+{
+    bench_callbacks_t *pCb = (pParam->gatts_if < GATTS_IF_MAX) ? g_cb_by_if[pParam->gatts_if] : NULL;
+    if (pCb == NULL)
+        return;
+
+    if (pParam->event < EVT_COUNT && g_event_handlers[pParam->event] != NULL)
+        g_event_handlers[pParam->event](pCb, pParam);
+}
+
+static bench_param_t g_events[EVENTS];
+
+// 45 % reads, 45 % writes, the rest spread over the other events. One in 64 goes to an
+// interface nobody registered.
+static void make_events(void)
+{
+    static const uint8_t others[] = {EVT_MTU, EVT_CONF, EVT_CONNECT, EVT_DISCONNECT, EVT_CONGEST, EVT_EXEC_WRITE, 6};
+    uint32_t state = 0x2545F491;
+    for (size_t i = 0; i < EVENTS; ++i)
+    {
+        uint32_t r = bench_rand(&state);
+        uint32_t pick = r % 100;
+        g_events[i].event = (pick < 45) ? EVT_READ : (pick < 90) ? EVT_WRITE : others[(r >> 8) % sizeof(others)];
+        g_events[i].gatts_if = ((r >> 16) % 64 == 0) ? 9 : (uint8_t)(3 + (r >> 24) % 3);
+        g_events[i].handle = (uint16_t)(40 + (r >> 12) % 16);
+    }
+}
+
+static uint64_t run(void (*dispatch)(const bench_param_t *))
+{
+    uint64_t start = bench_now_ns();
+    for (int round = 0; round < ROUNDS; ++round)
+        for (size_t i = 0; i < EVENTS; ++i)
+            dispatch(&g_events[i]);
+    return bench_now_ns() - start;
+}
+
+int main(void)
+{
+    static bench_callbacks_t hashed[3];
+    static bench_callbacks_t indexed[3];
+
+    BENCH_CHECK(bat_hash_table_init(&g_cb_table, 16, NULL, NULL) == ESP_OK);
+    for (int i = 0; i < 3; ++i)
+    {
+        bench_callbacks_init(&hashed[i]);
+        bench_callbacks_init(&indexed[i]);
+        BENCH_CHECK(bat_hash_table_set(&g_cb_table, (uint16_t)(3 + i), &hashed[i]) == ESP_OK);
+        g_cb_by_if[3 + i] = &indexed[i];
+    }
+    make_events();
+
+    printf("GATTS dispatch, %d events x %d rounds\n", EVENTS, ROUNDS);
+    uint64_t hashed_ns = run(dispatch_hashed);
+    uint64_t indexed_ns = run(dispatch_indexed);
+    bench_report("hash table lookup + switch", hashed_ns, (uint64_t)EVENTS * ROUNDS);
+    bench_report("gatts_if array + handler table", indexed_ns, (uint64_t)EVENTS * ROUNDS);
+
+    // Both must have delivered the same events to the same callbacks.
+    for (int i = 0; i < 3; ++i)
+    {
+        BENCH_CHECK(memcmp(hashed[i].calls, indexed[i].calls, sizeof(hashed[i].calls)) == 0);
+        BENCH_CHECK(hashed[i].handle_sum == indexed[i].handle_sum);
+        BENCH_CHECK(hashed[i].calls[EVT_READ] != 0 && hashed[i].calls[EVT_WRITE] != 0);
+    }
+
+    bat_hash_table_cleanup(&g_cb_table);
+    return bench_result();
+}
@@ -0,0 +1,175 @@
+/**
+ * @file bench_hash_table.c
+ * @brief Chained against open addressing bat_hash_table at several load factors.
+ *
+ * Tables are fixed-size so the load factor holds while they are measured. Each case times
+ * lookups that hit, lookups that miss, and remove + re-insert churn, with `uint16_t` keys
+ * as on the GATTS path.
+ *
+ * The growth case removes keys from a table that has just started growing, as the peer store
+ * does when it evicts, and checks that no call migrates more than `BAT_HASH_TABLE_REHASH_STEP`
+ * buckets of the old set while every remaining key stays reachable. One open addressing run
+ * gives every key the same home bucket near the end of the set, so the probe sequence wraps
+ * around into the buckets that are drained first.
+ */
+#include "bat_hash_table.h"
+#include "bench.h"
+
+#define BUCKETS 1024
+#define LOOKUP_ROUNDS 400
+#define CHURN_ROUNDS 100
+#define GROWTH_BUCKETS 256
+#define WRAP_BUCKETS 16
+
+static uint16_t g_keys[BUCKETS];
+static uint16_t g_absent[BUCKETS];
+
+// Distinct keys, half of them stored and half kept back for misses.
+static void make_keys(void)
+{
+    static uint8_t seen[65536 / 8];
+    uint32_t state = 0x9E3779B9;
+    for (size_t i = 0; i < 2 * BUCKETS;)
+    {
+        uint16_t key = (uint16_t)bench_rand(&state);
+        if (seen[key >> 3] & (1u << (key & 7)))
+            continue;
+        seen[key >> 3] |= (uint8_t)(1u << (key & 7));
+        if (i < BUCKETS)
+            g_keys[i] = key;
+        else
+            g_absent[i - BUCKETS] = key;
+        ++i;
+    }
+}
+
+static void run_case(bat_hash_table_type_t type, const char *pszType, unsigned load_percent)
+{
+    size_t count = BUCKETS * load_percent / 100;
+    bat_hash_table_t table;
+    bat_hash_table_config_t config = {.type = type, .size = BUCKETS, .fixed_size = true};
+    BENCH_CHECK(bat_hash_table_init_ex(&table, &config) == ESP_OK);
+
+    for (size_t i = 0; i < count; ++i)
+        BENCH_CHECK(bat_hash_table_set(&table, g_keys[i], &g_keys[i]) == ESP_OK);
+    BENCH_CHECK(bat_hash_table_count(&table) == count);
+    for (size_t i = 0; i < count; ++i)
+        BENCH_CHECK(bat_hash_table_try_get(&table, g_keys[i]) == &g_keys[i]);
+    for (size_t i = 0; i < count; ++i)
+        BENCH_CHECK(bat_hash_table_try_get(&table, g_absent[i]) == NULL);
+
+    bat_hash_table_stats_t stats;
+    bat_hash_table_get_stats(&table, &stats);
+    printf("%s, load %u%% (%zu keys), longest chain/probe %zu\n", pszType, load_percent, count, stats.max_chain_len);
+
+    uintptr_t sink = 0;
+    uint64_t start = bench_now_ns();
+    for (int r = 0; r < LOOKUP_ROUNDS; ++r)
+        for (size_t i = 0; i < count; ++i)
+            sink += (uintptr_t)bat_hash_table_try_get(&table, g_keys[i]);
+    bench_report("get, hit", bench_now_ns() - start, (uint64_t)LOOKUP_ROUNDS * count);
+
+    start = bench_now_ns();
+    for (int r = 0; r < LOOKUP_ROUNDS; ++r)
+        for (size_t i = 0; i < count; ++i)
+            sink += (uintptr_t)bat_hash_table_try_get(&table, g_absent[i]);
+    bench_report("get, miss", bench_now_ns() - start, (uint64_t)LOOKUP_ROUNDS * count);
+
+    start = bench_now_ns();
+    for (int r = 0; r < CHURN_ROUNDS; ++r)
+        for (size_t i = 0; i < count; ++i)
+        {
+            bat_hash_table_remove(&table, g_keys[i]);
+            bat_hash_table_set(&table, g_keys[i], &g_keys[i]);
+        }
+    bench_report("remove + set", bench_now_ns() - start, (uint64_t)CHURN_ROUNDS * count);
+    g_bench_sink = sink;
+
+    BENCH_CHECK(bat_hash_table_count(&table) == count);
+    for (size_t i = 0; i < count; ++i)
+        BENCH_CHECK(bat_hash_table_try_get(&table, g_keys[i]) == &g_keys[i]);
+    bat_hash_table_cleanup(&table);
+}
+
+// Buckets of the old set migrated since `prev_idx`, counting the ones finished by the last step.
+static size_t migrated_since(const bat_hash_table_t *pTable, size_t old_size, size_t prev_idx)
+{
+    return (pTable->old.size == 0) ? old_size - prev_idx : pTable->rehash_idx - prev_idx;
+}
+
+// Every key hashes to the second to last bucket of the wrap case table, before and after it grows.
+static uint32_t wrap_hash(const void *pKey, size_t len)
+{
+    (void)pKey;
+    (void)len;
+    return WRAP_BUCKETS - 2;
+}
+
+static void run_growth_case(
+    bat_hash_table_type_t type, const char *pszType, size_t size, uint16_t max_load_percent, bat_hash_fn_t hash_fn)
+{
+    bat_hash_table_t table;
+    bat_hash_table_config_t config = {
+        .type = type, .size = size, .max_load_percent = max_load_percent, .hash_fn = hash_fn};
+    BENCH_CHECK(bat_hash_table_init_ex(&table, &config) == ESP_OK);
+
+    size_t count = 0;
+    bat_hash_table_stats_t stats = {0};
+    while (!stats.rehashing && count < BUCKETS)
+    {
+        BENCH_CHECK(bat_hash_table_set(&table, g_keys[count], &g_keys[count]) == ESP_OK);
+        ++count;
+        bat_hash_table_get_stats(&table, &stats);
+    }
+    BENCH_CHECK(stats.rehashing);
+
+    const size_t old_size = table.old.size;
+    size_t removed = 0;
+    size_t max_migrated = 0;
+    uint64_t elapsed = 0;
+    while (table.old.size != 0 && removed < count)
+    {
+        size_t prev_idx = table.rehash_idx;
+        uint64_t start = bench_now_ns();
+        BENCH_CHECK(bat_hash_table_remove(&table, g_keys[removed]) == ESP_OK);
+        elapsed += bench_now_ns() - start;
+
+        size_t migrated = migrated_since(&table, old_size, prev_idx);
+        if (migrated > max_migrated)
+            max_migrated = migrated;
+        BENCH_CHECK(migrated <= BAT_HASH_TABLE_REHASH_STEP);
+        BENCH_CHECK(bat_hash_table_try_get(&table, g_keys[removed]) == NULL);
+        ++removed;
+
+        for (size_t i = removed; i < count; ++i)
+            BENCH_CHECK(bat_hash_table_try_get(&table, g_keys[i]) == &g_keys[i]);
+    }
+    BENCH_CHECK(table.old.size == 0); // The removals alone drive the migration to its end.
+
+    printf("%s, growing from %zu buckets at load %u%%, %zu removals\n", pszType, old_size, (unsigned)table.max_load_percent,
+           removed);
+    printf("  most buckets migrated by one remove: %zu (limit %d)\n", max_migrated, BAT_HASH_TABLE_REHASH_STEP);
+    bench_report("remove while growing", elapsed, removed);
+
+    BENCH_CHECK(bat_hash_table_count(&table) == count - removed);
+    bat_hash_table_cleanup(&table);
+}
+
+int main(void)
+{
+    static const unsigned loads[] = {25, 50, 75, 90};
+    make_keys();
+
+    printf("bat_hash_table, %d buckets\n", BUCKETS);
+    for (size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); ++i)
+    {
+        run_case(BAT_HASH_TABLE_CHAINED, "chained", loads[i]);
+        run_case(BAT_HASH_TABLE_OPEN, "open addressing", loads[i]);
+    }
+
+    run_growth_case(BAT_HASH_TABLE_CHAINED, "chained", GROWTH_BUCKETS, 0, NULL);
+    run_growth_case(BAT_HASH_TABLE_OPEN, "open addressing", GROWTH_BUCKETS, 0, NULL);
+    run_growth_case(BAT_HASH_TABLE_OPEN, "open addressing", GROWTH_BUCKETS, 90, NULL);
+    run_growth_case(BAT_HASH_TABLE_OPEN, "open addressing, one wrapping probe sequence", WRAP_BUCKETS, 0, wrap_hash);
+    return bench_result();
+}
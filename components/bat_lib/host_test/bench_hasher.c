@@ -0,0 +1,195 @@
+/**
+ * @file bench_hasher.c
+ * @brief bat_hash_table hashers: cost per key and bucket distribution.
+ *
+ * Times the old bucket index, `bat_rs_hash_uint16` with its `% size`, against
+ * `bat_hash_uint32` masked to a power of two, and `bat_hash_bytes` on BDA and UUID keys.
+ *
+ * The distribution check hashes key sets shaped like the real ones (consecutive and
+ * strided small integers, BDAs sharing a vendor prefix, UUIDs differing only in their
+ * 16-bit alias) into 64, 256 and 1024 buckets. The chi-squared statistic over the degrees
+ * of freedom is about 1 for a uniform spread. The new hashers must stay below
+ * `MAX_CHI2_RATIO`, the old one is reported for comparison.
+ */
+#include "bat_hash_table.h"
+#include "bench.h"
+#include <string.h>
+
+#define KEYS 4096
+#define ROUNDS 2000
+#define KEYS_PER_BUCKET 8
+#define MAX_CHI2_RATIO 1.5
+
+typedef enum {
+    KEYS_SEQUENTIAL,
+    KEYS_STRIDE_16,
+    KEYS_RANDOM,
+    KEYS_BDA_SAME_OUI,
+    KEYS_UUID_16BIT_ALIAS,
+    KEYS_KIND_COUNT,
+} key_kind_t;
+
+static const char *g_kind_names[KEYS_KIND_COUNT] = {
+    "consecutive uint16", "uint16 stride 16", "random uint16", "BDA, one OUI", "UUID, 16-bit aliases",
+};
+
+// The Bluetooth base UUID, little endian, the 16-bit alias goes in bytes 12 and 13.
+static const uint8_t g_base_uuid[16] = {
+    0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static size_t key_len(key_kind_t kind)
+{
+    return (kind == KEYS_BDA_SAME_OUI) ? 6 : (kind == KEYS_UUID_16BIT_ALIAS) ? 16 : 2;
+}
+
+static void make_key(key_kind_t kind, size_t i, uint32_t *pState, uint8_t *pKey)
+{
+    uint16_t small = 0;
+    switch (kind)
+    {
+    case KEYS_SEQUENTIAL:
+        small = (uint16_t)i;
+        break;
+    case KEYS_STRIDE_16:
+        small = (uint16_t)(i * 16);
+        break;
+    case KEYS_RANDOM:
+        small = (uint16_t)bench_rand(pState);
+        break;
+    case KEYS_BDA_SAME_OUI:
+        pKey[0] = 0x24;
+        pKey[1] = 0x0A;
+        pKey[2] = 0xC4;
+        pKey[3] = (uint8_t)(i >> 16);
+        pKey[4] = (uint8_t)(i >> 8);
+        pKey[5] = (uint8_t)i;
+        return;
+    case KEYS_UUID_16BIT_ALIAS:
+        memcpy(pKey, g_base_uuid, sizeof(g_base_uuid));
+        pKey[12] = (uint8_t)(0x1800 + i);
+        pKey[13] = (uint8_t)((0x1800 + i) >> 8);
+        return;
+    default:
+        return;
+    }
+    memcpy(pKey, &small, sizeof(small));
+}
+
+static uint32_t new_hash(key_kind_t kind, const uint8_t *pKey)
+{
+    if (key_len(kind) == 2)
+    {
+        uint16_t key;
+        memcpy(&key, pKey, sizeof(key));
+        return bat_hash_uint32(key);
+    }
+    return bat_hash_bytes(pKey, key_len(kind));
+}
+
+static double chi2_ratio(const uint32_t *pCounts, size_t buckets, size_t keys)
+{
+    double expected = (double)keys / (double)buckets;
+    double chi2 = 0.0;
+    for (size_t b = 0; b < buckets; ++b)
+    {
+        double d = (double)pCounts[b] - expected;
+        chi2 += d * d / expected;
+    }
+    return chi2 / (double)(buckets - 1);
+}
+
+static void check_distribution(void)
+{
+    static const size_t bucket_counts[] = {64, 256, 1024};
+    static uint32_t counts_new[1024];
+    static uint32_t counts_old[1024];
+
+    printf("Distribution, chi2 / degrees of freedom (1.0 = uniform), %d keys per bucket\n", KEYS_PER_BUCKET);
+    printf("  %-24s %8s %14s %14s\n", "keys", "buckets", "new", "old (uint16)");
+    for (int kind = 0; kind < KEYS_KIND_COUNT; ++kind)
+    {
+        for (size_t s = 0; s < sizeof(bucket_counts) / sizeof(bucket_counts[0]); ++s)
+        {
+            size_t buckets = bucket_counts[s];
+            size_t keys = buckets * KEYS_PER_BUCKET;
+            uint32_t state = 0xC0FFEE;
+            memset(counts_new, 0, sizeof(counts_new));
+            memset(counts_old, 0, sizeof(counts_old));
+
+            for (size_t i = 0; i < keys; ++i)
+            {
+                uint8_t key[16];
+                make_key((key_kind_t)kind, i, &state, key);
+                counts_new[new_hash((key_kind_t)kind, key) & (buckets - 1)]++;
+                if (key_len((key_kind_t)kind) == 2)
+                {
+                    uint16_t small;
+                    memcpy(&small, key, sizeof(small));
+                    counts_old[bat_rs_hash_uint16(small, buckets)]++;
+                }
+            }
+
+            double ratio = chi2_ratio(counts_new, buckets, keys);
+            if (key_len((key_kind_t)kind) == 2)
+                printf("  %-24s %8zu %14.2f %14.2f\n", g_kind_names[kind], buckets, ratio,
+                       chi2_ratio(counts_old, buckets, keys));
+            else
+                printf("  %-24s %8zu %14.2f %14s\n", g_kind_names[kind], buckets, ratio, "-");
+            BENCH_CHECK(ratio < MAX_CHI2_RATIO);
+        }
+    }
+}
+
+static void time_hashers(void)
+{
+    static uint16_t keys16[KEYS];
+    static uint8_t bdas[KEYS][6];
+    static uint8_t uuids[KEYS][16];
+    uint32_t state = 0xBADC0DE;
+    for (size_t i = 0; i < KEYS; ++i)
+    {
+        keys16[i] = (uint16_t)bench_rand(&state);
+        make_key(KEYS_BDA_SAME_OUI, bench_rand(&state), &state, bdas[i]);
+        make_key(KEYS_UUID_16BIT_ALIAS, i, &state, uuids[i]);
+    }
+
+    // Read back through a volatile so the compiler cannot turn the modulo into a mask.
+    volatile size_t size_var = 256;
+    size_t size = size_var;
+    uint32_t mask = (uint32_t)size - 1;
+    uint32_t sink = 0;
+
+    printf("Hash + bucket index, %d keys x %d rounds\n", KEYS, ROUNDS);
+    uint64_t start = bench_now_ns();
+    for (int r = 0; r < ROUNDS; ++r)
+        for (size_t i = 0; i < KEYS; ++i)
+            sink += bat_rs_hash_uint16(keys16[i], size);
+    bench_report("bat_rs_hash_uint16, % size", bench_now_ns() - start, (uint64_t)KEYS * ROUNDS);
+
+    start = bench_now_ns();
+    for (int r = 0; r < ROUNDS; ++r)
+        for (size_t i = 0; i < KEYS; ++i)
+            sink += bat_hash_uint32(keys16[i]) & mask;
+    bench_report("bat_hash_uint32, & mask", bench_now_ns() - start, (uint64_t)KEYS * ROUNDS);
+
+    start = bench_now_ns();
+    for (int r = 0; r < ROUNDS; ++r)
+        for (size_t i = 0; i < KEYS; ++i)
+            sink += bat_hash_bytes(bdas[i], 6) & mask;
+    bench_report("bat_hash_bytes, 6-byte BDA", bench_now_ns() - start, (uint64_t)KEYS * ROUNDS);
+
+    start = bench_now_ns();
+    for (int r = 0; r < ROUNDS; ++r)
+        for (size_t i = 0; i < KEYS; ++i)
+            sink += bat_hash_bytes(uuids[i], 16) & mask;
+    bench_report("bat_hash_bytes, 16-byte UUID", bench_now_ns() - start, (uint64_t)KEYS * ROUNDS);
+    g_bench_sink = sink;
+}
+
+int main(void)
+{
+    check_distribution();
+    time_hashers();
+    return bench_result();
+}
@@ -0,0 +1,152 @@
+/**
+ * @file bench_pool.c
+ * @brief bat_pool against calloc/free for hash table overflow entries.
+ *
+ * Replays the same random allocate/free sequence, a live set that wanders between empty
+ * and `LIVE_MAX` blocks, through both allocators. Also checks the pool's accounting: every
+ * block distinct and zeroed, in-use and high-water marks, and refusals once `max_slabs`
+ * is reached.
+ */
+#include "bat_pool.h"
+#include "bench.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_SIZE 24                    // A chained bat_hash_entry_t with a 2-byte key, on a 64-bit host.
+#define LIVE_MAX 256
+#define STEPS 200000
+#define ROUNDS 20
+
+static uint8_t g_ops[STEPS];             // 1 = allocate, 0 = free a random live block.
+static uint16_t g_picks[STEPS];
+static const uint8_t g_zero[BLOCK_SIZE];
+
+static void make_ops(void)
+{
+    uint32_t state = 0x1234567;
+    size_t live = 0;
+    for (size_t i = 0; i < STEPS; ++i)
+    {
+        uint32_t r = bench_rand(&state);
+        bool alloc = (live == 0) || (live < LIVE_MAX && (r & 1));
+        g_ops[i] = alloc;
+        g_picks[i] = (uint16_t)(r >> 16);
+        live += alloc ? 1 : -1;
+    }
+}
+
+static uint64_t run_calloc(void)
+{
+    void *live[LIVE_MAX];
+    size_t count = 0;
+    uint64_t start = bench_now_ns();
+    for (int r = 0; r < ROUNDS; ++r)
+    {
+        for (size_t i = 0; i < STEPS; ++i)
+        {
+            if (g_ops[i])
+            {
+                live[count++] = calloc(1, BLOCK_SIZE);
+            }
+            else
+            {
+                size_t pick = g_picks[i] % count;
+                free(live[pick]);
+                live[pick] = live[--count];
+            }
+        }
+        while (count != 0)
+            free(live[--count]);
+    }
+    return bench_now_ns() - start;
+}
+
+static uint64_t run_pool(bat_pool_t *pPool)
+{
+    void *live[LIVE_MAX];
+    size_t count = 0;
+    uint64_t start = bench_now_ns();
+    for (int r = 0; r < ROUNDS; ++r)
+    {
+        for (size_t i = 0; i < STEPS; ++i)
+        {
+            if (g_ops[i])
+            {
+                live[count++] = bat_pool_alloc(pPool);
+            }
+            else
+            {
+                size_t pick = g_picks[i] % count;
+                bat_pool_free(pPool, live[pick]);
+                live[pick] = live[--count];
+            }
+        }
+        while (count != 0)
+            bat_pool_free(pPool, live[--count]);
+    }
+    return bench_now_ns() - start;
+}
+
+static void check_accounting(void)
+{
+    bat_pool_t pool;
+    bat_pool_stats_t stats;
+    void *blocks[33];
+
+    // Four slabs of eight: 32 blocks, then refusals.
+    BENCH_CHECK(bat_pool_init(&pool, BLOCK_SIZE, 8, 4) == ESP_OK);
+    for (size_t i = 0; i < 33; ++i)
+    {
+        blocks[i] = bat_pool_alloc(&pool);
+        if (blocks[i] != NULL)
+        {
+            BENCH_CHECK(memcmp(blocks[i], g_zero, BLOCK_SIZE) == 0);
+            BENCH_CHECK(((uintptr_t)blocks[i] % sizeof(void *)) == 0);
+            memset(blocks[i], 0xA5, BLOCK_SIZE);
+        }
+    }
+    BENCH_CHECK(blocks[32] == NULL);
+    for (size_t i = 0; i < 32; ++i)
+        for (size_t j = i + 1; j < 32; ++j)
+            BENCH_CHECK(blocks[i] != blocks[j]);
+
+    bat_pool_get_stats(&pool, &stats);
+    BENCH_CHECK(stats.capacity == 32 && stats.slab_count == 4);
+    BENCH_CHECK(stats.in_use == 32 && stats.high_water == 32);
+    BENCH_CHECK(stats.alloc_failures == 1);
+
+    for (size_t i = 0; i < 32; i += 2)
+        bat_pool_free(&pool, blocks[i]);
+    bat_pool_reset_high_water(&pool);
+    bat_pool_get_stats(&pool, &stats);
+    BENCH_CHECK(stats.in_use == 16 && stats.high_water == 16 && stats.capacity == 32);
+
+    // Freed blocks come back zeroed.
+    void *pAgain = bat_pool_alloc(&pool);
+    BENCH_CHECK(pAgain != NULL && memcmp(pAgain, g_zero, BLOCK_SIZE) == 0);
+    bat_pool_deinit(&pool);
+}
+
+int main(void)
+{
+    check_accounting();
+    make_ops();
+
+    bat_pool_t pool;
+    BENCH_CHECK(bat_pool_init(&pool, BLOCK_SIZE, 0, 0) == ESP_OK);
+
+    printf("%d-byte blocks, up to %d live, %d steps x %d rounds\n", BLOCK_SIZE, LIVE_MAX, STEPS, ROUNDS);
+    uint64_t calloc_ns = run_calloc();
+    uint64_t pool_ns = run_pool(&pool);
+    bench_report("calloc/free", calloc_ns, (uint64_t)STEPS * ROUNDS);
+    bench_report("bat_pool_alloc/free", pool_ns, (uint64_t)STEPS * ROUNDS);
+
+    bat_pool_stats_t stats;
+    bat_pool_get_stats(&pool, &stats);
+    printf("  pool: %zu slabs, capacity %zu, high water %zu\n", stats.slab_count, stats.capacity, stats.high_water);
+    BENCH_CHECK(stats.in_use == 0);
+    BENCH_CHECK(stats.high_water <= LIVE_MAX && stats.capacity >= stats.high_water);
+    bat_pool_deinit(&pool);
+    return bench_result();
+}
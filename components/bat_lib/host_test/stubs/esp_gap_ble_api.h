@@ -0,0 +1,21 @@
+// Host stand-in for the ESP-IDF header, only what the host-built bat_lib sources use.
+#pragma once
+
+#include "esp_err.h"
+
+#define ESP_UUID_LEN_16 2
+#define ESP_UUID_LEN_32 4
+#define ESP_UUID_LEN_128 16
+
+#define ESP_BLE_AD_TYPE_FLAG 0x01
+#define ESP_BLE_AD_TYPE_16SRV_PART 0x02
+#define ESP_BLE_AD_TYPE_16SRV_CMPL 0x03
+#define ESP_BLE_AD_TYPE_32SRV_PART 0x04
+#define ESP_BLE_AD_TYPE_32SRV_CMPL 0x05
+#define ESP_BLE_AD_TYPE_128SRV_PART 0x06
+#define ESP_BLE_AD_TYPE_128SRV_CMPL 0x07
+#define ESP_BLE_AD_TYPE_NAME_SHORT 0x08
+#define ESP_BLE_AD_TYPE_NAME_CMPL 0x09
+#define ESP_BLE_AD_TYPE_TX_PWR 0x0A
+#define ESP_BLE_AD_TYPE_APPEARANCE 0x19
+#define ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE 0xFF
@@ -0,0 +1,125 @@
+/**
+ * @file bat_adv_builder.h
+ * @brief Serializes advertising data into raw 31-byte payloads, the inverse of bat_adv_parser.h.
+ *
+ * `esp_ble_gap_config_adv_data` lays out an `esp_ble_adv_data_t` inside the stack and, when
+ * the fields do not fit, silently truncates them ("Partial data write into ADV"). Building the
+ * payload here instead makes the byte budget explicit:
+ *   - each `bat_adv_add_*` call appends one AD structure (length, type, data),
+ *   - a structure that does not fit is refused with `ESP_ERR_INVALID_SIZE` and nothing is written,
+ *   - `bat_adv_buf_remaining` tells how many bytes are left for the next one.
+ *
+ * Payloads are plain buffers, they can be built once (at startup or even as static data) and
+ * applied with `bat_gatts_set_advert_raw` (bat_ble_server.h), which uses the raw config calls.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_gap_ble_api.h"
+#include "bat_ble.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BAT_ADV_MAX_LEN ESP_BLE_ADV_DATA_LEN_MAX  ///< Legacy advertising and scan response payload size (31).
+
+/**
+ * @brief A payload being built.
+ */
+typedef struct {
+    uint8_t data[BAT_ADV_MAX_LEN];       ///< AD structures, back to back.
+    uint8_t len;                         ///< Bytes used.
+} bat_adv_buf_t;
+
+/**
+ * @brief Empties a payload.
+ */
+static inline void bat_adv_buf_init(bat_adv_buf_t *pBuf)
+{
+    pBuf->len = 0;
+}
+
+/**
+ * @brief Bytes left in a payload. An AD structure needs two of them plus its data.
+ */
+static inline size_t bat_adv_buf_remaining(const bat_adv_buf_t *pBuf)
+{
+    return BAT_ADV_MAX_LEN - pBuf->len;
+}
+
+/**
+ * @brief Appends one AD structure.
+ *
+ * @param pBuf The payload.
+ * @param type AD type (ESP_BLE_AD_TYPE_*).
+ * @param pData Data, may be NULL if `len` is 0.
+ * @param len Data length.
+ * @return `ESP_OK`, `ESP_ERR_INVALID_ARG` or `ESP_ERR_INVALID_SIZE` if it does not fit.
+ */
+esp_err_t bat_adv_add_field(bat_adv_buf_t *pBuf, uint8_t type, const uint8_t *pData, size_t len);
+
+/**
+ * @brief Appends the flags, e.g. `ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT`.
+ */
+esp_err_t bat_adv_add_flags(bat_adv_buf_t *pBuf, uint8_t flags);
+
+/**
+ * @brief Appends a list of 16-bit service UUIDs.
+ *
+ * @param complete Whether the list holds every service (complete) or only some (incomplete).
+ */
+esp_err_t bat_adv_add_uuid16s(bat_adv_buf_t *pBuf, const uint16_t *pUuids, size_t count, bool complete);
+
+/**
+ * @brief Appends a list of 128-bit service UUIDs.
+ *
+ * @param complete Whether the list holds every service (complete) or only some (incomplete).
+ */
+esp_err_t bat_adv_add_uuid128s(bat_adv_buf_t *pBuf, const bat_ble_uuid128_t *pUuids, size_t count, bool complete);
+
+/**
+ * @brief Appends the device name.
+ *
+ * @param pszName The name.
+ * @param allow_short If the name does not fit, append as much as fits as the shortened name
+ *                    instead of failing. At least one character must fit.
+ */
+esp_err_t bat_adv_add_name(bat_adv_buf_t *pBuf, const char *pszName, bool allow_short);
+
+/**
+ * @brief Appends the appearance (e.g. 0x0944 for headphones).
+ */
+esp_err_t bat_adv_add_appearance(bat_adv_buf_t *pBuf, uint16_t appearance);
+
+/**
+ * @brief Appends the TX power level in dBm.
+ */
+esp_err_t bat_adv_add_tx_power(bat_adv_buf_t *pBuf, int8_t dbm);
+
+/**
+ * @brief Appends the preferred connection interval range, 1.25 ms units.
+ */
+esp_err_t bat_adv_add_conn_interval(bat_adv_buf_t *pBuf, uint16_t min_interval, uint16_t max_interval);
+
+/**
+ * @brief Appends manufacturer specific data, prefixed with the company identifier.
+ */
+esp_err_t bat_adv_add_manufacturer(bat_adv_buf_t *pBuf, uint16_t company_id, const uint8_t *pData, size_t len);
+
+/**
+ * @brief Appends service data for a 16-bit service UUID.
+ */
+esp_err_t bat_adv_add_service_data16(bat_adv_buf_t *pBuf, uint16_t uuid, const uint8_t *pData, size_t len);
+
+/**
+ * @brief Appends service data for a 128-bit service UUID.
+ */
+esp_err_t bat_adv_add_service_data128(bat_adv_buf_t *pBuf, const bat_ble_uuid128_t *pUuid, const uint8_t *pData, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
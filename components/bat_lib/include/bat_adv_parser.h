@@ -0,0 +1,109 @@
+/**
+ * @file bat_adv_parser.h
+ * @brief Single-pass parser for BLE advertising data.
+ *
+ * bat_adv_parse walks the AD structures (length, type, data) of an advertising payload
+ * once and records a compact (type, offset, length) entry for each of them. The entries
+ * point into the caller's buffer, nothing is copied, so the buffer must outlive the index.
+ *
+ * For a scan result pass `ble_adv` and `adv_data_len + scan_rsp_len`: the scan response
+ * follows the advertising data in the same buffer, and is indexed in the same pass.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum number of AD structures in an index.
+ *
+ * A legacy advertisement and its scan response hold at most 62 bytes and every AD
+ * structure takes at least two, so 31 entries always suffice.
+ */
+#define BAT_ADV_MAX_FIELDS 31
+
+/**
+ * @brief One AD structure.
+ */
+typedef struct {
+    uint8_t type;                        ///< AD type (ESP_BLE_AD_TYPE_*).
+    uint8_t offset;                      ///< Offset of the data (after the type byte) in the payload.
+    uint8_t len;                         ///< Length of the data, excluding the type byte.
+} bat_adv_field_t;
+
+/**
+ * @brief Index of the AD structures in a payload.
+ */
+typedef struct {
+    const uint8_t *pData;                ///< The indexed payload, not owned.
+    uint8_t count;                       ///< Number of entries in `fields`.
+    uint32_t types[8];                   ///< Bitmap of the AD types present, for constant time rejection.
+    bat_adv_field_t fields[BAT_ADV_MAX_FIELDS]; ///< Entries, in payload order.
+} bat_adv_index_t;
+
+/**
+ * @brief Indexes the AD structures of a payload in a single pass.
+ *
+ * Parsing stops at the end of the payload or at a zero length byte (padding). A structure
+ * that runs past the end of the payload is dropped, the ones before it stay indexed.
+ *
+ * @param pData Advertising payload.
+ * @param len Payload length in bytes.
+ * @param pIndex Receives the index.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_SIZE` if the payload is truncated,
+ *         or `ESP_ERR_INVALID_ARG`.
+ */
+esp_err_t bat_adv_parse(const uint8_t *pData, size_t len, bat_adv_index_t *pIndex);
+
+/**
+ * @brief Tells whether an AD type is present, without walking the index.
+ *
+ * @param pIndex The index.
+ * @param type AD type.
+ * @return `true` if at least one structure of that type is present.
+ */
+static inline bool bat_adv_has_type(const bat_adv_index_t *pIndex, uint8_t type)
+{
+    return (pIndex->types[type >> 5] & (1u << (type & 31))) != 0;
+}
+
+/**
+ * @brief Finds the first structure of a given type.
+ *
+ * Same contract as `esp_ble_resolve_adv_data`, but backed by the index.
+ *
+ * @param pIndex The index.
+ * @param type AD type.
+ * @param pLen Receives the data length, 0 if not found. May be NULL.
+ * @return Pointer to the data in the original payload, or `NULL` if not found.
+ */
+const uint8_t *bat_adv_find(const bat_adv_index_t *pIndex, uint8_t type, uint8_t *pLen);
+
+/**
+ * @brief Copies the complete name, or failing that the short name, as a C string.
+ *
+ * @param pIndex The index.
+ * @param pszName Receives the name, truncated to fit.
+ * @param size Size of `pszName` in bytes.
+ * @return `ESP_OK` if a non-empty name was found, otherwise `ESP_ERR_NOT_FOUND`.
+ */
+esp_err_t bat_adv_get_name(const bat_adv_index_t *pIndex, char *pszName, size_t size);
+
+/**
+ * @brief Looks for a 128-bit service UUID in the complete and incomplete lists.
+ *
+ * @param pIndex The index.
+ * @param pUuid UUID bytes, little endian as advertised.
+ * @return `true` if the UUID is advertised.
+ */
+bool bat_adv_has_uuid128(const bat_adv_index_t *pIndex, const uint8_t *pUuid);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file bat_bench.h
+ * @brief Throughput and latency measurement for on-target benchmarks.
+ *
+ * A run records one latency sample and a byte count per completed operation. The report
+ * gives bytes and operations per second over the run and the latency percentiles. Samples
+ * beyond the capacity still count towards the throughput but not the percentiles.
+ *
+ * Recording neither allocates nor logs. Not thread‐safe—external synchronization required.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Represents a benchmark run.
+ */
+typedef struct {
+    uint32_t *pSamples;                  ///< Latencies in microseconds.
+    size_t capacity;                     ///< Capacity of `pSamples`.
+    size_t sample_count;                 ///< Samples recorded.
+    uint32_t ops;                        ///< Operations completed.
+    uint64_t bytes;                      ///< Bytes moved.
+    int64_t start_us;                    ///< esp_timer time of `bat_bench_start`.
+    int64_t stop_us;                     ///< esp_timer time of `bat_bench_stop`, 0 while running.
+} bat_bench_t;
+
+/**
+ * @brief Results of a run.
+ */
+typedef struct {
+    uint32_t ops;                        ///< Operations completed.
+    uint64_t bytes;                      ///< Bytes moved.
+    int64_t elapsed_us;                  ///< Duration of the run.
+    uint32_t bytes_per_sec;              ///< Throughput.
+    uint32_t ops_per_sec;                ///< Operation rate.
+    uint32_t p50_us;                     ///< Median latency.
+    uint32_t p90_us;                     ///< 90th percentile latency.
+    uint32_t p99_us;                     ///< 99th percentile latency.
+    uint32_t max_us;                     ///< Highest latency.
+} bat_bench_report_t;
+
+/**
+ * @brief Allocates room for the latency samples.
+ *
+ * @param pBench The run.
+ * @param capacity Samples kept for the percentiles.
+ * @return `ESP_OK`, `ESP_ERR_INVALID_ARG` or `ESP_ERR_NO_MEM`.
+ */
+esp_err_t bat_bench_init(bat_bench_t *pBench, size_t capacity);
+
+/**
+ * @brief Frees the samples.
+ */
+void bat_bench_free(bat_bench_t *pBench);
+
+/**
+ * @brief Clears the counters and starts the clock.
+ */
+void bat_bench_start(bat_bench_t *pBench);
+
+/**
+ * @brief Records one completed operation.
+ *
+ * @param pBench The run.
+ * @param latency_us Time the operation took.
+ * @param bytes Bytes it moved.
+ */
+void bat_bench_record(bat_bench_t *pBench, uint32_t latency_us, size_t bytes);
+
+/**
+ * @brief Stops the clock.
+ */
+void bat_bench_stop(bat_bench_t *pBench);
+
+/**
+ * @brief Computes the report, sorting the samples in place.
+ *
+ * @param pBench The run, the clock is read if it is still running.
+ * @param pReport Receives the report.
+ * @return `ESP_OK` or `ESP_ERR_INVALID_ARG`.
+ */
+esp_err_t bat_bench_get_report(bat_bench_t *pBench, bat_bench_report_t *pReport);
+
+/**
+ * @brief Logs a report on one line.
+ *
+ * @param pszName Name of the benchmark.
+ * @param pReport The report.
+ */
+void bat_bench_log_report(const char *pszName, const bat_bench_report_t *pReport);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,7 +2,17 @@
 
 #include "esp_err.h"
 #include "esp_gap_ble_api.h"
+#include "esp_gattc_api.h"
 #include "bat_ble.h"
+#include "bat_peer_store.h"
+#include "bat_adv_parser.h"
+#include "bat_scan_dedup.h"
+#include "bat_scan_worker.h"
+#include "bat_ble_throughput.h"
+#include "bat_gattc_conn.h"
+#include "bat_gattc_cache.h"
+#include "bat_gattc_queue.h"
+#include "bat_gattc_notify.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -43,11 +53,23 @@ extern "C"
     esp_err_t bat_ble_client_deinit();
     esp_err_t bat_ble_register_gattc(bat_gattc_app_id_t);
     esp_err_t bat_ble_unregister_gattc(bat_gattc_app_id_t);
+    esp_gatt_if_t bat_ble_client_get_gattc_if(bat_gattc_app_id_t); // ESP_GATT_IF_NONE until ESP_GATTC_REG_EVT.
 
     esp_err_t bat_ble_client_set_scan_params(); // Effectively initiates scanning.
     esp_err_t bat_ble_start_scanning(uint32_t scan_duration_secs);
     esp_err_t bat_ble_client_stop_scanning();
 
+    // Duplicate suppression ahead of on_scan_result, enabled with the defaults by bat_ble_client_init.
+    esp_err_t bat_ble_client_configure_scan_dedup(const bat_scan_dedup_config_t *pConfig); // NULL disables it. Safe while scanning.
+    esp_err_t bat_ble_client_get_scan_dedup_stats(bat_scan_dedup_stats_t *pStats);
+
+    // Optional: queue scan results and run on_scan_result on a worker task instead of the Bluedroid task.
+    // Safe to start/stop while scanning; process_cb and pContext in the config are ignored.
+    esp_err_t bat_ble_client_start_scan_worker(const bat_scan_worker_config_t *pConfig); // NULL for the defaults.
+    void bat_ble_client_stop_scan_worker(void);
+    esp_err_t bat_ble_client_get_scan_worker_stats(bat_scan_worker_stats_t *pStats);
+
+    esp_err_t bat_ble_client_index_adv(const bat_scan_result_t *, bat_adv_index_t *); // One pass over advertising data and scan response.
     esp_err_t bat_ble_client_get_advertised_name(bat_scan_result_t *, bat_advertised_name_t *);
     bool bat_ble_advname_matches(bat_scan_result_t *, const char *pszName);
     bool bat_ble_client_find_service_uuid(bat_scan_result_t *pScanResult, bat_ble_uuid128_t * pId);
@@ -67,10 +89,60 @@ extern "C"
     } bat_gapc_callbacks_t;
     void bat_ble_gapc_callbacks_init(bat_gapc_callbacks_t *, void *pContext);
 
+    // Optional callbacks from GATT client events, called after bat_lib has handled the event.
+    // A link that opens gets the throughput profile (bat_ble_throughput.h) requested before on_open.
+    typedef struct bat_gattc_callbacks_t
+    {
+        void *pContext;
+        void (*on_open)(struct bat_gattc_callbacks_t *, esp_gatt_if_t, esp_ble_gattc_cb_param_t *);
+        void (*on_disconnect)(struct bat_gattc_callbacks_t *, esp_gatt_if_t, esp_ble_gattc_cb_param_t *);
+        void (*on_cfg_mtu)(struct bat_gattc_callbacks_t *, esp_gatt_if_t, esp_ble_gattc_cb_param_t *);
+        void (*on_search_cmpl)(struct bat_gattc_callbacks_t *, esp_gatt_if_t, esp_ble_gattc_cb_param_t *);
+        void (*on_read_char)(struct bat_gattc_callbacks_t *, esp_gatt_if_t, esp_ble_gattc_cb_param_t *);
+        void (*on_write_char)(struct bat_gattc_callbacks_t *, esp_gatt_if_t, esp_ble_gattc_cb_param_t *);
+        void (*on_link_ready)(struct bat_gattc_callbacks_t *, bat_gattc_link_t *); // A bat_ble_client_connect link is usable.
+        void (*on_subscribe)(struct bat_gattc_callbacks_t *, bat_gattc_sub_t *); // Active, or failed: see its status.
+    } bat_gattc_callbacks_t;
+    void bat_ble_gattc_callbacks_init(bat_gattc_callbacks_t *, void *pContext);
+
+    // Connection manager, see bat_gattc_conn.h. Queues a peer found by the scan, links are opened one at a time
+    // once scanning stops, discovered, then reported through on_link_ready. pContext is kept in the link.
+    esp_err_t bat_ble_client_connect(bat_gattc_app_id_t, const esp_bd_addr_t bda, esp_ble_addr_type_t addr_type, void *pContext);
+    esp_err_t bat_ble_client_get_link(uint16_t conn_id, bat_gattc_link_t *pLink); // Copies the link.
+    void bat_ble_client_record_op(uint16_t conn_id, uint32_t latency_us, size_t bytes); // Counts a completed operation.
+    esp_err_t bat_ble_client_get_link_stats(bat_gattc_conn_stats_t *pStats, bool reset_traffic);
+
+    // Request queue of a ready link, see bat_gattc_queue.h. The batch is queued whole or not at all, each operation
+    // completes through its own callback and its event is not passed to on_read_char/on_write_char. Completed
+    // operations are recorded like bat_ble_client_record_op. Do not mix with direct esp_ble_gattc reads and writes.
+    esp_err_t bat_ble_client_submit(uint16_t conn_id, const bat_gattc_op_t *pOps, size_t count);
+    esp_err_t bat_ble_client_get_queue_stats(uint16_t conn_id, bat_gattc_queue_stats_t *pStats);
+
+    // Notifications and indications, see bat_gattc_notify.h. Registers the characteristic with Bluedroid, then writes
+    // its CCCD through the request queue; on_subscribe reports the outcome unless the link drops first. Values go into
+    // the subscription's ring, drained with bat_gattc_notify_peek/release from the application's task. A subscription
+    // outlives its link (CLOSED), unsubscribe once its consumer has stopped to free the ring.
+    esp_err_t bat_ble_client_subscribe(uint16_t conn_id, uint16_t handle, const bat_gattc_sub_config_t *pConfig,
+                                       bat_gattc_sub_t **ppSub); // handle: characteristic value handle.
+    esp_err_t bat_ble_client_unsubscribe(bat_gattc_sub_t *pSub);
+
+    // Attribute cache, see bat_gattc_cache.h. Known peers skip the discovery: their links are made ready from the
+    // cached database (on_search_cmpl is not called) and bat_ble_client_find_char resolves handles either way.
+    esp_err_t bat_ble_client_find_char(uint16_t conn_id, const bat_ble_uuid128_t *pService, const bat_ble_uuid128_t *pChar,
+                                       uint16_t *pHandle); // Characteristic value handle.
+    esp_err_t bat_ble_client_get_cache_stats(bat_gattc_cache_stats_t *pStats);
+    esp_err_t bat_ble_client_clear_cache(void); // Forgets every peer, in RAM and NVS.
+
     // GAP BDA-specific callbacks, we might want to associate context with each BDA.
+    // Contexts are held in a bat_peer_store: O(1) lookup, LRU eviction once the capacity is reached.
+    // Thread-safe: events look contexts up on the Bluedroid task while the app sets them, evict_cb is called
+    // with the store's lock released.
+#define BAT_BDA_CONTEXT_DEFAULT_CAPACITY 64
+    esp_err_t bat_bda_context_configure(const bat_peer_store_config_t *pConfig); // Optional, call before bat_ble_client_init.
     void bat_bda_context_reset(const esp_bd_addr_t *pbda);
     void *bat_bda_context_lookup(const esp_bd_addr_t *pbda);
     esp_err_t bat_bda_context_set(const esp_bd_addr_t *pbda, void *pContext);
+    size_t bat_bda_context_evict_stale(void); // Drops contexts older than the configured max_age_us.
 
 
 #ifdef __cplusplus
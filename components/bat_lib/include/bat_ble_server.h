@@ -3,12 +3,21 @@
 #include "esp_err.h"
 #include "esp_gatts_api.h"
 #include "bat_ble.h"
+#include "bat_gatts_table.h"
+#include "bat_gatts_notify.h"
+#include "bat_gatts_conn.h"
+#include "bat_gatts_prep_write.h"
+#include "bat_ble_throughput.h"
+#include "bat_adv_builder.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    // gatts_if values are small integers handed out by the stack, callbacks are indexed by them.
+#define BAT_GATTS_IF_MAX 32
+
     typedef uint16_t bat_gatts_app_id;
     typedef uint16_t bat_gatts_service_handle;
 
@@ -17,6 +26,8 @@ extern "C"
         void *pContext;
         esp_gatt_if_t gatts_if;
         bat_gatts_service_handle service_handle;
+        bat_gatts_table_t *pPendingTable; // Set by bat_gatts_create_attr_table until ESP_GATTS_CREAT_ATTR_TAB_EVT.
+        bat_gatts_notify_t *pNotify;      // Optional, fed the connection, CCCD write, confirm and congestion events.
 
         void (*on_reg)(struct bat_gatts_callbacks_t *, esp_ble_gatts_cb_param_t *);
         void (*on_create)(struct bat_gatts_callbacks_t *, esp_ble_gatts_cb_param_t *);
@@ -29,6 +40,7 @@ extern "C"
         void (*on_read)(struct bat_gatts_callbacks_t *, esp_ble_gatts_cb_param_t *);
         void (*on_write)(struct bat_gatts_callbacks_t *, esp_ble_gatts_cb_param_t *);
         void (*on_unreg)(struct bat_gatts_callbacks_t *, esp_ble_gatts_cb_param_t *);
+        void (*on_create_attr_tab)(struct bat_gatts_callbacks_t *, esp_ble_gatts_cb_param_t *);
 
     } bat_gatts_callbacks_t;    
 	
@@ -40,12 +52,22 @@ extern "C"
 
     esp_err_t bat_gatts_stop_advertising();
     esp_err_t bat_gatts_start_advertising();
+
+    // Restarts advertising with the payloads last applied by bat_gatts_set_advert_raw, without
+    // uploading them again. ESP_ERR_INVALID_STATE if none were confirmed by the stack yet.
+    esp_err_t bat_gatts_readvertise();
     esp_err_t bat_gatts_start_service(bat_gatts_service_handle);
     esp_err_t bat_gatts_stop_service(bat_gatts_service_handle);
     esp_err_t bat_gatts_add_cccd(uint16_t service_handle, uint16_t char_handle);
     esp_err_t bat_gatts_begin_advert_data_set128(const char *, bat_ble_uuid128_t *pId);
     esp_err_t bat_gatts_create_service128(esp_gatt_if_t gatts_if, bat_ble_uuid128_t *pId);
+    // When the payloads equal the ones last applied, advertising is restarted with
+    // bat_gatts_readvertise and on_advert_data_set is not called.
     esp_err_t bat_gatts_begin_advert_data_set(const char *pszAdvertisedName, uint8_t *pId, uint8_t idLen);
+
+    // Applies prebuilt payloads (bat_adv_builder.h) with the raw config calls, pScanRsp may be NULL.
+    // on_advert_data_set is called once, when the stack has taken both.
+    esp_err_t bat_gatts_set_advert_raw(const bat_adv_buf_t *pAdv, const bat_adv_buf_t *pScanRsp);
     
     esp_err_t bat_gatts_register(bat_gatts_app_id app_id, bat_gatts_callbacks_t *, void *pContext);
     esp_err_t bat_gatts_unregister(bat_gatts_app_id app_id);
@@ -59,6 +81,28 @@ extern "C"
     esp_err_t bat_gatts_create_char128(esp_gatt_if_t, bat_gatts_service_handle,
         bat_ble_uuid128_t *, esp_gatt_char_prop_t, esp_gatt_perm_t);
 
+    // Registers a whole service in one stack call, see bat_gatts_table.h. Typically called from on_reg.
+    // On ESP_GATTS_CREAT_ATTR_TAB_EVT the handle map in pTable is filled, the service is started
+    // and on_create_attr_tab is called. pTable must stay valid while the service exists.
+    esp_err_t bat_gatts_create_attr_table(bat_gatts_callbacks_t *, const bat_gatts_service_def_t *, bat_gatts_table_t *pTable);
+
+    // Updates the value the stack answers reads of an auto-response attribute with (every table attribute
+    // without rsp_by_app). Such reads never reach on_read. Subscribers are not notified, see bat_gatts_notify_update.
+    esp_err_t bat_gatts_set_value(uint16_t handle, const uint8_t *pValue, uint16_t len);
+
+    // Time from the first bat_gatts_register to the first successful advertising start, 0 until then.
+    int64_t bat_gatts_get_startup_latency_us(void);
+
+    // Connections are tracked across all interfaces, see bat_gatts_conn.h. Advertising is resumed after
+    // a connection while fewer than the maximum (BAT_GATTS_CONN_MAX by default) are open.
+    bat_gatts_conn_table_t *bat_gatts_get_conn_table(void);
+    bat_gatts_conn_t *bat_gatts_get_conn(uint16_t conn_id); // NULL if not connected.
+    esp_err_t bat_gatts_set_max_connections(size_t max_conns);
+
+    // Prepared (long) writes are reassembled per connection, on_write gets one write at offset 0 on
+    // execute and never sees the fragments. Both are answered by bat_lib. See bat_gatts_prep_write.h.
+    const bat_gatts_prep_write_t *bat_gatts_get_prep_write(void);
+
     typedef struct bat_gaps_callbacks_t
     {
         void *pContext;
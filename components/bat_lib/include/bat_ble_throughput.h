@@ -0,0 +1,257 @@
+/**
+ * @file bat_ble_throughput.h
+ * @brief Link throughput profile: ATT MTU, data length, PHY and connection interval as one set.
+ *
+ * Each of the four limits throughput on its own, so they are requested together on every new
+ * link, from either role:
+ *   - ATT MTU: the local MTU is set once by `bat_ble_throughput_set_profile`, a client also
+ *     requests the exchange when the link opens (only the client can start it),
+ *   - data length extension (DLE): `esp_ble_gap_set_pkt_data_len`, up to 251 octets per LL packet,
+ *   - PHY: `esp_ble_gap_set_preferred_phy`, only with a BLE 5.0 controller
+ *     (`CONFIG_BT_BLE_50_FEATURES_SUPPORTED`), the ESP32 stays on 1M,
+ *   - connection interval, latency and timeout: `esp_ble_gap_update_conn_params`.
+ *
+ * The values the stack reports back are recorded per link. Requests still unanswered are
+ * flagged in `pending`, once none are left the negotiated set is logged.
+ *
+ * Once a link is up its connection parameters can be renegotiated from either role with a
+ * connection profile (`bat_ble_throughput_request_conn_profile`):
+ *   - bulk: 7.5 ms interval, no latency, the most connection events per second,
+ *   - interactive: 30 to 50 ms, no latency, quick answers at a fraction of the radio time,
+ *   - low power: 100 to 125 ms with a peripheral latency of 9, the peripheral may sleep
+ *     through up to 9 events in a row while it has nothing to send.
+ * A central applies the parameters, a peripheral asks for them with an L2CAP connection
+ * parameter update request, the central may refuse or adjust them.
+ *
+ * `bat_ble_throughput_set_conn_policy` switches profiles by traffic volume: the bytes both
+ * libraries record per link (`bat_ble_throughput_on_traffic`) are measured over a window, a
+ * busy link gets the bulk profile, a quiet one interactive, and one idle for several windows
+ * low power. Run the policy on one side of a link only, both would contend.
+ *
+ * Time, traffic and an estimate of the radio time are kept per link and per profile, see
+ * `bat_ble_throughput_get_usage`. The estimate counts the connection events the device attends
+ * (all of them for a central, one in latency + 1 for an idle peripheral) at the airtime of an
+ * empty exchange, plus the airtime of the recorded bytes at the negotiated PHY and packet size.
+ *
+ * bat_ble_server.c and bat_ble_client.c feed the module their connect, disconnect, MTU, GAP
+ * events and traffic. The state is guarded by a critical section, queries take a copy.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_gap_ble_api.h"
+#include "esp_gatt_defs.h"
+#include "esp_bt_defs.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_BT_ACL_CONNECTIONS
+#define BAT_BLE_LINK_MAX CONFIG_BT_ACL_CONNECTIONS ///< Links tracked at once.
+#else
+#define BAT_BLE_LINK_MAX 4                          ///< Links tracked at once.
+#endif
+
+#define BAT_BLE_PHY_1M 0x01                         ///< 1M PHY, same bit as `ESP_BLE_GAP_PHY_1M_PREF_MASK`.
+#define BAT_BLE_PHY_2M 0x02                         ///< 2M PHY, same bit as `ESP_BLE_GAP_PHY_2M_PREF_MASK`.
+#define BAT_BLE_PHY_CODED 0x04                      ///< Coded PHY, same bit as `ESP_BLE_GAP_PHY_CODED_PREF_MASK`.
+
+#define BAT_BLE_LINK_PENDING_MTU 0x01               ///< MTU exchange requested, not answered yet.
+#define BAT_BLE_LINK_PENDING_DLE 0x02               ///< Data length requested, not answered yet.
+#define BAT_BLE_LINK_PENDING_PHY 0x04               ///< PHY requested, not answered yet.
+#define BAT_BLE_LINK_PENDING_CONN_PARAMS 0x08       ///< Connection parameters requested, not answered yet.
+
+#define BAT_BLE_CONN_POLICY_DEFAULT_WINDOW_MS 1000  ///< Default traffic measurement window.
+#define BAT_BLE_CONN_POLICY_DEFAULT_BULK_BPS 2048   ///< Default bytes per second that call for the bulk profile.
+#define BAT_BLE_CONN_POLICY_DEFAULT_IDLE_WINDOWS 3  ///< Default idle windows before low power.
+#define BAT_BLE_CONN_POLICY_RETRY_WINDOWS 5         ///< Windows before a refused profile is asked for again.
+
+/**
+ * @brief Settings requested on every new link, zeroed fields are left to the stack.
+ */
+typedef struct {
+    uint16_t mtu;                        ///< ATT MTU, 23 to 517.
+    uint16_t tx_octets;                  ///< LL payload per packet, 27 to 251.
+    uint8_t phy_mask;                    ///< Preferred PHYs, `BAT_BLE_PHY_*` bits.
+    uint16_t min_interval;               ///< Minimum connection interval, 1.25 ms units (6 = 7.5 ms).
+    uint16_t max_interval;               ///< Maximum connection interval, 1.25 ms units.
+    uint16_t latency;                    ///< Peripheral latency, in connection events. Used with the interval.
+    uint16_t timeout;                    ///< Supervision timeout, 10 ms units. Used with the interval.
+} bat_ble_throughput_profile_t;
+
+/**
+ * @brief Largest packets, fastest PHY and the shortest interval: bulk transfers.
+ */
+#define BAT_BLE_THROUGHPUT_PROFILE_MAX                                                          \
+    {                                                                                           \
+        .mtu = 517, .tx_octets = 251, .phy_mask = BAT_BLE_PHY_2M,                               \
+        .min_interval = 6, .max_interval = 12, .latency = 0, .timeout = 400,                    \
+    }
+
+/**
+ * @brief Connection profiles, see the file description.
+ */
+typedef enum {
+    BAT_BLE_CONN_PROFILE_DEFAULT = 0,    ///< Parameters from link up or chosen by the peer, matching no profile.
+    BAT_BLE_CONN_PROFILE_BULK,           ///< Shortest interval, for transfers.
+    BAT_BLE_CONN_PROFILE_INTERACTIVE,    ///< Short interval, for request and response traffic.
+    BAT_BLE_CONN_PROFILE_LOW_POWER,      ///< Long interval and peripheral latency, for idle links.
+    BAT_BLE_CONN_PROFILE_COUNT,
+} bat_ble_conn_profile_t;
+
+/**
+ * @brief Connection parameters of a profile.
+ */
+typedef struct {
+    uint16_t min_interval;               ///< Minimum connection interval, 1.25 ms units (6 = 7.5 ms).
+    uint16_t max_interval;               ///< Maximum connection interval, 1.25 ms units.
+    uint16_t latency;                    ///< Peripheral latency, in connection events.
+    uint16_t timeout;                    ///< Supervision timeout, 10 ms units.
+} bat_ble_conn_params_t;
+
+#define BAT_BLE_CONN_PARAMS_BULK {.min_interval = 6, .max_interval = 6, .latency = 0, .timeout = 400}
+#define BAT_BLE_CONN_PARAMS_INTERACTIVE {.min_interval = 24, .max_interval = 40, .latency = 0, .timeout = 400}
+#define BAT_BLE_CONN_PARAMS_LOW_POWER {.min_interval = 80, .max_interval = 100, .latency = 9, .timeout = 600}
+
+/**
+ * @brief Traffic thresholds of the switching policy, zeroed fields take the defaults.
+ */
+typedef struct {
+    uint32_t window_ms;                  ///< Measurement window.
+    uint32_t bulk_bytes_per_sec;         ///< At or above, the link gets the bulk profile.
+    uint32_t idle_bytes_per_sec;         ///< At or below, the window counts as idle. 0: only windows without traffic.
+    uint8_t idle_windows;                ///< Idle windows in a row before low power.
+} bat_ble_conn_policy_t;
+
+/**
+ * @brief Time a link spent with one profile, see `bat_ble_throughput_get_usage`.
+ */
+typedef struct {
+    uint64_t time_us;                    ///< Time with the profile's parameters in effect.
+    uint64_t bytes;                      ///< Traffic recorded meanwhile.
+    uint64_t radio_us;                   ///< Estimated radio time.
+    uint32_t entered;                    ///< Times the link switched to the profile.
+} bat_ble_conn_usage_t;
+
+/**
+ * @brief What was negotiated on one link.
+ */
+typedef struct {
+    esp_bd_addr_t bda;                   ///< Peer address.
+    uint16_t conn_id;                    ///< GATT connection ID.
+    bool is_client;                      ///< This side is the GATT client.
+    uint16_t mtu;                        ///< ATT MTU.
+    uint16_t tx_octets;                  ///< LL payload sent per packet.
+    uint16_t rx_octets;                  ///< LL payload received per packet.
+    uint8_t tx_phy;                      ///< `BAT_BLE_PHY_*` in use for sending.
+    uint8_t rx_phy;                      ///< `BAT_BLE_PHY_*` in use for receiving.
+    uint16_t interval;                   ///< Connection interval, 1.25 ms units, 0 until reported.
+    uint16_t latency;                    ///< Peripheral latency.
+    uint16_t timeout;                    ///< Supervision timeout, 10 ms units.
+    bat_ble_conn_profile_t profile;      ///< Connection profile in effect.
+    bat_ble_conn_profile_t requested;    ///< Connection profile last asked for.
+    uint8_t pending;                     ///< `BAT_BLE_LINK_PENDING_*` requests not answered yet.
+    int64_t up_us;                       ///< esp_timer time the link came up.
+    int64_t settled_us;                  ///< esp_timer time the last request was answered, 0 while pending.
+} bat_ble_link_params_t;
+
+/**
+ * @brief Sets the local MTU and the profile requested on links that come up afterwards.
+ *
+ * @param pProfile The profile, copied. NULL stops requesting anything on new links.
+ * @return `ESP_OK`, `ESP_ERR_INVALID_ARG` (values out of range) or the error of `esp_ble_gatt_set_local_mtu`.
+ */
+esp_err_t bat_ble_throughput_set_profile(const bat_ble_throughput_profile_t *pProfile);
+
+/**
+ * @brief Starts tracking a link and requests the profile on it.
+ *
+ * @param bda Peer address.
+ * @param conn_id GATT connection ID.
+ * @param gattc_if The GATT client interface when this side is the client, which then requests
+ *                 the MTU exchange, `ESP_GATT_IF_NONE` for the server.
+ * @return `ESP_OK`, or `ESP_ERR_NO_MEM` if `BAT_BLE_LINK_MAX` links are tracked.
+ */
+esp_err_t bat_ble_throughput_link_up(const esp_bd_addr_t bda, uint16_t conn_id, esp_gatt_if_t gattc_if);
+
+/**
+ * @brief Stops tracking a link.
+ */
+void bat_ble_throughput_link_down(const esp_bd_addr_t bda);
+
+/**
+ * @brief Records the MTU of `ESP_GATTS_MTU_EVT` or `ESP_GATTC_CFG_MTU_EVT`.
+ */
+void bat_ble_throughput_on_mtu(uint16_t conn_id, uint16_t mtu);
+
+/**
+ * @brief Records the data length, PHY and connection parameter events, ignores the others.
+ */
+void bat_ble_throughput_on_gap_event(esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t *pParam);
+
+/**
+ * @brief Replaces the parameters of a connection profile, for links switched afterwards.
+ *
+ * @return `ESP_OK`, or `ESP_ERR_INVALID_ARG` for `BAT_BLE_CONN_PROFILE_DEFAULT` or values out of range.
+ */
+esp_err_t bat_ble_throughput_set_conn_params(bat_ble_conn_profile_t profile, const bat_ble_conn_params_t *pParams);
+
+/**
+ * @brief Asks for the parameters of a connection profile on a link.
+ *
+ * The answer, `ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT`, is recorded and the achieved parameters logged.
+ *
+ * @return `ESP_OK`, `ESP_ERR_INVALID_ARG`, `ESP_ERR_NOT_FOUND`, `ESP_ERR_INVALID_STATE` while a
+ *         parameter request is pending, or the error of `esp_ble_gap_update_conn_params`.
+ */
+esp_err_t bat_ble_throughput_request_conn_profile(uint16_t conn_id, bat_ble_conn_profile_t profile);
+
+/**
+ * @brief Starts or stops switching connection profiles by traffic volume.
+ *
+ * @param pPolicy Thresholds, copied. NULL stops switching, links keep their parameters.
+ * @return `ESP_OK`, `ESP_ERR_INVALID_ARG` if `bulk_bytes_per_sec` is not above `idle_bytes_per_sec`,
+ *         or the error of the window timer.
+ */
+esp_err_t bat_ble_throughput_set_conn_policy(const bat_ble_conn_policy_t *pPolicy);
+
+/**
+ * @brief Records bytes moved on a link, reads, writes and notifications alike.
+ */
+void bat_ble_throughput_on_traffic(uint16_t conn_id, size_t bytes);
+
+/**
+ * @brief Copies the time, traffic and radio time of a link per connection profile.
+ *
+ * @param conn_id GATT connection ID.
+ * @param pUsage Receives `BAT_BLE_CONN_PROFILE_COUNT` entries, indexed by profile.
+ * @return `ESP_OK`, `ESP_ERR_INVALID_ARG` or `ESP_ERR_NOT_FOUND`.
+ */
+esp_err_t bat_ble_throughput_get_usage(uint16_t conn_id, bat_ble_conn_usage_t *pUsage);
+
+/**
+ * @brief Logs the throughput and estimated radio duty cycle of a link per connection profile.
+ */
+void bat_ble_throughput_log_usage(uint16_t conn_id);
+
+/**
+ * @brief Name of a connection profile, for logs.
+ */
+const char *bat_ble_conn_profile_name(bat_ble_conn_profile_t profile);
+
+/**
+ * @brief Copies what was negotiated on a link.
+ *
+ * @param conn_id GATT connection ID.
+ * @param pParams Receives the parameters.
+ * @return `ESP_OK`, `ESP_ERR_INVALID_ARG` or `ESP_ERR_NOT_FOUND`.
+ */
+esp_err_t bat_ble_throughput_get_link(uint16_t conn_id, bat_ble_link_params_t *pParams);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,239 @@
+/**
+ * @file bat_gattc_cache.h
+ * @brief Attribute database of known GATT servers, kept in RAM and persisted to NVS.
+ *
+ * Service discovery takes a round trip per service, characteristic and descriptor
+ * range, hundreds of milliseconds on every connection. After the first discovery of a
+ * peer its services, characteristics and descriptors are copied out of Bluedroid's
+ * database into an entry keyed on the peer BDA; reconnections then skip
+ * `esp_ble_gattc_search_service` and use the cached handles.
+ *
+ * An entry is trusted until the server says its database changed:
+ *   - a peer exposing the Database Hash characteristic (0x2B2A) has it read once per
+ *     connection, a hash other than the cached one drops the entry,
+ *   - a Service Changed indication (`ESP_GATTC_SRVC_CHG_EVT`) drops the entry.
+ *
+ * Entries live in a small RAM table with least recently used replacement and are
+ * written to NVS, one blob per peer, so they survive a restart. A peer missing from RAM
+ * is looked for in NVS before it counts as a miss.
+ *
+ * UUIDs are stored expanded to 128 bits, see `bat_ble_uuid16_to_uuid128`.
+ *
+ * Not thread‐safe—external synchronization required.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_gattc_api.h"
+#include "esp_bt_defs.h"
+#include "bat_ble.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_BAT_GATTC_CACHE_PEERS
+#define BAT_GATTC_CACHE_PEERS CONFIG_BAT_GATTC_CACHE_PEERS ///< Peers held in RAM.
+#else
+#define BAT_GATTC_CACHE_PEERS 8                             ///< Peers held in RAM.
+#endif
+
+#ifdef CONFIG_BAT_GATTC_CACHE_ATTRS
+#define BAT_GATTC_CACHE_ATTRS CONFIG_BAT_GATTC_CACHE_ATTRS ///< Attributes per peer, larger databases are not cached.
+#else
+#define BAT_GATTC_CACHE_ATTRS 32                            ///< Attributes per peer, larger databases are not cached.
+#endif
+
+#define BAT_GATTC_CACHE_HASH_LEN 16                         ///< Size of the Database Hash value.
+#define BAT_GATTC_CACHE_HASH_UUID 0x2B2A                    ///< Database Hash characteristic.
+#define BAT_GATTC_CACHE_NVS_NAMESPACE "bat_gattc"           ///< NVS namespace of the persisted entries.
+
+/**
+ * @brief One attribute of a cached database.
+ */
+typedef struct {
+    uint8_t uuid[ESP_UUID_LEN_128];      ///< Attribute type, expanded to 128 bits.
+    uint16_t handle;                     ///< Service start, characteristic value or descriptor handle.
+    uint16_t end_handle;                 ///< Service end handle, `handle` for other attributes.
+    uint8_t type;                        ///< `esp_gatt_db_attr_type_t`.
+    uint8_t properties;                  ///< Characteristic properties, 0 for other attributes.
+} bat_gattc_cache_attr_t;
+
+/**
+ * @brief The cached database of one peer, also the layout of its NVS blob.
+ */
+typedef struct {
+    uint32_t version;                    ///< Layout version, blobs of another layout are dropped.
+    esp_bd_addr_t bda;                   ///< Peer address.
+    bool has_hash;                       ///< `db_hash` holds the peer's Database Hash.
+    uint8_t db_hash[BAT_GATTC_CACHE_HASH_LEN]; ///< Database Hash read after the discovery.
+    uint16_t hash_handle;                ///< Database Hash value handle, 0 if the peer has none.
+    uint32_t discovery_us;               ///< Time the discovery took, what a cache hit saves.
+    int64_t last_used_us;                ///< esp_timer time of the last store or lookup.
+    uint16_t count;                      ///< Attributes in use.
+    bat_gattc_cache_attr_t attrs[BAT_GATTC_CACHE_ATTRS]; ///< Services, characteristics and descriptors.
+} bat_gattc_cache_entry_t;
+
+/**
+ * @brief Cache statistics, see `bat_gattc_cache_get_stats`.
+ */
+typedef struct {
+    size_t entries;                      ///< Peers held in RAM.
+    uint32_t hits;                       ///< Links made ready from the cache.
+    uint32_t misses;                     ///< Links that ran a discovery.
+    uint32_t invalidations;              ///< Entries dropped for a changed database.
+    uint32_t nvs_errors;                 ///< Failed NVS reads or writes.
+    uint64_t saved_us;                   ///< Discovery time saved by the hits.
+    uint32_t last_saved_us;              ///< Discovery time saved by the latest hit.
+} bat_gattc_cache_stats_t;
+
+/**
+ * @brief The cache.
+ */
+typedef struct {
+    bat_gattc_cache_entry_t entries[BAT_GATTC_CACHE_PEERS]; ///< Slots, `count == 0` when unused.
+    bool persist;                        ///< Entries are written to and read from NVS.
+    uint32_t hits;                       ///< See bat_gattc_cache_stats_t.
+    uint32_t misses;
+    uint32_t invalidations;
+    uint32_t nvs_errors;
+    uint64_t saved_us;
+    uint32_t last_saved_us;
+} bat_gattc_cache_t;
+
+/**
+ * @brief Empties the cache.
+ *
+ * @param pCache The cache.
+ * @param persist Write entries to NVS and look up peers missing from RAM there; NVS must be initialized.
+ * @return `ESP_OK` or `ESP_ERR_INVALID_ARG`.
+ */
+esp_err_t bat_gattc_cache_init(bat_gattc_cache_t *pCache, bool persist);
+
+/**
+ * @brief Empties the RAM table, persisted entries are kept.
+ */
+void bat_gattc_cache_deinit(bat_gattc_cache_t *pCache);
+
+/**
+ * @brief Finds the entry of a peer, in RAM then in NVS.
+ *
+ * @return The entry, or NULL if the peer is unknown.
+ */
+bat_gattc_cache_entry_t *bat_gattc_cache_lookup(bat_gattc_cache_t *pCache, const esp_bd_addr_t bda);
+
+/**
+ * @brief Copies the database Bluedroid discovered on a connection into the peer's entry.
+ *
+ * The caller persists the entry with `bat_gattc_cache_persist`, and once more through
+ * `bat_gattc_cache_set_hash` if `hash_handle` is set and the Database Hash has been read.
+ *
+ * @param pCache The cache.
+ * @param gattc_if Interface of the connection.
+ * @param conn_id The connection, its discovery complete.
+ * @param bda Peer address.
+ * @param discovery_us Time the discovery took.
+ * @param ppEntry Receives the entry.
+ * @return `ESP_OK`, `ESP_ERR_INVALID_SIZE` if the database has more than `BAT_GATTC_CACHE_ATTRS`
+ *         attributes, or `ESP_FAIL` if Bluedroid has no database for the connection.
+ */
+esp_err_t bat_gattc_cache_store(bat_gattc_cache_t *pCache, esp_gatt_if_t gattc_if, uint16_t conn_id,
+                                const esp_bd_addr_t bda, uint32_t discovery_us, bat_gattc_cache_entry_t **ppEntry);
+
+/**
+ * @brief Writes an entry to NVS, a no-op unless the cache persists.
+ */
+esp_err_t bat_gattc_cache_persist(bat_gattc_cache_t *pCache, const bat_gattc_cache_entry_t *pEntry);
+
+/**
+ * @brief Records the Database Hash of an entry and persists it.
+ *
+ * @return `ESP_OK`, `ESP_ERR_INVALID_SIZE` if `len` is not `BAT_GATTC_CACHE_HASH_LEN`, or an NVS error.
+ */
+esp_err_t bat_gattc_cache_set_hash(bat_gattc_cache_t *pCache, bat_gattc_cache_entry_t *pEntry,
+                                   const uint8_t *pHash, uint16_t len);
+
+/**
+ * @brief Tells whether a Database Hash read on reconnection matches the cached one.
+ */
+bool bat_gattc_cache_hash_matches(const bat_gattc_cache_entry_t *pEntry, const uint8_t *pHash, uint16_t len);
+
+/**
+ * @brief Drops the entry of a peer whose database changed, from RAM and NVS.
+ *
+ * @return true if the peer had an entry.
+ */
+bool bat_gattc_cache_invalidate(bat_gattc_cache_t *pCache, const esp_bd_addr_t bda);
+
+/**
+ * @brief Drops every entry, from RAM and NVS.
+ */
+esp_err_t bat_gattc_cache_clear(bat_gattc_cache_t *pCache);
+
+/**
+ * @brief Counts a link made ready from an entry.
+ *
+ * @param pCache The cache.
+ * @param pEntry The entry used.
+ * @param spent_us Time the link took to become ready from the cache, a hash read for instance.
+ * @return Discovery time saved, the entry's `discovery_us` less `spent_us`.
+ */
+uint32_t bat_gattc_cache_on_hit(bat_gattc_cache_t *pCache, const bat_gattc_cache_entry_t *pEntry, uint32_t spent_us);
+
+/**
+ * @brief Counts a link that had to run a discovery.
+ */
+void bat_gattc_cache_on_miss(bat_gattc_cache_t *pCache);
+
+/**
+ * @brief Copies the statistics.
+ */
+void bat_gattc_cache_get_stats(const bat_gattc_cache_t *pCache, bat_gattc_cache_stats_t *pStats);
+
+/**
+ * @brief Finds the attribute at a handle.
+ *
+ * @return The attribute, or NULL.
+ */
+const bat_gattc_cache_attr_t *bat_gattc_cache_find_handle(const bat_gattc_cache_entry_t *pEntry, uint16_t handle);
+
+/**
+ * @brief Finds the service a handle belongs to.
+ *
+ * @return The service, or NULL.
+ */
+const bat_gattc_cache_attr_t *bat_gattc_cache_find_owner(const bat_gattc_cache_entry_t *pEntry, uint16_t handle);
+
+/**
+ * @brief Finds a primary service of an entry.
+ *
+ * @return The service, `handle` to `end_handle` is its range, or NULL.
+ */
+const bat_gattc_cache_attr_t *bat_gattc_cache_find_service(const bat_gattc_cache_entry_t *pEntry,
+                                                           const bat_ble_uuid128_t *pUuid);
+
+/**
+ * @brief Finds a characteristic within a service.
+ *
+ * @return The characteristic, `handle` is its value handle, or NULL.
+ */
+const bat_gattc_cache_attr_t *bat_gattc_cache_find_char(const bat_gattc_cache_entry_t *pEntry,
+                                                        const bat_gattc_cache_attr_t *pService,
+                                                        const bat_ble_uuid128_t *pUuid);
+
+/**
+ * @brief Finds a descriptor of a characteristic, the CCCD for instance.
+ *
+ * @return The descriptor, or NULL.
+ */
+const bat_gattc_cache_attr_t *bat_gattc_cache_find_descr(const bat_gattc_cache_entry_t *pEntry,
+                                                         const bat_gattc_cache_attr_t *pService,
+                                                         const bat_gattc_cache_attr_t *pChar,
+                                                         const bat_ble_uuid128_t *pUuid);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,216 @@
+/**
+ * @file bat_gattc_conn.h
+ * @brief Links of the GATT client, one state machine per peer.
+ *
+ * Each link walks through:
+ *
+ *   SCAN_HIT ──open──► CONNECTING ──OPEN_EVT──► DISCOVERING ──SEARCH_CMPL_EVT──► READY
+ *       ▲                   │ failed                  │ failed/disconnect          │ disconnect
+ *       └── retry ──────────┴─────────► (free) ◄──────┴────────────────────────────┘
+ *
+ * The controller creates one connection at a time and cannot initiate while it scans, so
+ * links wait in SCAN_HIT until `bat_gattc_conn_next_to_open` hands them out, one at a time.
+ * `bat_ble_client.c` owns the table of the client (see `bat_ble_client_connect`) and drives
+ * the transitions from the GATTC events.
+ *
+ * A peer found in the attribute cache (bat_gattc_cache.h) skips the discovery: DISCOVERING
+ * then only lasts for a Database Hash read, or not at all.
+ *
+ * Peers stay unknown until their link opens, so slots are looked up by BDA or `conn_id`
+ * with a scan of the (few) slots instead of being indexed.
+ *
+ * Traffic is recorded per link and in a shared bat_bench_t, which gives the aggregate
+ * throughput and latency percentiles across links.
+ *
+ * Not thread‐safe—external synchronization required.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_gattc_api.h"
+#include "esp_bt_defs.h"
+#include "bat_bench.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_BT_ACL_CONNECTIONS
+#define BAT_GATTC_CONN_MAX CONFIG_BT_ACL_CONNECTIONS ///< Link slots, one per possible connection.
+#else
+#define BAT_GATTC_CONN_MAX 4                          ///< Link slots, one per possible connection.
+#endif
+
+#define BAT_GATTC_CONN_DEFAULT_MTU 23                 ///< ATT MTU until `ESP_GATTC_CFG_MTU_EVT`.
+#define BAT_GATTC_CONN_DEFAULT_RETRIES 2              ///< Failed opens retried before the link is dropped.
+#define BAT_GATTC_CONN_DEFAULT_SAMPLES 1024           ///< Latency samples kept for the aggregate percentiles.
+#define BAT_GATTC_CONN_NONE 0xffff                    ///< `conn_id` of a link that is not open.
+
+/**
+ * @brief Where a link is in its life.
+ */
+typedef enum {
+    BAT_GATTC_LINK_FREE = 0,             ///< Slot unused.
+    BAT_GATTC_LINK_SCAN_HIT,             ///< Peer found, waiting for its turn to connect.
+    BAT_GATTC_LINK_CONNECTING,           ///< `esp_ble_gattc_open` issued.
+    BAT_GATTC_LINK_DISCOVERING,          ///< Open, services being discovered or the cached ones checked.
+    BAT_GATTC_LINK_READY,                ///< Discovered, usable.
+} bat_gattc_link_state_t;
+
+/**
+ * @brief State of one link.
+ */
+typedef struct {
+    bat_gattc_link_state_t state;        ///< Current state.
+    esp_bd_addr_t bda;                   ///< Peer address.
+    esp_ble_addr_type_t addr_type;       ///< Peer address type, from the scan result.
+    esp_gatt_if_t gattc_if;              ///< Interface the link is opened on.
+    uint16_t conn_id;                    ///< Connection ID, `BAT_GATTC_CONN_NONE` until open.
+    uint16_t mtu;                        ///< Negotiated ATT MTU.
+    uint8_t retries_left;                ///< Failed opens still retried.
+    void *pContext;                      ///< Application data, set with the scan hit.
+    bool cached;                         ///< Made ready from the attribute cache, no discovery ran.
+    uint16_t hash_read_handle;           ///< Database Hash read in flight for the cache, 0 if none.
+    uint32_t discovery_saved_us;         ///< Discovery time the cache saved.
+
+    int64_t hit_us;                      ///< esp_timer time of the scan hit.
+    int64_t open_us;                     ///< esp_timer time of `ESP_GATTC_OPEN_EVT`.
+    int64_t ready_us;                    ///< esp_timer time the link became ready.
+
+    uint32_t ops;                        ///< Operations completed on the link.
+    uint64_t bytes;                      ///< Bytes moved by them.
+    uint64_t latency_sum_us;             ///< Sum of their latencies.
+    uint32_t latency_max_us;             ///< Highest latency.
+} bat_gattc_link_t;
+
+/**
+ * @brief Aggregate figures across links.
+ */
+typedef struct {
+    size_t links;                        ///< Links in any state.
+    size_t ready;                        ///< Links ready.
+    uint32_t connects;                   ///< Links that became ready.
+    uint32_t connect_failures;           ///< Opens that failed, retried or not.
+    uint32_t disconnects;                ///< Open links that went down.
+    uint32_t connect_avg_us;             ///< Average scan hit to ready time.
+    uint32_t connect_max_us;             ///< Highest scan hit to ready time.
+    bat_bench_report_t traffic;          ///< Throughput and latency of the recorded operations.
+} bat_gattc_conn_stats_t;
+
+/**
+ * @brief The link table.
+ */
+typedef struct {
+    bat_gattc_link_t links[BAT_GATTC_CONN_MAX]; ///< Slots, in no particular order.
+    size_t count;                        ///< Slots in use.
+    bat_gattc_link_t *pOpening;          ///< Link with an open in flight, NULL if none.
+    uint8_t max_retries;                 ///< Retries given to new links.
+
+    uint32_t connects;                   ///< See bat_gattc_conn_stats_t.
+    uint32_t connect_failures;
+    uint32_t disconnects;
+    uint64_t connect_sum_us;
+    uint32_t connect_max_us;
+    bat_bench_t traffic;                 ///< Every recorded operation, all links together.
+} bat_gattc_conn_table_t;
+
+/**
+ * @brief Empties the table and allocates the latency samples.
+ *
+ * @param pTable The table.
+ * @param max_retries Failed opens retried per link.
+ * @param samples Latency samples kept for the aggregate percentiles, 0 for `BAT_GATTC_CONN_DEFAULT_SAMPLES`.
+ * @return `ESP_OK`, `ESP_ERR_INVALID_ARG` or `ESP_ERR_NO_MEM`.
+ */
+esp_err_t bat_gattc_conn_table_init(bat_gattc_conn_table_t *pTable, uint8_t max_retries, size_t samples);
+
+/**
+ * @brief Frees the latency samples and empties the table.
+ */
+void bat_gattc_conn_table_deinit(bat_gattc_conn_table_t *pTable);
+
+/**
+ * @brief Adds a scan hit, or returns the link of the peer if it already has one.
+ *
+ * @param pTable The table.
+ * @param bda Peer address.
+ * @param addr_type Peer address type.
+ * @param gattc_if Interface to open the link on.
+ * @param pContext Application data for the link.
+ * @return The link, or NULL if every slot is taken.
+ */
+bat_gattc_link_t *bat_gattc_conn_add(bat_gattc_conn_table_t *pTable, const esp_bd_addr_t bda,
+                                     esp_ble_addr_type_t addr_type, esp_gatt_if_t gattc_if, void *pContext);
+
+/**
+ * @brief Picks the next link to open and marks it connecting.
+ *
+ * @return The link, or NULL if an open is already in flight or no link waits.
+ */
+bat_gattc_link_t *bat_gattc_conn_next_to_open(bat_gattc_conn_table_t *pTable);
+
+/**
+ * @brief Records the outcome of an open (`ESP_GATTC_OPEN_EVT` or a failed `esp_ble_gattc_open`).
+ *
+ * A link that opens moves to DISCOVERING. One that fails goes back to SCAN_HIT while it has
+ * retries left, otherwise it is freed.
+ *
+ * @return The link, or NULL if the peer has none or it was freed.
+ */
+bat_gattc_link_t *bat_gattc_conn_on_open(bat_gattc_conn_table_t *pTable, const esp_bd_addr_t bda,
+                                         uint16_t conn_id, uint16_t mtu, bool success);
+
+/**
+ * @brief Marks a discovering link ready.
+ *
+ * @return The link, or NULL if `conn_id` has none.
+ */
+bat_gattc_link_t *bat_gattc_conn_on_ready(bat_gattc_conn_table_t *pTable, uint16_t conn_id);
+
+/**
+ * @brief Frees the link of a peer that disconnected.
+ *
+ * @return true if a link was freed.
+ */
+bool bat_gattc_conn_on_close(bat_gattc_conn_table_t *pTable, const esp_bd_addr_t bda);
+
+/**
+ * @brief Returns the link of a peer.
+ *
+ * @return The link, or NULL if the peer has none.
+ */
+bat_gattc_link_t *bat_gattc_conn_find(bat_gattc_conn_table_t *pTable, const esp_bd_addr_t bda);
+
+/**
+ * @brief Returns the link of an open connection.
+ *
+ * @return The link, or NULL if `conn_id` has none.
+ */
+bat_gattc_link_t *bat_gattc_conn_get(bat_gattc_conn_table_t *pTable, uint16_t conn_id);
+
+/**
+ * @brief Records one completed operation on a link.
+ *
+ * @param pTable The table.
+ * @param pLink The link.
+ * @param latency_us Time the operation took.
+ * @param bytes Bytes it moved.
+ */
+void bat_gattc_conn_record(bat_gattc_conn_table_t *pTable, bat_gattc_link_t *pLink, uint32_t latency_us, size_t bytes);
+
+/**
+ * @brief Computes the aggregate figures, sorting the latency samples in place.
+ */
+void bat_gattc_conn_get_stats(bat_gattc_conn_table_t *pTable, bat_gattc_conn_stats_t *pStats);
+
+/**
+ * @brief Restarts the traffic figures, the link states are kept.
+ */
+void bat_gattc_conn_reset_traffic(bat_gattc_conn_table_t *pTable);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,198 @@
+/**
+ * @file bat_gattc_notify.h
+ * @brief GATT client subscriptions, notifications and indications received into rings.
+ *
+ * A subscription binds one characteristic of one link to a ring of preallocated slots.
+ * The Bluedroid task copies each `ESP_GATTC_NOTIFY_EVT` value into the next slot and
+ * returns; the application drains the ring from its own task, a batch at a time, with
+ * `bat_gattc_notify_peek` and `bat_gattc_notify_release`. Nothing is called back per
+ * value, so a slow consumer never holds up the stack. A full ring drops the new value
+ * and counts it, values longer than a slot are truncated and counted.
+ *
+ * The ring has a single producer, the Bluedroid task, and a single consumer. Its indices
+ * run free and are published with acquire/release atomics, neither side takes a lock.
+ * The consumer task named in the configuration gets a task notification when a value
+ * lands in an empty ring, see `bat_gattc_notify_wait`.
+ *
+ * `bat_ble_client.c` keeps the subscriptions, writes the CCCD through the request queue
+ * and fills the rings, see `bat_ble_client_subscribe`.
+ *
+ * Thread-safe for one producer and one consumer per subscription; opening and closing
+ * need external synchronization.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_gattc_api.h"
+#include "esp_bt_defs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_BAT_GATTC_NOTIFY_SUBS
+#define BAT_GATTC_NOTIFY_SUBS CONFIG_BAT_GATTC_NOTIFY_SUBS ///< Subscriptions held by the client.
+#else
+#define BAT_GATTC_NOTIFY_SUBS 8                             ///< Subscriptions held by the client.
+#endif
+
+#define BAT_GATTC_NOTIFY_DEFAULT_SLOTS 64                   ///< Default ring capacity, in values.
+
+/**
+ * @brief Configuration passed to `bat_ble_client_subscribe`, zeroed fields take the defaults.
+ */
+typedef struct {
+    size_t slots;                        ///< Ring capacity in values, a power of two.
+    uint16_t slot_size;                  ///< Bytes kept per value, 0 for the link's MTU - 3.
+    bool indicate;                       ///< Ask for indications, used anyway if the characteristic only indicates.
+    TaskHandle_t consumer;               ///< Task woken when a value lands in an empty ring, NULL to poll.
+    void *pContext;                      ///< User-defined context, kept in the subscription.
+} bat_gattc_sub_config_t;
+
+/**
+ * @brief State of a subscription.
+ */
+typedef enum {
+    BAT_GATTC_SUB_FREE = 0,              ///< Slot unused.
+    BAT_GATTC_SUB_REGISTERING,           ///< Awaits `ESP_GATTC_REG_FOR_NOTIFY_EVT`.
+    BAT_GATTC_SUB_ENABLING,              ///< CCCD write queued.
+    BAT_GATTC_SUB_ACTIVE,                ///< The server sends, values are received.
+    BAT_GATTC_SUB_CLOSED,                ///< Failed or link lost, awaits `bat_ble_client_unsubscribe`.
+} bat_gattc_sub_state_t;
+
+/**
+ * @brief Bookkeeping of one ring slot.
+ */
+typedef struct {
+    int64_t received_us;                 ///< esp_timer time the value arrived.
+    uint16_t len;                        ///< Bytes kept.
+    uint16_t value_len;                  ///< Bytes received, more than `len` if truncated.
+} bat_gattc_notify_slot_t;
+
+/**
+ * @brief Single producer, single consumer ring of values.
+ */
+typedef struct {
+    bat_gattc_notify_slot_t *pSlots;     ///< One per value, followed by the value bytes in the same block.
+    uint8_t *pData;                      ///< `slot_size` bytes per slot.
+    uint32_t mask;                       ///< Slots - 1.
+    uint16_t slot_size;                  ///< Bytes kept per value.
+    uint32_t head;                       ///< Values written, advanced by the producer only.
+    uint32_t tail;                       ///< Values released, advanced by the consumer only.
+} bat_gattc_notify_ring_t;
+
+/**
+ * @brief One value handed out by `bat_gattc_notify_peek`.
+ */
+typedef struct {
+    const uint8_t *pValue;               ///< Into the ring, valid until released.
+    uint16_t len;                        ///< Bytes at `pValue`.
+    uint16_t value_len;                  ///< Bytes received, more than `len` if truncated.
+    int64_t received_us;                 ///< esp_timer time the value arrived.
+} bat_gattc_notify_msg_t;
+
+/**
+ * @brief Subscription statistics, see `bat_gattc_notify_get_stats`.
+ */
+typedef struct {
+    uint32_t received;                   ///< Values received.
+    uint32_t dropped;                    ///< Values dropped because the ring was full.
+    uint32_t truncated;                  ///< Values longer than a slot.
+    size_t pending;                      ///< Values waiting to be released.
+    size_t high_water;                   ///< Most values waiting at once.
+} bat_gattc_notify_stats_t;
+
+/**
+ * @brief A subscription, owned by `bat_ble_client.c`.
+ *
+ * The link fields are set when subscribing and guarded by the client. The counters are
+ * written by the producer only.
+ */
+typedef struct {
+    bat_gattc_sub_state_t state;         ///< Current state.
+    esp_gatt_status_t status;            ///< Outcome of the subscription, `ESP_GATT_OK` once active.
+    esp_gatt_if_t gattc_if;              ///< Interface of the link.
+    uint16_t conn_id;                    ///< Connection of the link.
+    esp_bd_addr_t bda;                   ///< Peer address.
+    uint16_t handle;                     ///< Characteristic value handle.
+    uint16_t cccd_handle;                ///< Its CCCD handle.
+    bool indicate;                       ///< Indications rather than notifications.
+    uint32_t seq;                        ///< Order of registration, pairs `ESP_GATTC_REG_FOR_NOTIFY_EVT` up.
+    TaskHandle_t consumer;               ///< See `bat_gattc_sub_config_t`.
+    void *pContext;                      ///< See `bat_gattc_sub_config_t`.
+    bat_gattc_notify_ring_t ring;        ///< Values received.
+
+    uint32_t received;                   ///< See bat_gattc_notify_stats_t.
+    uint32_t dropped;
+    uint32_t truncated;
+    size_t high_water;
+} bat_gattc_sub_t;
+
+/**
+ * @brief Allocates the ring of a free subscription and takes the configuration.
+ *
+ * @param pSub The subscription, its link fields are left to the caller.
+ * @param pConfig Configuration, `slot_size` resolved.
+ * @return `ESP_OK`, `ESP_ERR_INVALID_ARG` if `slots` is not a power of two or `slot_size` is 0,
+ *         or `ESP_ERR_NO_MEM`.
+ */
+esp_err_t bat_gattc_notify_open(bat_gattc_sub_t *pSub, const bat_gattc_sub_config_t *pConfig);
+
+/**
+ * @brief Frees the ring and the slot. Neither side may use the ring any more.
+ */
+void bat_gattc_notify_close(bat_gattc_sub_t *pSub);
+
+/**
+ * @brief Stores a received value, the producer side.
+ *
+ * Wakes the consumer task if the ring was empty.
+ *
+ * @return true if stored, false if the ring was full and the value dropped.
+ */
+bool bat_gattc_notify_push(bat_gattc_sub_t *pSub, const uint8_t *pValue, uint16_t len);
+
+/**
+ * @brief Hands out the oldest values without removing them, the consumer side.
+ *
+ * @param pSub The subscription.
+ * @param pMsgs Receives the values, oldest first.
+ * @param max_msgs Capacity of `pMsgs`.
+ * @return Values handed out.
+ */
+size_t bat_gattc_notify_peek(const bat_gattc_sub_t *pSub, bat_gattc_notify_msg_t *pMsgs, size_t max_msgs);
+
+/**
+ * @brief Gives the oldest `count` values back to the producer, the consumer side.
+ */
+void bat_gattc_notify_release(bat_gattc_sub_t *pSub, size_t count);
+
+/**
+ * @brief Values waiting to be released.
+ */
+size_t bat_gattc_notify_pending(const bat_gattc_sub_t *pSub);
+
+/**
+ * @brief Blocks the consumer task until the ring holds values.
+ *
+ * Must run on the `consumer` task of the configuration, it takes the task's notification.
+ * Values pushed between a release and the wait are not missed. A task draining several
+ * subscriptions may name itself consumer of each and wait on any of them.
+ *
+ * @return Values waiting, 0 on timeout or a stale wake-up.
+ */
+size_t bat_gattc_notify_wait(const bat_gattc_sub_t *pSub, TickType_t ticks_to_wait);
+
+/**
+ * @brief Copies the statistics.
+ */
+void bat_gattc_notify_get_stats(const bat_gattc_sub_t *pSub, bat_gattc_notify_stats_t *pStats);
+
+#ifdef __cplusplus
+}
+#endif
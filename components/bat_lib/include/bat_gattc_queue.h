@@ -0,0 +1,182 @@
+/**
+ * @file bat_gattc_queue.h
+ * @brief Per-link queue of GATT client reads and writes, issued back to back.
+ *
+ * Bluedroid takes one ATT request per link at a time, so an application doing its own
+ * reads and writes waits for each completion event before it can issue the next one.
+ * The queue holds a link's pending operations and hands the next one to the stack from
+ * the completion event of the previous one, on the Bluedroid task, so the link never
+ * idles while work is queued. Each operation reports its outcome through its own
+ * callback.
+ *
+ * Writes without response complete as soon as the stack has queued the packet. While
+ * the link is congested (`ESP_GATTC_CONGEST_EVT`) the queue holds back.
+ *
+ * The ring of operations is preallocated. Write data is not copied: the buffer must stay
+ * valid until the operation's callback has run.
+ *
+ * `bat_ble_client.c` keeps one queue per link slot of its bat_gattc_conn table, see
+ * `bat_ble_client_submit`.
+ *
+ * Not thread‐safe—external synchronization required.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_gattc_api.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_BAT_GATTC_QUEUE_DEPTH
+#define BAT_GATTC_QUEUE_DEPTH CONFIG_BAT_GATTC_QUEUE_DEPTH ///< Operations queued per link.
+#else
+#define BAT_GATTC_QUEUE_DEPTH 16                            ///< Operations queued per link.
+#endif
+
+/**
+ * @brief Kind of operation.
+ */
+typedef enum {
+    BAT_GATTC_OP_READ = 0,               ///< `esp_ble_gattc_read_char`.
+    BAT_GATTC_OP_WRITE,                  ///< Write with response, long values use prepared writes.
+    BAT_GATTC_OP_WRITE_NO_RSP,           ///< Write without response, at most MTU - 3 bytes.
+} bat_gattc_op_type_t;
+
+struct bat_gattc_op_result_t;
+
+/**
+ * @brief Called once an operation completes or fails, on the Bluedroid task.
+ *
+ * The result, and the read value it points to, are only valid during the call.
+ * More operations may be submitted from the callback.
+ */
+typedef void (*bat_gattc_op_cb_t)(const struct bat_gattc_op_result_t *pResult);
+
+/**
+ * @brief One operation.
+ */
+typedef struct {
+    bat_gattc_op_type_t type;            ///< Read or write.
+    uint16_t handle;                     ///< Characteristic value or descriptor handle.
+    uint16_t len;                        ///< Bytes to write.
+    const uint8_t *pData;                ///< Bytes to write, valid until the callback has run.
+    bat_gattc_op_cb_t cb;                ///< Optional completion callback.
+    void *pContext;                      ///< User-defined context for the callback.
+} bat_gattc_op_t;
+
+/**
+ * @brief Outcome of an operation.
+ */
+typedef struct bat_gattc_op_result_t {
+    bat_gattc_op_t op;                   ///< The operation, as submitted.
+    uint16_t conn_id;                    ///< Link it ran on.
+    esp_gatt_status_t status;            ///< `ESP_GATT_OK`, the stack's error, or `ESP_GATT_ERROR` if never issued.
+    const uint8_t *pValue;               ///< Value read, NULL for writes.
+    uint16_t value_len;                  ///< Bytes read.
+    uint32_t latency_us;                 ///< Issue to completion, 0 if never issued.
+} bat_gattc_op_result_t;
+
+/**
+ * @brief Queue statistics, see `bat_gattc_queue_get_stats`.
+ */
+typedef struct {
+    size_t queued;                       ///< Operations waiting, the one in flight included.
+    size_t high_water;                   ///< Most operations waiting at once.
+    uint32_t issued;                     ///< Operations handed to the stack.
+    uint32_t completed;                  ///< Operations that succeeded.
+    uint32_t failed;                     ///< Operations that failed or were flushed.
+    uint32_t congestion_stalls;          ///< Times the queue held back for congestion.
+} bat_gattc_queue_stats_t;
+
+/**
+ * @brief The queue of one link.
+ */
+typedef struct {
+    bat_gattc_op_t ops[BAT_GATTC_QUEUE_DEPTH]; ///< Ring, `head` is the oldest.
+    size_t head;                         ///< Index of the oldest operation.
+    size_t count;                        ///< Operations in the ring, the one in flight included.
+    bool open;                           ///< Bound to an open link.
+    bool in_flight;                      ///< `ops[head]` was issued and awaits its completion event.
+    bool congested;                      ///< The link reported congestion.
+    esp_gatt_if_t gattc_if;              ///< Interface of the link.
+    uint16_t conn_id;                    ///< Connection of the link.
+    int64_t issued_us;                   ///< esp_timer time `ops[head]` was issued.
+
+    size_t high_water;                   ///< See bat_gattc_queue_stats_t.
+    uint32_t issued;
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t congestion_stalls;
+} bat_gattc_queue_t;
+
+/**
+ * @brief Empties the queue and binds it to an open link.
+ */
+void bat_gattc_queue_open(bat_gattc_queue_t *pQueue, esp_gatt_if_t gattc_if, uint16_t conn_id);
+
+/**
+ * @brief Unbinds the queue, `bat_gattc_queue_flush` then fails what is left.
+ */
+void bat_gattc_queue_close(bat_gattc_queue_t *pQueue);
+
+/**
+ * @brief Room left, a batch fits if its size is at most this.
+ */
+size_t bat_gattc_queue_space(const bat_gattc_queue_t *pQueue);
+
+/**
+ * @brief Appends an operation.
+ *
+ * @return `ESP_OK`, `ESP_ERR_INVALID_STATE` if the queue is not open, or `ESP_ERR_NO_MEM` if it is full.
+ */
+esp_err_t bat_gattc_queue_push(bat_gattc_queue_t *pQueue, const bat_gattc_op_t *pOp);
+
+/**
+ * @brief Issues the oldest operation unless one is in flight or the link is congested.
+ *
+ * @param pQueue The queue.
+ * @param pFailed Receives the operation if the stack refused it; it is removed from the queue.
+ * @return `ESP_OK` if an operation was issued or there was nothing to do, otherwise the stack's error.
+ */
+esp_err_t bat_gattc_queue_issue(bat_gattc_queue_t *pQueue, bat_gattc_op_result_t *pFailed);
+
+/**
+ * @brief Completes the operation in flight from its `ESP_GATTC_READ_CHAR_EVT` or `ESP_GATTC_WRITE_CHAR_EVT`.
+ *
+ * @param pQueue The queue.
+ * @param is_read The event is a read completion.
+ * @param handle Handle of the event.
+ * @param status Status of the event.
+ * @param pValue Value read, NULL for writes.
+ * @param value_len Bytes read.
+ * @param pResult Receives the completed operation.
+ * @return true if the event completed the operation in flight, false if it belongs to something else.
+ */
+bool bat_gattc_queue_complete(bat_gattc_queue_t *pQueue, bool is_read, uint16_t handle, esp_gatt_status_t status,
+                              const uint8_t *pValue, uint16_t value_len, bat_gattc_op_result_t *pResult);
+
+/**
+ * @brief Records the congestion state of the link, from `ESP_GATTC_CONGEST_EVT`.
+ */
+void bat_gattc_queue_set_congested(bat_gattc_queue_t *pQueue, bool congested);
+
+/**
+ * @brief Removes the oldest operation of a closed queue as failed.
+ *
+ * @return true if an operation was removed into `pResult`.
+ */
+bool bat_gattc_queue_flush(bat_gattc_queue_t *pQueue, bat_gattc_op_result_t *pResult);
+
+/**
+ * @brief Copies the statistics.
+ */
+void bat_gattc_queue_get_stats(const bat_gattc_queue_t *pQueue, bat_gattc_queue_stats_t *pStats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,130 @@
+/**
+ * @file bat_gatts_conn.h
+ * @brief Per connection state of the GATT server, indexed by `conn_id`.
+ *
+ * Bluedroid hands the GATT server a `conn_id` that is the index of the link, below
+ * `CONFIG_BT_ACL_CONNECTIONS`, so the table is a plain array indexed by it: finding the
+ * connection of a read or write event is one bounds check and one load.
+ *
+ * `bat_ble_server.c` owns the table of the server (see `bat_gatts_get_conn`). It opens and
+ * closes entries on connect and disconnect, records the MTU and counts traffic. The CCCD and
+ * pacing fields belong to the notification engine (bat_gatts_notify.h) and are only changed
+ * under its lock, the prepared write fields belong to bat_gatts_prep_write.h.
+ *
+ * Not thread‐safe—external synchronization required.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_gatts_api.h"
+#include "esp_bt_defs.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_BT_ACL_CONNECTIONS
+#define BAT_GATTS_CONN_MAX CONFIG_BT_ACL_CONNECTIONS ///< Connection slots, one per possible link.
+#else
+#define BAT_GATTS_CONN_MAX 4                          ///< Connection slots, one per possible link.
+#endif
+
+#define BAT_GATTS_CONN_DEFAULT_MTU 23                 ///< ATT MTU until `ESP_GATTS_MTU_EVT`.
+
+/**
+ * @brief State of one connection.
+ */
+typedef struct {
+    bool in_use;                         ///< Slot holds a connection.
+    esp_gatt_if_t gatts_if;              ///< Interface that saw the connection first.
+    uint16_t conn_id;                    ///< Connection ID, also the slot index.
+    esp_bd_addr_t remote_bda;            ///< Peer address.
+    uint16_t mtu;                        ///< Negotiated ATT MTU.
+    int64_t connected_us;                ///< esp_timer time of the connection.
+
+    uint32_t notify_mask;                ///< CCCD notification bits, one per notification engine characteristic.
+    uint32_t indicate_mask;              ///< CCCD indication bits, one per notification engine characteristic.
+    uint32_t pending_mask;               ///< Characteristics with an unsent value.
+    bool indication_pending;             ///< An indication awaits its confirmation.
+    bool congested;                      ///< The stack reported the link congested.
+    uint8_t in_flight;                   ///< Sends awaiting `ESP_GATTS_CONF_EVT`.
+    uint8_t next_char;                   ///< Where the notification round robin resumes.
+
+    uint32_t reads;                      ///< Read requests.
+    uint32_t writes;                     ///< Write requests.
+    uint64_t rx_bytes;                   ///< Bytes written by the peer.
+    uint64_t tx_bytes;                   ///< Bytes sent in read responses, notifications and indications.
+
+    uint8_t *pPrepBuf;                   ///< Prepared write queue, see bat_gatts_prep_write.h. NULL when empty.
+    uint16_t prep_handle;                ///< Attribute the queued fragments write.
+    uint16_t prep_len;                   ///< Bytes reassembled so far.
+    esp_gatt_status_t prep_status;       ///< First error of the queue, answered at execute.
+} bat_gatts_conn_t;
+
+/**
+ * @brief The connection table.
+ */
+typedef struct {
+    bat_gatts_conn_t slots[BAT_GATTS_CONN_MAX]; ///< Indexed by `conn_id`.
+    size_t max_conns;                    ///< Connections accepted at once, at most `BAT_GATTS_CONN_MAX`.
+    size_t count;                        ///< Connections currently open.
+} bat_gatts_conn_table_t;
+
+/**
+ * @brief Empties the table.
+ *
+ * @param pTable The table.
+ * @param max_conns Connections accepted at once, 0 or more than `BAT_GATTS_CONN_MAX` for `BAT_GATTS_CONN_MAX`.
+ */
+void bat_gatts_conn_table_init(bat_gatts_conn_table_t *pTable, size_t max_conns);
+
+/**
+ * @brief Opens the entry of a new connection, or returns it if already open.
+ *
+ * The CCCD and pacing fields are not touched, see `bat_gatts_notify_on_connect`.
+ *
+ * @param pTable The table.
+ * @param gatts_if Interface reporting the connection.
+ * @param conn_id Connection ID.
+ * @param remote_bda Peer address.
+ * @param pOpened Set to true if the entry was opened by this call, may be NULL.
+ * @return The entry, or NULL if `conn_id` is out of range or `max_conns` are already open.
+ */
+bat_gatts_conn_t *bat_gatts_conn_open(bat_gatts_conn_table_t *pTable, esp_gatt_if_t gatts_if, uint16_t conn_id,
+                                      const esp_bd_addr_t remote_bda, bool *pOpened);
+
+/**
+ * @brief Closes the entry of a connection, if open.
+ *
+ * The CCCD and pacing fields are not touched, see `bat_gatts_notify_on_disconnect`.
+ *
+ * @return true if an entry was closed.
+ */
+bool bat_gatts_conn_close(bat_gatts_conn_table_t *pTable, uint16_t conn_id);
+
+/**
+ * @brief Returns the entry of an open connection.
+ *
+ * @return The entry, or NULL if `conn_id` is not open.
+ */
+static inline bat_gatts_conn_t *bat_gatts_conn_get(bat_gatts_conn_table_t *pTable, uint16_t conn_id)
+{
+    if (conn_id >= BAT_GATTS_CONN_MAX || !pTable->slots[conn_id].in_use)
+        return NULL;
+    return &pTable->slots[conn_id];
+}
+
+/**
+ * @brief Whether another connection would be accepted.
+ */
+static inline bool bat_gatts_conn_has_free_slot(const bat_gatts_conn_table_t *pTable)
+{
+    return pTable->count < pTable->max_conns;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,195 @@
+/**
+ * @file bat_gatts_notify.h
+ * @brief Notifications and indications for GATT server characteristics.
+ *
+ * Characteristics that notify or indicate are registered with their value and CCCD handles
+ * (`bat_gatts_notify_add_table` does it for a whole attribute table). The engine records the
+ * CCCD writes of each connection in its connection table entry (bat_gatts_conn.h), so it knows
+ * who subscribed to what.
+ *
+ * `bat_gatts_notify_update` stores the new value and marks it pending for every subscribed
+ * connection. Updates coalesce: a characteristic updated several times before it could be sent
+ * is sent once, with the latest value. Pending values are sent round robin per connection until:
+ *   - the stack reports the link congested (`ESP_GATTS_CONGEST_EVT`), sending resumes when it clears,
+ *   - `max_in_flight` sends await their `ESP_GATTS_CONF_EVT`,
+ *   - an indication awaits its confirmation, only one can be outstanding per connection (ATT rule).
+ * The latest value is never dropped, it stays pending until one of these events frees the link. A
+ * send the stack refuses stays pending too and is retried `retry_us` later.
+ *
+ * `bat_ble_server.c` feeds the engine the disconnect, write, confirm and congestion events of
+ * the callbacks it is attached to, see `bat_gatts_callbacks_t::pNotify`.
+ *
+ * Thread-safe: a mutex guards the state, including the CCCD and pacing fields of the connection
+ * entries. It is released while a value is handed to the stack: the BT task takes it for every
+ * event above, and `esp_ble_gatts_send_indicate` may wait for the BT task.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_gatts_api.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "bat_gatts_table.h"
+#include "bat_gatts_conn.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BAT_GATTS_NOTIFY_MAX_CHARS 32            ///< Characteristics per engine, one bit each in the masks.
+#define BAT_GATTS_NOTIFY_DEFAULT_MAX_CHARS 8     ///< Default number of characteristics.
+#define BAT_GATTS_NOTIFY_DEFAULT_MAX_IN_FLIGHT 4 ///< Default sends awaiting confirmation per connection.
+#define BAT_GATTS_NOTIFY_DEFAULT_RETRY_US 20000  ///< Default delay before a refused send is retried.
+
+/**
+ * @brief Configuration passed to `bat_gatts_notify_init`, zeroed fields take the defaults.
+ */
+typedef struct {
+    bat_gatts_conn_table_t *pConnTable;  ///< Connections, NULL for the server's (`bat_gatts_get_conn_table`).
+    size_t max_chars;                    ///< Characteristics, at most `BAT_GATTS_NOTIFY_MAX_CHARS`.
+    uint8_t max_in_flight;               ///< Sends awaiting `ESP_GATTS_CONF_EVT` per connection.
+    uint32_t retry_us;                   ///< Delay before sends the stack refused are retried.
+} bat_gatts_notify_config_t;
+
+/**
+ * @brief A characteristic that can be notified or indicated.
+ */
+typedef struct {
+    uint16_t value_handle;               ///< Characteristic value handle.
+    uint16_t cccd_handle;                ///< Its CCCD handle.
+    uint16_t max_len;                    ///< Capacity of `pValue`.
+    uint16_t len;                        ///< Length of the latest value.
+    uint8_t *pValue;                     ///< Latest value.
+} bat_gatts_notify_char_t;
+
+/**
+ * @brief Represents a notification engine.
+ */
+typedef struct {
+    bat_gatts_conn_table_t *pConnTable;  ///< Connections, their CCCD and pacing fields are guarded by `lock`.
+    bat_gatts_notify_char_t *pChars;     ///< Registered characteristics.
+    size_t max_chars;                    ///< Capacity of `pChars`.
+    size_t char_count;                   ///< Registered characteristics.
+    uint8_t max_in_flight;               ///< See `bat_gatts_notify_config_t`.
+    uint32_t retry_us;                   ///< See `bat_gatts_notify_config_t`.
+    esp_timer_handle_t retry_timer;      ///< One-shot, started when the stack refuses a send.
+    bool retry_armed;                    ///< `retry_timer` is running.
+    SemaphoreHandle_t lock;              ///< Guards everything above and the counters.
+    uint32_t updates;                    ///< Calls to `bat_gatts_notify_update`.
+    uint32_t coalesced;                  ///< Pending values replaced before they were sent.
+    uint32_t notified;                   ///< Notifications handed to the stack.
+    uint32_t indicated;                  ///< Indications handed to the stack.
+    uint32_t confirmed;                  ///< `ESP_GATTS_CONF_EVT` received.
+    uint32_t congestions;                ///< Times a link reported congestion.
+    uint32_t send_errors;                ///< Sends refused by the stack.
+} bat_gatts_notify_t;
+
+/**
+ * @brief Notification engine statistics, see `bat_gatts_notify_get_stats`.
+ */
+typedef struct {
+    uint32_t updates;                    ///< Calls to `bat_gatts_notify_update`.
+    uint32_t coalesced;                  ///< Pending values replaced before they were sent.
+    uint32_t notified;                   ///< Notifications handed to the stack.
+    uint32_t indicated;                  ///< Indications handed to the stack.
+    uint32_t confirmed;                  ///< Confirmations received.
+    uint32_t congestions;                ///< Times a link reported congestion.
+    uint32_t send_errors;                ///< Sends refused by the stack.
+    size_t connections;                  ///< Connections currently open.
+    size_t subscriptions;                ///< Subscribed (connection, characteristic) pairs.
+} bat_gatts_notify_stats_t;
+
+/**
+ * @brief Allocates the characteristic slots.
+ *
+ * @param pNotify Pointer to the engine structure to initialize.
+ * @param pConfig Configuration, or NULL for the defaults.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_ARG` or `ESP_ERR_NO_MEM` on failure.
+ */
+esp_err_t bat_gatts_notify_init(bat_gatts_notify_t *pNotify, const bat_gatts_notify_config_t *pConfig);
+
+/**
+ * @brief Frees the engine, pending values are discarded.
+ *
+ * @param pNotify Pointer to the engine structure.
+ */
+void bat_gatts_notify_deinit(bat_gatts_notify_t *pNotify);
+
+/**
+ * @brief Registers a characteristic.
+ *
+ * @param pNotify Pointer to the engine structure.
+ * @param value_handle Characteristic value handle, used by `bat_gatts_notify_update`.
+ * @param cccd_handle Its CCCD handle.
+ * @param max_len Longest value that will be sent.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_ARG`, `ESP_ERR_NO_MEM` (all slots used or
+ *         allocation failed) or `ESP_ERR_INVALID_STATE` (already registered).
+ */
+esp_err_t bat_gatts_notify_add_char(bat_gatts_notify_t *pNotify, uint16_t value_handle, uint16_t cccd_handle, uint16_t max_len);
+
+/**
+ * @brief Registers every characteristic of a created attribute table that has a CCCD.
+ *
+ * @param pNotify Pointer to the engine structure.
+ * @param pTable Attribute table, typically from `on_create_attr_tab`.
+ * @return `ESP_OK` on success, or the first error of `bat_gatts_notify_add_char`.
+ */
+esp_err_t bat_gatts_notify_add_table(bat_gatts_notify_t *pNotify, const bat_gatts_table_t *pTable);
+
+/**
+ * @brief Publishes a new value, sending it to subscribers as the links allow.
+ *
+ * @param pNotify Pointer to the engine structure.
+ * @param value_handle Characteristic value handle.
+ * @param pValue The value, copied.
+ * @param len Value length, at most the registered `max_len`.
+ * @return `ESP_OK` on success (including when nobody is subscribed), `ESP_ERR_NOT_FOUND`
+ *         (unregistered handle), `ESP_ERR_INVALID_SIZE` or `ESP_ERR_INVALID_ARG`.
+ */
+esp_err_t bat_gatts_notify_update(bat_gatts_notify_t *pNotify, uint16_t value_handle, const uint8_t *pValue, uint16_t len);
+
+/**
+ * @brief Starts a connection with no subscriptions, after its entry is opened.
+ *
+ * `bat_gatts_conn_open` leaves the CCCD and pacing fields alone, they are cleared here under the lock.
+ */
+void bat_gatts_notify_on_connect(bat_gatts_notify_t *pNotify, uint16_t conn_id);
+
+/**
+ * @brief Forgets the subscriptions and pending values of a connection, before its entry is closed.
+ */
+void bat_gatts_notify_on_disconnect(bat_gatts_notify_t *pNotify, uint16_t conn_id);
+
+/**
+ * @brief Records a CCCD write. A new subscriber is sent the latest value.
+ *
+ * @param pNotify Pointer to the engine structure.
+ * @param pParam `ESP_GATTS_WRITE_EVT` parameters.
+ * @return true if the write was to a registered CCCD.
+ */
+bool bat_gatts_notify_on_write(bat_gatts_notify_t *pNotify, const esp_ble_gatts_cb_param_t *pParam);
+
+/**
+ * @brief Handles `ESP_GATTS_CONF_EVT`, freeing a send slot and sending what is pending.
+ */
+void bat_gatts_notify_on_conf(bat_gatts_notify_t *pNotify, uint16_t conn_id, esp_gatt_status_t status);
+
+/**
+ * @brief Handles `ESP_GATTS_CONGEST_EVT`, pausing or resuming the connection.
+ */
+void bat_gatts_notify_on_congest(bat_gatts_notify_t *pNotify, uint16_t conn_id, bool congested);
+
+/**
+ * @brief Retrieves the engine statistics.
+ *
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_STATE` if not initialized, or `ESP_ERR_INVALID_ARG`.
+ */
+esp_err_t bat_gatts_notify_get_stats(bat_gatts_notify_t *pNotify, bat_gatts_notify_stats_t *pStats);
+
+#ifdef __cplusplus
+}
+#endif
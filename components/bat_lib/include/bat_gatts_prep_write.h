@@ -0,0 +1,100 @@
+/**
+ * @file bat_gatts_prep_write.h
+ * @brief Reassembly of prepared (long) writes on the GATT server.
+ *
+ * A client writing more than `MTU - 3` bytes sends a queue of Prepare Write requests,
+ * each with a fragment and its offset, followed by one Execute Write request. The
+ * fragments are copied into a per connection buffer and, on execute, handed to the
+ * application as a single contiguous write.
+ *
+ * Buffers are blocks of one `bat_pool_t` slab sized for every connection, allocated once
+ * by `bat_gatts_prep_write_init`: a queue takes a block on its first fragment and gives it
+ * back on execute, cancel or disconnect, so fragments never touch the heap.
+ *
+ * One queue holds writes to a single attribute, fragments may be rewritten but must not
+ * leave a gap. The reassembly state lives in the connection entry (bat_gatts_conn.h).
+ *
+ * Not thread‐safe—external synchronization required.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_gatts_api.h"
+#include "bat_pool.h"
+#include "bat_gatts_conn.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BAT_GATTS_PREP_WRITE_MAX 512          ///< Longest reassembled value, the largest attribute ATT allows.
+
+/**
+ * @brief Reassembly buffers and counters.
+ */
+typedef struct {
+    bat_pool_t pool;                     ///< One `BAT_GATTS_PREP_WRITE_MAX` byte block per queue.
+    uint32_t fragments;                  ///< Prepare Write requests accepted.
+    uint32_t executed;                   ///< Queues delivered as one write.
+    uint32_t cancelled;                  ///< Queues cancelled by the client or dropped on disconnect.
+    uint32_t rejected;                   ///< Prepare Write requests refused.
+} bat_gatts_prep_write_t;
+
+/**
+ * @brief Allocates the buffers.
+ *
+ * @param pPrep The reassembler.
+ * @param max_queues Queues reassembled at once, 0 for `BAT_GATTS_CONN_MAX`.
+ * @return `ESP_OK`, `ESP_ERR_INVALID_ARG` or `ESP_ERR_NO_MEM`.
+ */
+esp_err_t bat_gatts_prep_write_init(bat_gatts_prep_write_t *pPrep, size_t max_queues);
+
+/**
+ * @brief Releases the buffers. Connection entries must not reference them afterwards.
+ */
+void bat_gatts_prep_write_deinit(bat_gatts_prep_write_t *pPrep);
+
+/**
+ * @brief Copies the fragment of a Prepare Write request into the queue of its connection.
+ *
+ * A refused fragment also fails the whole queue, its Execute Write is answered with the same status.
+ *
+ * @param pPrep The reassembler.
+ * @param pConn Connection of the request.
+ * @param pParam `ESP_GATTS_WRITE_EVT` parameters with `is_prep` set.
+ * @return `ESP_GATT_OK`, `ESP_GATT_INVALID_OFFSET`, `ESP_GATT_INVALID_ATTR_LEN`,
+ *         `ESP_GATT_PREPARE_Q_FULL` (another attribute is queued) or `ESP_GATT_NO_RESOURCES`.
+ */
+esp_gatt_status_t bat_gatts_prep_write_append(bat_gatts_prep_write_t *pPrep, bat_gatts_conn_t *pConn,
+                                              const esp_ble_gatts_cb_param_t *pParam);
+
+/**
+ * @brief Fills a write event describing the reassembled value of a connection.
+ *
+ * `pWrite->write.value` points into the queue buffer and stays valid until
+ * `bat_gatts_prep_write_release`. `need_rsp` and `is_prep` are false.
+ *
+ * @param pConn Connection of the Execute Write request.
+ * @param pExec `ESP_GATTS_EXEC_WRITE_EVT` parameters.
+ * @param pWrite Receives the write.
+ * @param pStatus Receives the status to answer the Execute Write with.
+ * @return true if `pWrite` was filled, false if nothing is queued or the queue failed.
+ */
+bool bat_gatts_prep_write_take(const bat_gatts_conn_t *pConn, const esp_ble_gatts_cb_param_t *pExec,
+                               esp_ble_gatts_cb_param_t *pWrite, esp_gatt_status_t *pStatus);
+
+/**
+ * @brief Empties the queue of a connection and returns its buffer.
+ *
+ * @param pPrep The reassembler.
+ * @param pConn The connection, may be NULL.
+ * @param executed Whether the queue was delivered, otherwise it counts as cancelled.
+ */
+void bat_gatts_prep_write_release(bat_gatts_prep_write_t *pPrep, bat_gatts_conn_t *pConn, bool executed);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,198 @@
+/**
+ * @file bat_gatts_table.h
+ * @brief Declarative GATT service description, registered in one attribute-table call.
+ *
+ * Building a service attribute by attribute costs one Bluetooth stack round trip per
+ * attribute (create service, add char, add descriptor, ...). Instead a service can be
+ * described as static const data:
+ *
+ *     static const bat_gatts_char_def_t chars[] = {
+ *         {.uuid = {.uuid16 = 0x2A19}, .properties = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY,
+ *          .perm = ESP_GATT_PERM_READ, .max_len = 1},
+ *     };
+ *     static const bat_gatts_service_def_t service = {.uuid = {.uuid16 = 0x180F}, .pChars = chars, .char_count = 1};
+ *
+ * bat_gatts_table_build flattens it into an `esp_gatts_attr_db_t` array laid out as:
+ *     service declaration,
+ *     for each characteristic: declaration, value, CCCD (if it notifies or indicates), descriptors.
+ * `bat_gatts_create_attr_table` (bat_ble_server.h) registers that array with a single
+ * `esp_ble_gatts_create_attr_tab` call, and fills the handle map when the stack reports
+ * `ESP_GATTS_CREAT_ATTR_TAB_EVT`.
+ *
+ * The stack copies the array but not what it points to (UUIDs, initial values), so the
+ * built array is kept until the event arrives. The description itself must outlive the table.
+ *
+ * Every attribute, characteristic values included, is answered by the stack from its own copy
+ * of the value (`ESP_GATT_AUTO_RSP`), which the application updates with `bat_gatts_set_value`.
+ * A characteristic whose value is computed per read sets `rsp_by_app` and answers from on_read.
+ *
+ * Not thread‐safe—external synchronization required.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_gatts_api.h"
+#include "bat_ble.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief A 16 or 128-bit UUID in a description.
+ */
+typedef struct {
+    uint16_t uuid16;                     ///< 16-bit UUID, used when `pUuid128` is NULL.
+    const bat_ble_uuid128_t *pUuid128;   ///< 128-bit UUID, or NULL.
+} bat_gatts_uuid_t;
+
+/**
+ * @brief Describes a characteristic descriptor (other than the CCCD, which is implied).
+ */
+typedef struct {
+    bat_gatts_uuid_t uuid;               ///< Descriptor UUID.
+    esp_gatt_perm_t perm;                ///< Access permissions.
+    uint16_t max_len;                    ///< Maximum value length (0 = `len`).
+    uint16_t len;                        ///< Initial value length.
+    const uint8_t *pValue;               ///< Initial value, or NULL.
+} bat_gatts_descr_def_t;
+
+/**
+ * @brief Describes a characteristic.
+ */
+typedef struct {
+    bat_gatts_uuid_t uuid;               ///< Characteristic UUID.
+    esp_gatt_char_prop_t properties;     ///< ESP_GATT_CHAR_PROP_BIT_*, NOTIFY or INDICATE adds a CCCD.
+    esp_gatt_perm_t perm;                ///< Value access permissions.
+    uint16_t max_len;                    ///< Maximum value length (0 = `len`).
+    uint16_t len;                        ///< Initial value length.
+    const uint8_t *pValue;               ///< Initial value, or NULL.
+    const bat_gatts_descr_def_t *pDescrs;///< Additional descriptors, or NULL.
+    size_t descr_count;                  ///< Number of entries in `pDescrs`.
+    bool rsp_by_app;                     ///< Reads and writes of the value are answered by the application, not the stack.
+} bat_gatts_char_def_t;
+
+/**
+ * @brief Describes a service.
+ */
+typedef struct {
+    bat_gatts_uuid_t uuid;               ///< Service UUID.
+    bool secondary;                      ///< Secondary rather than primary service.
+    uint8_t inst_id;                     ///< Service instance ID.
+    const bat_gatts_char_def_t *pChars;  ///< Characteristics.
+    size_t char_count;                   ///< Number of entries in `pChars`.
+} bat_gatts_service_def_t;
+
+/**
+ * @brief What an attribute of the table is.
+ */
+typedef enum {
+    BAT_GATTS_ATTR_SERVICE = 0,          ///< Service declaration.
+    BAT_GATTS_ATTR_CHAR_DECL,            ///< Characteristic declaration.
+    BAT_GATTS_ATTR_VALUE,                ///< Characteristic value.
+    BAT_GATTS_ATTR_CCCD,                 ///< Client Characteristic Configuration Descriptor.
+    BAT_GATTS_ATTR_DESCR,                ///< Other descriptor.
+} bat_gatts_attr_role_t;
+
+/**
+ * @brief Where an attribute comes from in the description.
+ */
+typedef struct {
+    uint16_t char_index;                 ///< Characteristic index (0 for the service declaration).
+    uint8_t role;                        ///< A `bat_gatts_attr_role_t`.
+    uint8_t descr_index;                 ///< Descriptor index for `BAT_GATTS_ATTR_DESCR`.
+} bat_gatts_attr_info_t;
+
+/**
+ * @brief A built attribute table and, once created, its handle map.
+ */
+typedef struct {
+    const bat_gatts_service_def_t *pDef; ///< The description, not owned.
+    uint16_t attr_count;                 ///< Number of attributes.
+    esp_gatts_attr_db_t *pDb;            ///< Attribute array, freed once the stack has created the table.
+    uint8_t *pCharProps;                 ///< Characteristic declaration values, freed with `pDb`.
+    bat_gatts_attr_info_t *pAttrs;       ///< Per attribute origin.
+    uint16_t *pValueIndex;               ///< Per characteristic index of the value attribute.
+    uint16_t *pHandles;                  ///< Per attribute handle, all 0 until created.
+    uint16_t service_handle;             ///< Service handle, 0 until created.
+    int64_t requested_us;                ///< esp_timer time of the create request.
+    int64_t created_us;                  ///< esp_timer time of the creation event.
+} bat_gatts_table_t;
+
+/**
+ * @brief Flattens a description into an attribute array.
+ *
+ * @param pTable Receives the table.
+ * @param pDef The description, must outlive the table.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_ARG` (bad description),
+ *         `ESP_ERR_INVALID_SIZE` (more than `ESP_GATT_ATTR_HANDLE_MAX` attributes) or `ESP_ERR_NO_MEM` on failure.
+ */
+esp_err_t bat_gatts_table_build(bat_gatts_table_t *pTable, const bat_gatts_service_def_t *pDef);
+
+/**
+ * @brief Records the handles reported by `ESP_GATTS_CREAT_ATTR_TAB_EVT` and frees the attribute array.
+ *
+ * @param pTable The table.
+ * @param pHandles Handles, one per attribute in table order.
+ * @param count Number of handles.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_SIZE` if `count` does not match the table.
+ */
+esp_err_t bat_gatts_table_set_handles(bat_gatts_table_t *pTable, const uint16_t *pHandles, size_t count);
+
+/**
+ * @brief Frees the attribute array, keeping the handle map.
+ *
+ * @param pTable The table.
+ */
+void bat_gatts_table_release_db(bat_gatts_table_t *pTable);
+
+/**
+ * @brief Frees everything.
+ *
+ * @param pTable The table.
+ */
+void bat_gatts_table_free(bat_gatts_table_t *pTable);
+
+/**
+ * @brief Returns the value handle of a characteristic.
+ *
+ * @param pTable The table.
+ * @param char_index Index of the characteristic in the description.
+ * @return The handle, or 0 if unknown or not created yet.
+ */
+uint16_t bat_gatts_table_value_handle(const bat_gatts_table_t *pTable, size_t char_index);
+
+/**
+ * @brief Returns the CCCD handle of a characteristic.
+ *
+ * @param pTable The table.
+ * @param char_index Index of the characteristic in the description.
+ * @return The handle, or 0 if the characteristic has no CCCD or the table is not created yet.
+ */
+uint16_t bat_gatts_table_cccd_handle(const bat_gatts_table_t *pTable, size_t char_index);
+
+/**
+ * @brief Returns the handle of an additional descriptor.
+ *
+ * @param pTable The table.
+ * @param char_index Index of the characteristic in the description.
+ * @param descr_index Index of the descriptor in the characteristic's `pDescrs`.
+ * @return The handle, or 0 if unknown or not created yet.
+ */
+uint16_t bat_gatts_table_descr_handle(const bat_gatts_table_t *pTable, size_t char_index, size_t descr_index);
+
+/**
+ * @brief Finds which attribute of the description a handle belongs to.
+ *
+ * @param pTable The table.
+ * @param handle Attribute handle, e.g. from a read or write event.
+ * @return The attribute origin, or NULL if the handle is not in the table.
+ */
+const bat_gatts_attr_info_t *bat_gatts_table_lookup(const bat_gatts_table_t *pTable, uint16_t handle);
+
+#ifdef __cplusplus
+}
+#endif
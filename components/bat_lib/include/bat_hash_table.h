@@ -1,51 +1,97 @@
 /**
  * @file bat_hash_table.h
- * @brief Simple hash‐table API for mapping uint16_t keys to void* values.
+ * @brief Simple hash‐table API for mapping fixed-width keys to void* values.
+ *
+ * Keys are uint16_t by default. A wider key size (e.g. 6 bytes for an esp_bd_addr_t or
+ * 16 bytes for a bat_ble_uuid128_t) can be chosen at init time and used through the
+ * *_key functions. Keys are stored zero padded to whole 32-bit words and compared a
+ * word at a time.
  *
  * Provides functions to:
- *   - initialize a fixed‐size table with optional value cleanup callback
- *   - insert or update entries (bat_hash_table_set)
- *   - retrieve entries (bat_hash_table_get / try_get)
- *   - remove entries (bat_hash_table_remove)
+ *   - initialize a table with optional value cleanup callback
+ *   - insert or update entries (bat_hash_table_set / set_key)
+ *   - retrieve entries (bat_hash_table_get / try_get / get_key / try_get_key)
+ *   - remove entries (bat_hash_table_remove / remove_key)
  *   - clean up all entries (bat_hash_table_cleanup)
+ *   - report entry count, chain length and growth stats (bat_hash_table_get_stats)
+ *
+ * Two storage engines are available, selected at init time:
+ *   - BAT_HASH_TABLE_CHAINED: separate chaining, one pre-allocated entry per bucket.
+ *   - BAT_HASH_TABLE_OPEN: open addressing (linear probing) with keys and values
+ *     held in separate parallel arrays, so a lookup touches one or two cache lines.
+ *
+ * Overflow entries of the chained engine come from a per-table block pool (bat_pool.h)
+ * rather than the heap.
  *
- * Uses separate chaining for collision resolution and a bitmap to track
- * which buckets are in use. Not thread‐safe—external synchronization required.
+ * Bucket counts are powers of two so a bucket is selected by masking the hash. The hash
+ * function defaults to a multiplicative mixer and can be replaced at init time.
+ *
+ * Both engines use a bitmap to track which buckets are in use and grow automatically once
+ * a configurable load factor is crossed. Growth is incremental: a few buckets are migrated
+ * on each set/remove so no single call has to rehash the whole table.
+ * Not thread‐safe—external synchronization required.
  */
 #pragma once
 
 #include "esp_err.h"
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include "bat_pool.h"
 
 /**
  * @file bat_hash_table.h
- * @brief Simple hash‐table API for mapping uint16_t keys to void* values.
+ * @brief Simple hash‐table API for mapping fixed-width keys to void* values.
+ *
+ * Keys are uint16_t by default. A wider key size (e.g. 6 bytes for an esp_bd_addr_t or
+ * 16 bytes for a bat_ble_uuid128_t) can be chosen at init time and used through the
+ * *_key functions. Keys are stored zero padded to whole 32-bit words and compared a
+ * word at a time.
  *
  * Provides functions to:
- *   - initialize a fixed‐size table with optional value cleanup callback
- *   - insert or update entries (bat_hash_table_set)
- *   - retrieve entries (bat_hash_table_get / try_get)
- *   - remove entries (bat_hash_table_remove)
+ *   - initialize a table with optional value cleanup callback
+ *   - insert or update entries (bat_hash_table_set / set_key)
+ *   - retrieve entries (bat_hash_table_get / try_get / get_key / try_get_key)
+ *   - remove entries (bat_hash_table_remove / remove_key)
  *   - clean up all entries (bat_hash_table_cleanup)
+ *   - report entry count, chain length and growth stats (bat_hash_table_get_stats)
+ *
+ * Two storage engines are available, selected at init time:
+ *   - BAT_HASH_TABLE_CHAINED: separate chaining, one pre-allocated entry per bucket.
+ *   - BAT_HASH_TABLE_OPEN: open addressing (linear probing) with keys and values
+ *     held in separate parallel arrays, so a lookup touches one or two cache lines.
  *
- * Uses separate chaining for collision resolution and a bitmap to track
- * which buckets are in use. Not thread‐safe—external synchronization required.
+ * Overflow entries of the chained engine come from a per-table block pool (bat_pool.h)
+ * rather than the heap.
+ *
+ * Bucket counts are powers of two so a bucket is selected by masking the hash. The hash
+ * function defaults to a multiplicative mixer and can be replaced at init time.
+ *
+ * Both engines use a bitmap to track which buckets are in use and grow automatically once
+ * a configurable load factor is crossed. Growth is incremental: a few buckets are migrated
+ * on each set/remove so no single call has to rehash the whole table.
+ * Not thread‐safe—external synchronization required.
  */
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Largest key size, in bytes, accepted by `bat_hash_table_init_ex`.
+ */
+#define BAT_HASH_TABLE_MAX_KEY_SIZE 32
+
 /**
  * @brief Represents a single entry in the hash table.
  * 
  * Each entry contains a key, a value pointer, and a pointer to the next entry
- * for handling collisions via chaining.
+ * for handling collisions via chaining. Entries are `entry_size` bytes apart, the
+ * key follows the header.
  */
 typedef struct bat_hash_entry_t {
-    uint16_t key;                        ///< The key associated with the entry.
-    void *pValue;                        ///< Pointer to the value stored in the entry.
     struct bat_hash_entry_t *pNext;  ///< Pointer to the next entry in the chain (for collisions).
+    void *pValue;                        ///< Pointer to the value stored in the entry.
+    uint32_t key[];                      ///< The key, zero padded to `key_words` words.
 } bat_hash_entry_t;
 
 /**
@@ -58,25 +104,111 @@ typedef struct bat_hash_entry_t {
  */
 typedef void (*bat_hash_value_cleanup_cb_t)(void *pValue, void *pContext);
 
+/**
+ * @brief Hash function type.
+ * 
+ * Must spread its input over all 32 bits: the table keeps only the low bits.
+ * 
+ * @param pKey Pointer to the key bytes.
+ * @param len Length of the key in bytes.
+ * @return 32-bit hash of the key.
+ */
+typedef uint32_t (*bat_hash_fn_t)(const void *pKey, size_t len);
+
+/**
+ * @brief Selects the storage engine used by a hash table.
+ */
+typedef enum {
+    BAT_HASH_TABLE_CHAINED = 0,          ///< Separate chaining, overflow entries come from a block pool.
+    BAT_HASH_TABLE_OPEN,                 ///< Open addressing (linear probing), no per-entry allocation.
+} bat_hash_table_type_t;
+
+/**
+ * @brief Default load factor (percent) at which a table starts to grow.
+ */
+#define BAT_HASH_TABLE_DEFAULT_LOAD_PERCENT 75
+
+/**
+ * @brief Number of buckets migrated per set/remove while a table is growing.
+ */
+#define BAT_HASH_TABLE_REHASH_STEP 4
+
+/**
+ * @brief Configuration passed to `bat_hash_table_init_ex`.
+ */
+typedef struct {
+    bat_hash_table_type_t type;          ///< Storage engine.
+    size_t size;                         ///< Initial number of buckets, rounded up to a power of two.
+    size_t key_size;                     ///< Key width in bytes (0 = `sizeof(uint16_t)`).
+    uint16_t max_load_percent;           ///< Grow once count exceeds this percentage of the buckets (0 = default).
+    bool fixed_size;                     ///< Never grow (open addressing then holds at most `size` entries).
+    size_t pool_blocks_per_slab;         ///< Chained: overflow entries per pool slab (0 = `BAT_POOL_DEFAULT_BLOCKS_PER_SLAB`).
+    bat_hash_fn_t hash_fn;               ///< Optional hash function (NULL = `bat_hash_uint32`).
+    bat_hash_value_cleanup_cb_t value_cleanup_cb; ///< Optional callback for cleaning up values.
+    void *pContext;                      ///< User-defined context for the cleanup callback.
+} bat_hash_table_config_t;
+
+/**
+ * @brief One set of buckets.
+ * 
+ * A table normally owns one set, while growing it owns two: the new (larger) set receives
+ * all inserts and the old set is drained into it a few buckets at a time.
+ */
+typedef struct {
+    size_t size;                         ///< Number of buckets, always a power of two.
+    uint8_t *pUsedEntries;               ///< Bitmap to track used buckets.
+    uint8_t *pEntries;                   ///< Chained: pre-allocated entries (one per bucket, `entry_size` apart).
+    uint32_t *pKeys;                     ///< Open addressing: key array (`key_words` per bucket).
+    void **pValues;                      ///< Open addressing: value array, parallel to pKeys.
+} bat_hash_buckets_t;
+
 /**
  * @brief Represents the hash table structure.
  * 
- * The hash table uses a bitmap to track used buckets and supports collision handling
- * via chaining. The first entry in each bucket is pre-allocated, while additional
- * entries are dynamically allocated.
+ * The hash table uses a bitmap to track used buckets.
+ * 
+ * The chained engine handles collisions via chaining. The first entry in each bucket is
+ * pre-allocated, while additional entries are taken from `entry_pool`.
+ * 
+ * The open addressing engine stores keys and values in two parallel arrays (structure of
+ * arrays). Collisions probe linearly to the next bucket and removals use backward-shift
+ * deletion, so no tombstones are needed.
  */
 typedef struct {
-    size_t size;                         ///< Number of buckets in the hash table.
+    bat_hash_table_type_t type;          ///< Storage engine selected at init time.
+    size_t key_size;                     ///< Key width in bytes.
+    size_t key_words;                    ///< Key width in 32-bit words.
+    size_t entry_size;                   ///< Chained: size of one entry including its key.
+    bat_hash_buckets_t buckets;          ///< Current buckets, all inserts go here.
+    bat_hash_buckets_t old;              ///< Buckets being migrated while growing (size 0 otherwise).
+    size_t rehash_idx;                   ///< Next bucket of `old` to migrate.
+    size_t count;                        ///< Number of entries across both bucket sets.
+    uint16_t max_load_percent;           ///< Growth threshold, 0 when the table never grows.
+    uint32_t rehash_count;               ///< Number of times the table has started growing.
+    bat_pool_t entry_pool;               ///< Chained: pool for overflow entries.
+    bat_hash_fn_t hash_fn;               ///< Hash function, NULL for `bat_hash_uint32`.
     void *pContext;                      ///< User-defined context for cleanup callbacks.
-    uint8_t *pUsedEntries;               ///< Bitmap to track used buckets.
-    bat_hash_entry_t *pEntries;      ///< Array of pre-allocated entries (one per bucket).
     bat_hash_value_cleanup_cb_t value_cleanup_cb; ///< Callback for cleaning up values.
 } bat_hash_table_t;
 
+/**
+ * @brief Hash table statistics, see `bat_hash_table_get_stats`.
+ */
+typedef struct {
+    size_t count;                        ///< Number of entries.
+    size_t size;                         ///< Number of buckets (of the current set).
+    size_t max_chain_len;                ///< Longest chain (chained) or probe sequence (open addressing).
+    uint32_t rehash_count;               ///< Number of times the table has grown.
+    bool rehashing;                      ///< A migration is in progress.
+    size_t overflow_in_use;              ///< Chained: overflow entries currently taken from the pool.
+    size_t overflow_high_water;          ///< Chained: most overflow entries in use at once.
+} bat_hash_table_stats_t;
+
 /**
  * @brief Computes a hash value for a given key.
  * 
  * Uses Robert Sedgwick's simple hash function for `uint16_t` keys.
+ * Kept for existing callers, the table itself uses `bat_hash_uint32` or the configured hasher.
  * 
  * @param key The key to hash.
  * @param size The size of the hash table (number of buckets).
@@ -84,13 +216,37 @@ typedef struct {
  */
 uint16_t bat_rs_hash_uint16(uint16_t key, size_t size);
 
+/**
+ * @brief Mixes a 32-bit integer key.
+ * 
+ * One multiply by the golden ratio constant followed by an xor-shift, which folds the
+ * well mixed high bits into the low bits used for masking.
+ * 
+ * @param key The key to hash.
+ * @return 32-bit hash of the key.
+ */
+uint32_t bat_hash_uint32(uint32_t key);
+
+/**
+ * @brief Hashes a byte string, a word at a time (MurmurHash3, x86 32-bit variant).
+ * 
+ * Matches `bat_hash_fn_t` so it can be passed as `hash_fn` for wide keys such as BDAs or
+ * 128-bit UUIDs.
+ * 
+ * @param pKey Pointer to the key bytes.
+ * @param len Length of the key in bytes.
+ * @return 32-bit hash of the key.
+ */
+uint32_t bat_hash_bytes(const void *pKey, size_t len);
+
 /**
  * @brief Initializes the hash table.
  * 
  * Allocates memory for the hash table's entries and bitmap, and sets up the cleanup callback.
  * 
  * @param pTable Pointer to the hash table structure to initialize.
- * @param size Number of buckets in the hash table.
+ * @param size Initial number of buckets (rounded up to a power of two), the table grows at
+ *             `BAT_HASH_TABLE_DEFAULT_LOAD_PERCENT`.
  * @param value_cleanup_cb Callback for cleaning up values.
  * @param pContext User-defined context for the cleanup callback.
  * @return `ESP_OK` on success, or an error code on failure.
@@ -98,6 +254,40 @@ uint16_t bat_rs_hash_uint16(uint16_t key, size_t size);
 esp_err_t bat_hash_table_init(bat_hash_table_t *pTable, size_t size, 
     bat_hash_value_cleanup_cb_t value_cleanup_cb, void *pContext);
 
+/**
+ * @brief Initializes the hash table with an explicit storage engine.
+ * 
+ * `bat_hash_table_init` is equivalent to calling this with `BAT_HASH_TABLE_CHAINED` and
+ * `uint16_t` keys.
+ * A `fixed_size` open addressing table holds at most `size` (rounded up to a power of two)
+ * entries, `bat_hash_table_set` returns `ESP_ERR_NO_MEM` once every bucket is in use.
+ * 
+ * @param pTable Pointer to the hash table structure to initialize.
+ * @param pConfig Engine, bucket count, key size and cleanup callback.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_SIZE` if the key size exceeds
+ *         `BAT_HASH_TABLE_MAX_KEY_SIZE`, or another error code on failure.
+ */
+esp_err_t bat_hash_table_init_ex(bat_hash_table_t *pTable, const bat_hash_table_config_t *pConfig);
+
+/**
+ * @brief Returns the number of entries in the hash table.
+ * 
+ * @param pTable Pointer to the hash table structure.
+ * @return Entry count, or 0 if `pTable` is NULL.
+ */
+size_t bat_hash_table_count(const bat_hash_table_t *pTable);
+
+/**
+ * @brief Collects statistics about the hash table.
+ * 
+ * Walks every bucket to find the longest chain, so keep it off hot paths.
+ * 
+ * @param pTable Pointer to the hash table structure.
+ * @param pStats Receives the statistics.
+ * @return `ESP_OK` on success, or `ESP_ERR_INVALID_ARG`.
+ */
+esp_err_t bat_hash_table_get_stats(const bat_hash_table_t *pTable, bat_hash_table_stats_t *pStats);
+
 /**
  * @brief Cleans up the hash table.
  * 
@@ -119,10 +309,21 @@ void bat_hash_table_cleanup(bat_hash_table_t *pTable);
  */
 esp_err_t bat_hash_table_remove(bat_hash_table_t *pTable, uint16_t key);
 
+/**
+ * @brief Removes an entry from the hash table, for any key size.
+ * 
+ * @param pTable Pointer to the hash table structure.
+ * @param pKey Pointer to `key_size` bytes of key.
+ * @return `ESP_OK` on success, or `ESP_ERR_INVALID_ARG`.
+ */
+esp_err_t bat_hash_table_remove_key(bat_hash_table_t *pTable, const void *pKey);
+
 /**
  * @brief Adds or updates an entry in the hash table.
  * 
  * If the key already exists, its value is updated. Otherwise, a new entry is added.
+ * The `uint16_t` functions require a table initialized with `uint16_t` keys, they return
+ * `ESP_ERR_INVALID_ARG` for other key sizes.
  * 
  * @param pTable Pointer to the hash table structure.
  * @param key The key of the entry to add or update.
@@ -131,6 +332,16 @@ esp_err_t bat_hash_table_remove(bat_hash_table_t *pTable, uint16_t key);
  */
 esp_err_t bat_hash_table_set(bat_hash_table_t *pTable, uint16_t key, void *pValue);
 
+/**
+ * @brief Adds or updates an entry in the hash table, for any key size.
+ * 
+ * @param pTable Pointer to the hash table structure.
+ * @param pKey Pointer to `key_size` bytes of key, copied into the table.
+ * @param pValue Pointer to the value to store.
+ * @return `ESP_OK` on success, or an error code on failure (e.g., memory allocation failure).
+ */
+esp_err_t bat_hash_table_set_key(bat_hash_table_t *pTable, const void *pKey, void *pValue);
+
 /**
  * @brief Retrieves an entry from the hash table.
  * 
@@ -143,6 +354,16 @@ esp_err_t bat_hash_table_set(bat_hash_table_t *pTable, uint16_t key, void *pValu
  */
 esp_err_t bat_hash_table_get(bat_hash_table_t *pTable, uint16_t key, void **ppValue);
 
+/**
+ * @brief Retrieves an entry from the hash table, for any key size.
+ * 
+ * @param pTable Pointer to the hash table structure.
+ * @param pKey Pointer to `key_size` bytes of key.
+ * @param ppValue Pointer to store the retrieved value.
+ * @return `ESP_OK` on success, or `ESP_ERR_NOT_FOUND` if the key is not found.
+ */
+esp_err_t bat_hash_table_get_key(bat_hash_table_t *pTable, const void *pKey, void **ppValue);
+
 /**
  * @brief Attempts to retrieve an entry from the hash table.
  * 
@@ -154,6 +375,15 @@ esp_err_t bat_hash_table_get(bat_hash_table_t *pTable, uint16_t key, void **ppVa
  */
 void *bat_hash_table_try_get(bat_hash_table_t *pTable, uint16_t key);
 
+/**
+ * @brief Attempts to retrieve an entry from the hash table, for any key size.
+ * 
+ * @param pTable Pointer to the hash table structure.
+ * @param pKey Pointer to `key_size` bytes of key.
+ * @return Pointer to the value if found, or `NULL` if not found.
+ */
+void *bat_hash_table_try_get_key(bat_hash_table_t *pTable, const void *pKey);
+
 #ifdef __cplusplus
 }
 #endif
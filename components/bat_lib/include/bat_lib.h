@@ -13,6 +13,7 @@
 #include "bat_ble.h"
 #include "bat_blink.h"
 #include "bat_ble_client.h"
+#include "bat_scan_filter.h"
 #include "bat_ble_server.h"
 #include "bat_wifi_logging.h"
 #include "bat_wifi_connect.h"
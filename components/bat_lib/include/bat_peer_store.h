@@ -0,0 +1,185 @@
+/**
+ * @file bat_peer_store.h
+ * @brief Bounded per-peer context store keyed on the Bluetooth Device Address (BDA).
+ *
+ * Entries live in a preallocated array sized at init time and are found through a
+ * bat_hash_table keyed on the 6-byte BDA, so lookups are O(1) however many peers are
+ * tracked. Entries are also kept on an index-linked LRU list:
+ *   - a lookup or set moves the entry to the front and refreshes its timestamp,
+ *   - a set on a full store evicts the least recently used entry,
+ *   - bat_peer_store_evict_stale drops entries older than `max_age_us` by walking
+ *     the list from its tail, so it only visits the entries it evicts (plus one).
+ *
+ * Not thread‐safe—external synchronization required.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_bt_defs.h"
+#include "bat_hash_table.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Index used to terminate the LRU and free lists.
+ */
+#define BAT_PEER_STORE_NONE UINT16_MAX
+
+/**
+ * @brief Callback invoked when an entry is evicted (LRU or stale), not on explicit removal.
+ *
+ * @param bda Address of the evicted peer.
+ * @param pValue Context stored for the peer.
+ * @param pContext User-defined context passed in the store configuration.
+ */
+typedef void (*bat_peer_store_evict_cb_t)(const esp_bd_addr_t bda, void *pValue, void *pContext);
+
+/**
+ * @brief A single peer entry.
+ */
+typedef struct {
+    esp_bd_addr_t bda;                   ///< Peer address.
+    void *pValue;                        ///< Context stored for the peer.
+    int64_t last_seen_us;                ///< esp_timer time of the last set or lookup.
+    uint16_t prev;                       ///< Previous (more recently used) entry, or the next free entry.
+    uint16_t next;                       ///< Next (less recently used) entry.
+} bat_peer_entry_t;
+
+/**
+ * @brief Configuration passed to `bat_peer_store_init`.
+ */
+typedef struct {
+    size_t capacity;                     ///< Maximum number of peers, at most `BAT_PEER_STORE_NONE - 1`.
+    int64_t max_age_us;                  ///< Age after which `bat_peer_store_evict_stale` drops a peer (0 = never).
+    bat_peer_store_evict_cb_t evict_cb;  ///< Optional eviction callback.
+    void *pContext;                      ///< User-defined context for the eviction callback.
+} bat_peer_store_config_t;
+
+/**
+ * @brief Represents a peer store.
+ */
+typedef struct {
+    bat_peer_entry_t *pEntries;          ///< Preallocated entries.
+    bat_hash_table_t index;              ///< BDA to entry pointer.
+    size_t capacity;                     ///< Number of entries in `pEntries`.
+    size_t count;                        ///< Number of entries in use.
+    uint16_t head;                       ///< Most recently used entry.
+    uint16_t tail;                       ///< Least recently used entry.
+    uint16_t free_head;                  ///< First unused entry.
+    int64_t max_age_us;                  ///< See `bat_peer_store_config_t`.
+    bat_peer_store_evict_cb_t evict_cb;  ///< See `bat_peer_store_config_t`.
+    void *pContext;                      ///< See `bat_peer_store_config_t`.
+    uint32_t evictions;                  ///< Entries evicted because the store was full.
+    uint32_t stale_evictions;            ///< Entries evicted by `bat_peer_store_evict_stale`.
+    size_t high_water;                   ///< Most entries in use at once.
+} bat_peer_store_t;
+
+/**
+ * @brief Peer store statistics, see `bat_peer_store_get_stats`.
+ */
+typedef struct {
+    size_t count;                        ///< Number of peers.
+    size_t capacity;                     ///< Maximum number of peers.
+    size_t high_water;                   ///< Most peers held at once.
+    uint32_t evictions;                  ///< Peers evicted because the store was full.
+    uint32_t stale_evictions;            ///< Peers evicted for age.
+} bat_peer_store_stats_t;
+
+/**
+ * @brief Initializes a peer store, allocating all of its entries.
+ *
+ * @param pStore Pointer to the store structure to initialize.
+ * @param pConfig Capacity, maximum age and eviction callback.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_ARG` or `ESP_ERR_NO_MEM` on failure.
+ */
+esp_err_t bat_peer_store_init(bat_peer_store_t *pStore, const bat_peer_store_config_t *pConfig);
+
+/**
+ * @brief Releases the store, the eviction callback is not invoked.
+ *
+ * @param pStore Pointer to the store structure.
+ */
+void bat_peer_store_deinit(bat_peer_store_t *pStore);
+
+/**
+ * @brief Adds or updates a peer and marks it most recently used.
+ *
+ * A full store evicts its least recently used peer to make room.
+ *
+ * @param pStore Pointer to the store structure.
+ * @param bda Peer address.
+ * @param pValue Context to store for the peer.
+ * @return `ESP_OK` on success, or an error code on failure.
+ */
+esp_err_t bat_peer_store_set(bat_peer_store_t *pStore, const esp_bd_addr_t bda, void *pValue);
+
+/**
+ * @brief Finds a peer and marks it most recently used.
+ *
+ * @param pStore Pointer to the store structure.
+ * @param bda Peer address.
+ * @return The peer's context, or `NULL` if the peer is unknown.
+ */
+void *bat_peer_store_lookup(bat_peer_store_t *pStore, const esp_bd_addr_t bda);
+
+/**
+ * @brief Finds a peer entry without changing its position or timestamp.
+ *
+ * @param pStore Pointer to the store structure.
+ * @param bda Peer address.
+ * @return The entry, or `NULL` if the peer is unknown. Valid until the next set/remove.
+ */
+const bat_peer_entry_t *bat_peer_store_peek(bat_peer_store_t *pStore, const esp_bd_addr_t bda);
+
+/**
+ * @brief Removes a peer, the eviction callback is not invoked.
+ *
+ * @param pStore Pointer to the store structure.
+ * @param bda Peer address.
+ * @return `ESP_OK` on success, `ESP_ERR_NOT_FOUND` if the peer is unknown.
+ */
+esp_err_t bat_peer_store_remove(bat_peer_store_t *pStore, const esp_bd_addr_t bda);
+
+/**
+ * @brief Evicts every peer not seen for `max_age_us`.
+ *
+ * @param pStore Pointer to the store structure.
+ * @return Number of peers evicted.
+ */
+size_t bat_peer_store_evict_stale(bat_peer_store_t *pStore);
+
+/**
+ * @brief Evicts up to `max_evictions` peers not seen for `max_age_us`, oldest first.
+ *
+ * Lets a caller that locks around the store release the lock between batches.
+ *
+ * @param pStore Pointer to the store structure.
+ * @param max_evictions Most peers to evict in this call.
+ * @return Number of peers evicted, `max_evictions` if more may be stale.
+ */
+size_t bat_peer_store_evict_stale_max(bat_peer_store_t *pStore, size_t max_evictions);
+
+/**
+ * @brief Returns the number of peers in the store.
+ *
+ * @param pStore Pointer to the store structure.
+ * @return Peer count, or 0 if `pStore` is NULL.
+ */
+size_t bat_peer_store_count(const bat_peer_store_t *pStore);
+
+/**
+ * @brief Retrieves the store statistics.
+ *
+ * @param pStore Pointer to the store structure.
+ * @param pStats Receives the statistics.
+ * @return `ESP_OK` on success, or `ESP_ERR_INVALID_ARG`.
+ */
+esp_err_t bat_peer_store_get_stats(const bat_peer_store_t *pStore, bat_peer_store_stats_t *pStats);
+
+#ifdef __cplusplus
+}
+#endif
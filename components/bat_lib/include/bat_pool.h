@@ -0,0 +1,116 @@
+/**
+ * @file bat_pool.h
+ * @brief Fixed-size block pool allocator.
+ *
+ * Hands out equally sized blocks from a free-list threaded through preallocated slabs.
+ * The first slab is allocated by bat_pool_init, further slabs are added on demand (up to
+ * an optional limit) and are only returned to the heap by bat_pool_deinit. This keeps
+ * long running allocation/free patterns from fragmenting the heap.
+ *
+ * High-water marks are tracked so a pool can be sized from real traffic.
+ * Not thread‐safe—external synchronization required.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Default number of blocks carved from each slab.
+ */
+#define BAT_POOL_DEFAULT_BLOCKS_PER_SLAB 8
+
+/**
+ * @brief Header placed at the start of each slab, the blocks follow it.
+ */
+typedef struct bat_pool_slab_t {
+    struct bat_pool_slab_t *pNext;       ///< Next slab owned by the pool.
+} bat_pool_slab_t;
+
+/**
+ * @brief Represents a block pool.
+ */
+typedef struct {
+    size_t block_size;                   ///< Size of each block, rounded up for pointer alignment.
+    size_t blocks_per_slab;              ///< Number of blocks in each slab.
+    size_t max_slabs;                    ///< Maximum number of slabs, 0 for no limit.
+    size_t slab_count;                   ///< Number of slabs allocated.
+    size_t in_use;                       ///< Number of blocks currently handed out.
+    size_t high_water;                   ///< Highest value `in_use` has reached.
+    uint32_t alloc_failures;             ///< Allocations refused because no slab could be added.
+    void *pFreeList;                     ///< Singly linked list of free blocks.
+    bat_pool_slab_t *pSlabs;             ///< List of slabs owned by the pool.
+} bat_pool_t;
+
+/**
+ * @brief Pool statistics, see `bat_pool_get_stats`.
+ */
+typedef struct {
+    size_t block_size;                   ///< Size of each block.
+    size_t capacity;                     ///< Blocks held by all slabs, handed out or free.
+    size_t slab_count;                   ///< Number of slabs allocated.
+    size_t in_use;                       ///< Number of blocks currently handed out.
+    size_t high_water;                   ///< Highest number of blocks handed out at once.
+    uint32_t alloc_failures;             ///< Allocations refused because no slab could be added.
+} bat_pool_stats_t;
+
+/**
+ * @brief Initializes a pool and allocates its first slab.
+ *
+ * @param pPool Pointer to the pool structure to initialize.
+ * @param block_size Size of each block in bytes.
+ * @param blocks_per_slab Blocks per slab, 0 for `BAT_POOL_DEFAULT_BLOCKS_PER_SLAB`.
+ * @param max_slabs Maximum number of slabs, 0 for no limit.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_ARG` or `ESP_ERR_NO_MEM` on failure.
+ */
+esp_err_t bat_pool_init(bat_pool_t *pPool, size_t block_size, size_t blocks_per_slab, size_t max_slabs);
+
+/**
+ * @brief Releases every slab owned by the pool.
+ *
+ * Any blocks still handed out become invalid.
+ *
+ * @param pPool Pointer to the pool structure.
+ */
+void bat_pool_deinit(bat_pool_t *pPool);
+
+/**
+ * @brief Allocates a zeroed block, adding a slab if the free-list is empty.
+ *
+ * @param pPool Pointer to the pool structure.
+ * @return Pointer to the block, or `NULL` if the pool is exhausted.
+ */
+void *bat_pool_alloc(bat_pool_t *pPool);
+
+/**
+ * @brief Returns a block to the pool.
+ *
+ * @param pPool Pointer to the pool structure.
+ * @param pBlock Block obtained from `bat_pool_alloc` on the same pool, `NULL` is ignored.
+ */
+void bat_pool_free(bat_pool_t *pPool, void *pBlock);
+
+/**
+ * @brief Retrieves the pool statistics, including the high-water mark.
+ *
+ * @param pPool Pointer to the pool structure.
+ * @param pStats Receives the statistics.
+ * @return `ESP_OK` on success, or `ESP_ERR_INVALID_ARG`.
+ */
+esp_err_t bat_pool_get_stats(const bat_pool_t *pPool, bat_pool_stats_t *pStats);
+
+/**
+ * @brief Resets the high-water mark to the number of blocks currently in use.
+ *
+ * @param pPool Pointer to the pool structure.
+ */
+void bat_pool_reset_high_water(bat_pool_t *pPool);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,124 @@
+/**
+ * @file bat_scan_dedup.h
+ * @brief Time-windowed duplicate suppression for scan results.
+ *
+ * With `BLE_SCAN_DUPLICATE_DISABLE` the controller reports every advertisement it hears,
+ * most of them identical to the previous one from the same device. The cache drops those
+ * before they reach the application:
+ *   - entries are keyed on the BDA plus a hash of the payload, so a device alternating
+ *     between two payloads (advertising data and scan response) keeps one entry for each,
+ *   - an advertisement is forwarded when its key is new, when the entry is older than
+ *     `window_us`, or when the RSSI moved by at least `rssi_threshold` dBm,
+ *   - otherwise it is dropped.
+ *
+ * The cache is a fixed, direct-mapped array: a key collision replaces the older entry,
+ * which can only cause an extra forward, never a wrong drop. Checking neither allocates
+ * nor logs.
+ *
+ * Not thread‐safe—external synchronization required.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_bt_defs.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BAT_SCAN_DEDUP_DEFAULT_SLOTS 32                   ///< Default number of entries.
+#define BAT_SCAN_DEDUP_DEFAULT_WINDOW_US (1000 * 1000)    ///< Default suppression window (1 s).
+#define BAT_SCAN_DEDUP_DEFAULT_RSSI_THRESHOLD 10          ///< Default RSSI change that still passes (dBm).
+
+/**
+ * @brief Configuration passed to `bat_scan_dedup_init`.
+ */
+typedef struct {
+    size_t slots;                        ///< Number of entries, rounded up to a power of two (0 = default).
+    int64_t window_us;                   ///< Suppression window (0 = default).
+    uint8_t rssi_threshold;              ///< RSSI change that passes anyway, 0 to ignore RSSI.
+} bat_scan_dedup_config_t;
+
+/**
+ * @brief One cache entry.
+ */
+typedef struct {
+    esp_bd_addr_t bda;                   ///< Advertiser address.
+    bool used;                           ///< Whether the entry holds a key.
+    int8_t rssi;                         ///< RSSI of the last forwarded advertisement.
+    uint32_t payload_hash;               ///< Hash of the last forwarded payload.
+    int64_t forwarded_us;                ///< esp_timer time of the last forward.
+} bat_scan_dedup_entry_t;
+
+/**
+ * @brief Represents a duplicate suppression cache.
+ */
+typedef struct {
+    bat_scan_dedup_entry_t *pEntries;    ///< Direct-mapped entries.
+    size_t mask;                         ///< Number of entries minus one.
+    int64_t window_us;                   ///< See `bat_scan_dedup_config_t`.
+    uint8_t rssi_threshold;              ///< See `bat_scan_dedup_config_t`.
+    uint32_t forwarded;                  ///< Advertisements passed on.
+    uint32_t dropped;                    ///< Advertisements suppressed.
+} bat_scan_dedup_t;
+
+/**
+ * @brief Duplicate suppression statistics, see `bat_scan_dedup_get_stats`.
+ */
+typedef struct {
+    uint32_t forwarded;                  ///< Advertisements passed on.
+    uint32_t dropped;                    ///< Advertisements suppressed.
+} bat_scan_dedup_stats_t;
+
+/**
+ * @brief Initializes a cache, allocating all of its entries.
+ *
+ * @param pDedup Pointer to the cache structure to initialize.
+ * @param pConfig Configuration, or NULL for the defaults.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_ARG` or `ESP_ERR_NO_MEM` on failure.
+ */
+esp_err_t bat_scan_dedup_init(bat_scan_dedup_t *pDedup, const bat_scan_dedup_config_t *pConfig);
+
+/**
+ * @brief Releases the cache.
+ *
+ * @param pDedup Pointer to the cache structure.
+ */
+void bat_scan_dedup_deinit(bat_scan_dedup_t *pDedup);
+
+/**
+ * @brief Forgets every entry, so the next advertisement of each device is forwarded.
+ *
+ * The counters are kept.
+ *
+ * @param pDedup Pointer to the cache structure.
+ */
+void bat_scan_dedup_clear(bat_scan_dedup_t *pDedup);
+
+/**
+ * @brief Decides whether an advertisement should be forwarded, and records it if so.
+ *
+ * @param pDedup Pointer to the cache structure.
+ * @param bda Advertiser address.
+ * @param pData Advertising payload (advertising data followed by the scan response).
+ * @param len Payload length.
+ * @param rssi Received signal strength in dBm.
+ * @return `true` to forward, `false` for a duplicate. An uninitialized cache forwards everything.
+ */
+bool bat_scan_dedup_check(bat_scan_dedup_t *pDedup, const esp_bd_addr_t bda, const uint8_t *pData, size_t len, int rssi);
+
+/**
+ * @brief Retrieves the forwarded and dropped counters.
+ *
+ * @param pDedup Pointer to the cache structure.
+ * @param pStats Receives the statistics.
+ * @return `ESP_OK` on success, or `ESP_ERR_INVALID_ARG`.
+ */
+esp_err_t bat_scan_dedup_get_stats(const bat_scan_dedup_t *pDedup, bat_scan_dedup_stats_t *pStats);
+
+#ifdef __cplusplus
+}
+#endif
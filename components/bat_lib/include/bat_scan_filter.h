@@ -0,0 +1,154 @@
+/**
+ * @file bat_scan_filter.h
+ * @brief Precompiled advertisement filter for scan results.
+ *
+ * An application describes the devices it is interested in as a set of rules, each one
+ * combining (AND) any of: advertised name (prefix or exact), service UUID sets (16, 32
+ * and 128-bit), manufacturer ID and minimum RSSI. A device matches the filter if any rule
+ * matches it (OR).
+ *
+ * bat_scan_filter_compile turns the rules into flat, de-duplicated tables where every
+ * entry carries a bitmask of the rules it belongs to. bat_scan_filter_match then:
+ *   - rejects on RSSI before touching the payload,
+ *   - walks the AD structures once, OR-ing rule bitmasks as names, UUIDs and the
+ *     manufacturer ID are seen,
+ *   - combines the bitmasks to find the matching rules.
+ * Matching neither allocates nor logs.
+ *
+ * A compiled filter is read-only and can be shared between tasks.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "bat_ble.h"
+#include "bat_ble_client.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum number of rules in a filter (one bit each in a uint32_t).
+ */
+#define BAT_SCAN_FILTER_MAX_RULES 32
+
+/**
+ * @brief RSSI value that disables the RSSI check of a rule, same as leaving `min_rssi` at 0.
+ */
+#define BAT_SCAN_FILTER_ANY_RSSI INT8_MIN
+
+/**
+ * @brief Describes one rule, all of the criteria that are set must match.
+ *
+ * Leave a criterion zeroed (NULL / 0 count / false) to ignore it. The arrays and
+ * strings are copied by `bat_scan_filter_compile`.
+ */
+typedef struct {
+    const char *pszName;                 ///< Advertised name (complete or short), NULL for any.
+    bool name_exact;                     ///< Require the whole name to match, otherwise `pszName` is a prefix.
+    const uint16_t *pUuid16;             ///< 16-bit service UUIDs, any one of the UUIDs (of any width) must be advertised.
+    size_t uuid16_count;                 ///< Number of entries in `pUuid16`.
+    const uint32_t *pUuid32;             ///< 32-bit service UUIDs.
+    size_t uuid32_count;                 ///< Number of entries in `pUuid32`.
+    const bat_ble_uuid128_t *pUuid128;   ///< 128-bit service UUIDs, little endian as advertised.
+    size_t uuid128_count;                ///< Number of entries in `pUuid128`.
+    bool match_manufacturer;             ///< Require manufacturer specific data with `manufacturer_id`.
+    uint16_t manufacturer_id;            ///< Company identifier.
+    int8_t min_rssi;                     ///< Minimum RSSI in dBm (negative), 0 or `BAT_SCAN_FILTER_ANY_RSSI` for any.
+} bat_scan_filter_rule_t;
+
+/**
+ * @brief A 16-bit UUID and the rules that list it.
+ */
+typedef struct {
+    uint16_t uuid;
+    uint32_t rules;
+} bat_scan_filter_uuid16_t;
+
+/**
+ * @brief A 32-bit UUID and the rules that list it.
+ */
+typedef struct {
+    uint32_t uuid;
+    uint32_t rules;
+} bat_scan_filter_uuid32_t;
+
+/**
+ * @brief A 128-bit UUID and the rules that list it.
+ */
+typedef struct {
+    bat_ble_uuid128_t uuid;
+    uint32_t rules;
+} bat_scan_filter_uuid128_t;
+
+/**
+ * @brief A compiled filter.
+ */
+typedef struct {
+    uint8_t rule_count;                  ///< Number of rules.
+    int8_t lowest_rssi;                  ///< Lowest `min_rssi` of all rules, for early rejection.
+    int8_t min_rssi[BAT_SCAN_FILTER_MAX_RULES]; ///< Per-rule minimum RSSI.
+    uint32_t need_name;                  ///< Rules with a name criterion.
+    uint32_t name_exact;                 ///< Rules whose name must match exactly.
+    uint32_t need_uuid;                  ///< Rules with a UUID criterion.
+    uint32_t need_manufacturer;          ///< Rules with a manufacturer criterion.
+    const char *pNames[BAT_SCAN_FILTER_MAX_RULES]; ///< Per-rule name, points into the pool.
+    uint8_t name_len[BAT_SCAN_FILTER_MAX_RULES];   ///< Per-rule name length.
+    uint16_t manufacturer_id[BAT_SCAN_FILTER_MAX_RULES]; ///< Per-rule manufacturer ID.
+    bat_scan_filter_uuid16_t *pUuid16;   ///< De-duplicated 16-bit UUIDs.
+    size_t uuid16_count;                 ///< Number of entries in `pUuid16`.
+    bat_scan_filter_uuid32_t *pUuid32;   ///< De-duplicated 32-bit UUIDs.
+    size_t uuid32_count;                 ///< Number of entries in `pUuid32`.
+    bat_scan_filter_uuid128_t *pUuid128; ///< De-duplicated 128-bit UUIDs.
+    size_t uuid128_count;                ///< Number of entries in `pUuid128`.
+    void *pPool;                         ///< Single allocation backing the tables and names.
+} bat_scan_filter_t;
+
+/**
+ * @brief Compiles rules into a filter.
+ *
+ * @param pFilter Receives the compiled filter.
+ * @param pRules Rules to compile.
+ * @param count Number of rules, 1 to `BAT_SCAN_FILTER_MAX_RULES`.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_ARG`, `ESP_ERR_INVALID_SIZE` (name longer
+ *         than 255 bytes) or `ESP_ERR_NO_MEM` on failure.
+ */
+esp_err_t bat_scan_filter_compile(bat_scan_filter_t *pFilter, const bat_scan_filter_rule_t *pRules, size_t count);
+
+/**
+ * @brief Releases a compiled filter.
+ *
+ * @param pFilter The filter.
+ */
+void bat_scan_filter_free(bat_scan_filter_t *pFilter);
+
+/**
+ * @brief Matches an advertising payload against the filter.
+ *
+ * @param pFilter The compiled filter.
+ * @param pData Advertising data followed by the scan response, if any.
+ * @param len Length of `pData`.
+ * @param rssi Received signal strength in dBm.
+ * @return Bitmask of the matching rules (bit n for rule n), 0 if none match.
+ */
+uint32_t bat_scan_filter_match(const bat_scan_filter_t *pFilter, const uint8_t *pData, size_t len, int rssi);
+
+/**
+ * @brief Matches a scan result against the filter.
+ *
+ * @param pFilter The compiled filter.
+ * @param pScanResult The scan result.
+ * @return Bitmask of the matching rules, 0 if none match.
+ */
+static inline uint32_t bat_scan_filter_match_result(const bat_scan_filter_t *pFilter, const bat_scan_result_t *pScanResult)
+{
+    return bat_scan_filter_match(pFilter, pScanResult->ble_adv,
+                                 pScanResult->adv_data_len + pScanResult->scan_rsp_len, pScanResult->rssi);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,153 @@
+/**
+ * @file bat_scan_worker.h
+ * @brief Hands scan results from the Bluedroid callback task to a dedicated worker task.
+ *
+ * `bat_scan_worker_post` copies the event into a fixed-size ring and wakes the worker, so
+ * the Bluetooth stack is never held up by application code. The worker drains the ring in
+ * batches of up to `batch_size` events: one critical section copies a batch out, then the
+ * callback runs for each event with the ring unlocked.
+ *
+ * When the ring is full the overflow policy decides which event is lost:
+ *   - `BAT_SCAN_WORKER_DROP_OLDEST` overwrites the oldest queued event (freshest data wins),
+ *   - `BAT_SCAN_WORKER_DROP_NEWEST` rejects the incoming event (queued order is preserved).
+ *
+ * Queueing latency (post to processing) and drops are recorded, see `bat_scan_worker_get_stats`.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_gap_ble_api.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BAT_SCAN_WORKER_DEFAULT_CAPACITY 16      ///< Default ring size, in events.
+#define BAT_SCAN_WORKER_DEFAULT_BATCH_SIZE 4     ///< Default number of events handled per batch.
+#define BAT_SCAN_WORKER_DEFAULT_STACK_SIZE 4096  ///< Default worker stack size, in bytes.
+#define BAT_SCAN_WORKER_DEFAULT_PRIORITY 5       ///< Default worker priority.
+
+/**
+ * @brief What to do when an event is posted to a full ring.
+ */
+typedef enum {
+    BAT_SCAN_WORKER_DROP_OLDEST = 0,     ///< Overwrite the oldest queued event.
+    BAT_SCAN_WORKER_DROP_NEWEST,         ///< Reject the incoming event.
+} bat_scan_worker_overflow_t;
+
+/**
+ * @brief Callback run on the worker task for each event.
+ *
+ * @param pParam Copy of the event parameters, valid for the duration of the call.
+ * @param pContext User-defined context passed in the worker configuration.
+ */
+typedef void (*bat_scan_worker_cb_t)(esp_ble_gap_cb_param_t *pParam, void *pContext);
+
+/**
+ * @brief Configuration passed to `bat_scan_worker_init`, zeroed fields take the defaults.
+ */
+typedef struct {
+    size_t capacity;                     ///< Ring size, in events.
+    size_t batch_size;                   ///< Events copied out of the ring at once.
+    bat_scan_worker_overflow_t overflow; ///< Overflow policy.
+    uint32_t stack_size;                 ///< Worker stack size, in bytes.
+    UBaseType_t priority;                ///< Worker priority.
+    bat_scan_worker_cb_t process_cb;     ///< Called for each event, required.
+    void *pContext;                      ///< User-defined context for `process_cb`.
+} bat_scan_worker_config_t;
+
+/**
+ * @brief A queued event.
+ */
+typedef struct {
+    esp_ble_gap_cb_param_t param;        ///< Copy of the event parameters.
+    int64_t posted_us;                   ///< esp_timer time of the post.
+} bat_scan_worker_item_t;
+
+/**
+ * @brief Represents a scan worker.
+ */
+typedef struct {
+    bat_scan_worker_item_t *pRing;       ///< Queued events.
+    bat_scan_worker_item_t *pBatch;      ///< Events being processed, owned by the worker task.
+    size_t capacity;                     ///< Number of entries in `pRing`.
+    size_t batch_size;                   ///< Number of entries in `pBatch`.
+    size_t head;                         ///< Oldest queued event.
+    size_t count;                        ///< Number of queued events.
+    bat_scan_worker_overflow_t overflow; ///< See `bat_scan_worker_config_t`.
+    bat_scan_worker_cb_t process_cb;     ///< See `bat_scan_worker_config_t`.
+    void *pContext;                      ///< See `bat_scan_worker_config_t`.
+    portMUX_TYPE lock;                   ///< Guards the ring and the producer counters.
+    TaskHandle_t task;                   ///< Worker task.
+    SemaphoreHandle_t stopped;           ///< Given by the worker task as it exits.
+    volatile bool stopping;              ///< Asks the worker task to exit.
+    uint32_t posted;                     ///< Events posted.
+    uint32_t dropped;                    ///< Events lost to overflow.
+    uint32_t processed;                  ///< Events handed to `process_cb`.
+    uint32_t batches;                    ///< Batches processed.
+    size_t high_water;                   ///< Most events queued at once.
+    int64_t latency_total_us;            ///< Sum of the queueing latencies.
+    int64_t latency_max_us;              ///< Longest queueing latency.
+} bat_scan_worker_t;
+
+/**
+ * @brief Scan worker statistics, see `bat_scan_worker_get_stats`.
+ */
+typedef struct {
+    uint32_t posted;                     ///< Events posted.
+    uint32_t dropped;                    ///< Events lost to overflow.
+    uint32_t processed;                  ///< Events processed.
+    uint32_t batches;                    ///< Batches processed.
+    size_t queued;                       ///< Events currently queued.
+    size_t high_water;                   ///< Most events queued at once.
+    int64_t latency_avg_us;              ///< Average time from post to processing.
+    int64_t latency_max_us;              ///< Longest time from post to processing.
+} bat_scan_worker_stats_t;
+
+/**
+ * @brief Allocates the ring and starts the worker task.
+ *
+ * @param pWorker Pointer to the worker structure to initialize.
+ * @param pConfig Configuration, `process_cb` is required.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_ARG`, `ESP_ERR_NO_MEM` or `ESP_FAIL` on failure.
+ */
+esp_err_t bat_scan_worker_init(bat_scan_worker_t *pWorker, const bat_scan_worker_config_t *pConfig);
+
+/**
+ * @brief Stops the worker task, waiting for the current batch to finish, and frees the ring.
+ *
+ * Queued events are discarded. Must not be called from the worker task itself.
+ *
+ * @param pWorker Pointer to the worker structure.
+ */
+void bat_scan_worker_deinit(bat_scan_worker_t *pWorker);
+
+/**
+ * @brief Copies an event into the ring and wakes the worker.
+ *
+ * @param pWorker Pointer to the worker structure.
+ * @param pParam Event parameters.
+ * @return `ESP_OK` if queued (possibly by dropping the oldest event), `ESP_ERR_NO_MEM` if
+ *         dropped under `BAT_SCAN_WORKER_DROP_NEWEST`, or `ESP_ERR_INVALID_STATE`.
+ */
+esp_err_t bat_scan_worker_post(bat_scan_worker_t *pWorker, const esp_ble_gap_cb_param_t *pParam);
+
+/**
+ * @brief Retrieves the worker statistics.
+ *
+ * @param pWorker Pointer to the worker structure.
+ * @param pStats Receives the statistics.
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_STATE` if the worker is not running,
+ *         or `ESP_ERR_INVALID_ARG`.
+ */
+esp_err_t bat_scan_worker_get_stats(bat_scan_worker_t *pWorker, bat_scan_worker_stats_t *pStats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,95 @@
+/**
+ * @file bat_trace.h
+ * @brief Binary event trace for the BLE hot path, enabled with CONFIG_BAT_TRACE.
+ *
+ * `BAT_TRACE` stores a fixed-size record in a ring owned by the calling core: one atomic
+ * increment claims a slot and the record is written in place. Nothing is formatted, nothing
+ * blocks and nothing is locked, so it is safe in the Bluedroid callbacks and from ISRs. When
+ * a ring wraps the oldest records are overwritten.
+ *
+ * Decoding happens later, off the hot path: `bat_trace_dump` logs the records of both cores
+ * in time order and `bat_trace_snapshot` copies them out for export (a host-side decoder only
+ * needs `bat_trace_record_t`).
+ *
+ * Without CONFIG_BAT_TRACE, `BAT_TRACE` expands to nothing and its arguments are not evaluated.
+ */
+#pragma once
+
+#include "sdkconfig.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Which event family a record belongs to, the event id is the stack's enum value.
+ */
+typedef enum {
+    BAT_TRACE_SRC_GAP = 0,               ///< esp_gap_ble_cb_event_t.
+    BAT_TRACE_SRC_GATTS,                 ///< esp_gatts_cb_event_t.
+    BAT_TRACE_SRC_GATTC,                 ///< esp_gattc_cb_event_t.
+    BAT_TRACE_SRC_GATTS_FSM,             ///< esp_gatts_cb_event_t, seen by bat_gatts_fsm.
+} bat_trace_src_t;
+
+/**
+ * @brief One traced event, 16 bytes.
+ */
+typedef struct {
+    uint32_t timestamp_us;               ///< Low 32 bits of esp_timer time.
+    uint16_t event;                      ///< Event id, see `source`.
+    uint16_t handle;                     ///< Attribute or service handle (app_id on registration), 0 if none.
+    uint16_t conn_id;                    ///< Connection, 0xffff if none.
+    uint16_t status;                     ///< Status, reason or flag carried by the event.
+    uint8_t source;                      ///< bat_trace_src_t.
+    uint8_t core;                        ///< Core that recorded it.
+    uint16_t seq;                        ///< Per-core sequence number, low 16 bits.
+} bat_trace_record_t;
+
+#define BAT_TRACE_NO_CONN 0xffff         ///< conn_id of events that are not about a connection.
+
+#if CONFIG_BAT_TRACE
+
+#define BAT_TRACE_RECORDS CONFIG_BAT_TRACE_RECORDS  ///< Ring size per core.
+
+/**
+ * @brief Records one event, use `BAT_TRACE` so the call compiles out with the trace disabled.
+ */
+void bat_trace_record(bat_trace_src_t source, uint16_t event, uint16_t handle, uint16_t conn_id, uint16_t status);
+
+#define BAT_TRACE(source, event, handle, conn_id, status) \
+    bat_trace_record((source), (uint16_t)(event), (uint16_t)(handle), (uint16_t)(conn_id), (uint16_t)(status))
+
+#else
+
+#define BAT_TRACE_RECORDS 0
+#define BAT_TRACE(source, event, handle, conn_id, status) do { } while (0)
+
+#endif
+
+/**
+ * @brief Copies the records of every core, oldest first.
+ *
+ * Records written while copying may be torn, take the snapshot once the traffic of interest
+ * is over.
+ *
+ * @param pRecords Receives the records.
+ * @param max_records Capacity of `pRecords`.
+ * @return The number of records copied, 0 with the trace disabled.
+ */
+size_t bat_trace_snapshot(bat_trace_record_t *pRecords, size_t max_records);
+
+/**
+ * @brief Logs every record, oldest first, one line each.
+ */
+void bat_trace_dump(void);
+
+/**
+ * @brief Empties the rings.
+ */
+void bat_trace_clear(void);
+
+#ifdef __cplusplus
+}
+#endif